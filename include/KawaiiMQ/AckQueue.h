@@ -0,0 +1,197 @@
+/**
+ * @file AckQueue.h
+ * @author ayano
+ * @date 2/21/24
+ * @brief A queue delivering messages at least once, fetched messages are leased until acknowledged
+*/
+
+#ifndef KAWAIIMQ_ACKQUEUE_H
+#define KAWAIIMQ_ACKQUEUE_H
+
+#include <chrono>
+#include <memory>
+#include <mutex>
+#include "Queue.h"
+#include "TimerWheel.h"
+
+namespace KawaiiMQ {
+
+    /**
+     * how an AckQueue leases and redelivers messages
+     */
+    struct AckOptions {
+        /// how long a fetched message stays invisible before it is delivered again
+        std::chrono::milliseconds visibility_timeout{30000};
+        /// deliveries after which a message still not acked goes to the dead letter queue, 0 means no limit
+        std::uint32_t max_deliveries = 0;
+        /// receives the messages that ran out of deliveries, nullptr drops them. a push finding it full under the
+        /// Block policy does not wait, the Scheduler tries it again every tick until it has room
+        std::shared_ptr<Queue> dead_letter;
+    };
+
+    /**
+     * a message fetched from an AckQueue
+     */
+    struct Delivery {
+        /// identifies the delivery, pass it to ack, nack or extend
+        std::uint64_t lease = 0;
+        std::shared_ptr<MessageData> message;
+        /// 1 on the first delivery of the message
+        std::uint32_t attempt = 0;
+    };
+
+    /**
+     * counters of an AckQueue
+     */
+    struct AckStats {
+        /// deliveries acked in time
+        std::uint64_t acked = 0;
+        /// deliveries that timed out or were nacked, and were delivered again
+        std::uint64_t redelivered = 0;
+        /// messages moved to the dead letter queue, or dropped for lack of one
+        std::uint64_t dead_lettered = 0;
+    };
+
+    struct AckStore;
+
+    /**
+     * A message queue with at least once delivery
+     * @remark fetch() leases a message instead of removing it. the message is invisible until ack() removes it for
+     * good. if the lease is not acked within the visibility timeout, or nack() is called, the message goes back to
+     * the front of the queue and is delivered again. after max_deliveries deliveries it goes to the dead letter queue
+     * @remark lease expiry runs on the shared TimerWheel, in flight messages cost no thread and no per message timer
+     * object
+     * @remark wait, tryWait and drain remove messages right away, like on any other queue. a Dispatcher handling
+     * the queue fetches instead, and acks a message once every handler returned without throwing
+     * @remark fetch discards expired messages like wait does, a redelivered message keeps its expiry
+     * @remark the queue is unbounded
+     */
+    class AckQueue : public Queue {
+    public:
+        /**
+         * construct a queue
+         * @param name name of the queue
+         * @param options lease options
+         */
+        explicit AckQueue(std::string name, AckOptions options = {});
+
+        AckQueue(const AckQueue& other) = delete;
+
+        AckQueue& operator=(const AckQueue& other) = delete;
+
+        /**
+         * drop every lease, pending lease timers become no-ops
+         */
+        ~AckQueue() override;
+
+        /**
+         * lease the next message, blocking until one is available
+         * @param out receives the delivery
+         * @param timeout_ms timeout in milliseconds, 0 means no timeout
+         * @return false if timed out
+         */
+        bool fetch(Delivery& out, int timeout_ms = 0);
+
+        /**
+         * lease the next message without blocking
+         * @param out receives the delivery
+         * @return false if no message is available
+         */
+        bool tryFetch(Delivery& out);
+
+        /**
+         * lease up to max_n messages without blocking
+         * @param out vector the deliveries are appended to
+         * @param max_n maximum number of messages
+         * @return number of messages leased
+         */
+        std::size_t fetchBulk(std::vector<Delivery>& out, std::size_t max_n);
+
+        /**
+         * remove a leased message for good
+         * @param lease lease of the delivery
+         * @return false if the lease already expired or was settled, the message may be delivered again then
+         */
+        bool ack(std::uint64_t lease);
+
+        /**
+         * give a leased message back, it counts as a failed delivery
+         * @param lease lease of the delivery
+         * @return false if the lease already expired or was settled
+         */
+        bool nack(std::uint64_t lease);
+
+        /**
+         * keep a message invisible for longer
+         * @param lease lease of the delivery
+         * @param visibility_timeout new timeout, counted from now
+         * @return false if the lease already expired or was settled
+         */
+        bool extend(std::uint64_t lease, std::chrono::milliseconds visibility_timeout);
+
+        /**
+         * get the number of leased messages
+         * @return number of messages fetched but neither acked nor expired
+         */
+        std::size_t getInFlightCount() const;
+
+        /**
+         * get the ack counters
+         * @return counters since the queue was constructed
+         */
+        AckStats getAckStats() const noexcept;
+
+        /**
+         * Size of the queue
+         * @return number of messages ready to be fetched, leased messages are not counted
+         */
+        std::size_t size() const noexcept override;
+
+        /**
+         * Check if queue is empty
+         * @return true if no message is ready to be fetched
+         */
+        [[nodiscard]] bool empty() const noexcept override;
+
+        /**
+         * Set what push does when the queue is full
+         * @param policy overflow policy
+         * @remark has no effect, the queue is unbounded
+         */
+        void setOverflowPolicy(OverflowPolicy policy) override;
+
+    protected:
+        void enqueue(Envelope msg) override;
+
+        void enqueueBulk(std::vector<Envelope>& msgs) override;
+
+        bool dequeue(Envelope& msg, bool block, int timeout_ms) override;
+
+        std::size_t dequeueBulk(const Sink& sink, std::size_t max_n, bool block, int timeout_ms) override;
+
+    private:
+        friend struct AckStore;
+
+        /**
+         * discard the expired messages at the front of the queue instead of leasing them, must hold store->mtx
+         */
+        void dropExpired() noexcept;
+
+        /**
+         * tell waiters and watchers about redelivered messages
+         */
+        void redelivered() noexcept;
+
+        std::shared_ptr<AckStore> store;
+    };
+
+    /**
+     * construct a queue with at least once delivery
+     * @param name name of the queue
+     * @param options lease options
+     * @return queue shared ptr
+     */
+    std::shared_ptr<AckQueue> makeAckQueue(const std::string& name, AckOptions options = {});
+}
+
+#endif //KAWAIIMQ_ACKQUEUE_H
@@ -0,0 +1,141 @@
+/**
+ * @file AsyncWaiter.h
+ * @author ayano
+ * @date 2/15/24
+ * @brief Awaitables suspending a coroutine until a queue has a message
+*/
+
+#ifndef KAWAIIMQ_ASYNCWAITER_H
+#define KAWAIIMQ_ASYNCWAITER_H
+
+#include <coroutine>
+#include <functional>
+#include <limits>
+#include <memory>
+#include <mutex>
+#include <vector>
+#include "Envelope.h"
+
+namespace KawaiiMQ {
+
+    class Queue;
+
+    /**
+     * resumes a suspended coroutine, usually by posting the handle to a thread pool. must not throw
+     * @remark it is called on the thread that pushed the message, so resuming inline runs the coroutine there
+     */
+    using Executor = std::function<void(std::coroutine_handle<>)>;
+
+    /**
+     * Suspends a coroutine until one of a set of queues hands it a message
+     * @remark the waiter is registered with every queue. the first push into any of them pops a message for the
+     * waiter and resumes the coroutine through the executor, no thread is parked meanwhile
+     * @warning do not destroy a coroutine while it is suspended on a waiter
+     */
+    class AsyncWaiter {
+    public:
+        AsyncWaiter(const AsyncWaiter&) = delete;
+
+        AsyncWaiter& operator=(const AsyncWaiter&) = delete;
+
+        ~AsyncWaiter();
+
+        /**
+         * take a message right away if any queue has one
+         * @return true if the coroutine does not need to suspend
+         */
+        bool await_ready();
+
+        /**
+         * register with the queues
+         * @param handle coroutine to resume
+         * @return false if a message arrived while registering, the coroutine then continues right away
+         */
+        bool await_suspend(std::coroutine_handle<> handle);
+
+    protected:
+        /**
+         * @param queues queues to wait on, must outlive the waiter
+         * @param executor resumes the coroutine
+         */
+        AsyncWaiter(std::vector<Queue*> queues, Executor executor);
+
+        /**
+         * unregister from the queues, called when the coroutine resumes
+         */
+        void finish();
+
+        std::vector<Queue*> queues;
+        // the message handed over and the queue it came from
+        Envelope msg;
+        Queue* source = nullptr;
+
+    private:
+        friend class Queue;
+
+        /**
+         * what a queue serving the waiter has to do with it
+         */
+        enum class Offer {
+            /// the queue was empty, stop serving
+            Empty,
+            /// already got a message from another queue, drop it from the list
+            Done,
+            /// took the message while still registering, await_suspend resumes the coroutine itself
+            Taken,
+            /// took the message, the queue has to resume the coroutine
+            Resume
+        };
+
+        /**
+         * try to take a message from a queue serving this waiter, called with the queue's waiter list locked
+         * @param from queue offering a message
+         * @return what the queue has to do next
+         */
+        Offer offer(Queue& from);
+
+        Executor executor;
+        std::coroutine_handle<> handle;
+        std::mutex mtx;
+        bool done = false;
+        bool suspended = false;
+        bool registered = false;
+    };
+
+    /**
+     * awaitable returned by Queue::asyncWait()
+     */
+    class QueueAwaiter : public AsyncWaiter {
+    public:
+        QueueAwaiter(Queue& queue, Executor executor);
+
+        /**
+         * @return the message
+         */
+        std::shared_ptr<MessageData> await_resume();
+    };
+
+    /**
+     * awaitable returned by Consumer::asyncFetch()
+     */
+    class FetchAwaiter : public AsyncWaiter {
+    public:
+        /**
+         * @param queues queues to wait on, kept alive by the awaiter
+         * @param executor resumes the coroutine
+         * @param max_n maximum number of messages to return, at least 1
+         */
+        FetchAwaiter(std::vector<std::shared_ptr<Queue>> queues, Executor executor, std::size_t max_n);
+
+        /**
+         * @return the message that woke the coroutine up, followed by whatever else is ready, at most max_n
+         */
+        std::vector<std::shared_ptr<MessageData>> await_resume();
+
+    private:
+        std::vector<std::shared_ptr<Queue>> owned;
+        std::size_t max_n;
+    };
+}
+
+#endif //KAWAIIMQ_ASYNCWAITER_H
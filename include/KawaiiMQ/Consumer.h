@@ -14,11 +14,16 @@
 #include "Topic.h"
 #include "Message.h"
 #include "MessageQueueManager.h"
+#include "LogQueue.h"
+#include "ConsumerGroup.h"
 
 namespace KawaiiMQ {
     /**
      * The client of the message queue
      * @remark A client is a user of the message queue system. It can subscribe to multiple topics and fetch messages from topics.
+     * @remark related LogQueues are read through a cursor owned by the consumer, so every consumer gets every message
+     * of a log. the cursor is opened at the oldest retained message on the first fetch
+     * @remark a consumer in a ConsumerGroup only reads the partitions assigned to it from partitioned topics
      */
     class Consumer {
     public:
@@ -26,6 +31,15 @@ namespace KawaiiMQ {
 
         explicit Consumer(const std::string& name);
 
+        Consumer(const Consumer& other) = delete;
+
+        Consumer& operator=(const Consumer& other) = delete;
+
+        /**
+         * leave the group, if any
+         */
+        ~Consumer();
+
         /**
          * subscribe a topic
          * @param topic given topic
@@ -40,17 +54,52 @@ namespace KawaiiMQ {
 
         /**
          * fetch all messages from subscribed topics
-         * @return all messages from subscribed topics
+         * @return messages of every related queue that has any, at least one message in total
+         * @remark blocks once until any related queue of any subscribed topic has a message, then drains only the
+         * queues that are ready. an idle queue never holds up the others
          */
         std::unordered_map<Topic, std::vector<std::shared_ptr<MessageData>>> fetchMessage();
 
+        /**
+         * fetch all messages from subscribed topics, giving up after a timeout
+         * @param timeout_ms time to wait when no message is ready, in milliseconds. 0 means no timeout
+         * @return messages of every related queue that has any, empty if timed out
+         */
+        std::unordered_map<Topic, std::vector<std::shared_ptr<MessageData>>> fetchMessage(int timeout_ms);
+
         /**
          * fetch all messages from a single topic
          * @param topic given topic
          * @return all messages from the topic
+         * @exception QueueException Will throw if a related queue has no message that did not expire
          */
         std::vector<std::shared_ptr<MessageData>> fetchSingleTopic(const Topic& topic);
 
+        /**
+         * fetch up to max_n messages from a single topic
+         * @param topic given topic
+         * @param max_n maximum number of messages to fetch
+         * @param timeout_ms time to wait when no message is ready, in milliseconds. 0 means no timeout
+         * @return fetched messages, empty if timed out
+         * @exception TopicException Will throw if the topic is not subscribed
+         * @remark ready messages are drained from every related queue with one lock acquisition per queue. when
+         * nothing is ready, blocks once until any related queue has a message, then drains the ready ones
+         */
+        std::vector<std::shared_ptr<MessageData>> fetchBatch(const Topic& topic, std::size_t max_n, int timeout_ms);
+
+        /**
+         * fetch messages from a single topic without blocking the thread
+         * @param topic given topic
+         * @param executor resumes the coroutine once a message arrives
+         * @param max_n maximum number of messages to fetch
+         * @return awaitable, co_await it to get the fetched messages, at least one
+         * @exception TopicException Will throw if the topic is not subscribed or not related to any queue
+         * @remark the coroutine is suspended on all related queues of the topic at once and resumed by the first
+         * push into any of them. LogQueues are read through their shared cursor here, not the consumer's own
+         */
+        FetchAwaiter asyncFetch(const Topic& topic, Executor executor,
+                                std::size_t max_n = std::numeric_limits<std::size_t>::max());
+
         /**
          * get the name of the consumer
          * @return name of the consumer
@@ -63,10 +112,115 @@ namespace KawaiiMQ {
          */
         std::vector<Topic> getSubscribedTopics() const;
 
+        /**
+         * join a consumer group, the partitions of the group are rebalanced
+         * @param group group to join
+         * @exception TopicException Will throw if the consumer is already in a group
+         */
+        void join(std::shared_ptr<ConsumerGroup> group);
+
+        /**
+         * leave the consumer group, the partitions of the group are rebalanced
+         * @exception TopicException Will throw if the consumer is not in a group
+         */
+        void leave();
+
+        /**
+         * get the group of the consumer
+         * @return group, nullptr if not in a group
+         */
+        std::shared_ptr<ConsumerGroup> getGroup() const;
+
+        /**
+         * get the cursor this consumer reads a log with
+         * @param queue a related LogQueue
+         * @return cursor, opened if needed. nullptr if the queue is not a LogQueue
+         */
+        LogCursor* getCursor(const std::shared_ptr<Queue>& queue);
+
+        /**
+         * get the metrics of the consumer
+         * @return counters and blocking time since the consumer was constructed
+         */
+        ConsumerSample getMetrics() const;
+
     private:
+        /**
+         * pop or read the ready messages of a related queue without blocking
+         * @param queue related queue
+         * @param cursor own cursor of the queue from getCursor(), nullptr if it is not a log
+         * @param out vector the messages are appended to
+         * @param max_n maximum number of messages
+         * @return number of messages taken
+         */
+        std::size_t take(Queue& queue, LogCursor* cursor, std::vector<std::shared_ptr<MessageData>>& out,
+                         std::size_t max_n);
+
+        /**
+         * count a fetch that had to block
+         * @param parked time it started blocking, from metricsNow()
+         * @param fetched number of messages it got
+         */
+        void countWait(std::uint64_t parked, std::size_t fetched) noexcept;
+
+        /**
+         * check whether a related queue has a message for this consumer
+         * @param queue related queue
+         * @param cursor own cursor of the queue from getCursor(), nullptr if it is not a log
+         */
+        static bool ready(const Queue& queue, const LogCursor* cursor);
+
+        /**
+         * pick up the latest assignment of the group
+         * @return false if the assignment did not change
+         */
+        bool refreshAssignment();
+
+        /**
+         * check whether this consumer reads a related queue of a topic
+         * @param topic subscribed topic
+         * @param queues related queues of the topic
+         * @param i index of the queue
+         * @return true if the topic is not partitioned or the partition is assigned to this consumer
+         */
+        bool owns(const Topic& topic, const MessageQueueManager::RelatedQueues& queues, std::size_t i) const;
+
+        /**
+         * check whether the group rebalanced since the last refreshAssignment
+         */
+        bool rebalanced() const noexcept;
+
+        friend class ConsumerGroup;
+
+        struct OwnedCursor {
+            // tells a reused address apart from the log the cursor was opened on
+            std::weak_ptr<Queue> log;
+            std::unique_ptr<LogCursor> cursor;
+        };
+
         std::mutex mtx;
         std::string name;
+        std::shared_ptr<ConsumerMetrics> metrics = MetricsRegistry::Instance()->addConsumer(name);
         std::vector<Topic> subscribed;
+        TopicSet subscribed_set;
+        std::shared_ptr<MessageQueueManager> manager = MessageQueueManager::Instance();
+        /**
+         * wakes up fetchMessage when any watched queue receives a message
+         */
+        struct Waker : QueueWatcher {
+            Parker parker;
+
+            void notify() noexcept override {
+                parker.unpark();
+            }
+        };
+
+        // registered with every watched queue while fetchMessage blocks
+        Waker waker;
+        std::unordered_map<const Queue*, OwnedCursor> cursors;
+        std::shared_ptr<ConsumerGroup> group;
+        ConsumerGroup::Assignment assignment;
+        std::uint64_t assignment_generation = 0;
     };
 
 } // KawaiiMQ
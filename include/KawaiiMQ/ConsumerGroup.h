@@ -0,0 +1,139 @@
+/**
+ * @file ConsumerGroup.h
+ * @author ayano
+ * @date 2/20/24
+ * @brief A group of consumers sharing the partitions of topics
+*/
+
+#ifndef KAWAIIMQ_CONSUMERGROUP_H
+#define KAWAIIMQ_CONSUMERGROUP_H
+
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include "Topic.h"
+
+namespace KawaiiMQ {
+
+    class Consumer;
+
+    /**
+     * A group of consumers, each partition of a topic is read by one member only
+     * @remark the partitions of a topic are spread over the members subscribed to it: with n such members, the k-th
+     * of them in joining order reads the partitions whose index modulo n is k. the assignment is recomputed whenever
+     * a member joins, leaves, subscribes or unsubscribes a topic, and members pick it up on their next fetch
+     * @remark topics that are not partitioned are not affected, every member reads all their queues
+     * @warning during a rebalance, a member still fetching may take one more batch from a partition just moved to
+     * another member, so the order of a key is only kept between rebalances
+     */
+    class ConsumerGroup {
+    public:
+        /**
+         * the share of a topic one member reads
+         */
+        struct Share {
+            /// position of the member among the members subscribed to the topic
+            std::size_t index;
+            /// number of members subscribed to the topic
+            std::size_t count;
+
+            /**
+             * check if a partition belongs to this share
+             * @param partition partition index
+             * @return true if the member reads the partition
+             */
+            [[nodiscard]] bool owns(std::size_t partition) const noexcept {
+                return partition % count == index;
+            }
+        };
+
+        /// shares of a member, by topic id
+        using Assignment = std::unordered_map<std::uint32_t, Share>;
+
+        /**
+         * construct a group
+         * @param name name of the group
+         */
+        explicit ConsumerGroup(std::string name);
+
+        ConsumerGroup(const ConsumerGroup& other) = delete;
+
+        ConsumerGroup& operator=(const ConsumerGroup& other) = delete;
+
+        /**
+         * get the name of the group
+         * @return name of the group
+         */
+        [[nodiscard]] const std::string& getName() const noexcept;
+
+        /**
+         * get the number of members
+         * @return number of members
+         */
+        std::size_t getMemberCount() const;
+
+        /**
+         * get the generation of the assignment
+         * @return generation, increased by every rebalance
+         */
+        std::uint64_t getGeneration() const noexcept;
+
+        /**
+         * get the partitions of a topic assigned to a member
+         * @param member member of the group
+         * @param topic partitioned topic
+         * @return partition queues of the member, empty if it is not a member or not subscribed to the topic
+         */
+        std::vector<std::shared_ptr<Queue>> getPartitions(const Consumer& member, const Topic& topic) const;
+
+    private:
+        friend class Consumer;
+
+        /**
+         * add a member and rebalance
+         */
+        void join(Consumer* member);
+
+        /**
+         * remove a member and rebalance
+         */
+        void leave(Consumer* member);
+
+        /**
+         * rebalance after a member changed its subscriptions
+         */
+        void resubscribed();
+
+        /**
+         * recompute the assignment and wake every member up. must hold mtx
+         */
+        void rebalance();
+
+        /**
+         * get the assignment of a member
+         * @param member member of the group
+         * @param assignment receives the assignment
+         * @return generation of the assignment
+         */
+        std::uint64_t assignmentOf(const Consumer* member, Assignment& assignment) const;
+
+        std::string name;
+        mutable std::mutex mtx;
+        // in joining order
+        std::vector<Consumer*> members;
+        std::unordered_map<const Consumer*, Assignment> assignments;
+        std::atomic<std::uint64_t> generation = 0;
+    };
+
+    /**
+     * construct a group
+     * @param name name of the group
+     * @return group shared ptr
+     */
+    std::shared_ptr<ConsumerGroup> makeConsumerGroup(const std::string& name);
+}
+
+#endif //KAWAIIMQ_CONSUMERGROUP_H
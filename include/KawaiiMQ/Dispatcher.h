@@ -0,0 +1,162 @@
+/**
+ * @file Dispatcher.h
+ * @author ayano
+ * @date 2/14/24
+ * @brief Runs message handlers of many topics on a small work-stealing thread pool
+*/
+
+#ifndef KAWAIIMQ_DISPATCHER_H
+#define KAWAIIMQ_DISPATCHER_H
+
+#include <atomic>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+#include "Topic.h"
+#include "Parker.h"
+#include "MessageQueueManager.h"
+#include "AckQueue.h"
+
+namespace KawaiiMQ {
+
+    /**
+     * Push-mode consumer: calls handlers for the messages of a topic on a pool of worker threads
+     * @remark every related queue of a handled topic is watched. a push schedules the queue on a worker, which
+     * drains it and calls the handlers. a queue is never run by two workers at once, so the messages of a queue
+     * are handled in order. idle workers steal scheduled queues from busy ones.
+     * @remark a queue related to several handled topics is still run as one unit, its messages go to the handlers
+     * of all those topics
+     * @remark queues related to a topic after onMessage() was called are not picked up
+     * @remark messages of an AckQueue are fetched with a lease, and acked once every handler returned. if a handler
+     * throws, the message is nacked and delivered again
+     */
+    class Dispatcher {
+    public:
+        /**
+         * message handler, called on a worker thread
+         */
+        using Handler = std::function<void(const std::shared_ptr<MessageData>&)>;
+
+        /**
+         * start the workers
+         * @param workers number of worker threads, 0 means one per hardware thread
+         */
+        explicit Dispatcher(std::size_t workers = 0);
+
+        Dispatcher(const Dispatcher&) = delete;
+
+        Dispatcher& operator=(const Dispatcher&) = delete;
+
+        /**
+         * stop the workers, messages still in the queues stay there
+         */
+        ~Dispatcher();
+
+        /**
+         * register a handler for the messages of a topic
+         * @param topic topic to handle
+         * @param handler called with every message of the topic, in the order of its queue. exceptions thrown by the
+         * handler are reported to std::cerr and otherwise ignored, except that a message of an AckQueue is redelivered
+         * @exception TopicException Will throw if the topic is not related to any queue
+         * @remark a topic can have several handlers, every message goes to all of them in registration order
+         */
+        void onMessage(const Topic& topic, Handler handler);
+
+        /**
+         * remove all handlers of a topic
+         * @param topic topic to stop handling
+         * @exception TopicException Will throw if the topic has no handler
+         * @remark a worker already running the queue may still call the handlers for the rest of its batch
+         */
+        void removeHandlers(const Topic& topic);
+
+        /**
+         * get the number of worker threads
+         * @return number of workers
+         */
+        std::size_t getWorkerCount() const noexcept;
+
+    private:
+        using Handlers = std::vector<std::pair<Topic, Handler>>;
+
+        /**
+         * a watched queue, scheduled on a worker when it has messages
+         */
+        struct Task : QueueWatcher, std::enable_shared_from_this<Task> {
+            Task(Dispatcher* owner, std::shared_ptr<Queue> queue)
+                    : owner(owner), queue(std::move(queue)), acks(dynamic_cast<AckQueue*>(this->queue.get())) {}
+
+            void notify() noexcept override;
+
+            Dispatcher* owner;
+            std::shared_ptr<Queue> queue;
+            // the queue if it leases its messages, nullptr otherwise
+            AckQueue* acks;
+            // replaced, never modified, so a worker can keep calling a snapshot while handlers change
+            std::shared_ptr<const Handlers> handlers = std::make_shared<const Handlers>();
+            std::mutex handlers_mtx;
+            // true while the task sits in a deque or is being run
+            std::atomic<bool> scheduled = false;
+            std::atomic<bool> active = true;
+        };
+
+        /**
+         * per worker deque, the owner pops from the front and thieves steal from the back
+         */
+        struct alignas(cacheLineSize) Worker {
+            std::mutex mtx;
+            std::deque<std::shared_ptr<Task>> tasks;
+        };
+
+        /**
+         * put a task on a deque and wake up a worker, the task must already be marked scheduled
+         * @param task task to schedule
+         */
+        void submit(const std::shared_ptr<Task>& task);
+
+        /**
+         * schedule a task unless it is already scheduled
+         * @param task task to schedule
+         */
+        void trySchedule(const std::shared_ptr<Task>& task);
+
+        /**
+         * take a task from the own deque, or steal one from another worker
+         * @param index index of the calling worker
+         * @return task, nullptr if every deque is empty
+         */
+        std::shared_ptr<Task> take(std::size_t index);
+
+        /**
+         * drain a scheduled queue and call the handlers
+         * @param task task to run
+         */
+        void run(const std::shared_ptr<Task>& task);
+
+        /**
+         * call the handlers of a message
+         * @param handlers handlers to call
+         * @param msg message
+         * @return false if a handler threw
+         */
+        static bool handle(const Handlers& handlers, const std::shared_ptr<MessageData>& msg);
+
+        void workerLoop(std::size_t index);
+
+        std::vector<std::unique_ptr<Worker>> workers;
+        std::vector<std::thread> threads;
+        std::atomic<std::size_t> pending = 0;
+        std::atomic<std::size_t> next_worker = 0;
+        std::atomic<bool> stopping = false;
+        Parker parker;
+        std::mutex mtx;
+        std::unordered_map<Queue*, std::shared_ptr<Task>> tasks;
+        std::shared_ptr<MessageQueueManager> manager = MessageQueueManager::Instance();
+    };
+}
+
+#endif //KAWAIIMQ_DISPATCHER_H
@@ -0,0 +1,127 @@
+/**
+ * @file DurableQueue.h
+ * @author ayano
+ * @date 2/17/24
+ * @brief A queue that logs every message to disk and replays the unconsumed ones after a restart
+*/
+
+#ifndef KAWAIIMQ_DURABLEQUEUE_H
+#define KAWAIIMQ_DURABLEQUEUE_H
+
+#include <filesystem>
+#include "Queue.h"
+#include "Serializer.h"
+#include "WriteAheadLog.h"
+
+namespace KawaiiMQ {
+
+    /**
+     * where and how durable queues store their messages
+     */
+    struct DurableOptions {
+        /// every durable queue gets a sub directory named after it
+        std::filesystem::path directory = "kawaiimq-data";
+        /// size at which a log segment is closed and a new one started
+        std::size_t segment_size = std::size_t(64) << 20;
+        /// when pushed messages are forced to disk
+        FsyncPolicy fsync;
+    };
+
+    /**
+     * A message queue whose messages survive a restart
+     * @remark every push is appended to a write ahead log before the message becomes visible. opening a queue with
+     * the same name and directory again replays the messages that were not popped yet, in order
+     * @remark a message counts as consumed once it is popped, the pop count is persisted with the next log write.
+     * messages popped shortly before a crash may be delivered again
+     * @remark payload types need a serializer, see registerSerializer(). the queue is unbounded
+     */
+    class DurableQueue : public Queue {
+    public:
+        /**
+         * open or create a durable queue
+         * @param name name of the queue, also the name of its directory
+         * @param options storage options
+         * @exception QueueException Will throw if the log cannot be opened
+         * @exception TypeException Will throw if a logged message has no registered serializer
+         */
+        DurableQueue(std::string name, const DurableOptions& options);
+
+        /**
+         * write and fsync whatever is still buffered
+         */
+        ~DurableQueue() override;
+
+        /**
+         * Set what push does when the queue is full
+         * @param policy overflow policy
+         * @remark has no effect, the queue is unbounded
+         */
+        void setOverflowPolicy(OverflowPolicy policy) override;
+
+        /**
+         * write and fsync every logged message and the consumed position, regardless of the fsync policy
+         * @exception QueueException Will throw if writing to disk fails
+         */
+        void sync();
+
+        /**
+         * get the number of messages replayed when the queue was opened
+         * @return number of messages
+         */
+        std::size_t getRecoveredCount() const noexcept;
+
+        /**
+         * get the names of the topics the queue was related to, stored next to the log
+         * @return topic names
+         */
+        std::vector<std::string> getStoredTopics() const;
+
+        /**
+         * get the log of the queue
+         * @return log
+         */
+        const WriteAheadLog& getLog() const noexcept;
+
+    protected:
+        /**
+         * serialize and log a message, then store it
+         * @param msg message pushing in
+         * @exception TypeException Will throw if the payload type has no registered serializer
+         * @exception QueueException Will throw if writing to disk fails
+         */
+        void enqueue(Envelope msg) override;
+
+        void enqueueBulk(std::vector<Envelope>& msgs) override;
+
+        bool dequeue(Envelope& msg, bool block, int timeout_ms) override;
+
+        std::size_t dequeueBulk(const Sink& sink, std::size_t max_n, bool block, int timeout_ms) override;
+
+        void onRelate(const Topic& topic, bool related) override;
+
+    private:
+        /**
+         * rewrite the topic file, must hold topics_mtx
+         */
+        void storeTopics() const;
+
+        std::filesystem::path directory;
+        WriteAheadLog log;
+        std::shared_ptr<SerializerRegistry> serializers = SerializerRegistry::Instance();
+        // keeps the log in push order
+        std::mutex order_mtx;
+        std::size_t recovered = 0;
+        mutable std::mutex topics_mtx;
+        std::vector<std::string> topics;
+    };
+
+    /**
+     * construct a durable queue
+     * @param name name of the queue, also the name of its directory
+     * @param options storage options
+     * @return queue shared ptr, already holding the messages left from a previous run
+     */
+    std::shared_ptr<DurableQueue> makeDurableQueue(const std::string& name, const DurableOptions& options = {});
+}
+
+#endif //KAWAIIMQ_DURABLEQUEUE_H
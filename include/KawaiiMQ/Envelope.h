@@ -0,0 +1,247 @@
+/**
+ * @file Envelope.h
+ * @author ayano
+ * @date 2/8/24
+ * @brief Value-semantic message holder that keeps small payloads inline
+*/
+
+#ifndef KAWAIIMQ_ENVELOPE_H
+#define KAWAIIMQ_ENVELOPE_H
+
+#include <chrono>
+#include <cstring>
+#include <new>
+#include <type_traits>
+#include "Message.h"
+
+namespace KawaiiMQ {
+
+    /**
+     * A message stored by value
+     * @remark small trivially copyable payloads are kept inside the envelope itself, so they need no allocation,
+     * no reference count and no virtual destructor. everything else lives in a regular Message<T> on the heap.
+     * @remark queues store envelopes in their slots, a shared_ptr message pushed into a queue is wrapped in one
+     * @remark an envelope may carry an expiry, queues discard it instead of delivering it once the expiry passed.
+     * the expiry stays with the envelope, toShared() and durable queues drop it
+     * @remark the latency stamp of a sampled message, see MetricsRegistry, follows the same rules as the expiry
+     */
+    class Envelope {
+    public:
+        /// payloads up to this size are stored inline
+        static constexpr std::size_t inlineSize = 24;
+
+        /**
+         * check whether a payload type is stored inline
+         * @tparam T payload type
+         */
+        template<typename T>
+        static constexpr bool fitsInline = std::is_trivially_copyable_v<T> && sizeof(T) <= inlineSize
+                                           && alignof(T) <= alignof(std::uint64_t);
+
+        Envelope() = default;
+
+        /**
+         * wrap a heap message
+         * @param msg message shared ptr
+         */
+        Envelope(std::shared_ptr<MessageData> msg) noexcept : heap(std::move(msg)) {}
+
+        /**
+         * make an envelope holding a value
+         * @tparam T payload type
+         * @param value payload
+         * @return envelope, the payload is inline when it fits, otherwise in a pooled Message<T>
+         */
+        template<typename T>
+        static Envelope of(T&& value) {
+            using Content = std::decay_t<T>;
+            Envelope ret;
+            if constexpr (fitsInline<Content>) {
+                ::new (static_cast<void*>(ret.storage)) Content(std::forward<T>(value));
+                ret.type_tag = typeTag<Content>();
+                ret.box = &boxInline<Content>;
+            }
+            else {
+                ret.heap = makeMessage(std::forward<T>(value));
+            }
+            return ret;
+        }
+
+        /**
+         * check whether the payload is stored inline
+         * @return true if inline
+         */
+        [[nodiscard]] bool isInline() const noexcept {
+            return box != nullptr;
+        }
+
+        /**
+         * check whether the envelope holds a message
+         * @return true if empty
+         */
+        [[nodiscard]] bool empty() const noexcept {
+            return box == nullptr && heap == nullptr;
+        }
+
+        /**
+         * set the point in time after which the message is discarded instead of delivered
+         * @param when expiry, time_point::max() means never
+         */
+        void setExpiry(std::chrono::steady_clock::time_point when) noexcept {
+            expiry = when;
+        }
+
+        /**
+         * get the point in time after which the message is discarded instead of delivered
+         * @return expiry, time_point::max() if the message never expires
+         */
+        [[nodiscard]] std::chrono::steady_clock::time_point getExpiry() const noexcept {
+            return expiry;
+        }
+
+        /**
+         * check whether the message has an expiry at all, lets callers skip reading the clock
+         * @return true if the message expires
+         */
+        [[nodiscard]] bool expires() const noexcept {
+            return expiry != std::chrono::steady_clock::time_point::max();
+        }
+
+        /**
+         * mark the message for latency metrics, done by push for one message in every sampling period
+         * @param when push time from metricsNow(), 0 clears the mark
+         */
+        void setStamp(std::uint64_t when) noexcept {
+            stamp = when;
+        }
+
+        /**
+         * get the push time of a message sampled for latency metrics
+         * @return push time in steady clock nanoseconds, 0 if the message was not sampled
+         */
+        [[nodiscard]] std::uint64_t getStamp() const noexcept {
+            return stamp;
+        }
+
+        /**
+         * get the heap message of the envelope
+         * @return message, nullptr if the payload is inline or the envelope is empty
+         */
+        [[nodiscard]] MessageData* getMessageData() const noexcept {
+            return box == nullptr ? heap.get() : nullptr;
+        }
+
+        /**
+         * get the type tag of the payload
+         * @return tag of the payload type, 0 if empty or not a Message<T>
+         */
+        [[nodiscard]] std::uint64_t getTypeTag() const noexcept {
+            if (box != nullptr) {
+                return type_tag;
+            }
+            return heap == nullptr ? 0 : heap->getTypeTag();
+        }
+
+        /**
+         * get the payload if it is a T
+         * @tparam T payload type
+         * @return pointer to the payload, nullptr if it is not a T
+         */
+        template<typename T>
+        const T* get() const noexcept {
+            if constexpr (fitsInline<T>) {
+                if (box != nullptr) {
+                    return type_tag == typeTag<T>() ? std::launder(reinterpret_cast<const T*>(storage)) : nullptr;
+                }
+            }
+            auto msg = messageCast<T>(heap);
+            return msg == nullptr ? nullptr : &msg->getContentRef();
+        }
+
+        /**
+         * convert to a shared_ptr message, boxing an inline payload into a pooled Message<T>
+         * @return message shared ptr, nullptr if empty
+         */
+        std::shared_ptr<MessageData> toShared() && {
+            if (box != nullptr) {
+                return box(storage);
+            }
+            return std::move(heap);
+        }
+
+        /**
+         * convert to a shared_ptr message, boxing an inline payload into a pooled Message<T>
+         * @return message shared ptr, nullptr if empty
+         */
+        std::shared_ptr<MessageData> toShared() const & {
+            if (box != nullptr) {
+                return box(storage);
+            }
+            return heap;
+        }
+
+        template<typename U>
+        friend U getMessage(Envelope&& in);
+
+    private:
+        template<typename T>
+        static std::shared_ptr<MessageData> boxInline(const unsigned char* storage) {
+            return makeMessage(*std::launder(reinterpret_cast<const T*>(storage)));
+        }
+
+        std::uint64_t type_tag = 0;
+        std::shared_ptr<MessageData> (*box)(const unsigned char*) = nullptr;
+        std::shared_ptr<MessageData> heap;
+        alignas(std::uint64_t) unsigned char storage[inlineSize]{};
+        std::chrono::steady_clock::time_point expiry = std::chrono::steady_clock::time_point::max();
+        std::uint64_t stamp = 0;
+    };
+
+    /**
+     * Get the payload of an envelope
+     * @tparam T type of message you are expecting
+     * @param in envelope
+     * @return reference to the payload, valid as long as the envelope is alive
+     * @exception TypeException Will throw if the type of the message is not the same as the type you are expecting
+     */
+    template<typename T>
+    const T& getMessage(const Envelope& in) {
+        if (auto ptr = in.get<T>()) {
+            return *ptr;
+        }
+        throw TypeException("Expected type " + std::string(typeid(T).name()) + ", got another type");
+    }
+
+    /**
+     * Get the payload of an envelope about to be released
+     * @tparam T type of message you are expecting
+     * @param in envelope
+     * @return payload, moved out of a heap message when the envelope held the last reference
+     * @exception TypeException Will throw if the type of the message is not the same as the type you are expecting
+     */
+    template<typename T>
+    T getMessage(Envelope&& in) {
+        if (in.box == nullptr) {
+            return getMessage<T>(std::move(in.heap));
+        }
+        return getMessage<T>(static_cast<const Envelope&>(in));
+    }
+
+    /**
+     * Call a visitor with the payload of an envelope if it is a T
+     * @tparam T type of message you are expecting
+     * @param in envelope
+     * @param visitor callable taking const T&
+     * @return true if the visitor was called, false if the payload is not a T
+     */
+    template<typename T, typename F>
+    bool visitMessage(const Envelope& in, F&& visitor) {
+        if (auto ptr = in.get<T>()) {
+            std::forward<F>(visitor)(*ptr);
+            return true;
+        }
+        return false;
+    }
+}
+
+#endif //KAWAIIMQ_ENVELOPE_H
@@ -0,0 +1,242 @@
+/**
+ * @file LogQueue.h
+ * @author ayano
+ * @date 2/19/24
+ * @brief A retained message log read through independent cursors
+*/
+
+#ifndef KAWAIIMQ_LOGQUEUE_H
+#define KAWAIIMQ_LOGQUEUE_H
+
+#include <chrono>
+#include <memory>
+#include <mutex>
+#include "Queue.h"
+
+namespace KawaiiMQ {
+
+    /**
+     * where a new cursor starts reading
+     */
+    enum class LogStart {
+        /// at the oldest retained message
+        Earliest,
+        /// after the newest message, only messages appended later are read
+        Latest
+    };
+
+    /**
+     * how long a log keeps its messages
+     * @remark the limits are combined, a message is dropped as soon as any of them says so
+     */
+    struct LogRetention {
+        /// drop messages every open cursor has read. without any cursor nothing is dropped this way
+        bool trim_read = true;
+        /// keep at most this many messages, 0 means no limit. a cursor behind the limit skips what was dropped
+        std::size_t max_messages = 0;
+        /// drop messages older than this, 0 means no limit
+        std::chrono::milliseconds max_age{0};
+    };
+
+    struct LogStore;
+
+    /**
+     * A read position in a LogQueue
+     * @remark reading never removes a message, every cursor sees the whole stream on its own
+     * @warning a cursor may only be used by one thread at a time
+     */
+    class LogCursor {
+    public:
+        LogCursor(const LogCursor&) = delete;
+
+        LogCursor& operator=(const LogCursor&) = delete;
+
+        /**
+         * close the cursor, it no longer holds back trimming
+         */
+        ~LogCursor();
+
+        /**
+         * read the next message without blocking
+         * @param msg receives the message
+         * @return false if the cursor is at the end of the log
+         */
+        bool tryRead(Envelope& msg);
+
+        /**
+         * read the next message, blocking until one is appended
+         * @param msg receives the message
+         * @param timeout_ms timeout in milliseconds, 0 means no timeout
+         * @return false if timed out
+         */
+        bool read(Envelope& msg, int timeout_ms = 0);
+
+        /**
+         * read up to max_n messages without blocking
+         * @param out vector the messages are appended to
+         * @param max_n maximum number of messages
+         * @return number of messages read
+         */
+        std::size_t readBulk(std::vector<std::shared_ptr<MessageData>>& out, std::size_t max_n);
+
+        /**
+         * read up to max_n messages without blocking, keeping small payloads inline
+         * @param out vector the messages are appended to
+         * @param max_n maximum number of messages
+         * @return number of messages read
+         */
+        std::size_t readBulk(std::vector<Envelope>& out, std::size_t max_n);
+
+        /**
+         * check whether a message is ready to be read
+         * @return true if the cursor is behind the end of the log
+         */
+        [[nodiscard]] bool available() const noexcept;
+
+        /**
+         * get the offset of the next message to read
+         * @return offset, offsets count every message ever appended to the log
+         */
+        std::uint64_t getOffset() const noexcept;
+
+        /**
+         * move the cursor
+         * @param offset offset of the next message to read. an offset before the oldest retained message reads from
+         * the oldest one, an offset past the end waits for that message
+         */
+        void seek(std::uint64_t offset) noexcept;
+
+        /**
+         * get the number of messages appended but not read yet
+         * @return lag of the cursor
+         */
+        std::uint64_t getLag() const noexcept;
+
+        /**
+         * get the number of messages the cursor skipped because retention dropped them before they were read
+         * @return number of skipped messages
+         */
+        std::uint64_t getMissed() const noexcept;
+
+    private:
+        friend class LogQueue;
+        friend struct LogStore;
+
+        LogCursor(std::shared_ptr<LogStore> store, std::uint64_t offset);
+
+        /**
+         * read the message at the cursor, skipping the expired ones. must hold the store lock
+         */
+        bool readLocked(Envelope& msg);
+
+        std::shared_ptr<LogStore> store;
+        std::atomic<std::uint64_t> offset;
+        std::uint64_t missed = 0;
+    };
+
+    /**
+     * A message queue that keeps its messages and lets every reader hold its own offset
+     * @remark relate it to a topic instead of one queue per consumer: a publish is stored once and every Consumer
+     * reads it through a cursor of its own. messages are dropped according to the retention, see LogRetention
+     * @remark wait, tryWait and drain read through one cursor shared by all their callers, so they behave like a
+     * regular queue. that cursor is opened on first use, from the oldest retained message. size() and empty() refer
+     * to it as well, before it exists they count every retained message
+     * @remark the log is unbounded apart from its retention
+     * @remark an expired message stays in the log until retention drops it, but every cursor skips it when it gets
+     * there. QueueStats::expired counts these skips, once per cursor
+     */
+    class LogQueue : public Queue {
+    public:
+        /**
+         * construct a log
+         * @param name name of the queue
+         * @param retention when messages are dropped
+         */
+        explicit LogQueue(std::string name, LogRetention retention = {});
+
+        LogQueue(const LogQueue& other) = delete;
+
+        LogQueue& operator=(const LogQueue& other) = delete;
+
+        /**
+         * open a cursor
+         * @param start where the cursor starts reading
+         * @return cursor, it may outlive the log
+         */
+        std::unique_ptr<LogCursor> openCursor(LogStart start = LogStart::Earliest);
+
+        /**
+         * Size of the queue
+         * @return number of messages the shared cursor has not read yet
+         */
+        std::size_t size() const noexcept override;
+
+        /**
+         * Check if queue is empty
+         * @return true if the shared cursor has nothing to read
+         */
+        [[nodiscard]] bool empty() const noexcept override;
+
+        /**
+         * Set what push does when the queue is full
+         * @param policy overflow policy
+         * @remark has no effect, the log only drops messages according to its retention
+         */
+        void setOverflowPolicy(OverflowPolicy policy) override;
+
+        /**
+         * Get the backpressure counters
+         * @return counters since the queue was constructed, expired counts the messages skipped by any cursor
+         */
+        QueueStats getStats() const noexcept override;
+
+        /**
+         * get the offset of the oldest retained message
+         * @return offset
+         */
+        std::uint64_t getStartOffset() const noexcept;
+
+        /**
+         * get the offset the next appended message will get
+         * @return offset
+         */
+        std::uint64_t getEndOffset() const noexcept;
+
+        /**
+         * get the number of retained messages
+         * @return number of messages
+         */
+        std::size_t getRetainedCount() const noexcept;
+
+    protected:
+        void enqueue(Envelope msg) override;
+
+        void enqueueBulk(std::vector<Envelope>& msgs) override;
+
+        bool dequeue(Envelope& msg, bool block, int timeout_ms) override;
+
+        std::size_t dequeueBulk(const Sink& sink, std::size_t max_n, bool block, int timeout_ms) override;
+
+    private:
+        /**
+         * get the shared cursor, opening it on first use. must hold shared_mtx
+         */
+        LogCursor& sharedCursor();
+
+        bool tryReadShared(Envelope& msg);
+
+        std::shared_ptr<LogStore> store;
+        mutable std::mutex shared_mtx;
+        std::unique_ptr<LogCursor> shared;
+    };
+
+    /**
+     * construct a log
+     * @param name name of the queue
+     * @param retention when messages are dropped
+     * @return log shared ptr
+     */
+    std::shared_ptr<LogQueue> makeLogQueue(const std::string& name, LogRetention retention = {});
+}
+
+#endif //KAWAIIMQ_LOGQUEUE_H
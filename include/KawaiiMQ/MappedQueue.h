@@ -0,0 +1,173 @@
+/**
+ * @file MappedQueue.h
+ * @author ayano
+ * @date 2/18/24
+ * @brief A byte queue stored in memory mapped segment files, read without copying
+*/
+
+#ifndef KAWAIIMQ_MAPPEDQUEUE_H
+#define KAWAIIMQ_MAPPEDQUEUE_H
+
+#include <deque>
+#include <filesystem>
+#include <mutex>
+#include "Queue.h"
+#include "Parker.h"
+
+namespace KawaiiMQ {
+
+    /**
+     * where mapped queues store their segments
+     */
+    struct MappedOptions {
+        /// every mapped queue gets a sub directory named after it
+        std::filesystem::path directory = "kawaiimq-mapped";
+        /// size of a segment file, also the largest message. fixed when the queue is created
+        std::size_t segment_size = std::size_t(64) << 20;
+    };
+
+    /**
+     * A message queue whose messages live in memory mapped files
+     * @remark a push copies the bytes into the mapped segment once. a pop hands out a Message<Bytes> pointing straight
+     * into the mapping, the segment stays mapped while any such message is alive. the page cache decides what is in
+     * memory, so the queue can grow larger than RAM
+     * @remark the read and write positions live in a mapped header, reopening the queue maps the segments again
+     * instead of reading them. segments are deleted once every message in them is popped
+     * @remark only Bytes and std::string messages can be pushed, both come out as Bytes. the queue is unbounded
+     * @remark only the bytes are stored, the expiry of a message is dropped on push and its pops never discard it
+     * @remark data reaches the disk when the kernel writes the pages back or when sync() is called
+     */
+    class MappedQueue : public Queue {
+    public:
+        /**
+         * open or create a mapped queue
+         * @param name name of the queue, also the name of its directory
+         * @param options storage options
+         * @exception QueueException Will throw if a file cannot be created or mapped
+         */
+        MappedQueue(std::string name, const MappedOptions& options);
+
+        MappedQueue(const MappedQueue& other) = delete;
+
+        MappedQueue& operator=(const MappedQueue& other) = delete;
+
+        ~MappedQueue() override;
+
+        /**
+         * Push bytes into the queue without wrapping them in a message first
+         * @param bytes bytes to copy into the segment
+         * @exception QueueException Will throw if the bytes do not fit into one segment
+         */
+        void pushBytes(std::string_view bytes);
+
+        /**
+         * Size of the queue
+         * @return size of the queue
+         */
+        std::size_t size() const noexcept override;
+
+        /**
+         * Check if queue is empty
+         * @return false if not empty, true if empty
+         */
+        [[nodiscard]] bool empty() const noexcept override;
+
+        /**
+         * Set what push does when the queue is full
+         * @param policy overflow policy
+         * @remark has no effect, the queue is unbounded
+         */
+        void setOverflowPolicy(OverflowPolicy policy) override;
+
+        /**
+         * write the mapped pages back to disk and wait for it
+         * @exception QueueException Will throw if msync fails
+         */
+        void sync();
+
+        /**
+         * get the number of segment files
+         * @return number of segments still holding unpopped messages, at least 1
+         */
+        std::size_t getSegmentCount() const;
+
+    protected:
+        /**
+         * store a message
+         * @param msg message pushing in, must hold Bytes or std::string
+         * @exception TypeException Will throw if the message holds another type
+         * @exception QueueException Will throw if the message does not fit into one segment
+         */
+        void enqueue(Envelope msg) override;
+
+        void enqueueBulk(std::vector<Envelope>& msgs) override;
+
+        bool dequeue(Envelope& msg, bool block, int timeout_ms) override;
+
+        std::size_t dequeueBulk(const Sink& sink, std::size_t max_n, bool block, int timeout_ms) override;
+
+    private:
+        /**
+         * a mapped segment file, unmapped when the queue and every message pointing into it are gone
+         */
+        struct Segment {
+            Segment(std::filesystem::path path, std::size_t size, bool create);
+
+            ~Segment();
+
+            std::filesystem::path path;
+            char* data = nullptr;
+            std::size_t size;
+        };
+
+        /**
+         * positions kept in the mapped header file
+         */
+        struct Header {
+            std::uint64_t magic;
+            std::uint64_t segment_size;
+            std::uint64_t read_segment;
+            std::uint64_t read_offset;
+            std::uint64_t write_segment;
+            std::uint64_t write_offset;
+            std::uint64_t pushed;
+            std::uint64_t popped;
+        };
+
+        std::shared_ptr<Segment> openSegment(std::uint64_t index, bool create) const;
+
+        /**
+         * copy a record into the write segment, must hold mtx
+         */
+        void write(std::string_view bytes);
+
+        /**
+         * take the record at the read position, must hold mtx
+         * @return false if the queue is empty
+         */
+        bool read(Envelope& msg);
+
+        bool tryPop(Envelope& msg);
+
+        bool popBlocking(Envelope& msg, int timeout_ms);
+
+        void popped();
+
+        std::filesystem::path directory;
+        mutable std::mutex mtx;
+        Header* header = nullptr;
+        // segments from the read segment to the write segment
+        std::deque<std::shared_ptr<Segment>> segments;
+        Parker parker;
+    };
+
+    /**
+     * construct a mapped queue
+     * @param name name of the queue, also the name of its directory
+     * @param options storage options
+     * @return queue shared ptr, already holding the messages left from a previous run
+     */
+    std::shared_ptr<MappedQueue> makeMappedQueue(const std::string& name, const MappedOptions& options = {});
+}
+
+#endif //KAWAIIMQ_MAPPEDQUEUE_H
@@ -9,16 +9,139 @@
 #define KAWAIIMQ_MESSAGE_H
 #include <string>
 #include <memory>
+#include <cstddef>
+#include <atomic>
+#include <cstdint>
+#include <span>
+#include <string_view>
+#include <typeinfo>
+#include <type_traits>
 #include "Exceptions.h"
+#include "MessagePool.h"
+#include "Tracer.h"
 
 namespace KawaiiMQ {
+
+    /**
+     * a variable of its own for every type, only its address is used
+     */
+    template<typename T>
+    inline constexpr char typeAnchor{};
+
+    /**
+     * tag identifying a type
+     * @tparam T type
+     * @return address of typeAnchor<T>
+     * @remark a type with internal linkage, like one in an anonymous namespace, gets an anchor per translation unit,
+     * so two of them sharing a name never share a tag. tags differ between processes, never store one
+     */
+    template<typename T>
+    inline std::uint64_t typeTag() noexcept {
+        return reinterpret_cast<std::uintptr_t>(&typeAnchor<T>);
+    }
+
+    /**
+     * read-only bytes that may live in memory owned by something else, like a mapped file
+     * @remark copying a Bytes copies the view, never the bytes. the owner keeps the memory alive for as long as any
+     * copy exists
+     */
+    class Bytes {
+    public:
+        Bytes() = default;
+
+        /**
+         * view bytes kept alive by an owner
+         * @param bytes bytes to view
+         * @param owner keeps the bytes alive, may be nullptr if they outlive every copy anyway
+         */
+        Bytes(std::string_view bytes, std::shared_ptr<const void> owner) noexcept
+                : bytes(bytes), owner(std::move(owner)) {}
+
+        /**
+         * copy bytes into a buffer owned by the result
+         * @param bytes bytes to copy
+         * @return bytes viewing the copy
+         */
+        static Bytes copyOf(std::string_view bytes) {
+            auto buffer = std::make_shared<const std::string>(bytes);
+            return {*buffer, buffer};
+        }
+
+        [[nodiscard]] std::string_view view() const noexcept {
+            return bytes;
+        }
+
+        [[nodiscard]] std::span<const std::byte> span() const noexcept {
+            return {reinterpret_cast<const std::byte*>(bytes.data()), bytes.size()};
+        }
+
+        [[nodiscard]] const char* data() const noexcept {
+            return bytes.data();
+        }
+
+        [[nodiscard]] std::size_t size() const noexcept {
+            return bytes.size();
+        }
+
+        [[nodiscard]] bool empty() const noexcept {
+            return bytes.empty();
+        }
+
+    private:
+        std::string_view bytes;
+        std::shared_ptr<const void> owner;
+    };
+
     /**
      * base class of message
      */
     class MessageData {
     public:
         MessageData() = default;
+
+        /**
+         * copy a message, the copy is not traced
+         */
+        MessageData(const MessageData& other) noexcept : type_tag(other.type_tag) {}
+
         virtual ~MessageData() = default;
+
+        /**
+         * get the type tag of the content
+         * @return tag of the content type, 0 if this is not a Message<T>
+         */
+        [[nodiscard]] std::uint64_t getTypeTag() const noexcept {
+            return type_tag;
+        }
+
+        /**
+         * get the trace following the message
+         * @return trace id, 0 if the message is not traced
+         */
+        [[nodiscard]] std::uint64_t getTraceId() const noexcept {
+            return trace_id.load(std::memory_order_relaxed);
+        }
+
+        /**
+         * start a trace on the message if the calling thread samples it, see Tracer::sample()
+         * @return trace id, 0 if the message is not traced
+         */
+        std::uint64_t trace() noexcept {
+            auto id = trace_id.load(std::memory_order_relaxed);
+            if (id == 0 && Tracer::sample()) {
+                auto fresh = Tracer::newTraceId();
+                // a message pushed into several queues at once keeps the first trace started on it
+                id = trace_id.compare_exchange_strong(id, fresh, std::memory_order_relaxed) ? fresh : id;
+            }
+            return id;
+        }
+
+    protected:
+        explicit MessageData(std::uint64_t type_tag) : type_tag(type_tag) {}
+
+    private:
+        const std::uint64_t type_tag = 0;
+        std::atomic<std::uint64_t> trace_id = 0;
     };
 
     /**
@@ -28,7 +151,7 @@ namespace KawaiiMQ {
     template<typename T>
     class Message : public MessageData {
     public:
-        explicit Message(T content) : content(std::move(content)) {}
+        explicit Message(T content) : MessageData(typeTag<T>()), content(std::move(content)) {}
 
         /**
          * set content of the message
@@ -46,40 +169,123 @@ namespace KawaiiMQ {
             return content;
         }
 
+        /**
+         * get content of the message without copying
+         * @return reference to the content of the message
+         */
+        const T& getContentRef() const noexcept {
+            return content;
+        }
+
+        template<typename U>
+        friend const U& getMessage(const std::shared_ptr<MessageData>& in);
+
         template<typename U>
-        friend U getMessage(std::shared_ptr<MessageData> in);
+        friend U getMessage(std::shared_ptr<MessageData>&& in);
 
     private:
         T content;
     };
 
+    /**
+     * Check the content type of a message
+     * @tparam T type of message you are expecting
+     * @param in shared ptr of message
+     * @return pointer to the message if the content is a T, nullptr otherwise
+     */
+    template<typename T>
+    Message<T>* messageCast(const std::shared_ptr<MessageData>& in) noexcept {
+        if (in != nullptr && in->getTypeTag() == typeTag<T>()) {
+            return static_cast<Message<T>*>(in.get());
+        }
+        return nullptr;
+    }
+
     /**
      * Get the message content from a message
      * @tparam T type of message you are expecting
      * @param in shared ptr of message
-     * @return message content
+     * @return reference to the message content, valid as long as the message is alive
      * @exception TypeException Will throw if the type of the message is not the same as the type you are expecting
      */
     template<typename T>
-    T getMessage(std::shared_ptr<MessageData> in) {
-        std::shared_ptr<Message<T>> tmp = std::dynamic_pointer_cast<Message<T>>(in);
-        if (tmp != nullptr) {
-            return tmp->content;
+    const T& getMessage(const std::shared_ptr<MessageData>& in) {
+        if (auto msg = messageCast<T>(in)) {
+            if (Tracer::enabled()) [[unlikely]] {
+                if (auto id = msg->getTraceId()) {
+                    Tracer::record(TracePoint::Read, id);
+                }
+            }
+            return msg->content;
         }
-        throw TypeException(
-                "Expected type " + std::string(typeid(T).name()) + ", got " + std::string(typeid(in).name()));
+        throw TypeException("Expected type " + std::string(typeid(T).name()) + ", got another type");
+    }
+
+    /**
+     * Get the message content from a message about to be released
+     * @tparam T type of message you are expecting
+     * @param in shared ptr of message
+     * @return message content, moved out when this was the last reference to the message
+     * @exception TypeException Will throw if the type of the message is not the same as the type you are expecting
+     * @warning a weak_ptr to the message must not be locked meanwhile, it could read the content being moved out
+     */
+    template<typename T>
+    T getMessage(std::shared_ptr<MessageData>&& in) {
+        if (auto msg = messageCast<T>(in)) {
+            if (Tracer::enabled()) [[unlikely]] {
+                if (auto id = msg->getTraceId()) {
+                    Tracer::record(TracePoint::Read, id);
+                }
+            }
+            if (in.use_count() == 1) {
+                // use_count() is a relaxed load. the fence makes the release of every other reference, and the
+                // reads of the content its owner made before, happen before the move
+                std::atomic_thread_fence(std::memory_order_acquire);
+                return std::move(msg->content);
+            }
+            return msg->content;
+        }
+        throw TypeException("Expected type " + std::string(typeid(T).name()) + ", got another type");
+    }
+
+    /**
+     * Call a visitor with the message content if it is a T
+     * @tparam T type of message you are expecting
+     * @param in shared ptr of message
+     * @param visitor callable taking const T&
+     * @return true if the visitor was called, false if the content is not a T
+     */
+    template<typename T, typename F>
+    bool visitMessage(const std::shared_ptr<MessageData>& in, F&& visitor) {
+        if (auto msg = messageCast<T>(in)) {
+            std::forward<F>(visitor)(msg->getContentRef());
+            return true;
+        }
+        return false;
     }
 
     /**
      * construct a message shared ptr
      * @tparam T type of content
-     * @param content message content
+     * @param content message content, forwarded into the message
      * @return message shared ptr
+     * @remark the message and its control block live in one block drawn from MessagePool, the block goes back to
+     * the pool when the last reference drops
+     */
+    template<typename T>
+    std::shared_ptr<Message<std::decay_t<T>>> makeMessage(T&& content) {
+        using Content = std::decay_t<T>;
+        return std::allocate_shared<Message<Content>>(PoolAllocator<Message<Content>, Content>(), std::forward<T>(content));
+    }
+
+    /**
+     * get the counters of the pool backing messages of a content type
+     * @tparam T type of content
+     * @return pool counters
      */
     template<typename T>
-    std::shared_ptr<Message<T>> makeMessage(T content) {
-        auto msg = std::make_shared<Message<T>>(content);
-        return msg;
+    PoolStats messagePoolStats() {
+        return MessagePool<T>::stats();
     }
 }
 #endif //KAWAIIMQ_MESSAGE_H
@@ -0,0 +1,272 @@
+/**
+ * @file MessagePool.h
+ * @author ayano
+ * @date 2/7/24
+ * @brief Per-type thread-caching block pool backing makeMessage
+*/
+
+#ifndef KAWAIIMQ_MESSAGEPOOL_H
+#define KAWAIIMQ_MESSAGEPOOL_H
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <mutex>
+#include <new>
+#include <vector>
+
+namespace KawaiiMQ {
+
+    /**
+     * counters of a message pool
+     */
+    struct PoolStats {
+        /// allocations requested from the pool
+        std::size_t requests = 0;
+        /// allocations served by a recycled block
+        std::size_t hits = 0;
+        /// allocations that had to go to operator new
+        std::size_t misses = 0;
+        /// size of one block in bytes, 0 before the first allocation
+        std::size_t block_size = 0;
+        /// blocks currently owned by the pool, in use or cached
+        std::size_t blocks = 0;
+
+        /**
+         * get the share of allocations served from the pool
+         * @return hit rate in [0, 1]
+         */
+        [[nodiscard]] double hitRate() const noexcept {
+            return requests == 0 ? 0.0 : static_cast<double>(hits) / static_cast<double>(requests);
+        }
+
+        /**
+         * get the memory held by the pool
+         * @return bytes owned by the pool, in use or cached
+         */
+        [[nodiscard]] std::size_t footprint() const noexcept {
+            return blocks * block_size;
+        }
+    };
+
+    /**
+     * Block pool shared by all messages of content type T
+     * @tparam T message content type, only used to give every type its own pool
+     * @remark every thread keeps a small cache of free blocks and only takes the pool lock to exchange a batch with
+     * the shared free list. blocks freed on another thread go to that thread's cache, so producer/consumer pairs
+     * recycle blocks through the shared list.
+     * @remark all blocks of a pool have the size of the first allocation, other sizes bypass the pool
+     */
+    template<typename T>
+    class MessagePool {
+    public:
+        /**
+         * Allocate a block
+         * @param size size in bytes
+         * @param align alignment in bytes
+         * @return pointer to the block
+         */
+        static void* allocate(std::size_t size, std::size_t align) {
+            auto& g = global();
+            // a plain load, every allocation after the first would otherwise take the shared line exclusively
+            auto block = g.block_size.load(std::memory_order_relaxed);
+            if (block == 0) {
+                if (g.block_size.compare_exchange_strong(block, size, std::memory_order_relaxed)) {
+                    g.block_align.store(align, std::memory_order_release);
+                    block = size;
+                }
+            }
+            if (block != size) {
+                return ::operator new(size, std::align_val_t(align));
+            }
+            Cache* c = cache_dead ? nullptr : &cache;
+            if (c != nullptr) {
+                c->count();
+                if (c->free.empty()) {
+                    refill(*c);
+                }
+                if (!c->free.empty()) {
+                    void* p = c->free.back();
+                    c->free.pop_back();
+                    return p;
+                }
+            }
+            else {
+                g.requests.fetch_add(1, std::memory_order_relaxed);
+            }
+            g.misses.fetch_add(1, std::memory_order_relaxed);
+            g.blocks.fetch_add(1, std::memory_order_relaxed);
+            return ::operator new(size, std::align_val_t(align));
+        }
+
+        /**
+         * Return a block to the pool
+         * @param p pointer from allocate()
+         * @param size size passed to allocate()
+         * @param align alignment passed to allocate()
+         */
+        static void deallocate(void* p, std::size_t size, std::size_t align) noexcept {
+            auto& g = global();
+            if (size != g.block_size.load(std::memory_order_relaxed)) {
+                ::operator delete(p, std::align_val_t(align));
+                return;
+            }
+            if (cache_dead) {
+                release(&p, 1);
+                return;
+            }
+            if (cache.free.size() >= cacheLimit) {
+                spill(cache);
+            }
+            else if (cache.free.capacity() == 0) {
+                cache.free.reserve(cacheLimit);
+            }
+            cache.free.push_back(p);
+        }
+
+        /**
+         * get the counters of this pool
+         * @return counters, allocations of other threads are flushed in batches so requests and hits lag a bit
+         */
+        static PoolStats stats() {
+            auto& g = global();
+            PoolStats ret;
+            ret.requests = g.requests.load(std::memory_order_relaxed);
+            if (!cache_dead) {
+                ret.requests += cache.requests;
+            }
+            ret.misses = g.misses.load(std::memory_order_relaxed);
+            ret.hits = ret.requests > ret.misses ? ret.requests - ret.misses : 0;
+            ret.block_size = g.block_size.load(std::memory_order_relaxed);
+            ret.blocks = g.blocks.load(std::memory_order_relaxed);
+            return ret;
+        }
+
+    private:
+        // blocks a thread keeps before spilling half of them to the shared list
+        static constexpr std::size_t cacheLimit = 256;
+        // blocks taken from the shared list at once
+        static constexpr std::size_t refillBatch = 64;
+        // blocks the shared list keeps before giving memory back to the system
+        static constexpr std::size_t globalLimit = 16384;
+        // requests counted locally before they are published
+        static constexpr std::size_t flushInterval = 1024;
+
+        struct Global {
+            std::mutex mtx;
+            std::vector<void*> free;
+            std::atomic<std::size_t> block_size{0};
+            // written once by the allocation that set block_size, before any block of that size exists
+            std::atomic<std::size_t> block_align{alignof(std::max_align_t)};
+            std::atomic<std::size_t> requests{0};
+            std::atomic<std::size_t> misses{0};
+            std::atomic<std::size_t> blocks{0};
+        };
+
+        struct Cache {
+            std::vector<void*> free;
+            std::size_t requests = 0;
+
+            void count() {
+                if (++requests == flushInterval) {
+                    global().requests.fetch_add(requests, std::memory_order_relaxed);
+                    requests = 0;
+                }
+            }
+
+            ~Cache() {
+                global().requests.fetch_add(requests, std::memory_order_relaxed);
+                release(free.data(), free.size());
+                cache_dead = true;
+            }
+        };
+
+        /**
+         * the shared state is never destroyed, messages may still be released during static destruction
+         */
+        static Global& global() {
+            static Global* g = new Global();
+            return *g;
+        }
+
+        static void refill(Cache& c) {
+            auto& g = global();
+            std::lock_guard lock(g.mtx);
+            std::size_t n = std::min(refillBatch, g.free.size());
+            c.free.insert(c.free.end(), g.free.end() - static_cast<std::ptrdiff_t>(n), g.free.end());
+            g.free.resize(g.free.size() - n);
+        }
+
+        static void spill(Cache& c) {
+            std::size_t n = c.free.size() / 2;
+            release(c.free.data() + c.free.size() - n, n);
+            c.free.resize(c.free.size() - n);
+        }
+
+        static void release(void** blocks, std::size_t n) noexcept {
+            auto& g = global();
+            auto align = std::align_val_t(g.block_align.load(std::memory_order_acquire));
+            std::size_t freed = 0;
+            {
+                std::lock_guard lock(g.mtx);
+                for (std::size_t i = 0; i < n; ++i) {
+                    if (g.free.size() < globalLimit) {
+                        g.free.push_back(blocks[i]);
+                    }
+                    else {
+                        ::operator delete(blocks[i], align);
+                        ++freed;
+                    }
+                }
+            }
+            g.blocks.fetch_sub(freed, std::memory_order_relaxed);
+        }
+
+        static inline thread_local Cache cache;
+        // trivially destructible, so it can still be read after cache is destroyed at thread exit
+        static inline thread_local bool cache_dead = false;
+    };
+
+    /**
+     * allocator drawing from MessagePool<T>, for use with std::allocate_shared
+     * @tparam U allocated type, rebound by the standard library to its control block type
+     * @tparam T message content type selecting the pool
+     */
+    template<typename U, typename T>
+    class PoolAllocator {
+    public:
+        using value_type = U;
+
+        template<typename V>
+        struct rebind {
+            using other = PoolAllocator<V, T>;
+        };
+
+        PoolAllocator() = default;
+
+        template<typename V>
+        explicit PoolAllocator(const PoolAllocator<V, T>&) noexcept {}
+
+        U* allocate(std::size_t n) {
+            if (n != 1) {
+                return static_cast<U*>(::operator new(n * sizeof(U), std::align_val_t(alignof(U))));
+            }
+            return static_cast<U*>(MessagePool<T>::allocate(sizeof(U), alignof(U)));
+        }
+
+        void deallocate(U* p, std::size_t n) noexcept {
+            if (n != 1) {
+                ::operator delete(p, std::align_val_t(alignof(U)));
+                return;
+            }
+            MessagePool<T>::deallocate(p, sizeof(U), alignof(U));
+        }
+
+        template<typename V>
+        bool operator==(const PoolAllocator<V, T>&) const noexcept {
+            return true;
+        }
+    };
+}
+
+#endif //KAWAIIMQ_MESSAGEPOOL_H
@@ -12,16 +12,85 @@
 #include <mutex>
 #include <iostream>
 #include <unordered_map>
+#include <algorithm>
+#include <array>
 #include "Queue.h"
+#include "Rcu.h"
 
 
 namespace KawaiiMQ {
 
+    class DurableQueue;
+
+    struct DurableOptions;
+
     /**
      * a singleton for managing the message queue
+     * @remark the queues of every topic are published as an immutable list behind an atomic pointer. relate and
+     * unrelate build a new list under a lock, lookups never lock.
      */
     class MessageQueueManager {
+        /**
+         * immutable queue list of a topic
+         */
+        struct Route {
+            std::vector<std::shared_ptr<Queue>> queues;
+            // each message goes to one queue instead of all of them
+            bool partitioned = false;
+        };
+
     public:
+        /**
+         * queues related to a topic, read without locking or copying
+         * @remark the view stays valid while this object is alive, even if the topic is unrelated meanwhile. keep it
+         * short lived, retired queue lists are only freed after every view that may see them is gone
+         */
+        class RelatedQueues {
+        public:
+            using iterator = std::vector<std::shared_ptr<Queue>>::const_iterator;
+
+            [[nodiscard]] iterator begin() const noexcept {
+                return route == nullptr ? iterator() : route->queues.begin();
+            }
+
+            [[nodiscard]] iterator end() const noexcept {
+                return route == nullptr ? iterator() : route->queues.end();
+            }
+
+            [[nodiscard]] std::size_t size() const noexcept {
+                return route == nullptr ? 0 : route->queues.size();
+            }
+
+            [[nodiscard]] bool empty() const noexcept {
+                return size() == 0;
+            }
+
+            /**
+             * check if the topic has ever been related to a queue
+             * @return true if related
+             */
+            [[nodiscard]] bool related() const noexcept {
+                return route != nullptr;
+            }
+
+            /**
+             * check if the topic is partitioned, the queues are then its partitions in order
+             * @return true if partitioned
+             */
+            [[nodiscard]] bool partitioned() const noexcept {
+                return route != nullptr && route->partitioned;
+            }
+
+            const std::shared_ptr<Queue>& operator[](std::size_t i) const noexcept {
+                return route->queues[i];
+            }
+
+        private:
+            friend class MessageQueueManager;
+            explicit RelatedQueues(const Route* route) : route(route) {}
+            Rcu::ReadGuard guard;
+            const Route* route;
+        };
 
         MessageQueueManager &operator=(const MessageQueueManager &other) = delete;
         MessageQueueManager(const MessageQueueManager &other) = delete;
@@ -48,6 +117,24 @@ namespace KawaiiMQ {
          */
         void unrelate(const Topic& topic, std::shared_ptr<Queue> queue);
 
+        /**
+         * split a topic into partitions
+         * @param topic topic you want to partition
+         * @param partitions one queue per partition, in partition order
+         * @exception TopicException Will throw if the topic is already related to a queue or no partition is given
+         * @remark a partitioned topic delivers every message to one partition instead of every related queue, picked
+         * by the key of the message. relating or unrelating a queue later adds or removes a partition, which moves
+         * keys between partitions
+         */
+        void partition(const Topic& topic, const std::vector<std::shared_ptr<Queue>>& partitions);
+
+        /**
+         * check if a topic is partitioned
+         * @param topic topic given
+         * @return true if partitioned
+         */
+        bool isPartitioned(const Topic& topic) const;
+
         /**
          * get all queues related to the topic
          * @param topic given topic
@@ -56,6 +143,13 @@ namespace KawaiiMQ {
          */
         std::vector<std::shared_ptr<Queue>> getAllRelatedQueue(const Topic& topic) const;
 
+        /**
+         * get all queues related to the topic without copying them
+         * @param topic given topic
+         * @return view of the related queues, empty when nothing is related to this topic
+         */
+        RelatedQueues relatedQueues(const Topic& topic) const;
+
         /**
          * get all topics that related to a queue
          * @return all topics
@@ -77,6 +171,29 @@ namespace KawaiiMQ {
          */
         bool isRelatedAny(const Topic& topic);
 
+        /**
+         * open every durable queue stored in a directory and relate it to the topics it was related to before
+         * @param options storage options the queues were created with
+         * @return opened queues, holding the messages left from the previous run
+         * @exception QueueException Will throw if a log cannot be opened
+         * @exception TypeException Will throw if a logged message has no registered serializer
+         */
+        std::vector<std::shared_ptr<DurableQueue>> recover(const DurableOptions& options);
+
+        /**
+         * read the metrics of every related queue, every topic, and every producer and consumer alive
+         * @return snapshot, a queue related to several topics is listed once
+         * @remark counters are read without stopping producers or consumers, they may be off by the operations in
+         * flight
+         */
+        MetricsSnapshot snapshotMetrics() const;
+
+        /**
+         * write the metrics in the Prometheus text exposition format
+         * @return text to serve on a metrics endpoint, see toPrometheus()
+         */
+        std::string exportPrometheus() const;
+
 #ifdef TEST
         /**
          * flush all queues and topics
@@ -86,11 +203,36 @@ namespace KawaiiMQ {
          */
         void flush();
 #endif
+
+        ~MessageQueueManager();
+
     private:
+        // routes are stored in chunks so the table grows without moving published slots
+        static constexpr std::size_t chunkBits = 10;
+        static constexpr std::size_t chunkSize = std::size_t(1) << chunkBits;
+        static constexpr std::size_t chunkCount = 4096;
+
+        using Chunk = std::array<std::atomic<const Route*>, chunkSize>;
+
         MessageQueueManager() = default;
-        mutable std::shared_mutex mtx;
-        std::unordered_map<Topic, std::vector<std::shared_ptr<Queue>>> topic_map;
-        std::unordered_map<std::string, Topic> related_topic;
+
+        /**
+         * load the route of a topic, must be inside a read section or hold the lock
+         */
+        const Route* load(const Topic& topic) const noexcept;
+
+        /**
+         * get the slot of a topic, allocating its chunk when needed. must hold the lock
+         */
+        std::atomic<const Route*>& slot(const Topic& topic);
+
+        /**
+         * publish a new route for a topic and retire the old one. must hold the lock
+         */
+        void publish(const Topic& topic, std::vector<std::shared_ptr<Queue>> queues, bool partitioned);
+
+        mutable std::mutex mtx;
+        std::array<std::atomic<Chunk*>, chunkCount> chunks{};
     };
 }
 #endif //KAWAIIMQ_MESSAGEQUEUEMANAGER_H
@@ -0,0 +1,426 @@
+/**
+ * @file Metrics.h
+ * @author ayano
+ * @date 2/23/24
+ * @brief Low overhead counters and latency histograms of queues, producers and consumers
+*/
+
+#ifndef KAWAIIMQ_METRICS_H
+#define KAWAIIMQ_METRICS_H
+
+#include <array>
+#include <atomic>
+#include <bit>
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+#include "RingBuffer.h"
+
+namespace KawaiiMQ {
+
+    /**
+     * gives every thread a shard of the sharded counters
+     * @remark the first shardCount threads alive at the same time own a shard each and bump it with a plain load and
+     * store. threads beyond them share one more shard and bump it with an atomic add
+     */
+    class MetricShard {
+    public:
+        static constexpr unsigned shardCount = 32;
+
+        /**
+         * get the shard of the calling thread
+         * @return index of the shard, shardCount for the shared one
+         */
+        static unsigned current() noexcept {
+            if (index == unassigned) [[unlikely]] {
+                acquire();
+            }
+            return index;
+        }
+
+    private:
+        static constexpr unsigned unassigned = 0xffffffff;
+
+        static void acquire() noexcept;
+
+        // trivially destructible, so it can still be read while other thread locals are destroyed at thread exit
+        static inline thread_local unsigned index = unassigned;
+    };
+
+    /**
+     * a group of counters sharded by thread, so bumping one never bounces a cache line between cores
+     * @tparam N number of counters
+     * @remark reading a counter sums every shard, it is a snapshot under concurrent updates
+     */
+    template<std::size_t N>
+    class ShardedCounters {
+    public:
+        /**
+         * bump a counter
+         * @param counter index of the counter
+         * @param n amount to add
+         */
+        void add(std::size_t counter, std::uint64_t n = 1) noexcept {
+            auto shard = MetricShard::current();
+            auto& value = shards[shard].values[counter];
+            if (shard != MetricShard::shardCount) [[likely]] {
+                // only this thread writes the shard
+                value.store(value.load(std::memory_order_relaxed) + n, std::memory_order_relaxed);
+            }
+            else {
+                value.fetch_add(n, std::memory_order_relaxed);
+            }
+        }
+
+        /**
+         * read a counter
+         * @param counter index of the counter
+         * @return sum over all shards
+         */
+        std::uint64_t load(std::size_t counter) const noexcept {
+            std::uint64_t ret = 0;
+            for (const auto& shard : shards) {
+                ret += shard.values[counter].load(std::memory_order_relaxed);
+            }
+            return ret;
+        }
+
+    private:
+        struct alignas(cacheLineSize) Shard {
+            std::array<std::atomic<std::uint64_t>, N> values{};
+        };
+
+        std::array<Shard, MetricShard::shardCount + 1> shards{};
+    };
+
+    /**
+     * a histogram read back without its recorder, see Histogram::snapshot()
+     */
+    struct HistogramSnapshot {
+        std::uint64_t count = 0;
+        std::uint64_t sum = 0;
+        std::uint64_t max = 0;
+        /// count of every bucket, see Histogram::upperBound()
+        std::vector<std::uint64_t> buckets;
+
+        /**
+         * get a percentile
+         * @param q quantile between 0 and 1
+         * @return upper bound of the bucket holding the quantile, exact up to 1/8 of the value. 0 if nothing was
+         * recorded
+         */
+        [[nodiscard]] std::uint64_t percentile(double q) const noexcept;
+
+        /**
+         * get the mean
+         * @return mean of the recorded values, 0 if nothing was recorded
+         */
+        [[nodiscard]] double mean() const noexcept;
+    };
+
+    /**
+     * A log-linear histogram in the style of HdrHistogram
+     * @remark every power of two is split into 8 buckets, so a value is known to 1/8 of itself whatever its
+     * magnitude. values of 2^40 and more share the last bucket, that is about 18 minutes in nanoseconds
+     * @remark recording is three relaxed atomic adds and no lock. histograms record sampled or rare events only,
+     * see MetricsRegistry::setSampleEvery()
+     */
+    class Histogram {
+    public:
+        static constexpr unsigned subBits = 3;
+        static constexpr unsigned maxBits = 40;
+        static constexpr std::size_t bucketCount = (maxBits - subBits + 1) << subBits;
+
+        /**
+         * record a value
+         * @param value value, usually nanoseconds
+         */
+        void record(std::uint64_t value) noexcept {
+            buckets[bucketOf(value)].fetch_add(1, std::memory_order_relaxed);
+            count.fetch_add(1, std::memory_order_relaxed);
+            sum.fetch_add(value, std::memory_order_relaxed);
+            auto seen = max.load(std::memory_order_relaxed);
+            while (value > seen && !max.compare_exchange_weak(seen, value, std::memory_order_relaxed)) {
+            }
+        }
+
+        /**
+         * read the histogram
+         * @return counts, a snapshot under concurrent updates
+         */
+        HistogramSnapshot snapshot() const;
+
+        /**
+         * get the bucket a value falls in
+         * @param value value
+         * @return index of the bucket
+         */
+        static constexpr std::size_t bucketOf(std::uint64_t value) noexcept {
+            constexpr std::uint64_t sub = std::uint64_t(1) << subBits;
+            if (value < sub) {
+                return static_cast<std::size_t>(value);
+            }
+            auto msb = static_cast<unsigned>(std::bit_width(value)) - 1;
+            if (msb >= maxBits) {
+                return bucketCount - 1;
+            }
+            auto shift = msb - subBits;
+            return ((msb - subBits + 1) << subBits) + static_cast<std::size_t>((value >> shift) & (sub - 1));
+        }
+
+        /**
+         * get the largest value a bucket holds
+         * @param bucket index of the bucket
+         * @return largest value in the bucket
+         */
+        static constexpr std::uint64_t upperBound(std::size_t bucket) noexcept {
+            constexpr std::uint64_t sub = std::uint64_t(1) << subBits;
+            if (bucket < sub) {
+                return bucket;
+            }
+            if (bucket == bucketCount - 1) {
+                return UINT64_MAX;
+            }
+            auto shift = static_cast<unsigned>(bucket >> subBits) - 1;
+            return ((sub + (bucket & (sub - 1)) + 1) << shift) - 1;
+        }
+
+    private:
+        std::array<std::atomic<std::uint64_t>, bucketCount> buckets{};
+        std::atomic<std::uint64_t> count{0};
+        std::atomic<std::uint64_t> sum{0};
+        std::atomic<std::uint64_t> max{0};
+    };
+
+    /**
+     * metrics recorded by a queue
+     */
+    struct QueueMetrics {
+        enum Counter : std::size_t {
+            /// messages pushed, including the ones the overflow policy dropped
+            Enqueued,
+            /// messages handed to consumers by wait, tryWait, drain, or fetch on an AckQueue
+            Dequeued,
+            /// lock acquisitions that found the lock taken, mutex engine only
+            Contended,
+            /// waits that found the queue empty and blocked
+            Waits,
+            CounterCount
+        };
+
+        ShardedCounters<CounterCount> counters;
+        /// push to pop time of sampled messages, in nanoseconds
+        Histogram latency;
+        /// time blocked in wait and drain, in nanoseconds
+        Histogram wait;
+    };
+
+    /**
+     * metrics recorded by a producer
+     */
+    struct ProducerMetrics {
+        enum Counter : std::size_t {
+            /// messages published, a message broadcast to several topics counts once per topic
+            Published,
+            CounterCount
+        };
+
+        std::string name;
+        ShardedCounters<CounterCount> counters;
+        /// number of queues a publish pushed into, for one message in every sampling period
+        Histogram fan_out;
+    };
+
+    /**
+     * metrics recorded by a consumer
+     */
+    struct ConsumerMetrics {
+        enum Counter : std::size_t {
+            /// messages fetched
+            Fetched,
+            /// fetches that found nothing and blocked
+            Waits,
+            CounterCount
+        };
+
+        std::string name;
+        ShardedCounters<CounterCount> counters;
+        /// time blocked in fetchMessage and fetchBatch, in nanoseconds
+        Histogram wait;
+    };
+
+    /**
+     * metrics of a queue at one point in time
+     */
+    struct QueueSample {
+        std::string name;
+        std::size_t depth = 0;
+        /// 0 if unbounded
+        std::size_t capacity = 0;
+        std::uint64_t enqueued = 0;
+        std::uint64_t dequeued = 0;
+        std::uint64_t contended = 0;
+        std::uint64_t waits = 0;
+        std::uint64_t dropped = 0;
+        std::uint64_t rejected = 0;
+        std::uint64_t blocked = 0;
+        std::uint64_t expired = 0;
+        HistogramSnapshot latency;
+        HistogramSnapshot wait;
+    };
+
+    /**
+     * metrics of a topic at one point in time
+     */
+    struct TopicSample {
+        std::string name;
+        /// related queues, or partitions
+        std::size_t queues = 0;
+        /// messages in all related queues
+        std::size_t depth = 0;
+        bool partitioned = false;
+    };
+
+    /**
+     * metrics of a producer at one point in time
+     */
+    struct ProducerSample {
+        std::string name;
+        std::uint64_t published = 0;
+        HistogramSnapshot fan_out;
+    };
+
+    /**
+     * metrics of a consumer at one point in time
+     */
+    struct ConsumerSample {
+        std::string name;
+        std::uint64_t fetched = 0;
+        std::uint64_t waits = 0;
+        HistogramSnapshot wait;
+    };
+
+    /**
+     * metrics of everything, see MessageQueueManager::snapshotMetrics()
+     */
+    struct MetricsSnapshot {
+        std::vector<TopicSample> topics;
+        std::vector<QueueSample> queues;
+        std::vector<ProducerSample> producers;
+        std::vector<ConsumerSample> consumers;
+    };
+
+    /**
+     * a singleton keeping track of the metrics of producers and consumers, and of the sampling rate
+     * @remark queues are reached through the topics they are related to, producers and consumers register their
+     * metrics here. a registration goes away with its producer or consumer
+     */
+    class MetricsRegistry {
+    public:
+        /**
+         * get instance of this class
+         * @return instance of this class
+         */
+        static std::shared_ptr<MetricsRegistry> Instance();
+
+        /**
+         * set how many pushes a thread does per message whose latency is recorded
+         * @param every sampling period, 1 records every message and 0 none
+         * @remark a sampled message costs two clock reads, the other ones none. a thread picks the new period up once
+         * the period it is in ends
+         */
+        void setSampleEvery(std::uint32_t every) noexcept;
+
+        /**
+         * get how many pushes a thread does per message whose latency is recorded
+         * @return sampling period, 0 if latencies are not recorded
+         */
+        std::uint32_t getSampleEvery() const noexcept;
+
+        /**
+         * check whether the calling thread records the latency of the message it is pushing
+         * @return true once every sampling period
+         */
+        static bool sample() noexcept {
+            return tick(push_countdown);
+        }
+
+        /**
+         * check whether the calling thread records the fan-out of the message it is publishing
+         * @return true once every sampling period
+         * @remark counted apart from sample(), a publish followed by its pushes would always land on the same one
+         */
+        static bool samplePublish() noexcept {
+            return tick(publish_countdown);
+        }
+
+        /**
+         * create the metrics of a producer
+         * @param name name of the producer
+         * @return metrics, registered until released
+         */
+        std::shared_ptr<ProducerMetrics> addProducer(const std::string& name);
+
+        /**
+         * create the metrics of a consumer
+         * @param name name of the consumer
+         * @return metrics, registered until released
+         */
+        std::shared_ptr<ConsumerMetrics> addConsumer(const std::string& name);
+
+        /**
+         * read the metrics of every producer and consumer alive
+         * @param out snapshot the samples are appended to
+         */
+        void sampleClients(MetricsSnapshot& out);
+
+    private:
+        static constexpr std::uint32_t defaultSampleEvery = 64;
+
+        MetricsRegistry() = default;
+
+        static bool tick(std::uint32_t& countdown) noexcept {
+            if (countdown != 0) [[likely]] {
+                --countdown;
+                return false;
+            }
+            auto every = sample_every.load(std::memory_order_relaxed);
+            if (every == 0) {
+                // read the period again after as many calls as the default period
+                countdown = defaultSampleEvery - 1;
+                return false;
+            }
+            countdown = every - 1;
+            return true;
+        }
+
+        static inline std::atomic<std::uint32_t> sample_every = defaultSampleEvery;
+        std::mutex mtx;
+        std::vector<std::weak_ptr<ProducerMetrics>> producers;
+        std::vector<std::weak_ptr<ConsumerMetrics>> consumers;
+        static inline thread_local std::uint32_t push_countdown = 0;
+        static inline thread_local std::uint32_t publish_countdown = 0;
+    };
+
+    /**
+     * get the current time for latency metrics
+     * @return steady clock nanoseconds, never 0
+     */
+    inline std::uint64_t metricsNow() noexcept {
+        return static_cast<std::uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(
+                std::chrono::steady_clock::now().time_since_epoch()).count()) | 1;
+    }
+
+    /**
+     * write a snapshot in the Prometheus text exposition format
+     * @param snapshot metrics
+     * @return text to serve on a metrics endpoint
+     * @remark histograms are written as summaries with the 0.5, 0.9, 0.99 and 0.999 quantiles, in seconds
+     */
+    std::string toPrometheus(const MetricsSnapshot& snapshot);
+}
+
+#endif //KAWAIIMQ_METRICS_H
@@ -0,0 +1,129 @@
+/**
+ * @file Parker.h
+ * @author ayano
+ * @date 2/4/24
+ * @brief Parking spot for consumers of lock-free queues
+*/
+
+#ifndef KAWAIIMQ_PARKER_H
+#define KAWAIIMQ_PARKER_H
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include "RingBuffer.h"
+
+namespace KawaiiMQ {
+
+    /**
+     * Hint the cpu that we are in a spin loop
+     */
+    inline void cpuRelax() noexcept {
+#if defined(__x86_64__) || defined(__i386__)
+        __builtin_ia32_pause();
+#elif defined(__aarch64__)
+        asm volatile("yield");
+#endif
+    }
+
+    /**
+     * Spin-then-yield backoff a waiter goes through before parking
+     * @remark the pause between two polls doubles with every spin step, up to 16 cpuRelax() calls
+     */
+    class Backoff {
+    public:
+        /**
+         * @param spin_limit spin steps before yielding
+         * @param yield_limit yields before giving up
+         */
+        Backoff(int spin_limit, int yield_limit) noexcept : spin_limit(spin_limit), yield_limit(yield_limit) {}
+
+        /**
+         * Wait a little before the next poll
+         * @return false when the backoff is exhausted and the caller should park
+         */
+        bool step() noexcept {
+            if (steps < spin_limit) {
+                int pauses = 1 << (steps < 4 ? steps : 4);
+                for (int i = 0; i < pauses; ++i) {
+                    cpuRelax();
+                }
+            }
+            else if (steps < spin_limit + yield_limit) {
+                std::this_thread::yield();
+            }
+            else {
+                return false;
+            }
+            ++steps;
+            return true;
+        }
+
+    private:
+        int spin_limit;
+        int yield_limit;
+        int steps = 0;
+    };
+
+    /**
+     * Lets consumers of a lock-free queue sleep while the queue is empty
+     * @remark producers call unpark() after every push, it only touches the mutex when a consumer is parked
+     * @remark a consumer waiting on many queues watches all of them with Queue::watch() and parks on its own parker
+     */
+    class Parker {
+    public:
+        /**
+         * Park until ready() returns true
+         * @param ready predicate checked under the parking lock, usually a pop attempt
+         * @param timeout_ms timeout in milliseconds, 0 means no timeout
+         * @return false if timed out, true otherwise
+         */
+        template<typename Pred>
+        bool park(Pred ready, int timeout_ms) {
+            std::unique_lock lock(mtx);
+            parked.fetch_add(1, std::memory_order_relaxed);
+            // pairs with the fence in unpark(): either the producer sees us parked, or we see its message
+            std::atomic_thread_fence(std::memory_order_seq_cst);
+            bool got = true;
+            if (timeout_ms == 0) {
+                cond.wait(lock, ready);
+            }
+            else {
+                got = cond.wait_for(lock, std::chrono::milliseconds(timeout_ms), ready);
+            }
+            parked.fetch_sub(1, std::memory_order_relaxed);
+            return got;
+        }
+
+        /**
+         * Wake up one parked consumer, if any
+         */
+        void unpark() {
+            std::atomic_thread_fence(std::memory_order_seq_cst);
+            if (parked.load(std::memory_order_relaxed) != 0) {
+                std::lock_guard lock(mtx);
+                cond.notify_one();
+            }
+        }
+
+        /**
+         * Wake up all parked consumers, if any
+         */
+        void unparkAll() {
+            std::atomic_thread_fence(std::memory_order_seq_cst);
+            if (parked.load(std::memory_order_relaxed) != 0) {
+                std::lock_guard lock(mtx);
+                cond.notify_all();
+            }
+        }
+
+    private:
+        alignas(cacheLineSize) std::atomic<std::size_t> parked{0};
+        std::mutex mtx;
+        std::condition_variable cond;
+    };
+}
+
+#endif //KAWAIIMQ_PARKER_H
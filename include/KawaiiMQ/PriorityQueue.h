@@ -0,0 +1,165 @@
+/**
+ * @file PriorityQueue.h
+ * @author ayano
+ * @date 2/22/24
+ * @brief A queue engine serving messages by priority, one lock-free ring per priority lane
+*/
+
+#ifndef KAWAIIMQ_PRIORITYQUEUE_H
+#define KAWAIIMQ_PRIORITYQUEUE_H
+
+#include <memory>
+#include <vector>
+#include "Queue.h"
+#include "RingBuffer.h"
+#include "Parker.h"
+
+namespace KawaiiMQ {
+
+    /**
+     * how a PriorityQueue picks the lane to serve next
+     */
+    enum class LaneScheduling {
+        /// always the highest non-empty lane, lower lanes wait while a higher one has messages
+        Strict,
+        /// lanes take turns in proportion to their weights, idle lanes give their turns away
+        WeightedFair
+    };
+
+    /**
+     * lanes of a PriorityQueue
+     */
+    struct PriorityOptions {
+        /// number of priority lanes, at most 64. priority 0 is the lowest lane
+        std::size_t lanes = 8;
+        /// capacity of every lane, rounded up to a power of two
+        std::size_t lane_capacity = 1024;
+        LaneScheduling scheduling = LaneScheduling::WeightedFair;
+        /// share of the turns of every lane under WeightedFair, lowest lane first. empty gives lane i weight i + 1
+        std::vector<std::uint32_t> weights;
+    };
+
+    /**
+     * A message queue with priority lanes
+     * @remark every lane is a bounded lock-free ring. a bitmap of the lanes holding messages lets a consumer find
+     * the lane to serve with one load, push and pop never take a lock and never touch the other lanes
+     * @remark under WeightedFair, consumers go through a fixed, interleaved table of lanes holding every lane as
+     * often as its weight. a turn whose lane is empty goes to the highest non-empty lane instead, so the queue
+     * never idles while it has messages and a low lane still gets its share under a flood of high priority ones
+     * @remark messages of the same lane keep their order. push without a priority goes to lane 0, a priority
+     * beyond the last lane goes to the last lane. the overflow policy applies per lane
+     */
+    class PriorityQueue : public Queue {
+    public:
+        /**
+         * construct a queue
+         * @param name name of the queue
+         * @param options lanes
+         * @exception QueueException Will throw if there are no lanes, more than 64 lanes, or weights not matching
+         * the lanes
+         */
+        explicit PriorityQueue(std::string name, PriorityOptions options = {});
+
+        PriorityQueue(const PriorityQueue& other) = delete;
+
+        PriorityQueue& operator=(const PriorityQueue& other) = delete;
+
+        /**
+         * get the number of lanes
+         * @return number of lanes
+         */
+        std::size_t getLaneCount() const noexcept;
+
+        /**
+         * get the number of messages in a lane
+         * @param priority priority of the lane
+         * @return size of the lane, a snapshot under concurrent access
+         */
+        std::size_t getLaneSize(unsigned priority) const noexcept;
+
+        /**
+         * Size of the queue
+         * @return number of messages in all lanes, a snapshot under concurrent access
+         */
+        std::size_t size() const noexcept override;
+
+        /**
+         * Check if queue is empty
+         * @return false if not empty, true if empty
+         */
+        [[nodiscard]] bool empty() const noexcept override;
+
+        /**
+         * Get the capacity of the queue
+         * @return capacity of all lanes together
+         */
+        std::size_t getCapacity() const noexcept override;
+
+    protected:
+        void enqueue(Envelope msg) override;
+
+        void enqueueWithPriority(Envelope msg, unsigned priority) override;
+
+        void enqueueBulk(std::vector<Envelope>& msgs) override;
+
+        bool dequeue(Envelope& msg, bool block, int timeout_ms) override;
+
+        std::size_t dequeueBulk(const Sink& sink, std::size_t max_n, bool block, int timeout_ms) override;
+
+    private:
+        /**
+         * store a message in a lane, without waking anyone up
+         * @return false if the message was discarded
+         */
+        bool store(Envelope& msg, std::size_t lane);
+
+        /**
+         * handle a push finding a lane full according to the overflow policy
+         * @param msg message pushing in, moved from if it was stored
+         * @param lane lane of the message
+         * @return false if the message was discarded
+         */
+        bool overflow(Envelope& msg, std::size_t lane);
+
+        /**
+         * pop from the lane whose turn it is
+         * @return false if every lane is empty
+         */
+        bool tryPop(Envelope& msg);
+
+        /**
+         * pick the lane to try next among the lanes in mask
+         */
+        std::size_t pick(std::uint64_t mask) noexcept;
+
+        /**
+         * pop a message, waiting according to the wait strategy when the queue is empty
+         */
+        bool popBlocking(Envelope& msg, int timeout_ms);
+
+        /**
+         * called after a successful pop, wakes up unrelate() when the queue drained
+         */
+        void popped();
+
+        std::vector<std::unique_ptr<MpmcRing<Envelope>>> lanes;
+        LaneScheduling scheduling;
+        // lane of every turn under WeightedFair
+        std::vector<std::uint8_t> turns;
+        alignas(cacheLineSize) std::atomic<std::size_t> turn = 0;
+        // bit i is set while lane i may hold messages
+        alignas(cacheLineSize) std::atomic<std::uint64_t> non_empty = 0;
+        Parker parker;
+    };
+
+    /**
+     * construct a queue with priority lanes
+     * @param name name of the queue
+     * @param options lanes
+     * @return queue shared ptr
+     * @exception QueueException Will throw if the options are invalid
+     */
+    std::shared_ptr<PriorityQueue> makePriorityQueue(const std::string& name, PriorityOptions options = {});
+}
+
+#endif //KAWAIIMQ_PRIORITYQUEUE_H
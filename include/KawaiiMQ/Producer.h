@@ -8,9 +8,14 @@
 #ifndef KAWAIIMQ_PRODUCER_H
 #define KAWAIIMQ_PRODUCER_H
 
+#include <atomic>
+#include <chrono>
+#include <optional>
+#include <string_view>
 #include "Topic.h"
 #include "Message.h"
 #include "MessageQueueManager.h"
+#include "Scheduler.h"
 
 namespace KawaiiMQ {
 
@@ -40,38 +45,187 @@ namespace KawaiiMQ {
          * @param topic topic you want to publish
          * @param message message you want to publish
          * @exception TopicException Will throw if the topic is not subscribed
+         * @exception QueueException Will throw if a related queue is full and its overflow policy refuses the message
+         * @remark a partitioned topic gets the message in one partition, taken in turn
          */
         template<typename T>
         void publishMessage(const Topic& topic, std::shared_ptr<T> message) {
-            if (std::find(subscribed.begin(), subscribed.end(), topic) == subscribed.end()) {
+            if (!subscribed_set.contains(topic)) {
                 throw TopicException("topic not subscribed");
             }
-            auto manager = MessageQueueManager::Instance();
-            auto queues = manager->getAllRelatedQueue(topic);
-            for(auto& queue : queues) {
-                queue->push(std::move(message));
+            deliver(manager->relatedQueues(topic), Envelope(std::shared_ptr<MessageData>(std::move(message))));
+        }
+
+        /**
+         * publish a message with a key to a topic
+         * @param topic topic you want to publish
+         * @param message message you want to publish
+         * @param key key of the message, hashed with std::hash. anything convertible to std::string_view is hashed
+         * as a string
+         * @exception TopicException Will throw if the topic is not subscribed
+         * @exception QueueException Will throw if a related queue is full and its overflow policy refuses the message
+         * @remark on a partitioned topic, messages with the same key go to the same partition and stay in order as
+         * long as the partitions do not change. other topics ignore the key
+         */
+        template<typename T, typename K>
+        void publishMessage(const Topic& topic, std::shared_ptr<T> message, const K& key) {
+            if (!subscribed_set.contains(topic)) {
+                throw TopicException("topic not subscribed");
+            }
+            deliver(manager->relatedQueues(topic), Envelope(std::shared_ptr<MessageData>(std::move(message))),
+                    hashKey(key));
+        }
+
+        /**
+         * publish a message to a topic after a delay
+         * @param topic topic you want to publish
+         * @param message message you want to publish
+         * @param delay how long the message is held back, it is invisible to the queues until then
+         * @exception TopicException Will throw if the topic is not subscribed
+         * @remark the queues are looked up now, a partitioned topic picks the partition now. the message is
+         * pushed by the Scheduler once due, see there for what happens if a queue is full or gone by then
+         */
+        template<typename T, typename Rep, typename Period>
+        void publishMessage(const Topic& topic, std::shared_ptr<T> message, std::chrono::duration<Rep, Period> delay) {
+            publishMessage(topic, std::move(message), Scheduler::Clock::now()
+                    + std::chrono::duration_cast<Scheduler::Clock::duration>(delay));
+        }
+
+        /**
+         * publish a message to a topic at a point in time
+         * @param topic topic you want to publish
+         * @param message message you want to publish
+         * @param when due time of the message, a time already passed publishes it on the next tick of the timer
+         * @exception TopicException Will throw if the topic is not subscribed
+         * @remark a time point of another clock than steady_clock is converted once, adjusting that clock later
+         * does not move the due time
+         */
+        template<typename T, typename Clock, typename Duration>
+        void publishMessage(const Topic& topic, std::shared_ptr<T> message,
+                            std::chrono::time_point<Clock, Duration> when) {
+            if (!subscribed_set.contains(topic)) {
+                throw TopicException("topic not subscribed");
+            }
+            Scheduler::Clock::time_point due;
+            if constexpr (std::is_same_v<Clock, Scheduler::Clock>) {
+                due = std::chrono::time_point_cast<Scheduler::Clock::duration>(when);
+            }
+            else {
+                due = Scheduler::Clock::now()
+                      + std::chrono::duration_cast<Scheduler::Clock::duration>(when - Clock::now());
+            }
+            schedule(manager->relatedQueues(topic), Envelope(std::shared_ptr<MessageData>(std::move(message))), due);
+        }
+
+        /**
+         * publish a value to a topic, small trivially copyable values are stored inline in every queue slot
+         * @param topic topic you want to publish
+         * @param value message content you want to publish
+         * @exception TopicException Will throw if the topic is not subscribed
+         * @exception QueueException Will throw if a related queue is full and its overflow policy refuses the message
+         */
+        template<typename T>
+        void publishValue(const Topic& topic, T&& value) {
+            if (!subscribed_set.contains(topic)) {
+                throw TopicException("topic not subscribed");
+            }
+            deliver(manager->relatedQueues(topic), Envelope::of(std::forward<T>(value)));
+        }
+
+        /**
+         * publish a value with a key to a topic
+         * @param topic topic you want to publish
+         * @param value message content you want to publish
+         * @param key key of the message, see publishMessage
+         * @exception TopicException Will throw if the topic is not subscribed
+         * @exception QueueException Will throw if a related queue is full and its overflow policy refuses the message
+         */
+        template<typename T, typename K>
+        void publishValue(const Topic& topic, T&& value, const K& key) {
+            if (!subscribed_set.contains(topic)) {
+                throw TopicException("topic not subscribed");
+            }
+            deliver(manager->relatedQueues(topic), Envelope::of(std::forward<T>(value)), hashKey(key));
+        }
+
+        /**
+         * publish a batch of messages to a topic
+         * @param topic topic you want to publish
+         * @param messages range of message shared ptrs you want to publish
+         * @exception TopicException Will throw if the topic is not subscribed
+         * @exception QueueException Will throw if a related queue is full and its overflow policy refuses a message
+         * @remark every related queue receives the whole batch under a single lock acquisition. a partitioned topic
+         * gets the whole batch in one partition, taken in turn
+         */
+        template<std::ranges::input_range R>
+        void publishBatch(const Topic& topic, const R& messages) {
+            if (!subscribed_set.contains(topic)) {
+                throw TopicException("topic not subscribed");
+            }
+            auto queues = manager->relatedQueues(topic);
+            if (queues.empty()) {
+                return;
+            }
+            // convert once, every queue then gets envelopes sharing the same payloads
+            std::vector<Envelope> batch;
+            if constexpr (std::ranges::sized_range<const R>) {
+                batch.reserve(std::ranges::size(messages));
+            }
+            for (const auto& msg : messages) {
+                batch.emplace_back(std::shared_ptr<MessageData>(msg));
+                if (Tracer::enabled()) [[unlikely]] {
+                    tracePublish(batch.back());
+                }
+            }
+            if (ttl.count() != 0) {
+                auto expiry = std::chrono::steady_clock::now() + ttl;
+                for (auto& msg : batch) {
+                    msg.setExpiry(expiry);
+                }
+            }
+            if (queues.partitioned()) {
+                count(batch.size(), 1);
+                queues[nextPartition(queues.size())]->pushBulk(std::move(batch));
+                return;
+            }
+            count(batch.size(), queues.size());
+            for (std::size_t i = 0; i + 1 < queues.size(); ++i) {
+                queues[i]->pushBulk(batch);
             }
+            queues[queues.size() - 1]->pushBulk(std::move(batch));
         }
 
         /**
          * broadcast a message to all topics
          * @param message message you want to broadcast
          * @exception TopicException Will throw if no topic is subscribed
+         * @exception QueueException Will throw if a related queue is full and its overflow policy refuses the message
          */
         template<typename T>
         void broadcastMessage(std::shared_ptr<T> message) {
-            auto manager = MessageQueueManager::Instance();
             if (subscribed.empty()) {
                 throw TopicException("no topic subscribed");
             }
+            Envelope msg(std::shared_ptr<MessageData>(std::move(message)));
             for (const auto& topic: subscribed) {
-                auto queues = manager->getAllRelatedQueue(topic);
-                for(auto& queue : queues) {
-                    queue->push(std::move(message));
-                }
+                deliver(manager->relatedQueues(topic), msg);
             }
         }
 
+        /**
+         * set how long the messages published from now on stay deliverable
+         * @param ttl time to live counted from publishing, 0 means the messages never expire
+         * @remark a message still queued when its time is up is discarded by the consumer popping it, and counted
+         * in QueueStats::expired of its queue. a delayed message counts from publishing too, not from its due time
+         */
+        void setTimeToLive(std::chrono::milliseconds ttl) noexcept;
+
+        /**
+         * get how long the published messages stay deliverable
+         * @return time to live, 0 if the messages never expire
+         */
+        std::chrono::milliseconds getTimeToLive() const noexcept;
+
         /**
          * get the name of the producer
          * @return name of the producer
@@ -83,10 +237,79 @@ namespace KawaiiMQ {
          * @return all subscribed topic, in a vector
          */
         std::vector<Topic> getSubscribedTopics() const;
+
+        /**
+         * get the metrics of the producer
+         * @return counters and fan-out since the producer was constructed
+         */
+        ProducerSample getMetrics() const;
     private:
+        /**
+         * push one message into every queue of a topic
+         * @param queues related queues
+         * @param msg message, shared by all queues. the payload is never copied, only the last queue takes over msg
+         */
+        static void fanOut(const MessageQueueManager::RelatedQueues& queues, Envelope msg);
+
+        /**
+         * push one message into the queues of a topic, or into one partition if the topic is partitioned
+         * @param queues related queues
+         * @param msg message
+         * @param key_hash hash of the message key, the partitions are taken in turn without a key
+         */
+        void deliver(const MessageQueueManager::RelatedQueues& queues, Envelope msg,
+                     std::optional<std::size_t> key_hash = std::nullopt);
+
+        /**
+         * hand a message for the queues of a topic to the Scheduler, or for one partition if the topic is partitioned
+         * @param queues related queues
+         * @param msg message, shared by all queues
+         * @param when due time
+         */
+        void schedule(const MessageQueueManager::RelatedQueues& queues, Envelope msg, Scheduler::Clock::time_point when);
+
+        /**
+         * stamp the expiry of a message about to be published, if a time to live is set
+         */
+        void stamp(Envelope& msg) const noexcept;
+
+        /**
+         * count published messages
+         * @param messages number of messages
+         * @param width number of queues every message goes to
+         */
+        void count(std::size_t messages, std::size_t width) noexcept;
+
+        /**
+         * record a message about to be published, starting a trace on it if the calling thread samples it
+         */
+        void tracePublish(const Envelope& msg) const noexcept;
+
+        /**
+         * take the next partition for a message without a key
+         * @param partitions number of partitions
+         * @return partition index
+         */
+        std::size_t nextPartition(std::size_t partitions) noexcept;
+
+        template<typename K>
+        static std::size_t hashKey(const K& key) noexcept {
+            if constexpr (std::is_convertible_v<const K&, std::string_view>) {
+                return std::hash<std::string_view>{}(key);
+            }
+            else {
+                return std::hash<K>{}(key);
+            }
+        }
+
         std::vector<Topic> subscribed;
+        TopicSet subscribed_set;
+        std::shared_ptr<MessageQueueManager> manager = MessageQueueManager::Instance();
         std::mutex mtx;
         std::string name;
+        std::shared_ptr<ProducerMetrics> metrics = MetricsRegistry::Instance()->addProducer(name);
+        std::atomic<std::size_t> next_partition = 0;
+        std::chrono::milliseconds ttl{0};
     };
 }
 
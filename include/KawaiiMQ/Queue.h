@@ -14,15 +14,104 @@
 #include <iostream>
 #include <utility>
 #include <limits>
+#include <atomic>
+#include <vector>
+#include <ranges>
+#include <type_traits>
+#include <chrono>
+#include <thread>
+#include <deque>
 #include "Message.h"
+#include "Envelope.h"
+#include "AsyncWaiter.h"
 #include "Exceptions.h"
+#include "Parker.h"
+#include "Metrics.h"
 /**
  * KawaiiMQ namespace
  */
 namespace KawaiiMQ {
 
+    /**
+     * storage engine of a queue
+     */
+    enum class QueueEngine {
+        /// unbounded std::queue guarded by a mutex
+        Mutex,
+        /// bounded lock-free multi-producer multi-consumer ring, see RingQueue
+        Ring,
+        /// bounded wait-free single-producer single-consumer ring, see SpscQueue
+        Spsc,
+        /// bounded lock-free rings, one per priority lane, see PriorityQueue
+        Priority
+    };
+
+    /**
+     * what push does when a bounded queue is full
+     */
+    enum class OverflowPolicy {
+        /// wait for a consumer to free a slot, throws QueueException once the push timeout expires
+        Block,
+        /// throw QueueException right away
+        Fail,
+        /// discard the oldest message in the queue to make room
+        DropOldest,
+        /// discard the message being pushed
+        DropNewest
+    };
+
+    /**
+     * how a consumer waits on an empty queue
+     */
+    enum class WaitStrategy {
+        /// sleep on a condition variable right away
+        Blocking,
+        /// poll without ever sleeping, lowest latency but keeps a core busy
+        BusySpin,
+        /// poll, yielding the cpu between two attempts
+        SpinYield,
+        /// poll with a growing pause, then yield, then sleep
+        SpinPark
+    };
+
+    /**
+     * backpressure counters of a queue
+     */
+    struct QueueStats {
+        /// messages discarded by DropOldest or DropNewest
+        std::uint64_t dropped = 0;
+        /// pushes refused with a QueueException, by Fail or by a Block timeout
+        std::uint64_t rejected = 0;
+        /// pushes that had to wait for a free slot
+        std::uint64_t blocked = 0;
+        /// total time producers spent waiting for a free slot
+        std::chrono::nanoseconds blocked_time{0};
+        /// messages discarded by a consumer because their expiry passed
+        std::uint64_t expired = 0;
+    };
+
+    /**
+     * Gets told about every push into the queues it watches, see Queue::watch()
+     */
+    class QueueWatcher {
+    public:
+        virtual ~QueueWatcher() = default;
+
+        /**
+         * called after a push, on the pushing thread. must not block and must not push into the watched queue
+         */
+        virtual void notify() noexcept = 0;
+    };
+
+    class Topic;
+
+    class MessageQueueManager;
+
     /**
      * A message queue that supports basic queue operation, and notification-based value fetch
+     * @remark this class is the mutex based engine, other engines derive from it and override the storage operations
+     * @remark messages whose expiry passed are discarded when wait, tryWait or drain pops them, see
+     * Envelope::setExpiry(). nothing scans the queue for them, and messages without an expiry never read the clock
      */
     class Queue {
         // convenience alias
@@ -34,10 +123,20 @@ namespace KawaiiMQ {
 
         explicit Queue(std::string name);
 
+        /**
+         * construct a bounded queue
+         * @param name name of the queue
+         * @param capacity maximum number of messages, 0 means unbounded
+         * @param policy what push does when the queue is full
+         */
+        Queue(std::string name, std::size_t capacity, OverflowPolicy policy = OverflowPolicy::Block);
+
         Queue(const Queue& other);
 
         Queue(Queue&& other) noexcept;
 
+        virtual ~Queue() = default;
+
         bool operator==(const Queue& other);
 
         Queue& operator=(const Queue& other);
@@ -47,9 +146,18 @@ namespace KawaiiMQ {
         /**
          * Wait for the result when called. Will pop the message if notified.
          * @return a std::shared_ptr containing message
+         * @exception QueueException Will throw if timeout is set and no message arrives in time
          */
         std::shared_ptr<MessageData> wait();
 
+        /**
+         * Wait for a message without blocking the thread
+         * @param executor resumes the coroutine once a message is handed to it
+         * @return awaitable, co_await it to get a std::shared_ptr containing message
+         * @remark the timeout set with setTimeout() does not apply
+         */
+        QueueAwaiter asyncWait(Executor executor);
+
         /**
          * Try to wait for the result when called. If the queue is empty, return false.
          * @param msg reference of a std::shared_ptr containing message
@@ -57,10 +165,25 @@ namespace KawaiiMQ {
          */
         bool tryWait(std::shared_ptr<MessageData>& msg);
 
+        /**
+         * Wait for the result when called, without boxing inline payloads
+         * @return envelope containing the message
+         * @exception QueueException Will throw if timeout is set and no message arrives in time
+         */
+        Envelope waitValue();
+
+        /**
+         * Try to fetch a message without boxing inline payloads. If the queue is empty, return false.
+         * @param msg reference of an envelope receiving the message
+         * @return true of can fetch a message, false if the queue is empty
+         */
+        bool tryWaitValue(Envelope& msg);
+
         /**
          * Push a message to the queue
          * @param msg message pushing in
          * @tparam T message content type
+         * @exception QueueException Will throw if the queue is full and the overflow policy refuses the message
          */
         template<typename T>
         void push(const std::shared_ptr<T>& msg);
@@ -69,21 +192,123 @@ namespace KawaiiMQ {
          * Push a message to the queue
          * @param msg message pushing in
          * @tparam T message content type
+         * @exception QueueException Will throw if the queue is full and the overflow policy refuses the message
+         */
+        template<typename T>
+        void push(std::shared_ptr<T>&& msg);
+
+        /**
+         * Push a message held in an envelope to the queue
+         * @param msg message pushing in
+         * @exception QueueException Will throw if the queue is full and the overflow policy refuses the message
+         */
+        void push(Envelope msg);
+
+        /**
+         * Push a message held in an envelope to the queue, without waiting for room
+         * @param msg message pushing in, left as it was if the queue had no room
+         * @return false if the queue is full and the overflow policy is Block, nothing was stored then
+         * @exception QueueException Will throw if the queue is full and the overflow policy is Fail
+         * @remark the other policies behave as in push(). meant for threads that must not block, like the timer
+         * thread, which try again later instead
+         */
+        bool tryPush(Envelope& msg);
+
+        /**
+         * Push a message to the queue with a priority
+         * @param msg message pushing in
+         * @param priority priority of the message, higher priorities are served first
+         * @tparam T message content type
+         * @exception QueueException Will throw if the queue is full and the overflow policy refuses the message
+         * @remark engines without priority lanes ignore the priority, see PriorityQueue
+         */
+        template<typename T>
+        void push(const std::shared_ptr<T>& msg, unsigned priority);
+
+        /**
+         * Push a message held in an envelope to the queue with a priority
+         * @param msg message pushing in
+         * @param priority priority of the message, higher priorities are served first
+         * @exception QueueException Will throw if the queue is full and the overflow policy refuses the message
+         * @remark engines without priority lanes ignore the priority, see PriorityQueue
+         */
+        void push(Envelope msg, unsigned priority);
+
+        /**
+         * Push a value to the queue, small trivially copyable values are stored inline in the queue slot
+         * @param value message content
+         * @tparam T message content type
+         * @exception QueueException Will throw if the queue is full and the overflow policy refuses the message
          */
         template<typename T>
-        void push(std::shared_ptr<T>&& msg) noexcept;
+        void pushValue(T&& value);
+
+        /**
+         * Push a value to the queue with a priority
+         * @param value message content
+         * @param priority priority of the message, higher priorities are served first
+         * @tparam T message content type
+         * @exception QueueException Will throw if the queue is full and the overflow policy refuses the message
+         * @remark engines without priority lanes ignore the priority, see PriorityQueue
+         */
+        template<typename T>
+        void pushValue(T&& value, unsigned priority);
+
+        /**
+         * Push a range of messages to the queue, with one lock acquisition and one notification
+         * @param msgs range of message shared ptrs or envelopes, elements are moved out if the range is an rvalue
+         * @tparam R range type
+         * @exception QueueException Will throw if the queue is full and the overflow policy refuses a message, the
+         * messages before it stay in the queue
+         */
+        template<std::ranges::input_range R>
+        void pushBulk(R&& msgs);
+
+        /**
+         * Pop up to max_n messages without blocking
+         * @param out vector the messages are appended to
+         * @param max_n maximum number of messages to pop
+         * @return number of messages popped
+         */
+        std::size_t drain(std::vector<std::shared_ptr<MessageData>>& out, std::size_t max_n);
+
+        /**
+         * Pop up to max_n messages without blocking or boxing inline payloads
+         * @param out vector the messages are appended to
+         * @param max_n maximum number of messages to pop
+         * @return number of messages popped
+         */
+        std::size_t drain(std::vector<Envelope>& out, std::size_t max_n);
+
+        /**
+         * Wait until at least one message is available, then pop up to max_n messages
+         * @param out vector the messages are appended to
+         * @param max_n maximum number of messages to pop
+         * @param timeout_ms timeout in milliseconds, 0 means no timeout
+         * @return number of messages popped, 0 if timed out
+         */
+        std::size_t drain(std::vector<std::shared_ptr<MessageData>>& out, std::size_t max_n, int timeout_ms);
+
+        /**
+         * Wait until at least one message is available, then pop up to max_n messages without boxing inline payloads
+         * @param out vector the messages are appended to
+         * @param max_n maximum number of messages to pop
+         * @param timeout_ms timeout in milliseconds, 0 means no timeout
+         * @return number of messages popped, 0 if timed out
+         */
+        std::size_t drain(std::vector<Envelope>& out, std::size_t max_n, int timeout_ms);
 
         /**
          * Size of the queue
          * @return size of the queue
          */
-        std::size_t size() const noexcept;
+        virtual std::size_t size() const noexcept;
 
         /**
          * Check if queue is empty
          * @return false if not empty, true if empty
          */
-        [[nodiscard]] bool empty() const noexcept;
+        [[nodiscard]] virtual bool empty() const noexcept;
 
         /**
          * Set timeout for wait()
@@ -98,6 +323,68 @@ namespace KawaiiMQ {
          */
         int getTimeout() const noexcept;
 
+        /**
+         * Get the capacity of the queue
+         * @return maximum number of messages, 0 if unbounded
+         */
+        virtual std::size_t getCapacity() const noexcept;
+
+        /**
+         * Set what push does when the queue is full
+         * @param policy overflow policy
+         * @exception QueueException Will throw if the engine does not support the policy
+         */
+        virtual void setOverflowPolicy(OverflowPolicy policy);
+
+        /**
+         * Get what push does when the queue is full
+         * @return overflow policy
+         */
+        OverflowPolicy getOverflowPolicy() const noexcept;
+
+        /**
+         * Set how long a push waits for a free slot under OverflowPolicy::Block
+         * @param timeout_ms timeout in milliseconds
+         * @remark 0 means no timeout
+         */
+        void setPushTimeout(int timeout_ms) noexcept;
+
+        /**
+         * Get how long a push waits for a free slot under OverflowPolicy::Block
+         * @return timeout in milliseconds
+         */
+        int getPushTimeout() const noexcept;
+
+        /**
+         * Set how a consumer waits when the queue is empty
+         * @param strategy wait strategy
+         * @param spin_limit polls with a growing pause before yielding, SpinPark only
+         * @param yield_limit yields before sleeping, SpinPark only
+         * @remark the mutex engine blocks by default, ring engines spin-then-park
+         * @remark on the mutex engine a spinning consumer polls a size hint and only locks once it shows a message,
+         * an idle spinner stays off the lock the producers take
+         */
+        void setWaitStrategy(WaitStrategy strategy, int spin_limit = 16, int yield_limit = 4) noexcept;
+
+        /**
+         * Get how a consumer waits when the queue is empty
+         * @return wait strategy
+         */
+        WaitStrategy getWaitStrategy() const noexcept;
+
+        /**
+         * Get the backpressure counters
+         * @return counters since the queue was constructed
+         */
+        virtual QueueStats getStats() const noexcept;
+
+        /**
+         * Get the metrics of the queue
+         * @return depth, counters and latency histograms since the queue was constructed
+         * @remark latencies are recorded for one message in every sampling period, see MetricsRegistry
+         */
+        QueueSample getMetrics() const;
+
         /**
          * Set the timeout time of the safely unrelate queue
          * @param timeout_ms timeout time in milliseconds
@@ -122,33 +409,387 @@ namespace KawaiiMQ {
          */
         std::string getName() const;
 
+        /**
+         * Register a watcher to be notified after every push, lets one thread wait on many queues at once
+         * @param watcher watcher to notify, must stay alive until unwatch() is called
+         * @remark pushes only pay for a fence and a load while no watcher is registered
+         */
+        void watch(QueueWatcher* watcher);
+
+        /**
+         * Remove a watcher registered with watch()
+         * @param watcher watcher to remove
+         */
+        void unwatch(QueueWatcher* watcher);
+
+    protected:
+        /**
+         * receives the messages popped by dequeueBulk, without allocating like std::function would
+         */
+        class Sink {
+        public:
+            template<typename F>
+            Sink(F& f) : ctx(&f), fn([](void* c, Envelope&& msg) { (*static_cast<F*>(c))(std::move(msg)); }) {}
+
+            void operator()(Envelope&& msg) const {
+                fn(ctx, std::move(msg));
+            }
+
+        private:
+            void* ctx;
+            void (*fn)(void*, Envelope&&);
+        };
+
+        /**
+         * Store a message and wake up a waiter, all push overloads end up here
+         * @param msg message pushing in
+         */
+        virtual void enqueue(Envelope msg);
+
+        /**
+         * Store a message pushed with a priority, the default ignores the priority and calls enqueue()
+         * @param msg message pushing in
+         * @param priority priority of the message
+         */
+        virtual void enqueueWithPriority(Envelope msg, unsigned priority);
+
+        /**
+         * Store a batch of messages and wake up waiters, pushBulk ends up here
+         * @param msgs messages pushing in, moved from
+         */
+        virtual void enqueueBulk(std::vector<Envelope>& msgs);
+
+        /**
+         * Pop a message, all wait overloads end up here
+         * @param msg reference receiving the message
+         * @param block whether to wait when the queue is empty
+         * @param timeout_ms timeout in milliseconds when blocking, 0 means no timeout
+         * @return true if a message was popped, false if the queue is empty or timed out
+         */
+        virtual bool dequeue(Envelope& msg, bool block, int timeout_ms);
+
+        /**
+         * Pop up to max_n messages, all drain overloads end up here
+         * @param sink receives the messages in order
+         * @param max_n maximum number of messages to pop
+         * @param block whether to wait for the first message when the queue is empty
+         * @param timeout_ms timeout in milliseconds when blocking, 0 means no timeout
+         * @return number of messages popped
+         */
+        virtual std::size_t dequeueBulk(const Sink& sink, std::size_t max_n, bool block, int timeout_ms);
+
+        /**
+         * wait for a message according to the wait strategy
+         * @param try_pop pops a message without blocking, returns true on success
+         * @param park blocks until a message is popped, takes the timeout in milliseconds (0 means no timeout) and
+         * returns false on timeout
+         * @param timeout_ms timeout in milliseconds, 0 means no timeout
+         * @return false if timed out
+         */
+        template<typename TryPop, typename Park>
+        bool waitWith(TryPop&& try_pop, Park&& park, int timeout_ms);
+
+        /**
+         * check whether a popped message expired, and count it if so. engines with pop functions of their own
+         * call it too
+         * @param msg message just popped
+         * @param now current time, read on the first message that expires at all and reused afterwards
+         * @return true if the message has to be discarded
+         */
+        bool discard(const Envelope& msg, std::chrono::steady_clock::time_point& now) noexcept;
+
+        /**
+         * count a push that had to wait for a free slot
+         * @param waited time spent waiting
+         */
+        void countBlocked(std::chrono::steady_clock::duration waited) noexcept;
+
+        /**
+         * called by a push finding the queue full under OverflowPolicy::Block, before it starts waiting
+         * @return true if the push runs inside tryPush() and has to store nothing instead of waiting
+         */
+        static bool refuseToWait() noexcept {
+            if (!no_wait.active) {
+                return false;
+            }
+            no_wait.refused = true;
+            return true;
+        }
+
+        /**
+         * called by MessageQueueManager after the queue was related to or unrelated from a topic
+         * @param topic topic
+         * @param related true if related, false if unrelated
+         */
+        virtual void onRelate(const Topic& topic, bool related) {}
+
+        /**
+         * wake up the registered watchers and hand messages to suspended coroutines, called after every push.
+         * engines with push functions of their own call it too
+         */
+        void signalWatchers() noexcept {
+            // pairs with the fences in watch() and addAwaiter(): either we see the waiter, or it sees our message
+            std::atomic_thread_fence(std::memory_order_seq_cst);
+            if (watcher_count.load(std::memory_order_relaxed) != 0) {
+                wakeWatchers();
+            }
+            if (awaiter_count.load(std::memory_order_relaxed) != 0) {
+                resumeAwaiters();
+            }
+        }
+
+        std::atomic<int> timeout_ms = 0;
+        std::atomic<int> push_timeout_ms = 0;
+        std::atomic<OverflowPolicy> policy = OverflowPolicy::Block;
+        std::atomic<WaitStrategy> wait_strategy = WaitStrategy::Blocking;
+        std::atomic<int> spin_limit = 16;
+        std::atomic<int> yield_limit = 4;
+        std::atomic<std::uint64_t> dropped = 0;
+        std::atomic<std::uint64_t> rejected = 0;
+        std::atomic<std::uint64_t> expired = 0;
+        mutable std::condition_variable_any safe_cond;
+        std::unique_ptr<QueueMetrics> metrics = std::make_unique<QueueMetrics>();
 
     private:
+        friend class AsyncWaiter;
+        friend class MessageQueueManager;
+
+        void wakeWatchers() noexcept;
+
+        /**
+         * pop messages for the suspended coroutines in arrival order, and resume them
+         */
+        void resumeAwaiters() noexcept;
+
+        /**
+         * register a suspended coroutine, the caller checks the queue again afterwards
+         * @param waiter waiter to register
+         */
+        void addAwaiter(AsyncWaiter* waiter);
+
+        /**
+         * unregister a waiter, no-op if it is not registered anymore
+         * @param waiter waiter to unregister
+         */
+        void removeAwaiter(AsyncWaiter* waiter);
+
+        /**
+         * state of a tryPush() running on this thread
+         */
+        struct NoWait {
+            bool active;
+            bool refused;
+        };
+
+        static inline thread_local NoWait no_wait{false, false};
+
+        /**
+         * stamp a message with its push time if the calling thread samples it, see MetricsRegistry::sample()
+         * @param msg message about to be pushed, a stamp it carries from an earlier queue is cleared
+         */
+        static void stampSampled(Envelope& msg) noexcept {
+            msg.setStamp(MetricsRegistry::sample() ? metricsNow() : 0);
+        }
+
+        /**
+         * record the latency of a popped message if it was sampled
+         * @param msg message popped
+         */
+        void recordLatency(const Envelope& msg) noexcept {
+            if (msg.getStamp() != 0) [[unlikely]] {
+                metrics->latency.record(metricsNow() - msg.getStamp());
+            }
+        }
+
+        /**
+         * record a traced message about to be pushed, starting a trace on it if the calling thread samples it
+         * @param msg message
+         */
+        void tracePush(const Envelope& msg) noexcept;
+
+        /**
+         * record a traced message just popped
+         * @param msg message
+         */
+        void tracePop(const Envelope& msg) noexcept;
+
+        /**
+         * lock the mutex engine, counting the acquisitions that find the lock taken
+         */
+        std::unique_lock<std::shared_mutex> lockCounted();
+
+        /**
+         * pop a message that did not expire, discarding the expired ones popped before it
+         * @param msg reference receiving the message
+         * @param block whether to wait when the queue is empty
+         * @param timeout_ms timeout in milliseconds when blocking, 0 means no timeout. covers the whole call
+         * @return false if the queue is empty or timed out
+         */
+        bool popLive(Envelope& msg, bool block, int timeout_ms);
+
+        /**
+         * pop up to max_n messages that did not expire, discarding the expired ones
+         * @param put receives the messages
+         * @param max_n maximum number of messages to hand to put
+         * @param block whether to wait until a message is available
+         * @param timeout_ms timeout in milliseconds when blocking, 0 means no timeout. covers the whole call
+         * @return number of messages handed to put
+         */
+        template<typename Put>
+        std::size_t drainLive(Put& put, std::size_t max_n, bool block, int timeout_ms);
+
+        /**
+         * make room for one message according to the overflow policy, called with the lock held
+         * @param lock lock of the queue, released while blocking
+         * @return false if the message has to be discarded
+         */
+        bool admit(std::unique_lock<std::shared_mutex>& lock);
+
+        /**
+         * sleep on the condition variable until the queue is not empty, called with the lock held
+         * @param lock lock of the queue, released while sleeping
+         * @param timeout_ms timeout in milliseconds, 0 means no timeout
+         */
+        void sleepWhileEmpty(std::unique_lock<std::shared_mutex>& lock, int timeout_ms);
+
+        /**
+         * pop a message, sleeping on the condition variable if asked to
+         */
+        bool pop(Envelope& msg, bool block, int timeout_ms);
+
         mutable std::shared_mutex mtx;
-        std::queue<std::shared_ptr<MessageData>> queue;
+        std::queue<Envelope> queue;
+        // size of queue, written under mtx and read without it by spinning consumers
+        std::atomic<std::size_t> queued = 0;
         mutable std::condition_variable_any cond;
+        // consumers sleeping on cond, pushes skip the notification when there are none
+        std::size_t waiters = 0;
+        // producers waiting for a free slot
+        std::condition_variable_any space_cond;
+        std::size_t space_waiters = 0;
+        std::atomic<std::uint64_t> blocked = 0;
+        std::atomic<std::int64_t> blocked_ns = 0;
         std::string name;
-        int timeout_ms = 0;
+        std::size_t capacity = 0;
         int safe_timeout_ms = 100;
-        mutable std::condition_variable_any safe_cond;
+        std::atomic<std::size_t> watcher_count = 0;
+        std::mutex watch_mtx;
+        std::vector<QueueWatcher*> watchers;
+        std::atomic<std::size_t> awaiter_count = 0;
+        std::mutex awaiter_mtx;
+        std::deque<AsyncWaiter*> awaiters;
     };
 
     template<typename T>
     void Queue::push(const std::shared_ptr<T>& msg) {
-        mtxsharedguard lock(mtx);
-        queue.push(msg);
-        cond.notify_one();
+        push(Envelope(std::shared_ptr<MessageData>(msg)));
+    }
+
+    template<typename T>
+    void Queue::push(std::shared_ptr<T> &&msg) {
+        push(Envelope(std::shared_ptr<MessageData>(std::move(msg))));
     }
 
     template<typename T>
-    void Queue::push(std::shared_ptr<T> &&msg) noexcept {
-        mtxsharedguard lock(mtx);
-        queue.push(msg);
-        cond.notify_one();
+    void Queue::pushValue(T&& value) {
+        push(Envelope::of(std::forward<T>(value)));
+    }
+
+    template<typename T>
+    void Queue::push(const std::shared_ptr<T>& msg, unsigned priority) {
+        push(Envelope(std::shared_ptr<MessageData>(msg)), priority);
+    }
+
+    template<typename T>
+    void Queue::pushValue(T&& value, unsigned priority) {
+        push(Envelope::of(std::forward<T>(value)), priority);
+    }
+
+    template<std::ranges::input_range R>
+    void Queue::pushBulk(R&& msgs) {
+        using Element = std::remove_cvref_t<std::ranges::range_reference_t<R>>;
+        std::vector<Envelope> batch;
+        if constexpr (std::ranges::sized_range<R>) {
+            batch.reserve(std::ranges::size(msgs));
+        }
+        for (auto&& msg : msgs) {
+            if constexpr (std::is_same_v<Element, Envelope>) {
+                if constexpr (std::is_rvalue_reference_v<R&&>) {
+                    batch.push_back(std::move(msg));
+                }
+                else {
+                    batch.push_back(msg);
+                }
+            }
+            else if constexpr (std::is_rvalue_reference_v<R&&>) {
+                batch.emplace_back(std::shared_ptr<MessageData>(std::move(msg)));
+            }
+            else {
+                batch.emplace_back(std::shared_ptr<MessageData>(msg));
+            }
+            stampSampled(batch.back());
+            if (Tracer::enabled()) [[unlikely]] {
+                tracePush(batch.back());
+            }
+        }
+        auto n = batch.size();
+        enqueueBulk(batch);
+        metrics->counters.add(QueueMetrics::Enqueued, n);
+        signalWatchers();
+    }
+
+    template<typename TryPop, typename Park>
+    bool Queue::waitWith(TryPop&& try_pop, Park&& park, int timeout_ms) {
+        auto strategy = wait_strategy.load(std::memory_order_relaxed);
+        if (strategy == WaitStrategy::Blocking) {
+            return park(timeout_ms);
+        }
+        auto start = std::chrono::steady_clock::now();
+        auto timeout = std::chrono::milliseconds(timeout_ms);
+        if (strategy == WaitStrategy::SpinPark) {
+            Backoff backoff(spin_limit.load(std::memory_order_relaxed), yield_limit.load(std::memory_order_relaxed));
+            do {
+                if (try_pop()) {
+                    return true;
+                }
+            } while (backoff.step());
+            if (timeout_ms == 0) {
+                return park(0);
+            }
+            auto left = std::chrono::duration_cast<std::chrono::milliseconds>(timeout - (std::chrono::steady_clock::now() - start));
+            return left.count() > 0 ? park(static_cast<int>(left.count())) : try_pop();
+        }
+        for (;;) {
+            if (try_pop()) {
+                return true;
+            }
+            if (timeout_ms != 0 && std::chrono::steady_clock::now() - start >= timeout) {
+                return false;
+            }
+            if (strategy == WaitStrategy::SpinYield) {
+                std::this_thread::yield();
+            }
+            else {
+                cpuRelax();
+            }
+        }
     }
 
     std::shared_ptr<Queue> makeQueue(const std::string& name);
 
+    /**
+     * construct a queue backed by the given engine
+     * @param name name of the queue
+     * @param engine storage engine
+     * @param capacity maximum number of messages, rounded up to a power of two by ring engines. 0 means unbounded
+     * for the mutex engine
+     * @param policy what push does when the queue is full
+     * @return queue shared ptr
+     * @exception QueueException Will throw if the engine does not support the policy
+     */
+    std::shared_ptr<Queue> makeQueue(const std::string& name, QueueEngine engine, std::size_t capacity = 1024,
+                                     OverflowPolicy policy = OverflowPolicy::Block);
+
     std::shared_ptr<Queue> makeQueue(std::string&& name);
 
     std::shared_ptr<Queue> makeQueue(const Queue& other);
@@ -0,0 +1,74 @@
+/**
+ * @file Rcu.h
+ * @author ayano
+ * @date 2/10/24
+ * @brief Epoch based reclamation for read-mostly data published through atomic pointers
+*/
+
+#ifndef KAWAIIMQ_RCU_H
+#define KAWAIIMQ_RCU_H
+
+#include <atomic>
+#include <cstdint>
+
+namespace KawaiiMQ {
+
+    /**
+     * Read-copy-update helper
+     * @remark readers enter a read section, load the atomic pointer and use the object without any lock or reference
+     * count. writers publish a new object, then retire the old one, which is deleted once every read section that
+     * could still see it has ended.
+     * @remark a read section costs two stores to a slot owned by the reading thread and one fence
+     */
+    class Rcu {
+    public:
+        /**
+         * RAII read section, sections may nest
+         */
+        class ReadGuard {
+        public:
+            ReadGuard();
+            ~ReadGuard();
+            ReadGuard(const ReadGuard&) = delete;
+            ReadGuard& operator=(const ReadGuard&) = delete;
+            ReadGuard(ReadGuard&& other) noexcept;
+            ReadGuard& operator=(ReadGuard&&) = delete;
+
+        private:
+            bool active = true;
+        };
+
+        /**
+         * Retire an object that is no longer reachable through its atomic pointer
+         * @tparam T object type
+         * @param ptr object to delete once no reader can see it
+         * @remark call after the new pointer is stored, also reclaims earlier retired objects that became safe
+         */
+        template<typename T>
+        static void retire(const T* ptr) {
+            if (ptr != nullptr) {
+                retire(const_cast<T*>(ptr), [](void* p) { delete static_cast<T*>(p); });
+            }
+        }
+
+        /**
+         * Delete every retired object no reader can see anymore
+         */
+        static void reclaim();
+
+        /**
+         * get the number of retired objects waiting for readers
+         * @return number of objects not deleted yet
+         */
+        static std::size_t pending();
+
+    private:
+        static void retire(void* ptr, void (*deleter)(void*));
+
+        static void enter();
+
+        static void leave() noexcept;
+    };
+}
+
+#endif //KAWAIIMQ_RCU_H
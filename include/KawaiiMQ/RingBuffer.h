@@ -0,0 +1,220 @@
+/**
+ * @file RingBuffer.h
+ * @author ayano
+ * @date 2/3/24
+ * @brief Lock-free bounded ring buffers used as queue storage
+*/
+
+#ifndef KAWAIIMQ_RINGBUFFER_H
+#define KAWAIIMQ_RINGBUFFER_H
+
+#include <atomic>
+#include <bit>
+#include <cstddef>
+#include <memory>
+#include <utility>
+
+namespace KawaiiMQ {
+
+    /**
+     * assumed cache line size, used to keep hot atomics on separate lines
+     */
+    inline constexpr std::size_t cacheLineSize = 64;
+
+    /**
+     * Bounded multi-producer multi-consumer ring buffer
+     * @tparam T element type, must be default constructible and movable
+     * @remark every cell carries a sequence number telling producers and consumers whether the cell is free or filled
+     * for the current lap, so no lock is ever taken. capacity is rounded up to a power of two.
+     */
+    template<typename T>
+    class MpmcRing {
+    public:
+        explicit MpmcRing(std::size_t capacity)
+                : mask(std::bit_ceil(capacity < 2 ? std::size_t(2) : capacity) - 1),
+                  cells(new Cell[mask + 1]) {
+            for (std::size_t i = 0; i <= mask; ++i) {
+                cells[i].sequence.store(i, std::memory_order_relaxed);
+            }
+        }
+
+        MpmcRing(const MpmcRing&) = delete;
+        MpmcRing& operator=(const MpmcRing&) = delete;
+
+        /**
+         * Try to push a value into the ring
+         * @param value value pushing in, only moved from when the push succeeds
+         * @return true if pushed, false if the ring is full
+         */
+        template<typename U>
+        bool tryPush(U&& value) {
+            std::size_t pos = enqueue_pos.load(std::memory_order_relaxed);
+            Cell* cell;
+            for (;;) {
+                cell = &cells[pos & mask];
+                std::size_t seq = cell->sequence.load(std::memory_order_acquire);
+                auto diff = static_cast<std::ptrdiff_t>(seq) - static_cast<std::ptrdiff_t>(pos);
+                if (diff == 0) {
+                    if (enqueue_pos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+                        break;
+                    }
+                }
+                else if (diff < 0) {
+                    return false;
+                }
+                else {
+                    pos = enqueue_pos.load(std::memory_order_relaxed);
+                }
+            }
+            cell->data = std::forward<U>(value);
+            cell->sequence.store(pos + 1, std::memory_order_release);
+            return true;
+        }
+
+        /**
+         * Try to pop a value from the ring
+         * @param value reference receiving the value
+         * @return true if popped, false if the ring is empty
+         */
+        bool tryPop(T& value) {
+            std::size_t pos = dequeue_pos.load(std::memory_order_relaxed);
+            Cell* cell;
+            for (;;) {
+                cell = &cells[pos & mask];
+                std::size_t seq = cell->sequence.load(std::memory_order_acquire);
+                auto diff = static_cast<std::ptrdiff_t>(seq) - static_cast<std::ptrdiff_t>(pos + 1);
+                if (diff == 0) {
+                    if (dequeue_pos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+                        break;
+                    }
+                }
+                else if (diff < 0) {
+                    return false;
+                }
+                else {
+                    pos = dequeue_pos.load(std::memory_order_relaxed);
+                }
+            }
+            value = std::move(cell->data);
+            cell->data = T();
+            cell->sequence.store(pos + mask + 1, std::memory_order_release);
+            return true;
+        }
+
+        /**
+         * Number of elements in the ring
+         * @return element count, only a snapshot when other threads are operating on the ring
+         */
+        [[nodiscard]] std::size_t sizeApprox() const noexcept {
+            std::size_t tail = dequeue_pos.load(std::memory_order_acquire);
+            std::size_t head = enqueue_pos.load(std::memory_order_acquire);
+            return head > tail ? head - tail : 0;
+        }
+
+        /**
+         * Capacity of the ring
+         * @return capacity, always a power of two
+         */
+        [[nodiscard]] std::size_t capacity() const noexcept {
+            return mask + 1;
+        }
+
+    private:
+        struct alignas(cacheLineSize) Cell {
+            std::atomic<std::size_t> sequence;
+            T data;
+        };
+
+        const std::size_t mask;
+        const std::unique_ptr<Cell[]> cells;
+        alignas(cacheLineSize) std::atomic<std::size_t> enqueue_pos{0};
+        alignas(cacheLineSize) std::atomic<std::size_t> dequeue_pos{0};
+    };
+
+    /**
+     * Bounded single-producer single-consumer ring buffer
+     * @tparam T element type, must be default constructible and movable
+     * @remark both ends are wait-free. each side keeps a cached copy of the other side's index and only reloads it
+     * when the cache says the ring is full or empty, so the shared indices rarely bounce between cores.
+     * @warning only one thread may push and only one thread may pop at a time
+     */
+    template<typename T>
+    class SpscRing {
+    public:
+        explicit SpscRing(std::size_t capacity)
+                : mask(std::bit_ceil(capacity < 2 ? std::size_t(2) : capacity) - 1),
+                  cells(new T[mask + 1]) {
+        }
+
+        SpscRing(const SpscRing&) = delete;
+        SpscRing& operator=(const SpscRing&) = delete;
+
+        /**
+         * Try to push a value into the ring, producer side only
+         * @param value value pushing in, only moved from when the push succeeds
+         * @return true if pushed, false if the ring is full
+         */
+        template<typename U>
+        bool tryPush(U&& value) {
+            std::size_t pos = tail.load(std::memory_order_relaxed);
+            if (pos - head_cache > mask) {
+                head_cache = head.load(std::memory_order_acquire);
+                if (pos - head_cache > mask) {
+                    return false;
+                }
+            }
+            cells[pos & mask] = std::forward<U>(value);
+            tail.store(pos + 1, std::memory_order_release);
+            return true;
+        }
+
+        /**
+         * Try to pop a value from the ring, consumer side only
+         * @param value reference receiving the value
+         * @return true if popped, false if the ring is empty
+         */
+        bool tryPop(T& value) {
+            std::size_t pos = head.load(std::memory_order_relaxed);
+            if (pos == tail_cache) {
+                tail_cache = tail.load(std::memory_order_acquire);
+                if (pos == tail_cache) {
+                    return false;
+                }
+            }
+            value = std::move(cells[pos & mask]);
+            cells[pos & mask] = T();
+            head.store(pos + 1, std::memory_order_release);
+            return true;
+        }
+
+        /**
+         * Number of elements in the ring
+         * @return element count, only a snapshot when other threads are operating on the ring
+         */
+        [[nodiscard]] std::size_t sizeApprox() const noexcept {
+            std::size_t h = head.load(std::memory_order_acquire);
+            std::size_t t = tail.load(std::memory_order_acquire);
+            return t > h ? t - h : 0;
+        }
+
+        /**
+         * Capacity of the ring
+         * @return capacity, always a power of two
+         */
+        [[nodiscard]] std::size_t capacity() const noexcept {
+            return mask + 1;
+        }
+
+    private:
+        const std::size_t mask;
+        const std::unique_ptr<T[]> cells;
+        // producer side
+        alignas(cacheLineSize) std::atomic<std::size_t> tail{0};
+        std::size_t head_cache = 0;
+        // consumer side
+        alignas(cacheLineSize) std::atomic<std::size_t> head{0};
+        std::size_t tail_cache = 0;
+    };
+}
+
+#endif //KAWAIIMQ_RINGBUFFER_H
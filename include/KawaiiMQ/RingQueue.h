@@ -0,0 +1,104 @@
+/**
+ * @file RingQueue.h
+ * @author ayano
+ * @date 2/3/24
+ * @brief Queue engines backed by lock-free bounded rings
+*/
+
+#ifndef KAWAIIMQ_RINGQUEUE_H
+#define KAWAIIMQ_RINGQUEUE_H
+
+#include "Queue.h"
+#include "RingBuffer.h"
+#include "Parker.h"
+
+namespace KawaiiMQ {
+
+    /**
+     * A message queue backed by a bounded lock-free ring
+     * @tparam Ring ring template providing tryPush, tryPop, sizeApprox and capacity
+     * @remark push and pop never take a lock. by default a consumer finding the ring empty spins for a short while
+     * and then parks, see setWaitStrategy(). producers only touch the parking lock when someone is parked.
+     * @remark when the ring is full, push follows the overflow policy. OverflowPolicy::Block yields until a consumer
+     * frees a slot or the push timeout expires
+     */
+    template<template<typename> class Ring>
+    class BasicRingQueue : public Queue {
+    public:
+        explicit BasicRingQueue(std::string name, std::size_t capacity = 1024);
+
+        BasicRingQueue(const BasicRingQueue& other) = delete;
+
+        BasicRingQueue& operator=(const BasicRingQueue& other) = delete;
+
+        /**
+         * Size of the queue
+         * @return size of the queue, a snapshot under concurrent access
+         */
+        std::size_t size() const noexcept override;
+
+        /**
+         * Check if queue is empty
+         * @return false if not empty, true if empty
+         */
+        [[nodiscard]] bool empty() const noexcept override;
+
+        /**
+         * Capacity of the ring
+         * @return capacity, always a power of two
+         */
+        std::size_t capacity() const noexcept;
+
+        /**
+         * Get the capacity of the queue
+         * @return capacity of the ring
+         */
+        std::size_t getCapacity() const noexcept override;
+
+    protected:
+        void enqueue(Envelope msg) override;
+
+        void enqueueBulk(std::vector<Envelope>& msgs) override;
+
+        bool dequeue(Envelope& msg, bool block, int timeout_ms) override;
+
+        std::size_t dequeueBulk(const Sink& sink, std::size_t max_n, bool block, int timeout_ms) override;
+
+    private:
+        /**
+         * handle a push finding the ring full according to the overflow policy
+         * @param msg message pushing in, moved from if it was stored
+         * @return false if the message was discarded
+         */
+        bool overflow(Envelope& msg);
+
+        /**
+         * pop a message, waiting according to the wait strategy when the ring is empty
+         * @param msg reference receiving the message
+         * @param timeout_ms timeout in milliseconds, 0 means no timeout
+         * @return false if timed out
+         */
+        bool popBlocking(Envelope& msg, int timeout_ms);
+
+        /**
+         * called after a successful pop, wakes up unrelate() when the queue drained
+         */
+        void popped();
+
+        Ring<Envelope> ring;
+        Parker parker;
+    };
+
+    extern template class BasicRingQueue<MpmcRing>;
+    extern template class BasicRingQueue<SpscRing>;
+
+    /**
+     * A message queue backed by a bounded lock-free multi-producer multi-consumer ring
+     */
+    class RingQueue : public BasicRingQueue<MpmcRing> {
+    public:
+        using BasicRingQueue::BasicRingQueue;
+    };
+}
+
+#endif //KAWAIIMQ_RINGQUEUE_H
@@ -0,0 +1,120 @@
+/**
+ * @file Scheduler.h
+ * @author ayano
+ * @date 2/22/24
+ * @brief Pushes messages into queues once they are due
+*/
+
+#ifndef KAWAIIMQ_SCHEDULER_H
+#define KAWAIIMQ_SCHEDULER_H
+
+#include <chrono>
+#include <memory>
+#include <mutex>
+#include <vector>
+#include "Envelope.h"
+#include "Queue.h"
+#include "TimerWheel.h"
+
+namespace KawaiiMQ {
+
+    /**
+     * a singleton holding messages back until their due time, then pushing them into their queue
+     * @remark every pending message is one timer on the shared TimerWheel and one slot in a pool, scheduling and
+     * cancelling are O(1) and no thread is spent on a waiting message
+     * @remark a message is invisible to the queue until it is due, wait and drain never see it early. messages due
+     * at the same tick are pushed in the order they were scheduled
+     * @remark queues are held weakly, a message whose queue is gone when it is due is dropped. the push runs on the
+     * timer thread and never waits there: a full queue with the Block policy is tried again every tick until it has
+     * room, meanwhile the message still counts as pending. under the other policies a full queue drops the message
+     * or refuses it
+     */
+    class Scheduler : public TimerTarget, public std::enable_shared_from_this<Scheduler> {
+    public:
+        using Clock = TimerWheel::Clock;
+
+        /**
+         * identifies a pending message, 0 never identifies one
+         */
+        using TaskId = std::uint64_t;
+
+        /**
+         * get instance of this class
+         * @return instance of this class
+         */
+        static std::shared_ptr<Scheduler> Instance();
+
+        Scheduler(const Scheduler&) = delete;
+
+        Scheduler& operator=(const Scheduler&) = delete;
+
+        /**
+         * push a message into a queue at a point in time
+         * @param queue queue the message goes into
+         * @param msg message
+         * @param when due time, a time already passed pushes the message on the next tick
+         * @return id of the pending message
+         */
+        TaskId pushAt(const std::shared_ptr<Queue>& queue, Envelope msg, Clock::time_point when);
+
+        /**
+         * push a message into a queue after a delay
+         * @param queue queue the message goes into
+         * @param msg message
+         * @param delay delay from now
+         * @return id of the pending message
+         */
+        TaskId pushAfter(const std::shared_ptr<Queue>& queue, Envelope msg, Clock::duration delay);
+
+        /**
+         * drop a pending message
+         * @param id id of the pending message
+         * @return false if the message was already pushed or cancelled, or is being pushed right now
+         */
+        bool cancel(TaskId id);
+
+        /**
+         * get the number of pending messages
+         * @return number of messages not due yet
+         */
+        std::size_t size() const;
+
+    private:
+        /**
+         * a pending message, its slot goes back to the pool once it is pushed or cancelled
+         */
+        struct Task {
+            std::weak_ptr<Queue> queue;
+            Envelope msg;
+            TimerWheel::TimerId timer = 0;
+            // bumped when the slot is freed, so a stale id never touches the next message in it
+            std::uint32_t generation = 1;
+            bool pending = false;
+            // the timer thread is pushing the message, it cannot be cancelled anymore
+            bool firing = false;
+        };
+
+        Scheduler() = default;
+
+        void onTimer(std::uint64_t cookie) noexcept override;
+
+        /**
+         * find the slot of a pending message, must hold mtx
+         * @return nullptr if the message is not pending
+         */
+        Task* find(TaskId id) noexcept;
+
+        /**
+         * put a slot back into the pool, must hold mtx
+         */
+        void release(std::uint32_t index) noexcept;
+
+        std::shared_ptr<TimerWheel> wheel = TimerWheel::Instance();
+        mutable std::mutex mtx;
+        std::vector<Task> tasks;
+        std::vector<std::uint32_t> free_tasks;
+        std::size_t pending = 0;
+    };
+}
+
+#endif //KAWAIIMQ_SCHEDULER_H
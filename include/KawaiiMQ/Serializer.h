@@ -0,0 +1,192 @@
+/**
+ * @file Serializer.h
+ * @author ayano
+ * @date 2/17/24
+ * @brief Pluggable conversion of message payloads to bytes, used by durable queues
+*/
+
+#ifndef KAWAIIMQ_SERIALIZER_H
+#define KAWAIIMQ_SERIALIZER_H
+
+#include <array>
+#include <bit>
+#include <memory>
+#include <shared_mutex>
+#include <string>
+#include <string_view>
+#include <type_traits>
+#include <unordered_map>
+#include "Envelope.h"
+#include "Exceptions.h"
+
+namespace KawaiiMQ {
+
+    /**
+     * Converts a payload type to bytes and back
+     * @tparam T payload type
+     * @remark the primary template copies the object representation, so it only works for trivially copyable types.
+     * specialize it for anything else, a specialization needs the same two static functions
+     */
+    template<typename T>
+    struct Serializer {
+        static_assert(std::is_trivially_copyable_v<T>, "specialize KawaiiMQ::Serializer for this payload type");
+
+        /**
+         * append the bytes of a value
+         * @param value value to serialize
+         * @param out buffer to append to
+         */
+        static void serialize(const T& value, std::string& out) {
+            out.append(reinterpret_cast<const char*>(&value), sizeof(T));
+        }
+
+        /**
+         * rebuild a value from its bytes
+         * @param in bytes written by serialize()
+         * @return value
+         * @exception TypeException Will throw if the size does not match
+         */
+        static T deserialize(std::string_view in) {
+            if (in.size() != sizeof(T)) {
+                throw TypeException("cannot deserialize " + std::string(typeid(T).name()) + ", size mismatch");
+            }
+            std::array<char, sizeof(T)> bytes;
+            in.copy(bytes.data(), sizeof(T));
+            return std::bit_cast<T>(bytes);
+        }
+    };
+
+    template<>
+    struct Serializer<std::string> {
+        static void serialize(const std::string& value, std::string& out) {
+            out.append(value);
+        }
+
+        static std::string deserialize(std::string_view in) {
+            return std::string(in);
+        }
+    };
+
+    template<>
+    struct Serializer<Bytes> {
+        static void serialize(const Bytes& value, std::string& out) {
+            out.append(value.view());
+        }
+
+        static Bytes deserialize(std::string_view in) {
+            return Bytes::copyOf(in);
+        }
+    };
+
+    /**
+     * stable id of the name a payload type is registered under, durable queues write it to disk
+     * @param name name of the payload type
+     * @return 64 bit FNV-1a hash of the name
+     * @remark unlike typeTag(), it is the same in every process, so logs stay readable after a restart
+     */
+    constexpr std::uint64_t serializerId(std::string_view name) noexcept {
+        std::uint64_t hash = 14695981039346656037ull;
+        for (char c : name) {
+            hash = (hash ^ static_cast<unsigned char>(c)) * 1099511628211ull;
+        }
+        return hash;
+    }
+
+    /**
+     * a singleton mapping payload types to serializers, and the names they are registered under to payload types
+     * @remark bool, the arithmetic types, std::string and Bytes are registered up front, under their name as spelled
+     * in C++: "int", "unsigned long long", "std::string", "KawaiiMQ::Bytes" and so on
+     */
+    class SerializerRegistry {
+    public:
+        SerializerRegistry &operator=(const SerializerRegistry &other) = delete;
+        SerializerRegistry(const SerializerRegistry &other) = delete;
+        SerializerRegistry(SerializerRegistry &&other) = delete;
+
+        /**
+         * get the instance
+         * @return instance of this class
+         */
+        static std::shared_ptr<SerializerRegistry> Instance();
+
+        /**
+         * register Serializer<T> for messages of type T
+         * @param name name of the payload type, must not change as long as logs written with it are kept
+         * @tparam T payload type
+         * @exception TypeException Will throw if the name is taken by another type, or T has another name
+         * @remark registering a type twice under the same name is a no-op
+         */
+        template<typename T>
+        void add(std::string_view name) {
+            Entry entry{
+                serializerId(name),
+                [](const Envelope& msg, std::string& out) { Serializer<T>::serialize(getMessage<T>(msg), out); },
+                [](std::string_view in) { return Envelope::of(Serializer<T>::deserialize(in)); }
+            };
+            std::lock_guard lock(mtx);
+            auto id = by_id.find(entry.id);
+            if (id != by_id.end() && id->second != typeTag<T>()) {
+                throw TypeException("serializer name " + std::string(name) + " is taken by another type");
+            }
+            auto [it, added] = entries.try_emplace(typeTag<T>(), entry);
+            if (!added && it->second.id != entry.id) {
+                throw TypeException("payload type is already registered under another name than " + std::string(name));
+            }
+            by_id.try_emplace(entry.id, typeTag<T>());
+        }
+
+        /**
+         * check whether a name has a serializer
+         * @param id id of the name, see serializerId()
+         * @return true if registered
+         */
+        bool contains(std::uint64_t id) const;
+
+        /**
+         * append the bytes of a message
+         * @param msg message to serialize
+         * @param out buffer to append to
+         * @return id of the name of the payload type, needed to deserialize it
+         * @exception TypeException Will throw if the payload type is not registered
+         */
+        std::uint64_t serialize(const Envelope& msg, std::string& out) const;
+
+        /**
+         * rebuild a message from its bytes
+         * @param id id returned by serialize()
+         * @param in bytes written by serialize()
+         * @return message
+         * @exception TypeException Will throw if no payload type is registered under that id
+         */
+        Envelope deserialize(std::uint64_t id, std::string_view in) const;
+
+    private:
+        struct Entry {
+            std::uint64_t id;
+            void (*serialize)(const Envelope&, std::string&);
+            Envelope (*deserialize)(std::string_view);
+        };
+
+        SerializerRegistry();
+
+        mutable std::shared_mutex mtx;
+        // by type tag, which only identifies a type within one build
+        std::unordered_map<std::uint64_t, Entry> entries;
+        // type tag of every registered name
+        std::unordered_map<std::uint64_t, std::uint64_t> by_id;
+    };
+
+    /**
+     * register Serializer<T> so messages of type T can be pushed into durable queues
+     * @param name name of the payload type, stored with every logged message instead of the per process
+     * typeTag(). must not change as long as logs written with it are kept
+     * @tparam T payload type
+     * @exception TypeException Will throw if the name is taken by another type, or T has another name
+     */
+    template<typename T>
+    void registerSerializer(std::string_view name) {
+        SerializerRegistry::Instance()->add<T>(name);
+    }
+}
+
+#endif //KAWAIIMQ_SERIALIZER_H
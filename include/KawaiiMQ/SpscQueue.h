@@ -0,0 +1,39 @@
+/**
+ * @file SpscQueue.h
+ * @author ayano
+ * @date 2/4/24
+ * @brief A queue engine for topics with exactly one producer and one consumer
+*/
+
+#ifndef KAWAIIMQ_SPSCQUEUE_H
+#define KAWAIIMQ_SPSCQUEUE_H
+
+#include "RingQueue.h"
+
+namespace KawaiiMQ {
+
+    /**
+     * A message queue backed by a wait-free single-producer single-consumer ring
+     * @remark relate it to a topic like any other queue. the producer only touches the parking lock when the consumer
+     * is parked.
+     * @warning at most one thread may push and at most one thread may wait/tryWait/drain at a time
+     */
+    class SpscQueue : public BasicRingQueue<SpscRing> {
+    public:
+        using BasicRingQueue::BasicRingQueue;
+
+        /**
+         * Set what push does when the queue is full
+         * @param policy overflow policy
+         * @exception QueueException Will throw for OverflowPolicy::DropOldest, the producer cannot pop from the ring
+         */
+        void setOverflowPolicy(OverflowPolicy policy) override {
+            if (policy == OverflowPolicy::DropOldest) {
+                throw QueueException("spsc queue does not support dropping the oldest message");
+            }
+            BasicRingQueue::setOverflowPolicy(policy);
+        }
+    };
+}
+
+#endif //KAWAIIMQ_SPSCQUEUE_H
@@ -0,0 +1,190 @@
+/**
+ * @file TimerWheel.h
+ * @author ayano
+ * @date 2/21/24
+ * @brief A hierarchical timing wheel driven by one timer thread
+*/
+
+#ifndef KAWAIIMQ_TIMERWHEEL_H
+#define KAWAIIMQ_TIMERWHEEL_H
+
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace KawaiiMQ {
+
+    /**
+     * Gets told when a timer scheduled on a TimerWheel is due
+     */
+    class TimerTarget {
+    public:
+        virtual ~TimerTarget() = default;
+
+        /**
+         * called on the timer thread once a timer is due. must not block for long, every other timer waits for it
+         * @param cookie value the timer was scheduled with
+         */
+        virtual void onTimer(std::uint64_t cookie) noexcept = 0;
+    };
+
+    /**
+     * A hierarchical timing wheel: four levels of 256 slots, each slot of a level spanning a whole turn of the level
+     * below. a timer goes into the lowest level its deadline fits in, and moves one level down whenever the level
+     * below finishes a turn, so scheduling is O(1) and a timer is touched at most once per level before it fires
+     * @remark a timer fires on the first tick at or after its deadline, never before it, and timers of the same tick
+     * fire in the order they were scheduled. deadlines beyond the top level, 2^32 ticks away, are parked in its
+     * last slot until they come into range
+     * @remark timers live in a pool of nodes linked into their slot, so cancelling one is O(1) and frees it right
+     * away. targets are held weakly, a target going away simply drops its timers
+     * @remark the timer thread sleeps until the next slot holding a timer, waking at least once per turn of the
+     * lowest level while any timer is pending
+     */
+    class TimerWheel {
+    public:
+        using Clock = std::chrono::steady_clock;
+
+        /**
+         * identifies a scheduled timer, 0 never identifies one
+         */
+        using TimerId = std::uint64_t;
+
+        /**
+         * get the wheel shared by all queues
+         * @return instance of this class
+         */
+        static std::shared_ptr<TimerWheel> Instance();
+
+        /**
+         * start a wheel and its timer thread
+         * @param tick resolution of the wheel
+         */
+        explicit TimerWheel(std::chrono::milliseconds tick = std::chrono::milliseconds(1));
+
+        TimerWheel(const TimerWheel&) = delete;
+
+        TimerWheel& operator=(const TimerWheel&) = delete;
+
+        /**
+         * stop the timer thread, pending timers never fire
+         */
+        ~TimerWheel();
+
+        /**
+         * schedule a timer
+         * @param when deadline of the timer
+         * @param target told when the timer is due, unless it is gone by then
+         * @param cookie handed to the target
+         * @return id of the timer
+         */
+        TimerId schedule(Clock::time_point when, std::weak_ptr<TimerTarget> target, std::uint64_t cookie);
+
+        /**
+         * cancel a timer
+         * @param id id of the timer
+         * @return false if the timer already fired or was cancelled
+         * @remark a timer taken off the wheel just before may still be about to fire
+         */
+        bool cancel(TimerId id);
+
+        /**
+         * get the number of timers that did not fire yet
+         * @return number of timers
+         */
+        std::size_t size() const;
+
+        /**
+         * get the resolution of the wheel
+         * @return tick length
+         */
+        std::chrono::milliseconds getTick() const noexcept;
+
+    private:
+        static constexpr std::uint32_t none = 0xffffffff;
+        static constexpr unsigned levelBits = 8;
+        static constexpr std::size_t levelSize = std::size_t(1) << levelBits;
+        static constexpr std::size_t levelCount = 4;
+
+        /**
+         * a timer, linked into the list of its slot while scheduled
+         */
+        struct Node {
+            std::uint64_t tick = 0;
+            std::weak_ptr<TimerTarget> target;
+            std::uint64_t cookie = 0;
+            std::uint32_t prev = none;
+            std::uint32_t next = none;
+            // bumped when the node is freed, so a stale id never cancels its next timer
+            std::uint32_t generation = 1;
+            std::uint32_t slot = none;
+        };
+
+        struct Due {
+            std::weak_ptr<TimerTarget> target;
+            std::uint64_t cookie;
+        };
+
+        /**
+         * link a node into the slot its tick falls in, seen from a tick about to be processed. must hold mtx
+         * @param index node
+         * @param base tick about to be processed
+         */
+        void place(std::uint32_t index, std::uint64_t base);
+
+        /**
+         * take a node off its slot, must hold mtx
+         */
+        void unlink(std::uint32_t index);
+
+        /**
+         * unlink a node and put it back into the pool, must hold mtx
+         */
+        void release(std::uint32_t index);
+
+        /**
+         * process one tick: move the timers of the upper levels down if a level finished a turn, then take the
+         * timers due. must hold mtx
+         * @param tick tick to process, the one after current
+         * @param due receives the timers due
+         */
+        void advance(std::uint64_t tick, std::vector<Due>& due);
+
+        /**
+         * get the next tick the thread has to wake up at: a non-empty slot of the lowest level, or the end of its
+         * turn. must hold mtx
+         */
+        std::uint64_t nextWake() const noexcept;
+
+        /**
+         * get the number of ticks from the start of the wheel to a point in time
+         * @param when point in time
+         * @param round_up round a partial tick up instead of down
+         */
+        std::uint64_t tickOf(Clock::time_point when, bool round_up) const noexcept;
+
+        void timerLoop();
+
+        std::chrono::milliseconds tick;
+        Clock::time_point start;
+        // first and last node of every slot, level after level
+        std::vector<std::uint32_t> heads;
+        std::vector<std::uint32_t> tails;
+        std::vector<Node> nodes;
+        std::vector<std::uint32_t> free_nodes;
+        mutable std::mutex mtx;
+        std::condition_variable cond;
+        // the last tick processed, every timer due at or before it has fired
+        std::uint64_t current = 0;
+        std::size_t pending = 0;
+        // the tick the thread sleeps until, a timer due earlier has to wake it up
+        std::uint64_t wake_tick = 0;
+        bool stopping = false;
+        std::thread thread;
+    };
+}
+
+#endif //KAWAIIMQ_TIMERWHEEL_H
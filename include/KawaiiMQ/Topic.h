@@ -10,30 +10,131 @@
 #define KAWAIIMQ_TOPIC_H
 
 #include <string>
+#include <string_view>
 #include <vector>
+#include <deque>
+#include <memory>
+#include <cstdint>
+#include <shared_mutex>
+#include <unordered_map>
 #include "Queue.h"
 
 namespace KawaiiMQ{
 
+    /**
+     * a singleton interning topic names to dense integer ids
+     * @remark ids start at 0 and are never reused, so they can index routing tables directly
+     */
+    class TopicRegistry {
+    public:
+        TopicRegistry &operator=(const TopicRegistry &other) = delete;
+        TopicRegistry(const TopicRegistry &other) = delete;
+        TopicRegistry(TopicRegistry &&other) = delete;
+
+        /**
+         * get the instance
+         * @return instance of this class
+         */
+        static std::shared_ptr<TopicRegistry> Instance();
+
+        /**
+         * intern a topic name
+         * @param name topic name
+         * @return id of the name, the same name always gets the same id
+         */
+        std::uint32_t intern(std::string_view name);
+
+        /**
+         * get the interned name of an id
+         * @param id topic id
+         * @return interned name, stays valid for the lifetime of the program
+         * @exception TopicException Will throw if the id was never handed out
+         */
+        const std::string& name(std::uint32_t id) const;
+
+        /**
+         * get the number of interned names
+         * @return number of interned names, also the smallest id not handed out yet
+         */
+        std::size_t size() const;
+
+    private:
+        TopicRegistry() = default;
+        mutable std::shared_mutex mtx;
+        // deque never moves its elements, so the views in ids stay valid
+        std::deque<std::string> names;
+        std::unordered_map<std::string_view, std::uint32_t> ids;
+    };
+
     class Topic {
     public:
         explicit Topic(std::string name);
         Topic(const Topic& other);
         Topic(Topic&& other) noexcept;
         Topic& operator=(const Topic& other);
+
+        /**
+         * get the topic of an interned id
+         * @param id topic id
+         * @return topic
+         * @exception TopicException Will throw if the id was never handed out
+         */
+        static Topic fromId(std::uint32_t id);
+
         /**
          * get topic name
          * @return topic name
          */
-        [[nodiscard]] std::string getName() const;
-        bool operator==(const Topic& other) const;
+        [[nodiscard]] const std::string& getName() const noexcept;
+
+        /**
+         * get the interned id of the topic
+         * @return dense id of the topic
+         */
+        [[nodiscard]] std::uint32_t getId() const noexcept;
+
+        bool operator==(const Topic& other) const noexcept;
+    private:
+        Topic(std::uint32_t id, const std::string* name) noexcept;
+        std::uint32_t id;
+        const std::string* name;
+    };
+
+    /**
+     * set of topics backed by a bitmap indexed by topic id
+     */
+    class TopicSet {
+    public:
+        /**
+         * check if a topic is in the set
+         * @param topic given topic
+         * @return true if in the set
+         */
+        [[nodiscard]] bool contains(const Topic& topic) const noexcept {
+            return topic.getId() < bits.size() && bits[topic.getId()];
+        }
+
+        /**
+         * add a topic to the set
+         * @param topic given topic
+         * @return false if the topic was already in the set
+         */
+        bool insert(const Topic& topic);
+
+        /**
+         * remove a topic from the set
+         * @param topic given topic
+         * @return false if the topic was not in the set
+         */
+        bool erase(const Topic& topic);
+
     private:
-        std::string name;
+        std::vector<bool> bits;
     };
 }
 template<>
 struct std::hash<KawaiiMQ::Topic>{
-    std::size_t operator()(const KawaiiMQ::Topic& topic) const;
+    std::size_t operator()(const KawaiiMQ::Topic& topic) const noexcept;
 };
 
 
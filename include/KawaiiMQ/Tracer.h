@@ -0,0 +1,139 @@
+/**
+ * @file Tracer.h
+ * @author ayano
+ * @date 2/24/24
+ * @brief Sampled tracing of messages through producers, queues and consumers, dumped as Chrome trace JSON
+*/
+
+#ifndef KAWAIIMQ_TRACER_H
+#define KAWAIIMQ_TRACER_H
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <ostream>
+#include <string>
+#include <string_view>
+
+namespace KawaiiMQ {
+
+    /**
+     * where a traced message was seen
+     */
+    enum class TracePoint : std::uint8_t {
+        /// handed to Producer::publishMessage or one of its siblings
+        Publish,
+        /// pushed into a queue
+        Enqueue,
+        /// popped by wait, tryWait or drain
+        Dequeue,
+        /// content read with getMessage
+        Read
+    };
+
+    /**
+     * a singleton recording where sampled messages go, and when
+     * @remark tracing is off by default. once setSampleEvery() turns it on, every thread starts a trace on one
+     * message in every sampling period, the first time it publishes or pushes it. the trace id is kept in the
+     * MessageData, so the queues and consumers the message goes through record it too. payloads stored inline in
+     * an envelope have no MessageData and are never traced
+     * @remark every thread records into a ring buffer of its own without locking, the oldest events of a thread
+     * are overwritten once its buffer is full. with tracing off, a push or a pop only pays for one relaxed load
+     * @remark timestamps are steady clock nanoseconds
+     */
+    class Tracer {
+    public:
+        /// events kept per thread
+        static constexpr std::size_t bufferSize = 8192;
+
+        /// bytes of a queue or producer name kept with an event
+        static constexpr std::size_t nameSize = 16;
+
+        /**
+         * get instance of this class
+         * @return instance of this class
+         */
+        static std::shared_ptr<Tracer> Instance();
+
+        /**
+         * set how many messages a thread publishes or pushes per message it traces
+         * @param every sampling period, 1 traces every message and 0 turns tracing off
+         */
+        void setSampleEvery(std::uint32_t every) noexcept;
+
+        /**
+         * get how many messages a thread publishes or pushes per message it traces
+         * @return sampling period, 0 if tracing is off
+         */
+        std::uint32_t getSampleEvery() const noexcept;
+
+        /**
+         * check whether tracing is on, lets callers skip looking at the message at all
+         * @return true if tracing is on
+         */
+        static bool enabled() noexcept {
+            return sample_every.load(std::memory_order_relaxed) != 0;
+        }
+
+        /**
+         * check whether the calling thread starts a trace on the message it is about to publish or push
+         * @return true once every sampling period
+         */
+        static bool sample() noexcept {
+            if (countdown != 0) [[likely]] {
+                --countdown;
+                return false;
+            }
+            auto every = sample_every.load(std::memory_order_relaxed);
+            if (every == 0) {
+                return false;
+            }
+            countdown = every - 1;
+            return true;
+        }
+
+        /**
+         * get an id for a new trace
+         * @return id, never 0
+         */
+        static std::uint64_t newTraceId() noexcept {
+            return next_id.fetch_add(1, std::memory_order_relaxed);
+        }
+
+        /**
+         * record an event into the buffer of the calling thread
+         * @param point where the message was seen
+         * @param trace trace id of the message
+         * @param where name of the queue or producer, cut to nameSize bytes
+         */
+        static void record(TracePoint point, std::uint64_t trace, std::string_view where = {}) noexcept;
+
+        /**
+         * write the recorded events as Chrome trace JSON, for chrome://tracing or Perfetto
+         * @param out stream the JSON is written to
+         * @remark every trace is an async slice named message, from its first event to its last, with an instant
+         * for every event on the thread that recorded it. events recorded while writing may be left out
+         */
+        void writeChromeTrace(std::ostream& out) const;
+
+        /**
+         * get the recorded events as Chrome trace JSON
+         * @return JSON, see writeChromeTrace()
+         */
+        std::string chromeTrace() const;
+
+        /**
+         * forget the events recorded so far, and the buffers of threads that exited
+         */
+        void clear();
+
+    private:
+        Tracer() = default;
+
+        static inline std::atomic<std::uint32_t> sample_every = 0;
+        static inline std::atomic<std::uint64_t> next_id = 1;
+        static inline thread_local std::uint32_t countdown = 0;
+    };
+}
+
+#endif //KAWAIIMQ_TRACER_H
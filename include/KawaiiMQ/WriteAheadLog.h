@@ -0,0 +1,219 @@
+/**
+ * @file WriteAheadLog.h
+ * @author ayano
+ * @date 2/17/24
+ * @brief Segmented append-only log with group commit, backing durable queues
+*/
+
+#ifndef KAWAIIMQ_WRITEAHEADLOG_H
+#define KAWAIIMQ_WRITEAHEADLOG_H
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <filesystem>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+namespace KawaiiMQ {
+
+    /**
+     * when a write ahead log forces its data to disk
+     * @remark both limits can be combined, whichever is reached first triggers the fsync
+     */
+    struct FsyncPolicy {
+        /// fsync once this many records were appended since the last one, 0 disables the limit
+        std::size_t every_messages = 1;
+        /// fsync at this interval from a background thread, 0 disables the timer
+        std::chrono::milliseconds every_ms{0};
+
+        /**
+         * fsync after every n records, n = 1 means every append returns only once its record is on disk
+         * @param n number of records
+         */
+        static FsyncPolicy everyMessages(std::size_t n) {
+            return {n, std::chrono::milliseconds(0)};
+        }
+
+        /**
+         * fsync at a fixed interval, a crash loses at most that much
+         * @param ms interval
+         */
+        static FsyncPolicy everyMillis(std::chrono::milliseconds ms) {
+            return {0, ms};
+        }
+
+        /**
+         * leave flushing to the operating system, a crash of the machine may lose anything not written back yet
+         */
+        static FsyncPolicy never() {
+            return {0, std::chrono::milliseconds(0)};
+        }
+    };
+
+    /**
+     * An append-only log split into segment files
+     * @remark records are buffered in memory and written by whichever appender has to fsync first, every other
+     * record buffered meanwhile goes to disk with the same write and fsync (group commit)
+     * @remark the log also stores a consumed watermark. segments holding only consumed records are deleted, the
+     * records still past the watermark are handed back when the log is opened again
+     * @remark records are checksummed, a torn or corrupt record and everything after it is dropped on open
+     * @remark the file format uses the byte order of the host
+     */
+    class WriteAheadLog {
+    public:
+        /**
+         * a record found when opening the log
+         */
+        struct Record {
+            std::uint64_t seq;
+            // id of the payload type, see serializerId()
+            std::uint64_t type_id;
+            std::string payload;
+        };
+
+        /**
+         * open or create a log
+         * @param directory directory holding the segment files, created if missing
+         * @param segment_size a segment is closed and a new one started once it grows past this many bytes
+         * @param policy when to fsync
+         * @exception QueueException Will throw if the directory or a segment cannot be opened
+         */
+        WriteAheadLog(std::filesystem::path directory, std::size_t segment_size, FsyncPolicy policy);
+
+        WriteAheadLog(const WriteAheadLog&) = delete;
+
+        WriteAheadLog& operator=(const WriteAheadLog&) = delete;
+
+        /**
+         * write and fsync whatever is still buffered
+         */
+        ~WriteAheadLog();
+
+        /**
+         * take the unconsumed records found when the log was opened
+         * @return records in append order, empty on the second call
+         */
+        std::vector<Record> takeRecovered();
+
+        /**
+         * buffer a record, call commit() afterwards
+         * @param type_id id of the payload type, see serializerId()
+         * @param payload serialized payload
+         * @return sequence number of the record, numbers are consecutive
+         * @remark only copies the record into memory, so callers can order appends under their own lock
+         */
+        std::uint64_t append(std::uint64_t type_id, std::string_view payload);
+
+        /**
+         * write and fsync a buffered record if the fsync policy says so
+         * @param seq sequence number returned by append()
+         * @exception QueueException Will throw if writing to disk fails
+         * @remark call it without holding a lock that other appenders need, or they cannot join the group commit
+         */
+        void commit(std::uint64_t seq);
+
+        /**
+         * mark the next records as consumed, the watermark is persisted with the next write
+         * @param n number of records
+         */
+        void consume(std::uint64_t n) noexcept;
+
+        /**
+         * get the consumed watermark
+         * @return every record below this sequence number is consumed
+         */
+        std::uint64_t getConsumed() const noexcept;
+
+        /**
+         * write and fsync every buffered record and the consumed watermark
+         * @exception QueueException Will throw if writing to disk fails
+         */
+        void sync();
+
+        /**
+         * get the number of segment files
+         * @return number of segments
+         */
+        std::size_t getSegmentCount() const;
+
+        /**
+         * get the number of fsync calls so far
+         * @return number of fsync calls
+         */
+        std::uint64_t getSyncCount() const noexcept;
+
+    private:
+        struct Segment {
+            std::filesystem::path path;
+            // sequence number of the first record, the segment ends where the next one starts
+            std::uint64_t first;
+        };
+
+        /**
+         * read the existing segments, truncating a damaged one
+         */
+        void recover();
+
+        /**
+         * write the buffered records, and fsync if asked to
+         * @param sync whether to fsync
+         * @param upto return right away if every record below this sequence number is already written, or synced
+         * when sync is set. the maximum value always flushes, including a changed watermark
+         */
+        void flush(bool sync, std::uint64_t upto);
+
+        /**
+         * start a new segment with the current watermark, must hold io_mtx
+         * @param first sequence number of the first record
+         */
+        void openSegment(std::uint64_t first);
+
+        /**
+         * delete the segments whose records are all consumed, must hold io_mtx
+         */
+        void removeConsumed();
+
+        void writeAll(std::string_view bytes);
+
+        void syncFile();
+
+        void timerLoop();
+
+        std::filesystem::path directory;
+        std::size_t segment_size;
+        FsyncPolicy policy;
+        std::vector<Record> recovered;
+
+        // guards the buffer and the sequence numbers, held only to copy a record in
+        std::mutex mtx;
+        std::string buffer;
+        std::uint64_t next_seq = 0;
+        std::size_t unsynced = 0;
+
+        // held by the one thread writing to disk
+        mutable std::mutex io_mtx;
+        std::string spare;
+        std::vector<Segment> segments;
+        int fd = -1;
+        std::size_t segment_bytes = 0;
+        bool dirty = false;
+        std::uint64_t written_seq = 0;
+        std::uint64_t synced_seq = 0;
+        std::uint64_t written_checkpoint = 0;
+
+        std::atomic<std::uint64_t> consumed = 0;
+        std::atomic<std::uint64_t> syncs = 0;
+
+        std::mutex timer_mtx;
+        std::condition_variable timer_cond;
+        bool stopping = false;
+        std::thread timer;
+    };
+}
+
+#endif //KAWAIIMQ_WRITEAHEADLOG_H
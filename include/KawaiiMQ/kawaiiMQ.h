@@ -8,10 +8,27 @@
 #ifndef KAWAIIMQ_KAWAIIMQ_H
 #define KAWAIIMQ_KAWAIIMQ_H
 #include "Message.h"
+#include "AckQueue.h"
+#include "Envelope.h"
+#include "AsyncWaiter.h"
 #include "Consumer.h"
+#include "ConsumerGroup.h"
+#include "Dispatcher.h"
+#include "LogQueue.h"
+#include "DurableQueue.h"
+#include "PriorityQueue.h"
 #include "Producer.h"
+#include "MappedQueue.h"
 #include "MessageQueueManager.h"
+#include "Metrics.h"
 #include "Queue.h"
+#include "RingQueue.h"
+#include "Scheduler.h"
+#include "Serializer.h"
+#include "SpscQueue.h"
+#include "TimerWheel.h"
 #include "Topic.h"
+#include "Tracer.h"
+#include "WriteAheadLog.h"
 
 #endif // KAWAIIMQ_KAWAIIMQ_H
@@ -0,0 +1,331 @@
+/**
+ * @file AckQueue.cpp
+ * @author ayano
+ * @date 2/21/24
+ * @brief
+*/
+
+#include "AckQueue.h"
+#include "Scheduler.h"
+#include <unordered_map>
+
+namespace KawaiiMQ {
+
+    /**
+     * ready and leased messages of a queue, shared with the timer wheel so lease timers can outlive the queue
+     */
+    struct AckStore : TimerTarget, std::enable_shared_from_this<AckStore> {
+        struct Ready {
+            Envelope msg;
+            std::uint32_t deliveries;
+        };
+
+        struct Lease {
+            Envelope msg;
+            std::uint32_t deliveries;
+            TimerWheel::Clock::time_point deadline;
+            TimerWheel::TimerId timer;
+        };
+
+        explicit AckStore(AckOptions options) : options(std::move(options)) {}
+
+        /**
+         * lease the next ready message, must hold mtx
+         */
+        bool leaseLocked(Delivery& out) {
+            if (ready.empty()) {
+                return false;
+            }
+            auto& next = ready.front();
+            auto id = next_lease++;
+            auto deadline = TimerWheel::Clock::now() + options.visibility_timeout;
+            out.lease = id;
+            out.attempt = next.deliveries + 1;
+            // the delivery and the lease share the payload, a redelivery keeps the expiry
+            auto expiry = next.msg.getExpiry();
+            out.message = std::move(next.msg).toShared();
+            ready.pop_front();
+            Envelope leased(out.message);
+            leased.setExpiry(expiry);
+            leases.emplace(id, Lease{std::move(leased), out.attempt, deadline,
+                                     wheel->schedule(deadline, weak_from_this(), id)});
+            return true;
+        }
+
+        /**
+         * end a lease that was not acked, the message is delivered again or dead lettered. must hold mtx
+         * @param it the lease
+         * @param dead receives the message if it ran out of deliveries
+         * @return true if the message is ready again
+         */
+        bool expireLocked(std::unordered_map<std::uint64_t, Lease>::iterator it, std::vector<Envelope>& dead) {
+            auto& lease = it->second;
+            bool again = options.max_deliveries == 0 || lease.deliveries < options.max_deliveries;
+            if (again) {
+                ready.push_front({std::move(lease.msg), lease.deliveries});
+                redelivered.fetch_add(1, std::memory_order_relaxed);
+            }
+            else {
+                dead.push_back(std::move(lease.msg));
+                dead_lettered.fetch_add(1, std::memory_order_relaxed);
+            }
+            leases.erase(it);
+            return again;
+        }
+
+        /**
+         * hand expired messages on, must not hold mtx
+         */
+        void settle(bool again, std::vector<Envelope>& dead) noexcept {
+            if (again) {
+                parker.unpark();
+                std::lock_guard lock(owner_mtx);
+                if (owner != nullptr) {
+                    owner->redelivered();
+                }
+            }
+            if (options.dead_letter == nullptr) {
+                return;
+            }
+            for (auto& msg : dead) {
+                try {
+                    // this may run on the timer thread, a full dead letter queue is left to the scheduler to retry
+                    if (!options.dead_letter->tryPush(msg)) {
+                        Scheduler::Instance()->pushAfter(options.dead_letter, std::move(msg), {});
+                    }
+                }
+                catch (const QueueException&) {
+                    // the dead letter queue refused it, counted in its own stats
+                }
+            }
+        }
+
+        void onTimer(std::uint64_t cookie) noexcept override {
+            std::vector<Envelope> dead;
+            bool again;
+            {
+                std::lock_guard lock(mtx);
+                auto it = leases.find(cookie);
+                // settled, or extended just after the timer was taken off the wheel
+                if (it == leases.end() || it->second.deadline > TimerWheel::Clock::now()) {
+                    return;
+                }
+                again = expireLocked(it, dead);
+            }
+            settle(again, dead);
+        }
+
+        AckOptions options;
+        std::shared_ptr<TimerWheel> wheel = TimerWheel::Instance();
+        mutable std::mutex mtx;
+        std::deque<Ready> ready;
+        std::unordered_map<std::uint64_t, Lease> leases;
+        std::uint64_t next_lease = 1;
+        Parker parker;
+        std::atomic<std::uint64_t> acked = 0;
+        std::atomic<std::uint64_t> redelivered = 0;
+        std::atomic<std::uint64_t> dead_lettered = 0;
+        // the queue, told about redeliveries. cleared when it is destroyed
+        std::mutex owner_mtx;
+        AckQueue* owner = nullptr;
+    };
+
+    AckQueue::AckQueue(std::string name, AckOptions options)
+            : Queue(std::move(name)), store(std::make_shared<AckStore>(std::move(options))) {
+        store->owner = this;
+    }
+
+    AckQueue::~AckQueue() {
+        std::lock_guard lock(store->owner_mtx);
+        store->owner = nullptr;
+    }
+
+    bool AckQueue::tryFetch(Delivery& out) {
+        std::lock_guard lock(store->mtx);
+        dropExpired();
+        if (!store->leaseLocked(out)) {
+            return false;
+        }
+        metrics->counters.add(QueueMetrics::Dequeued);
+        return true;
+    }
+
+    bool AckQueue::fetch(Delivery& out, int timeout_ms) {
+        auto try_fetch = [this, &out]() { return tryFetch(out); };
+        return waitWith(try_fetch, [this, &try_fetch](int timeout) { return store->parker.park(try_fetch, timeout); },
+                        timeout_ms);
+    }
+
+    std::size_t AckQueue::fetchBulk(std::vector<Delivery>& out, std::size_t max_n) {
+        std::lock_guard lock(store->mtx);
+        std::size_t n = 0;
+        Delivery delivery;
+        while (n < max_n) {
+            dropExpired();
+            if (!store->leaseLocked(delivery)) {
+                break;
+            }
+            out.push_back(std::move(delivery));
+            ++n;
+        }
+        metrics->counters.add(QueueMetrics::Dequeued, n);
+        return n;
+    }
+
+    bool AckQueue::ack(std::uint64_t lease) {
+        std::lock_guard lock(store->mtx);
+        auto it = store->leases.find(lease);
+        if (it == store->leases.end()) {
+            return false;
+        }
+        // frees the timer now instead of letting it linger until the deadline
+        store->wheel->cancel(it->second.timer);
+        store->leases.erase(it);
+        store->acked.fetch_add(1, std::memory_order_relaxed);
+        return true;
+    }
+
+    bool AckQueue::nack(std::uint64_t lease) {
+        std::vector<Envelope> dead;
+        bool again;
+        {
+            std::lock_guard lock(store->mtx);
+            auto it = store->leases.find(lease);
+            if (it == store->leases.end()) {
+                return false;
+            }
+            store->wheel->cancel(it->second.timer);
+            again = store->expireLocked(it, dead);
+        }
+        store->settle(again, dead);
+        return true;
+    }
+
+    bool AckQueue::extend(std::uint64_t lease, std::chrono::milliseconds visibility_timeout) {
+        std::lock_guard lock(store->mtx);
+        auto it = store->leases.find(lease);
+        if (it == store->leases.end()) {
+            return false;
+        }
+        // a timer already taken off the wheel finds the later deadline and leaves the lease alone
+        store->wheel->cancel(it->second.timer);
+        it->second.deadline = TimerWheel::Clock::now() + visibility_timeout;
+        it->second.timer = store->wheel->schedule(it->second.deadline, store->weak_from_this(), lease);
+        return true;
+    }
+
+    std::size_t AckQueue::getInFlightCount() const {
+        std::lock_guard lock(store->mtx);
+        return store->leases.size();
+    }
+
+    AckStats AckQueue::getAckStats() const noexcept {
+        AckStats ret;
+        ret.acked = store->acked.load(std::memory_order_relaxed);
+        ret.redelivered = store->redelivered.load(std::memory_order_relaxed);
+        ret.dead_lettered = store->dead_lettered.load(std::memory_order_relaxed);
+        return ret;
+    }
+
+    std::size_t AckQueue::size() const noexcept {
+        std::lock_guard lock(store->mtx);
+        return store->ready.size();
+    }
+
+    bool AckQueue::empty() const noexcept {
+        return size() == 0;
+    }
+
+    void AckQueue::setOverflowPolicy(OverflowPolicy policy) {
+
+    }
+
+    void AckQueue::enqueue(Envelope msg) {
+        {
+            std::lock_guard lock(store->mtx);
+            store->ready.push_back({std::move(msg), 0});
+        }
+        store->parker.unpark();
+    }
+
+    void AckQueue::enqueueBulk(std::vector<Envelope>& msgs) {
+        {
+            std::lock_guard lock(store->mtx);
+            for (auto& msg : msgs) {
+                store->ready.push_back({std::move(msg), 0});
+            }
+        }
+        store->parker.unparkAll();
+    }
+
+    bool AckQueue::dequeue(Envelope& msg, bool block, int timeout_ms) {
+        auto try_pop = [this, &msg]() {
+            std::lock_guard lock(store->mtx);
+            if (store->ready.empty()) {
+                return false;
+            }
+            msg = std::move(store->ready.front().msg);
+            store->ready.pop_front();
+            return true;
+        };
+        bool got;
+        if (!block) {
+            got = try_pop();
+        }
+        else {
+            got = waitWith(try_pop, [this, &try_pop](int timeout) { return store->parker.park(try_pop, timeout); },
+                           timeout_ms);
+        }
+        if (got && empty()) {
+            safe_cond.notify_all();
+        }
+        return got;
+    }
+
+    std::size_t AckQueue::dequeueBulk(const Sink& sink, std::size_t max_n, bool block, int timeout_ms) {
+        if (max_n == 0) {
+            return 0;
+        }
+        std::size_t n = 0;
+        Envelope msg;
+        if (block) {
+            if (!dequeue(msg, true, timeout_ms)) {
+                return 0;
+            }
+            sink(std::move(msg));
+            ++n;
+        }
+        std::vector<Envelope> popped;
+        {
+            std::lock_guard lock(store->mtx);
+            while (n + popped.size() < max_n && !store->ready.empty()) {
+                popped.push_back(std::move(store->ready.front().msg));
+                store->ready.pop_front();
+            }
+        }
+        // the sink runs outside the lock, it may push into this queue
+        for (auto& m : popped) {
+            sink(std::move(m));
+            ++n;
+        }
+        if (n != 0 && empty()) {
+            safe_cond.notify_all();
+        }
+        return n;
+    }
+
+    void AckQueue::dropExpired() noexcept {
+        std::chrono::steady_clock::time_point now;
+        while (!store->ready.empty() && discard(store->ready.front().msg, now)) {
+            store->ready.pop_front();
+        }
+    }
+
+    void AckQueue::redelivered() noexcept {
+        signalWatchers();
+    }
+
+    std::shared_ptr<AckQueue> makeAckQueue(const std::string& name, AckOptions options) {
+        return std::make_shared<AckQueue>(name, std::move(options));
+    }
+}
@@ -0,0 +1,116 @@
+/**
+ * @file AsyncWaiter.cpp
+ * @author ayano
+ * @date 2/15/24
+ * @brief
+*/
+
+#include "AsyncWaiter.h"
+#include "Queue.h"
+#include <algorithm>
+
+namespace KawaiiMQ {
+
+    AsyncWaiter::AsyncWaiter(std::vector<Queue*> queues, Executor executor)
+            : queues(std::move(queues)), executor(std::move(executor)) {
+
+    }
+
+    AsyncWaiter::~AsyncWaiter() {
+        finish();
+    }
+
+    bool AsyncWaiter::await_ready() {
+        for (auto queue : queues) {
+            if (queue->tryWaitValue(msg)) {
+                source = queue;
+                return true;
+            }
+        }
+        return false;
+    }
+
+    bool AsyncWaiter::await_suspend(std::coroutine_handle<> handle) {
+        this->handle = handle;
+        registered = true;
+        for (auto queue : queues) {
+            queue->addAwaiter(this);
+        }
+        // a push that came in before we were registered did not see us, look again
+        std::lock_guard lock(mtx);
+        for (auto it = queues.begin(); !done && it != queues.end(); ++it) {
+            if ((*it)->tryWaitValue(msg)) {
+                source = *it;
+                done = true;
+            }
+        }
+        if (done) {
+            return false;
+        }
+        suspended = true;
+        return true;
+    }
+
+    AsyncWaiter::Offer AsyncWaiter::offer(Queue &from) {
+        std::lock_guard lock(mtx);
+        if (done) {
+            return Offer::Done;
+        }
+        if (!from.tryWaitValue(msg)) {
+            return Offer::Empty;
+        }
+        source = &from;
+        done = true;
+        return suspended ? Offer::Resume : Offer::Taken;
+    }
+
+    void AsyncWaiter::finish() {
+        if (!registered) {
+            return;
+        }
+        for (auto queue : queues) {
+            queue->removeAwaiter(this);
+        }
+        registered = false;
+    }
+
+    QueueAwaiter::QueueAwaiter(Queue &queue, Executor executor) : AsyncWaiter({&queue}, std::move(executor)) {
+
+    }
+
+    std::shared_ptr<MessageData> QueueAwaiter::await_resume() {
+        finish();
+        return std::move(msg).toShared();
+    }
+
+    namespace {
+        std::vector<Queue*> rawPointers(const std::vector<std::shared_ptr<Queue>>& queues) {
+            std::vector<Queue*> ret;
+            ret.reserve(queues.size());
+            for (auto& queue : queues) {
+                ret.push_back(queue.get());
+            }
+            return ret;
+        }
+    }
+
+    FetchAwaiter::FetchAwaiter(std::vector<std::shared_ptr<Queue>> queues, Executor executor, std::size_t max_n)
+            : AsyncWaiter(rawPointers(queues), std::move(executor)), owned(std::move(queues)),
+              max_n(std::max<std::size_t>(max_n, 1)) {
+
+    }
+
+    std::vector<std::shared_ptr<MessageData>> FetchAwaiter::await_resume() {
+        finish();
+        std::vector<std::shared_ptr<MessageData>> ret;
+        ret.push_back(std::move(msg).toShared());
+        // the queue the message came from goes first, so its messages stay in order
+        source->drain(ret, max_n - ret.size());
+        for (auto queue : queues) {
+            if (queue != source && ret.size() < max_n) {
+                queue->drain(ret, max_n - ret.size());
+            }
+        }
+        return ret;
+    }
+}
@@ -6,70 +6,267 @@
 */
 
 #include "Consumer.h"
+#include <chrono>
+#include <iterator>
+#include <limits>
 
 namespace KawaiiMQ {
 
-    Consumer::Consumer(const std::vector<Topic> &topics) : subscribed(std::move(topics)) {
+    Consumer::Consumer(const std::vector<Topic> &topics) : subscribed(topics) {
+        for (const auto& topic : subscribed) {
+            subscribed_set.insert(topic);
+        }
+    }
 
+    Consumer::~Consumer() {
+        if (group != nullptr) {
+            group->leave(this);
+        }
     }
 
     void Consumer::subscribe(const Topic &topic) {
-        std::lock_guard lock(mtx);
-        auto manager = MessageQueueManager::Instance();
-        if (!manager->isRelatedAny(topic)) {
-            throw TopicException("Attempting to subscribe a topic not related to any queue! Topic: " + topic.getName());
-        }
-        if (std::find(subscribed.begin(), subscribed.end(), topic) == subscribed.end()) {
-            subscribed.push_back(topic);
+        {
+            std::lock_guard lock(mtx);
+            if (!manager->isRelatedAny(topic)) {
+                throw TopicException("Attempting to subscribe a topic not related to any queue! Topic: " + topic.getName());
+            }
+            if (subscribed_set.insert(topic)) {
+                subscribed.push_back(topic);
+            }
+            else {
+                throw TopicException("Attempting to subscribe a subscribed topic! Topic: " + topic.getName());
+            }
         }
-        else {
-            throw TopicException("Attempting to subscribe a subscribed topic! Topic: " + topic.getName());
+        if (group != nullptr) {
+            group->resubscribed();
         }
     }
 
     void Consumer::unsubscribe(const Topic &topic) {
-        std::lock_guard lock(mtx);
-        auto it = std::find(subscribed.begin(), subscribed.end(), topic);
-        if (it != subscribed.end()) {
-            subscribed.erase(it);
+        {
+            std::lock_guard lock(mtx);
+            if (subscribed_set.erase(topic)) {
+                subscribed.erase(std::find(subscribed.begin(), subscribed.end(), topic));
+            }
+            else {
+                throw TopicException("Attempting to unsubscribe a non-subscribed topic! Topic: " + topic.getName());
+            }
         }
-        else {
-            throw TopicException("Attempting to unsubscribe a non-subscribed topic! Topic: " + topic.getName());
+        if (group != nullptr) {
+            group->resubscribed();
         }
     }
 
     std::unordered_map<Topic, std::vector<std::shared_ptr<MessageData>>> Consumer::fetchMessage() {
-        auto manager = MessageQueueManager::Instance();
+        return fetchMessage(0);
+    }
+
+    std::unordered_map<Topic, std::vector<std::shared_ptr<MessageData>>> Consumer::fetchMessage(int timeout_ms) {
         std::unordered_map<Topic, std::vector<std::shared_ptr<MessageData>>> ret;
-        for(const auto& i : subscribed) {
-            auto queue = manager->getAllRelatedQueue(i);
-            for(auto& j : queue) {
-                auto message = j->wait();
-                {
-                    ret[i].push_back(message);
+        auto deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(timeout_ms);
+        refreshAssignment();
+        // copy the queues before blocking, a view held while waiting would keep retired routes alive
+        struct Watched {
+            Topic topic;
+            std::shared_ptr<Queue> queue;
+            LogCursor* cursor;
+        };
+        std::vector<Watched> watched;
+        for (const auto& topic : subscribed) {
+            auto queues = manager->relatedQueues(topic);
+            for (std::size_t i = 0; i < queues.size(); ++i) {
+                if (owns(topic, queues, i)) {
+                    watched.push_back({topic, queues[i], nullptr});
                 }
             }
         }
-        return ret;
+        // looked up once, not on every readiness check
+        for (auto& w : watched) {
+            w.cursor = getCursor(w.queue);
+        }
+        auto drainReady = [&]() {
+            for (auto& [topic, queue, cursor] : watched) {
+                if (ready(*queue, cursor)) {
+                    std::vector<std::shared_ptr<MessageData>> messages;
+                    if (take(*queue, cursor, messages, std::numeric_limits<std::size_t>::max()) != 0) {
+                        auto& out = ret[topic];
+                        std::move(messages.begin(), messages.end(), std::back_inserter(out));
+                    }
+                }
+            }
+            return !ret.empty();
+        };
+        if (drainReady() || watched.empty()) {
+            return ret;
+        }
+        for (auto& w : watched) {
+            w.queue->watch(&waker);
+        }
+        auto parked = metricsNow();
+        auto anyReady = [this, &watched]() {
+            return rebalanced() ||
+                   std::any_of(watched.begin(), watched.end(), [](const Watched& w) { return ready(*w.queue, w.cursor); });
+        };
+        // another consumer may take the messages between the wake up and the drain, then wait again
+        while (!drainReady() && !rebalanced()) {
+            int remaining = 0;
+            if (timeout_ms != 0) {
+                auto left = std::chrono::duration_cast<std::chrono::milliseconds>(deadline - std::chrono::steady_clock::now());
+                if (left.count() <= 0) {
+                    break;
+                }
+                remaining = static_cast<int>(left.count());
+            }
+            waker.parker.park(anyReady, remaining);
+        }
+        for (auto& w : watched) {
+            w.queue->unwatch(&waker);
+        }
+        // drainReady counted the messages already
+        countWait(parked, 0);
+        if (!ret.empty() || !rebalanced()) {
+            return ret;
+        }
+        // the partitions changed while waiting, watch the new ones for what is left of the timeout
+        if (timeout_ms == 0) {
+            return fetchMessage(0);
+        }
+        auto left = std::chrono::duration_cast<std::chrono::milliseconds>(deadline - std::chrono::steady_clock::now());
+        return left.count() > 0 ? fetchMessage(static_cast<int>(left.count())) : ret;
     }
 
     std::vector<std::shared_ptr<MessageData>> Consumer::fetchSingleTopic(const Topic &topic) {
-        if(std::find(subscribed.begin(), subscribed.end(), topic) == subscribed.end()) {
+        if(!subscribed_set.contains(topic)) {
             throw TopicException("topic not subscribed");
         }
-        auto manager = MessageQueueManager::Instance();
         std::vector<std::shared_ptr<MessageData>> ret;
-        auto queue = manager->getAllRelatedQueue(topic);
-        for (auto &j : queue) {
-            if (j->empty()) {
+        refreshAssignment();
+        auto queues = manager->relatedQueues(topic);
+        for (std::size_t i = 0; i < queues.size(); ++i) {
+            if (!owns(topic, queues, i)) {
+                continue;
+            }
+            auto& j = queues[i];
+            if (auto cursor = getCursor(j)) {
+                if (take(*j, cursor, ret, 1) == 0) {
+                    throw QueueException("queue empty");
+                }
+                continue;
+            }
+            // a queue holding only expired messages is empty, wait would discard them and then block
+            std::shared_ptr<MessageData> message;
+            if (!j->tryWait(message)) {
                 throw QueueException("queue empty");
             }
-            auto message = j->wait();
-            ret.push_back(message);
+            ret.push_back(std::move(message));
+            metrics->counters.add(ConsumerMetrics::Fetched);
         }
         return ret;
     }
 
+    std::vector<std::shared_ptr<MessageData>> Consumer::fetchBatch(const Topic &topic, std::size_t max_n, int timeout_ms) {
+        if(!subscribed_set.contains(topic)) {
+            throw TopicException("topic not subscribed");
+        }
+        std::vector<std::shared_ptr<MessageData>> ret;
+        auto deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(timeout_ms);
+        refreshAssignment();
+        std::vector<std::shared_ptr<Queue>> queues;
+        {
+            auto ready = manager->relatedQueues(topic);
+            for (std::size_t i = 0; i < ready.size(); ++i) {
+                if (ret.size() >= max_n) {
+                    return ret;
+                }
+                if (owns(topic, ready, i)) {
+                    take(*ready[i], getCursor(ready[i]), ret, max_n - ret.size());
+                }
+            }
+            if (!ret.empty() || max_n == 0) {
+                return ret;
+            }
+            // copy the list before blocking, a view held while waiting would keep retired routes alive
+            for (std::size_t i = 0; i < ready.size(); ++i) {
+                if (owns(topic, ready, i)) {
+                    queues.push_back(ready[i]);
+                }
+            }
+        }
+        if (queues.empty()) {
+            return ret;
+        }
+        // looked up once, not on every readiness check
+        std::vector<LogCursor*> logs;
+        for (auto& j : queues) {
+            logs.push_back(getCursor(j));
+        }
+        auto drainReady = [&]() {
+            for (std::size_t i = 0; i < queues.size() && ret.size() < max_n; ++i) {
+                take(*queues[i], logs[i], ret, max_n - ret.size());
+            }
+            return !ret.empty();
+        };
+        for (auto& j : queues) {
+            j->watch(&waker);
+        }
+        auto parked = metricsNow();
+        auto anyReady = [this, &queues, &logs]() {
+            if (rebalanced()) {
+                return true;
+            }
+            for (std::size_t i = 0; i < queues.size(); ++i) {
+                if (ready(*queues[i], logs[i])) {
+                    return true;
+                }
+            }
+            return false;
+        };
+        // blocks once on every queue, whichever receives a message first wakes it up
+        while (!drainReady() && !rebalanced()) {
+            int remaining = 0;
+            if (timeout_ms != 0) {
+                auto left = std::chrono::duration_cast<std::chrono::milliseconds>(deadline - std::chrono::steady_clock::now());
+                if (left.count() <= 0) {
+                    break;
+                }
+                remaining = static_cast<int>(left.count());
+            }
+            waker.parker.park(anyReady, remaining);
+        }
+        for (auto& j : queues) {
+            j->unwatch(&waker);
+        }
+        // take counted the messages already
+        countWait(parked, 0);
+        if (!ret.empty() || !rebalanced()) {
+            return ret;
+        }
+        // the partitions changed while waiting, wait on the new ones for what is left of the timeout
+        if (timeout_ms == 0) {
+            return fetchBatch(topic, max_n, 0);
+        }
+        auto left = std::chrono::duration_cast<std::chrono::milliseconds>(deadline - std::chrono::steady_clock::now());
+        return left.count() > 0 ? fetchBatch(topic, max_n, static_cast<int>(left.count())) : ret;
+    }
+
+    FetchAwaiter Consumer::asyncFetch(const Topic &topic, Executor executor, std::size_t max_n) {
+        if(!subscribed_set.contains(topic)) {
+            throw TopicException("topic not subscribed");
+        }
+        refreshAssignment();
+        std::vector<std::shared_ptr<Queue>> queues;
+        auto related = manager->relatedQueues(topic);
+        for (std::size_t i = 0; i < related.size(); ++i) {
+            if (owns(topic, related, i)) {
+                queues.push_back(related[i]);
+            }
+        }
+        if (queues.empty()) {
+            throw TopicException("topic not related to any queue");
+        }
+        return {std::move(queues), std::move(executor), max_n};
+    }
+
     Consumer::Consumer(const std::string &name): name(name) {
 
     }
@@ -82,4 +279,84 @@ namespace KawaiiMQ {
         return subscribed;
     }
 
+    void Consumer::join(std::shared_ptr<ConsumerGroup> group) {
+        if (this->group != nullptr) {
+            throw TopicException("Attempting to join a group while in group " + this->group->getName());
+        }
+        this->group = std::move(group);
+        assignment_generation = 0;
+        this->group->join(this);
+    }
+
+    void Consumer::leave() {
+        if (group == nullptr) {
+            throw TopicException("Attempting to leave a group while not in any");
+        }
+        group->leave(this);
+        group.reset();
+        assignment.clear();
+    }
+
+    std::shared_ptr<ConsumerGroup> Consumer::getGroup() const {
+        return group;
+    }
+
+    bool Consumer::refreshAssignment() {
+        if (!rebalanced()) {
+            return false;
+        }
+        assignment_generation = group->assignmentOf(this, assignment);
+        return true;
+    }
+
+    bool Consumer::rebalanced() const noexcept {
+        return group != nullptr && group->getGeneration() != assignment_generation;
+    }
+
+    bool Consumer::owns(const Topic& topic, const MessageQueueManager::RelatedQueues& queues, std::size_t i) const {
+        if (group == nullptr || !queues.partitioned()) {
+            return true;
+        }
+        auto share = assignment.find(topic.getId());
+        return share != assignment.end() && share->second.owns(i);
+    }
+
+    LogCursor* Consumer::getCursor(const std::shared_ptr<Queue>& queue) {
+        auto* log = dynamic_cast<LogQueue*>(queue.get());
+        if (log == nullptr) {
+            return nullptr;
+        }
+        auto& owned = cursors[queue.get()];
+        if (owned.cursor == nullptr || owned.log.lock() != queue) {
+            owned.log = queue;
+            owned.cursor = log->openCursor(LogStart::Earliest);
+        }
+        return owned.cursor.get();
+    }
+
+    std::size_t Consumer::take(Queue& queue, LogCursor* cursor, std::vector<std::shared_ptr<MessageData>>& out,
+                               std::size_t max_n) {
+        auto n = cursor != nullptr ? cursor->readBulk(out, max_n) : queue.drain(out, max_n);
+        metrics->counters.add(ConsumerMetrics::Fetched, n);
+        return n;
+    }
+
+    void Consumer::countWait(std::uint64_t parked, std::size_t fetched) noexcept {
+        metrics->wait.record(metricsNow() - parked);
+        metrics->counters.add(ConsumerMetrics::Waits);
+        metrics->counters.add(ConsumerMetrics::Fetched, fetched);
+    }
+
+    ConsumerSample Consumer::getMetrics() const {
+        return {name, metrics->counters.load(ConsumerMetrics::Fetched), metrics->counters.load(ConsumerMetrics::Waits),
+                metrics->wait.snapshot()};
+    }
+
+    bool Consumer::ready(const Queue& queue, const LogCursor* cursor) {
+        if (cursor != nullptr) {
+            return cursor->available();
+        }
+        return !queue.empty();
+    }
+
 }
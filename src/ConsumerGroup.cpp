@@ -0,0 +1,105 @@
+/**
+ * @file ConsumerGroup.cpp
+ * @author ayano
+ * @date 2/20/24
+ * @brief
+*/
+
+#include "ConsumerGroup.h"
+#include "Consumer.h"
+#include <algorithm>
+
+namespace KawaiiMQ {
+
+    ConsumerGroup::ConsumerGroup(std::string name) : name(std::move(name)) {
+
+    }
+
+    const std::string& ConsumerGroup::getName() const noexcept {
+        return name;
+    }
+
+    std::size_t ConsumerGroup::getMemberCount() const {
+        std::lock_guard lock(mtx);
+        return members.size();
+    }
+
+    std::uint64_t ConsumerGroup::getGeneration() const noexcept {
+        return generation.load(std::memory_order_acquire);
+    }
+
+    std::vector<std::shared_ptr<Queue>> ConsumerGroup::getPartitions(const Consumer& member, const Topic& topic) const {
+        std::vector<std::shared_ptr<Queue>> ret;
+        Assignment assignment;
+        assignmentOf(&member, assignment);
+        auto share = assignment.find(topic.getId());
+        if (share == assignment.end()) {
+            return ret;
+        }
+        auto queues = MessageQueueManager::Instance()->relatedQueues(topic);
+        for (std::size_t i = 0; i < queues.size(); ++i) {
+            if (share->second.owns(i)) {
+                ret.push_back(queues[i]);
+            }
+        }
+        return ret;
+    }
+
+    void ConsumerGroup::join(Consumer* member) {
+        std::lock_guard lock(mtx);
+        members.push_back(member);
+        rebalance();
+    }
+
+    void ConsumerGroup::leave(Consumer* member) {
+        std::lock_guard lock(mtx);
+        members.erase(std::find(members.begin(), members.end(), member));
+        assignments.erase(member);
+        rebalance();
+    }
+
+    void ConsumerGroup::resubscribed() {
+        std::lock_guard lock(mtx);
+        rebalance();
+    }
+
+    void ConsumerGroup::rebalance() {
+        std::unordered_map<std::uint32_t, std::size_t> counts;
+        for (auto* member : members) {
+            std::lock_guard lock(member->mtx);
+            for (const auto& topic : member->subscribed) {
+                ++counts[topic.getId()];
+            }
+        }
+        std::unordered_map<std::uint32_t, std::size_t> taken;
+        for (auto* member : members) {
+            auto& assignment = assignments[member];
+            assignment.clear();
+            std::lock_guard lock(member->mtx);
+            for (const auto& topic : member->subscribed) {
+                assignment[topic.getId()] = {taken[topic.getId()]++, counts[topic.getId()]};
+            }
+        }
+        generation.fetch_add(1, std::memory_order_acq_rel);
+        // a member blocked in fetchMessage watches the partitions it had, let it pick up the new ones
+        for (auto* member : members) {
+            member->waker.notify();
+        }
+    }
+
+    std::uint64_t ConsumerGroup::assignmentOf(const Consumer* member, Assignment& assignment) const {
+        std::lock_guard lock(mtx);
+        auto it = assignments.find(member);
+        if (it == assignments.end()) {
+            assignment.clear();
+        }
+        else {
+            assignment = it->second;
+        }
+        return generation.load(std::memory_order_relaxed);
+    }
+
+    std::shared_ptr<ConsumerGroup> makeConsumerGroup(const std::string& name) {
+        return std::make_shared<ConsumerGroup>(name);
+    }
+}
@@ -0,0 +1,229 @@
+/**
+ * @file Dispatcher.cpp
+ * @author ayano
+ * @date 2/14/24
+ * @brief
+*/
+
+#include "Dispatcher.h"
+#include <algorithm>
+#include <iostream>
+
+namespace KawaiiMQ {
+
+    namespace {
+        // messages handled per run before the queue goes back to the end of the line, keeps hot queues fair
+        constexpr std::size_t runBatch = 64;
+
+        // the dispatcher and worker index of the current thread, so handlers pushing into watched queues schedule
+        // them on their own deque
+        thread_local const void* current_dispatcher = nullptr;
+        thread_local std::size_t current_worker = 0;
+    }
+
+    Dispatcher::Dispatcher(std::size_t workers) {
+        if (workers == 0) {
+            workers = std::max(1u, std::thread::hardware_concurrency());
+        }
+        for (std::size_t i = 0; i < workers; ++i) {
+            this->workers.push_back(std::make_unique<Worker>());
+        }
+        for (std::size_t i = 0; i < workers; ++i) {
+            threads.emplace_back([this, i]() { workerLoop(i); });
+        }
+    }
+
+    Dispatcher::~Dispatcher() {
+        {
+            std::lock_guard lock(mtx);
+            for (auto& [queue, task] : tasks) {
+                task->active = false;
+                queue->unwatch(task.get());
+            }
+            tasks.clear();
+        }
+        stopping = true;
+        parker.unparkAll();
+        for (auto& t : threads) {
+            t.join();
+        }
+    }
+
+    void Dispatcher::onMessage(const Topic &topic, Handler handler) {
+        std::lock_guard lock(mtx);
+        auto queues = manager->getAllRelatedQueue(topic);
+        if (queues.empty()) {
+            throw TopicException("Attempting to handle a topic not related to any queue! Topic: " + topic.getName());
+        }
+        for (auto& queue : queues) {
+            auto& task = tasks[queue.get()];
+            bool created = task == nullptr;
+            if (created) {
+                task = std::make_shared<Task>(this, queue);
+            }
+            {
+                std::lock_guard handlers_lock(task->handlers_mtx);
+                auto handlers = std::make_shared<Handlers>(*task->handlers);
+                handlers->emplace_back(topic, handler);
+                task->handlers = std::move(handlers);
+            }
+            if (created) {
+                queue->watch(task.get());
+                // messages pushed before the watch would otherwise wait for the next push
+                if (!queue->empty()) {
+                    trySchedule(task);
+                }
+            }
+        }
+    }
+
+    void Dispatcher::removeHandlers(const Topic &topic) {
+        std::lock_guard lock(mtx);
+        bool found = false;
+        for (auto it = tasks.begin(); it != tasks.end();) {
+            auto& task = it->second;
+            std::shared_ptr<Handlers> handlers;
+            {
+                std::lock_guard handlers_lock(task->handlers_mtx);
+                handlers = std::make_shared<Handlers>(*task->handlers);
+                auto removed = std::erase_if(*handlers, [&topic](const auto& h) { return h.first == topic; });
+                found = found || removed != 0;
+                task->handlers = handlers;
+            }
+            if (handlers->empty()) {
+                task->active = false;
+                task->queue->unwatch(task.get());
+                it = tasks.erase(it);
+            }
+            else {
+                ++it;
+            }
+        }
+        if (!found) {
+            throw TopicException("Attempting to remove handlers of a topic without handler! Topic: " + topic.getName());
+        }
+    }
+
+    std::size_t Dispatcher::getWorkerCount() const noexcept {
+        return threads.size();
+    }
+
+    void Dispatcher::Task::notify() noexcept {
+        if (active.load(std::memory_order_relaxed)) {
+            owner->trySchedule(shared_from_this());
+        }
+    }
+
+    void Dispatcher::trySchedule(const std::shared_ptr<Task> &task) {
+        if (!task->scheduled.exchange(true)) {
+            submit(task);
+        }
+    }
+
+    void Dispatcher::submit(const std::shared_ptr<Task> &task) {
+        std::size_t index = current_dispatcher == this
+                            ? current_worker
+                            : next_worker.fetch_add(1, std::memory_order_relaxed) % workers.size();
+        {
+            std::lock_guard lock(workers[index]->mtx);
+            workers[index]->tasks.push_back(task);
+            // counted under the deque lock, so take() never decrements before the increment
+            pending.fetch_add(1, std::memory_order_relaxed);
+        }
+        parker.unpark();
+    }
+
+    std::shared_ptr<Dispatcher::Task> Dispatcher::take(std::size_t index) {
+        {
+            auto& own = *workers[index];
+            std::lock_guard lock(own.mtx);
+            if (!own.tasks.empty()) {
+                auto task = std::move(own.tasks.front());
+                own.tasks.pop_front();
+                pending.fetch_sub(1, std::memory_order_relaxed);
+                return task;
+            }
+        }
+        for (std::size_t i = 1; i < workers.size(); ++i) {
+            auto& victim = *workers[(index + i) % workers.size()];
+            std::lock_guard lock(victim.mtx);
+            if (!victim.tasks.empty()) {
+                auto task = std::move(victim.tasks.back());
+                victim.tasks.pop_back();
+                pending.fetch_sub(1, std::memory_order_relaxed);
+                return task;
+            }
+        }
+        return nullptr;
+    }
+
+    void Dispatcher::run(const std::shared_ptr<Task> &task) {
+        std::shared_ptr<const Handlers> handlers;
+        {
+            std::lock_guard lock(task->handlers_mtx);
+            handlers = task->handlers;
+        }
+        if (task->acks != nullptr) {
+            std::vector<Delivery> deliveries;
+            if (task->active.load(std::memory_order_relaxed)) {
+                task->acks->fetchBulk(deliveries, runBatch);
+            }
+            for (auto& delivery : deliveries) {
+                if (handle(*handlers, delivery.message)) {
+                    task->acks->ack(delivery.lease);
+                }
+                else {
+                    task->acks->nack(delivery.lease);
+                }
+            }
+        }
+        else {
+            std::vector<std::shared_ptr<MessageData>> messages;
+            if (task->active.load(std::memory_order_relaxed)) {
+                task->queue->drain(messages, runBatch);
+            }
+            for (auto& msg : messages) {
+                handle(*handlers, msg);
+            }
+        }
+        // acq_rel pairs with the exchange in trySchedule(): a push we missed either sees the task unscheduled and
+        // schedules it, or we see its message below
+        task->scheduled.exchange(false, std::memory_order_acq_rel);
+        if (task->active.load(std::memory_order_relaxed) && !task->queue->empty()) {
+            trySchedule(task);
+        }
+    }
+
+    bool Dispatcher::handle(const Handlers& handlers, const std::shared_ptr<MessageData>& msg) {
+        bool ok = true;
+        for (auto& [topic, handler] : handlers) {
+            try {
+                handler(msg);
+            }
+            catch (const std::exception& e) {
+                std::cerr << "handler of topic " << topic.getName() << " threw: " << e.what() << std::endl;
+                ok = false;
+            }
+            catch (...) {
+                // anything else would escape the worker thread and terminate the process
+                std::cerr << "handler of topic " << topic.getName() << " threw a non-standard exception" << std::endl;
+                ok = false;
+            }
+        }
+        return ok;
+    }
+
+    void Dispatcher::workerLoop(std::size_t index) {
+        current_dispatcher = this;
+        current_worker = index;
+        while (!stopping.load(std::memory_order_relaxed)) {
+            if (auto task = take(index)) {
+                run(task);
+                continue;
+            }
+            parker.park([this]() {
+                return pending.load(std::memory_order_relaxed) != 0 || stopping.load(std::memory_order_relaxed);
+            }, 0);
+        }
+    }
+}
@@ -0,0 +1,139 @@
+/**
+ * @file DurableQueue.cpp
+ * @author ayano
+ * @date 2/17/24
+ * @brief
+*/
+
+#include "DurableQueue.h"
+#include <algorithm>
+#include <fstream>
+#include "Topic.h"
+
+namespace KawaiiMQ {
+
+    DurableQueue::DurableQueue(std::string name, const DurableOptions& options)
+            : Queue(name), directory(options.directory / name),
+              log(directory, options.segment_size, options.fsync) {
+        for (auto& record : log.takeRecovered()) {
+            Queue::enqueue(serializers->deserialize(record.type_id, record.payload));
+            ++recovered;
+        }
+        std::ifstream in(directory / "topics");
+        for (std::string line; std::getline(in, line);) {
+            if (!line.empty()) {
+                topics.push_back(std::move(line));
+            }
+        }
+    }
+
+    DurableQueue::~DurableQueue() = default;
+
+    void DurableQueue::setOverflowPolicy(OverflowPolicy policy) {
+
+    }
+
+    void DurableQueue::sync() {
+        log.sync();
+    }
+
+    std::size_t DurableQueue::getRecoveredCount() const noexcept {
+        return recovered;
+    }
+
+    std::vector<std::string> DurableQueue::getStoredTopics() const {
+        std::lock_guard lock(topics_mtx);
+        return topics;
+    }
+
+    const WriteAheadLog& DurableQueue::getLog() const noexcept {
+        return log;
+    }
+
+    void DurableQueue::enqueue(Envelope msg) {
+        thread_local std::string bytes;
+        bytes.clear();
+        auto id = serializers->serialize(msg, bytes);
+        std::uint64_t seq;
+        {
+            // the n-th logged record has to be the n-th stored message, pops are counted against the log
+            std::lock_guard lock(order_mtx);
+            seq = log.append(id, bytes);
+            Queue::enqueue(std::move(msg));
+        }
+        log.commit(seq);
+    }
+
+    void DurableQueue::enqueueBulk(std::vector<Envelope>& msgs) {
+        if (msgs.empty()) {
+            return;
+        }
+        std::vector<std::pair<std::uint64_t, std::string>> records;
+        records.reserve(msgs.size());
+        for (const auto& msg : msgs) {
+            std::string bytes;
+            auto id = serializers->serialize(msg, bytes);
+            records.emplace_back(id, std::move(bytes));
+        }
+        std::uint64_t seq = 0;
+        {
+            std::lock_guard lock(order_mtx);
+            for (const auto& [id, bytes] : records) {
+                seq = log.append(id, bytes);
+            }
+            Queue::enqueueBulk(msgs);
+        }
+        log.commit(seq);
+    }
+
+    bool DurableQueue::dequeue(Envelope& msg, bool block, int timeout_ms) {
+        if (!Queue::dequeue(msg, block, timeout_ms)) {
+            return false;
+        }
+        log.consume(1);
+        return true;
+    }
+
+    std::size_t DurableQueue::dequeueBulk(const Sink& sink, std::size_t max_n, bool block, int timeout_ms) {
+        auto n = Queue::dequeueBulk(sink, max_n, block, timeout_ms);
+        if (n != 0) {
+            log.consume(n);
+        }
+        return n;
+    }
+
+    void DurableQueue::onRelate(const Topic& topic, bool related) {
+        std::lock_guard lock(topics_mtx);
+        auto it = std::find(topics.begin(), topics.end(), topic.getName());
+        if (related == (it != topics.end())) {
+            return;
+        }
+        if (related) {
+            topics.push_back(topic.getName());
+        }
+        else {
+            topics.erase(it);
+        }
+        storeTopics();
+    }
+
+    void DurableQueue::storeTopics() const {
+        auto tmp = directory / "topics.tmp";
+        {
+            std::ofstream out(tmp, std::ios::trunc);
+            for (const auto& name : topics) {
+                out << name << '\n';
+            }
+        }
+        // rename is atomic, a crash leaves either the old or the new list
+        std::error_code ec;
+        std::filesystem::rename(tmp, directory / "topics", ec);
+        if (ec) {
+            std::cerr << "durable queue " << getName() << ": cannot store topics: " << ec.message() << std::endl;
+        }
+    }
+
+    std::shared_ptr<DurableQueue> makeDurableQueue(const std::string& name, const DurableOptions& options) {
+        return std::make_shared<DurableQueue>(name, options);
+    }
+}
@@ -0,0 +1,302 @@
+/**
+ * @file LogQueue.cpp
+ * @author ayano
+ * @date 2/19/24
+ * @brief
+*/
+
+#include "LogQueue.h"
+#include <algorithm>
+
+namespace KawaiiMQ {
+
+    /**
+     * messages and cursors of a log, shared with the cursors so they can outlive the queue
+     */
+    struct LogStore {
+        struct Entry {
+            Envelope msg;
+            std::chrono::steady_clock::time_point at;
+        };
+
+        // cursors are only scanned for the slowest one every this many appends
+        static constexpr std::size_t trimInterval = 64;
+
+        explicit LogStore(LogRetention retention) : retention(retention) {}
+
+        /**
+         * store a message and drop what the retention no longer keeps, must hold mtx exclusively
+         */
+        void append(Envelope msg) {
+            auto at = retention.max_age.count() > 0 ? std::chrono::steady_clock::now()
+                                                    : std::chrono::steady_clock::time_point();
+            entries.push_back({std::move(msg), at});
+            end.fetch_add(1, std::memory_order_release);
+            trim(++since_trim % trimInterval == 0);
+        }
+
+        /**
+         * drop messages according to the retention, must hold mtx exclusively
+         * @param check_cursors whether to scan the cursors for the slowest one
+         */
+        void trim(bool check_cursors) {
+            auto first = start.load(std::memory_order_relaxed);
+            auto last = end.load(std::memory_order_relaxed);
+            auto keep = first;
+            if (retention.max_messages != 0 && last - keep > retention.max_messages) {
+                keep = last - retention.max_messages;
+            }
+            if (retention.max_age.count() > 0) {
+                auto limit = std::chrono::steady_clock::now() - retention.max_age;
+                while (keep < last && entries[keep - first].at < limit) {
+                    ++keep;
+                }
+            }
+            if (check_cursors && retention.trim_read && !cursors.empty()) {
+                auto slowest = last;
+                for (auto* cursor : cursors) {
+                    slowest = std::min(slowest, cursor->offset.load(std::memory_order_relaxed));
+                }
+                keep = std::max(keep, slowest);
+            }
+            if (keep == first) {
+                return;
+            }
+            entries.erase(entries.begin(), entries.begin() + static_cast<std::ptrdiff_t>(keep - first));
+            start.store(keep, std::memory_order_release);
+        }
+
+        LogRetention retention;
+        // expired messages skipped by any cursor, readers count it under the shared lock
+        std::atomic<std::uint64_t> expired = 0;
+        mutable std::shared_mutex mtx;
+        std::deque<Entry> entries;
+        // offsets of the oldest retained message and of the next appended one
+        std::atomic<std::uint64_t> start = 0;
+        std::atomic<std::uint64_t> end = 0;
+        std::vector<LogCursor*> cursors;
+        std::size_t since_trim = 0;
+        // every cursor may be waiting for the next message, appends wake them all
+        Parker parker;
+    };
+
+    LogCursor::LogCursor(std::shared_ptr<LogStore> store, std::uint64_t offset)
+            : store(std::move(store)), offset(offset) {
+
+    }
+
+    LogCursor::~LogCursor() {
+        std::unique_lock lock(store->mtx);
+        store->cursors.erase(std::find(store->cursors.begin(), store->cursors.end(), this));
+    }
+
+    bool LogCursor::readLocked(Envelope& msg) {
+        auto start = store->start.load(std::memory_order_relaxed);
+        auto off = offset.load(std::memory_order_relaxed);
+        if (off < start) {
+            missed += start - off;
+            off = start;
+        }
+        std::chrono::steady_clock::time_point now;
+        for (auto last = start + store->entries.size(); off < last;) {
+            auto& entry = store->entries[off - start].msg;
+            ++off;
+            if (entry.expires()) {
+                if (now == std::chrono::steady_clock::time_point()) {
+                    now = std::chrono::steady_clock::now();
+                }
+                if (entry.getExpiry() <= now) {
+                    store->expired.fetch_add(1, std::memory_order_relaxed);
+                    continue;
+                }
+            }
+            // a copy, the message stays in the log for the other cursors
+            msg = entry;
+            offset.store(off, std::memory_order_relaxed);
+            return true;
+        }
+        offset.store(off, std::memory_order_relaxed);
+        return false;
+    }
+
+    bool LogCursor::tryRead(Envelope& msg) {
+        std::shared_lock lock(store->mtx);
+        return readLocked(msg);
+    }
+
+    bool LogCursor::read(Envelope& msg, int timeout_ms) {
+        if (tryRead(msg)) {
+            return true;
+        }
+        return store->parker.park([this, &msg]() { return tryRead(msg); }, timeout_ms);
+    }
+
+    std::size_t LogCursor::readBulk(std::vector<std::shared_ptr<MessageData>>& out, std::size_t max_n) {
+        std::shared_lock lock(store->mtx);
+        std::size_t n = 0;
+        Envelope msg;
+        while (n < max_n && readLocked(msg)) {
+            out.push_back(std::move(msg).toShared());
+            ++n;
+        }
+        return n;
+    }
+
+    std::size_t LogCursor::readBulk(std::vector<Envelope>& out, std::size_t max_n) {
+        std::shared_lock lock(store->mtx);
+        std::size_t n = 0;
+        Envelope msg;
+        while (n < max_n && readLocked(msg)) {
+            out.push_back(std::move(msg));
+            ++n;
+        }
+        return n;
+    }
+
+    bool LogCursor::available() const noexcept {
+        return offset.load(std::memory_order_relaxed) < store->end.load(std::memory_order_acquire);
+    }
+
+    std::uint64_t LogCursor::getOffset() const noexcept {
+        return offset.load(std::memory_order_relaxed);
+    }
+
+    void LogCursor::seek(std::uint64_t offset) noexcept {
+        this->offset.store(std::max(offset, store->start.load(std::memory_order_acquire)), std::memory_order_relaxed);
+    }
+
+    std::uint64_t LogCursor::getLag() const noexcept {
+        auto end = store->end.load(std::memory_order_acquire);
+        auto off = std::max(offset.load(std::memory_order_relaxed), store->start.load(std::memory_order_acquire));
+        return end > off ? end - off : 0;
+    }
+
+    std::uint64_t LogCursor::getMissed() const noexcept {
+        return missed;
+    }
+
+    LogQueue::LogQueue(std::string name, LogRetention retention)
+            : Queue(std::move(name)), store(std::make_shared<LogStore>(retention)) {
+
+    }
+
+    std::unique_ptr<LogCursor> LogQueue::openCursor(LogStart start) {
+        std::unique_lock lock(store->mtx);
+        auto offset = start == LogStart::Earliest ? store->start.load(std::memory_order_relaxed)
+                                                  : store->end.load(std::memory_order_relaxed);
+        std::unique_ptr<LogCursor> cursor(new LogCursor(store, offset));
+        store->cursors.push_back(cursor.get());
+        return cursor;
+    }
+
+    LogCursor& LogQueue::sharedCursor() {
+        if (shared == nullptr) {
+            shared = openCursor(LogStart::Earliest);
+        }
+        return *shared;
+    }
+
+    bool LogQueue::tryReadShared(Envelope& msg) {
+        std::lock_guard lock(shared_mtx);
+        return sharedCursor().tryRead(msg);
+    }
+
+    void LogQueue::enqueue(Envelope msg) {
+        {
+            std::unique_lock lock(store->mtx);
+            store->append(std::move(msg));
+        }
+        store->parker.unparkAll();
+    }
+
+    void LogQueue::enqueueBulk(std::vector<Envelope>& msgs) {
+        {
+            std::unique_lock lock(store->mtx);
+            for (auto& msg : msgs) {
+                store->append(std::move(msg));
+            }
+        }
+        store->parker.unparkAll();
+    }
+
+    bool LogQueue::dequeue(Envelope& msg, bool block, int timeout_ms) {
+        bool got;
+        if (!block) {
+            got = tryReadShared(msg);
+        }
+        else {
+            auto try_read = [this, &msg]() { return tryReadShared(msg); };
+            got = waitWith(try_read, [this, &try_read](int timeout) { return store->parker.park(try_read, timeout); },
+                           timeout_ms);
+        }
+        if (got && empty()) {
+            safe_cond.notify_all();
+        }
+        return got;
+    }
+
+    std::size_t LogQueue::dequeueBulk(const Sink& sink, std::size_t max_n, bool block, int timeout_ms) {
+        if (max_n == 0) {
+            return 0;
+        }
+        std::size_t n = 0;
+        Envelope msg;
+        if (block) {
+            if (!dequeue(msg, true, timeout_ms)) {
+                return 0;
+            }
+            sink(std::move(msg));
+            ++n;
+        }
+        {
+            std::lock_guard lock(shared_mtx);
+            auto& cursor = sharedCursor();
+            while (n < max_n && cursor.tryRead(msg)) {
+                sink(std::move(msg));
+                ++n;
+            }
+        }
+        if (n != 0 && empty()) {
+            safe_cond.notify_all();
+        }
+        return n;
+    }
+
+    std::size_t LogQueue::size() const noexcept {
+        std::lock_guard lock(shared_mtx);
+        if (shared == nullptr) {
+            return getRetainedCount();
+        }
+        return shared->getLag();
+    }
+
+    bool LogQueue::empty() const noexcept {
+        return size() == 0;
+    }
+
+    void LogQueue::setOverflowPolicy(OverflowPolicy policy) {
+
+    }
+
+    QueueStats LogQueue::getStats() const noexcept {
+        auto ret = Queue::getStats();
+        ret.expired += store->expired.load(std::memory_order_relaxed);
+        return ret;
+    }
+
+    std::uint64_t LogQueue::getStartOffset() const noexcept {
+        return store->start.load(std::memory_order_acquire);
+    }
+
+    std::uint64_t LogQueue::getEndOffset() const noexcept {
+        return store->end.load(std::memory_order_acquire);
+    }
+
+    std::size_t LogQueue::getRetainedCount() const noexcept {
+        return getEndOffset() - getStartOffset();
+    }
+
+    std::shared_ptr<LogQueue> makeLogQueue(const std::string& name, LogRetention retention) {
+        return std::make_shared<LogQueue>(name, retention);
+    }
+}
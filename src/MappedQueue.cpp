@@ -0,0 +1,286 @@
+/**
+ * @file MappedQueue.cpp
+ * @author ayano
+ * @date 2/18/24
+ * @brief
+*/
+
+#include "MappedQueue.h"
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+namespace KawaiiMQ {
+
+    namespace {
+        constexpr std::uint64_t headerMagic = 0x4b61776169694d51ull;
+        // marks the end of a segment that had no room for the next record
+        constexpr std::uint32_t endOfSegment = 0xffffffffu;
+        constexpr std::size_t lengthSize = sizeof(std::uint32_t);
+
+        // records are [u32 size][bytes], padded so the next size field is 8 byte aligned
+        std::size_t recordSize(std::size_t size) {
+            return (lengthSize + size + 7) & ~std::size_t(7);
+        }
+
+        std::string segmentName(std::uint64_t index) {
+            char name[32];
+            std::snprintf(name, sizeof(name), "%020llu.seg", static_cast<unsigned long long>(index));
+            return name;
+        }
+
+        [[noreturn]] void fail(const std::string& what) {
+            throw QueueException("mapped queue: " + what + ": " + std::strerror(errno));
+        }
+
+        /**
+         * map a file read-write, creating and sizing it if asked to
+         */
+        char* mapFile(const std::filesystem::path& path, std::size_t size, bool create) {
+            int fd = ::open(path.c_str(), O_RDWR | O_CLOEXEC | (create ? O_CREAT : 0), 0644);
+            if (fd < 0) {
+                fail("cannot open " + path.string());
+            }
+            if (create && ::ftruncate(fd, static_cast<off_t>(size)) != 0) {
+                ::close(fd);
+                fail("cannot size " + path.string());
+            }
+            void* data = ::mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+            // the mapping keeps the file open
+            ::close(fd);
+            if (data == MAP_FAILED) {
+                fail("cannot map " + path.string());
+            }
+            return static_cast<char*>(data);
+        }
+    }
+
+    MappedQueue::Segment::Segment(std::filesystem::path path, std::size_t size, bool create)
+            : path(std::move(path)), size(size) {
+        data = mapFile(this->path, size, create);
+    }
+
+    MappedQueue::Segment::~Segment() {
+        ::munmap(data, size);
+    }
+
+    MappedQueue::MappedQueue(std::string name, const MappedOptions& options)
+            : Queue(name), directory(options.directory / name) {
+        std::error_code ec;
+        std::filesystem::create_directories(directory, ec);
+        if (ec) {
+            throw QueueException("mapped queue: cannot create " + directory.string() + ": " + ec.message());
+        }
+        auto header_path = directory / "header";
+        bool exists = std::filesystem::exists(header_path) && std::filesystem::file_size(header_path) >= sizeof(Header);
+        header = reinterpret_cast<Header*>(mapFile(header_path, sizeof(Header), !exists));
+        if (!exists || header->magic != headerMagic) {
+            if (options.segment_size < recordSize(0) + lengthSize) {
+                throw QueueException("mapped queue: segment size too small");
+            }
+            *header = Header{headerMagic, options.segment_size, 0, 0, 0, 0, 0, 0};
+        }
+        // a restart only maps the live segments again, the positions come from the header
+        for (auto i = header->read_segment; i < header->write_segment; ++i) {
+            segments.push_back(openSegment(i, false));
+        }
+        segments.push_back(openSegment(header->write_segment,
+                                       !std::filesystem::exists(directory / segmentName(header->write_segment))));
+        for (const auto& entry : std::filesystem::directory_iterator(directory)) {
+            if (entry.path().extension() == ".seg" && std::stoull(entry.path().stem().string()) < header->read_segment) {
+                std::filesystem::remove(entry.path(), ec);
+            }
+        }
+        setWaitStrategy(WaitStrategy::SpinPark, 16, 0);
+    }
+
+    MappedQueue::~MappedQueue() {
+        ::munmap(header, sizeof(Header));
+    }
+
+    std::shared_ptr<MappedQueue::Segment> MappedQueue::openSegment(std::uint64_t index, bool create) const {
+        return std::make_shared<Segment>(directory / segmentName(index), header->segment_size, create);
+    }
+
+    void MappedQueue::write(std::string_view bytes) {
+        auto need = recordSize(bytes.size());
+        if (need > header->segment_size) {
+            throw QueueException("mapped queue: message larger than a segment");
+        }
+        if (header->write_offset + need > header->segment_size) {
+            auto* end = segments.back()->data + header->write_offset;
+            if (header->write_offset + lengthSize <= header->segment_size) {
+                std::memcpy(end, &endOfSegment, lengthSize);
+            }
+            segments.push_back(openSegment(header->write_segment + 1, true));
+            ++header->write_segment;
+            header->write_offset = 0;
+        }
+        auto* at = segments.back()->data + header->write_offset;
+        auto size = static_cast<std::uint32_t>(bytes.size());
+        std::memcpy(at, &size, lengthSize);
+        std::memcpy(at + lengthSize, bytes.data(), bytes.size());
+        header->write_offset += need;
+        ++header->pushed;
+    }
+
+    bool MappedQueue::read(Envelope& msg) {
+        for (;;) {
+            if (header->pushed == header->popped) {
+                return false;
+            }
+            const auto& segment = segments.front();
+            std::uint32_t size = endOfSegment;
+            if (header->read_offset + lengthSize <= header->segment_size) {
+                std::memcpy(&size, segment->data + header->read_offset, lengthSize);
+            }
+            if (size == endOfSegment) {
+                // the file goes away now, the mapping stays until the last message pointing into it is gone
+                std::error_code ec;
+                std::filesystem::remove(segment->path, ec);
+                segments.pop_front();
+                ++header->read_segment;
+                header->read_offset = 0;
+                continue;
+            }
+            msg = Envelope(makeMessage(Bytes(std::string_view(segment->data + header->read_offset + lengthSize, size),
+                                             segment)));
+            header->read_offset += recordSize(size);
+            ++header->popped;
+            return true;
+        }
+    }
+
+    void MappedQueue::pushBytes(std::string_view bytes) {
+        {
+            std::lock_guard lock(mtx);
+            write(bytes);
+        }
+        parker.unpark();
+        metrics->counters.add(QueueMetrics::Enqueued);
+        signalWatchers();
+    }
+
+    void MappedQueue::enqueue(Envelope msg) {
+        std::string_view bytes;
+        if (auto ptr = msg.get<Bytes>()) {
+            bytes = ptr->view();
+        }
+        else if (auto str = msg.get<std::string>()) {
+            bytes = *str;
+        }
+        else {
+            throw TypeException("mapped queue only stores Bytes and std::string messages");
+        }
+        {
+            std::lock_guard lock(mtx);
+            write(bytes);
+        }
+        parker.unpark();
+    }
+
+    void MappedQueue::enqueueBulk(std::vector<Envelope>& msgs) {
+        {
+            std::lock_guard lock(mtx);
+            for (const auto& msg : msgs) {
+                if (auto ptr = msg.get<Bytes>()) {
+                    write(ptr->view());
+                }
+                else if (auto str = msg.get<std::string>()) {
+                    write(*str);
+                }
+                else {
+                    throw TypeException("mapped queue only stores Bytes and std::string messages");
+                }
+            }
+        }
+        parker.unparkAll();
+    }
+
+    bool MappedQueue::tryPop(Envelope& msg) {
+        std::lock_guard lock(mtx);
+        return read(msg);
+    }
+
+    bool MappedQueue::popBlocking(Envelope& msg, int timeout_ms) {
+        auto try_pop = [this, &msg]() { return tryPop(msg); };
+        return waitWith(try_pop, [this, &try_pop](int timeout) { return parker.park(try_pop, timeout); }, timeout_ms);
+    }
+
+    bool MappedQueue::dequeue(Envelope& msg, bool block, int timeout_ms) {
+        if (!(block ? popBlocking(msg, timeout_ms) : tryPop(msg))) {
+            return false;
+        }
+        popped();
+        return true;
+    }
+
+    std::size_t MappedQueue::dequeueBulk(const Sink& sink, std::size_t max_n, bool block, int timeout_ms) {
+        if (max_n == 0) {
+            return 0;
+        }
+        std::size_t n = 0;
+        Envelope msg;
+        if (block) {
+            if (!popBlocking(msg, timeout_ms)) {
+                return 0;
+            }
+            sink(std::move(msg));
+            ++n;
+        }
+        {
+            std::lock_guard lock(mtx);
+            while (n < max_n && read(msg)) {
+                sink(std::move(msg));
+                ++n;
+            }
+        }
+        if (n != 0) {
+            popped();
+        }
+        return n;
+    }
+
+    void MappedQueue::popped() {
+        if (empty()) {
+            safe_cond.notify_all();
+        }
+    }
+
+    std::size_t MappedQueue::size() const noexcept {
+        std::lock_guard lock(mtx);
+        return header->pushed - header->popped;
+    }
+
+    bool MappedQueue::empty() const noexcept {
+        return size() == 0;
+    }
+
+    void MappedQueue::setOverflowPolicy(OverflowPolicy policy) {
+
+    }
+
+    void MappedQueue::sync() {
+        std::lock_guard lock(mtx);
+        for (const auto& segment : segments) {
+            if (::msync(segment->data, segment->size, MS_SYNC) != 0) {
+                fail("msync failed");
+            }
+        }
+        if (::msync(header, sizeof(Header), MS_SYNC) != 0) {
+            fail("msync failed");
+        }
+    }
+
+    std::size_t MappedQueue::getSegmentCount() const {
+        std::lock_guard lock(mtx);
+        return segments.size();
+    }
+
+    std::shared_ptr<MappedQueue> makeMappedQueue(const std::string& name, const MappedOptions& options) {
+        return std::make_shared<MappedQueue>(name, options);
+    }
+}
@@ -6,6 +6,8 @@
 */
 
 #include "MessageQueueManager.h"
+#include "DurableQueue.h"
+#include <unordered_set>
 
 namespace KawaiiMQ {
     std::shared_ptr<MessageQueueManager> MessageQueueManager::Instance() {
@@ -13,74 +15,213 @@ namespace KawaiiMQ {
         return instance;
     }
 
+    MessageQueueManager::~MessageQueueManager() {
+        for (auto& chunk : chunks) {
+            auto* c = chunk.load(std::memory_order_relaxed);
+            if (c == nullptr) {
+                continue;
+            }
+            for (auto& s : *c) {
+                delete s.load(std::memory_order_relaxed);
+            }
+            delete c;
+        }
+    }
+
+    const MessageQueueManager::Route *MessageQueueManager::load(const Topic &topic) const noexcept {
+        std::size_t index = topic.getId() >> chunkBits;
+        if (index >= chunkCount) {
+            return nullptr;
+        }
+        auto* chunk = chunks[index].load(std::memory_order_acquire);
+        if (chunk == nullptr) {
+            return nullptr;
+        }
+        return (*chunk)[topic.getId() & (chunkSize - 1)].load(std::memory_order_seq_cst);
+    }
+
+    std::atomic<const MessageQueueManager::Route *> &MessageQueueManager::slot(const Topic &topic) {
+        std::size_t index = topic.getId() >> chunkBits;
+        if (index >= chunkCount) {
+            throw TopicException("Too many topics to route " + topic.getName());
+        }
+        auto* chunk = chunks[index].load(std::memory_order_relaxed);
+        if (chunk == nullptr) {
+            chunk = new Chunk();
+            for (auto& s : *chunk) {
+                s.store(nullptr, std::memory_order_relaxed);
+            }
+            chunks[index].store(chunk, std::memory_order_release);
+        }
+        return (*chunk)[topic.getId() & (chunkSize - 1)];
+    }
+
+    void MessageQueueManager::publish(const Topic &topic, std::vector<std::shared_ptr<Queue>> queues, bool partitioned) {
+        auto& s = slot(topic);
+        auto* old = s.exchange(new Route{std::move(queues), partitioned}, std::memory_order_seq_cst);
+        Rcu::retire(old);
+    }
+
     void MessageQueueManager::relate(const Topic &topic, std::shared_ptr<Queue> queue) {
         std::lock_guard lock(mtx);
-        for (const auto& q : topic_map[topic]) {
-            if (q->getName() == queue->getName()) {
-                return;
+        auto* current = load(topic);
+        std::vector<std::shared_ptr<Queue>> queues;
+        if (current != nullptr) {
+            for (const auto& q : current->queues) {
+                if (q->getName() == queue->getName()) {
+                    return;
+                }
             }
+            queues.reserve(current->queues.size() + 1);
+            queues = current->queues;
+        }
+        queues.push_back(queue);
+        publish(topic, std::move(queues), current != nullptr && current->partitioned);
+        queue->onRelate(topic, true);
+    }
+
+    void MessageQueueManager::partition(const Topic &topic, const std::vector<std::shared_ptr<Queue>> &partitions) {
+        std::lock_guard lock(mtx);
+        if (partitions.empty()) {
+            throw TopicException("No partition given for topic " + topic.getName());
+        }
+        auto* current = load(topic);
+        if (current != nullptr && !current->queues.empty()) {
+            throw TopicException("Attempting to partition a topic already related to a queue! Topic: " + topic.getName());
         }
-        topic_map[topic].push_back(queue);
+        publish(topic, partitions, true);
+        for (const auto& queue : partitions) {
+            queue->onRelate(topic, true);
+        }
+    }
 
+    bool MessageQueueManager::isPartitioned(const Topic &topic) const {
+        return relatedQueues(topic).partitioned();
     }
 
 
     void MessageQueueManager::unrelate(const Topic &topic, std::shared_ptr<Queue> queue) {
         std::unique_lock lock(mtx);
         queue->getSafeCond().wait_for(lock, std::chrono::milliseconds(queue->getSafeTimeout()), [&queue](){return !queue->empty();});
-        bool find = false;
-        for (const auto& q : topic_map[topic]) {
-            if (q->getName() == queue->getName()) {
-                auto &queues = topic_map[topic];
-                auto it = std::find_if(
-                        queues.begin(), queues.end(),
-                        [&queue](const std::shared_ptr<Queue> &q) {
-                            return queue->getName() == q->getName();
-                        });
-                queues.erase(it);
-            }
+        auto* current = load(topic);
+        if (current == nullptr) {
+            return;
+        }
+        auto queues = current->queues;
+        auto it = std::find_if(
+                queues.begin(), queues.end(),
+                [&queue](const std::shared_ptr<Queue> &q) {
+                    return queue->getName() == q->getName();
+                });
+        if (it != queues.end()) {
+            auto removed = *it;
+            queues.erase(it);
+            publish(topic, std::move(queues), current->partitioned);
+            removed->onRelate(topic, false);
         }
     }
 
     std::vector<std::shared_ptr<Queue>> MessageQueueManager::getAllRelatedQueue(const Topic& topic) const {
-        std::shared_lock lock(mtx);
-        try {
-            return topic_map.at(topic);
-        }
-        catch (std::out_of_range& e) {
+        auto queues = relatedQueues(topic);
+        if (!queues.related()) {
             std::cerr << "Topic " + topic.getName() + " is not related to any queue";
             return std::vector<std::shared_ptr<Queue>>();
         }
+        return {queues.begin(), queues.end()};
+    }
+
+    MessageQueueManager::RelatedQueues MessageQueueManager::relatedQueues(const Topic &topic) const {
+        Rcu::ReadGuard guard;
+        return RelatedQueues(load(topic));
     }
 
     bool MessageQueueManager::isRelated(const Topic& topic, std::shared_ptr<Queue> queue) {
-        std::shared_lock lock(mtx);
-        auto& queues = topic_map[topic];
+        auto queues = relatedQueues(topic);
         return std::find_if(queues.begin(), queues.end(), [&queue](const std::shared_ptr<Queue>& q) {
             return q->getName() == queue->getName();
         }) != queues.end();
     }
 
     std::vector<Topic> MessageQueueManager::getRelatedTopic() const {
-        std::shared_lock lock(mtx);
+        Rcu::ReadGuard guard;
         std::vector<Topic> ret;
-        ret.reserve(related_topic.size());
-        for(const auto& i : related_topic) {
-            ret.push_back(i.second);
+        auto count = static_cast<std::uint32_t>(TopicRegistry::Instance()->size());
+        for (std::uint32_t i = 0; i < count; ++i) {
+            auto topic = Topic::fromId(i);
+            if (load(topic) != nullptr) {
+                ret.push_back(topic);
+            }
         }
         return ret;
     }
 
     bool MessageQueueManager::isRelatedAny(const Topic& topic){
-        std::shared_lock lock(mtx);
-        return topic_map.find(topic) != topic_map.end();
+        return relatedQueues(topic).related();
+    }
+
+    MetricsSnapshot MessageQueueManager::snapshotMetrics() const {
+        MetricsSnapshot ret;
+        std::unordered_set<const Queue*> seen;
+        for (const auto& topic : getRelatedTopic()) {
+            TopicSample sample;
+            sample.name = topic.getName();
+            // copied, the queues are locked while they are read and retired routes must not wait for that
+            std::vector<std::shared_ptr<Queue>> queues;
+            {
+                auto related = relatedQueues(topic);
+                queues.assign(related.begin(), related.end());
+                sample.partitioned = related.partitioned();
+            }
+            sample.queues = queues.size();
+            for (const auto& queue : queues) {
+                if (seen.insert(queue.get()).second) {
+                    ret.queues.push_back(queue->getMetrics());
+                    sample.depth += ret.queues.back().depth;
+                }
+                else {
+                    sample.depth += queue->size();
+                }
+            }
+            ret.topics.push_back(std::move(sample));
+        }
+        MetricsRegistry::Instance()->sampleClients(ret);
+        return ret;
+    }
+
+    std::string MessageQueueManager::exportPrometheus() const {
+        return toPrometheus(snapshotMetrics());
+    }
+
+    std::vector<std::shared_ptr<DurableQueue>> MessageQueueManager::recover(const DurableOptions& options) {
+        std::vector<std::shared_ptr<DurableQueue>> ret;
+        if (!std::filesystem::is_directory(options.directory)) {
+            return ret;
+        }
+        for (const auto& entry : std::filesystem::directory_iterator(options.directory)) {
+            if (!entry.is_directory()) {
+                continue;
+            }
+            auto queue = makeDurableQueue(entry.path().filename().string(), options);
+            for (const auto& name : queue->getStoredTopics()) {
+                relate(Topic(name), queue);
+            }
+            ret.push_back(std::move(queue));
+        }
+        return ret;
     }
 
 #ifdef TEST
     void MessageQueueManager::flush() {
         std::lock_guard lock(mtx);
-        topic_map.clear();
-        related_topic.clear();
+        for (auto& chunk : chunks) {
+            auto* c = chunk.load(std::memory_order_relaxed);
+            if (c == nullptr) {
+                continue;
+            }
+            for (auto& s : *c) {
+                Rcu::retire(s.exchange(nullptr, std::memory_order_seq_cst));
+            }
+        }
     }
 #endif
 }
@@ -0,0 +1,282 @@
+/**
+ * @file Metrics.cpp
+ * @author ayano
+ * @date 2/23/24
+ * @brief
+*/
+
+#include "Metrics.h"
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+
+namespace KawaiiMQ {
+
+    namespace {
+        // bit i is set while shard i is owned by a thread
+        std::atomic<std::uint64_t> owned_shards{0};
+
+        /**
+         * gives the shard of a thread back when the thread exits
+         */
+        struct ShardRelease {
+            unsigned shard = MetricShard::shardCount;
+
+            ~ShardRelease() {
+                if (shard != MetricShard::shardCount) {
+                    // the next owner continues from the counts left in the shard
+                    owned_shards.fetch_and(~(std::uint64_t(1) << shard), std::memory_order_release);
+                }
+            }
+        };
+
+        thread_local ShardRelease shard_release;
+    }
+
+    void MetricShard::acquire() noexcept {
+        auto owned = owned_shards.load(std::memory_order_relaxed);
+        for (;;) {
+            auto free = ~owned & ((std::uint64_t(1) << shardCount) - 1);
+            if (free == 0) {
+                index = shardCount;
+                return;
+            }
+            auto shard = static_cast<unsigned>(std::countr_zero(free));
+            if (owned_shards.compare_exchange_weak(owned, owned | (std::uint64_t(1) << shard),
+                                                   std::memory_order_acquire, std::memory_order_relaxed)) {
+                index = shard;
+                shard_release.shard = shard;
+                return;
+            }
+        }
+    }
+
+    std::uint64_t HistogramSnapshot::percentile(double q) const noexcept {
+        if (count == 0) {
+            return 0;
+        }
+        auto rank = static_cast<std::uint64_t>(std::ceil(std::clamp(q, 0.0, 1.0) * static_cast<double>(count)));
+        std::uint64_t seen = 0;
+        for (std::size_t i = 0; i < buckets.size(); ++i) {
+            seen += buckets[i];
+            if (seen >= std::max<std::uint64_t>(rank, 1)) {
+                return std::min(Histogram::upperBound(i), max);
+            }
+        }
+        return max;
+    }
+
+    double HistogramSnapshot::mean() const noexcept {
+        return count == 0 ? 0 : static_cast<double>(sum) / static_cast<double>(count);
+    }
+
+    HistogramSnapshot Histogram::snapshot() const {
+        HistogramSnapshot ret;
+        ret.buckets.resize(bucketCount);
+        for (std::size_t i = 0; i < bucketCount; ++i) {
+            ret.buckets[i] = buckets[i].load(std::memory_order_relaxed);
+            ret.count += ret.buckets[i];
+        }
+        // summed from the buckets, so the count always matches them
+        ret.sum = sum.load(std::memory_order_relaxed);
+        ret.max = max.load(std::memory_order_relaxed);
+        return ret;
+    }
+
+    std::shared_ptr<MetricsRegistry> MetricsRegistry::Instance() {
+        static std::shared_ptr<MetricsRegistry> instance(new MetricsRegistry());
+        return instance;
+    }
+
+    void MetricsRegistry::setSampleEvery(std::uint32_t every) noexcept {
+        sample_every.store(every, std::memory_order_relaxed);
+    }
+
+    std::uint32_t MetricsRegistry::getSampleEvery() const noexcept {
+        return sample_every.load(std::memory_order_relaxed);
+    }
+
+    std::shared_ptr<ProducerMetrics> MetricsRegistry::addProducer(const std::string& name) {
+        auto ret = std::make_shared<ProducerMetrics>();
+        ret->name = name;
+        std::lock_guard lock(mtx);
+        std::erase_if(producers, [](const auto& p) { return p.expired(); });
+        producers.push_back(ret);
+        return ret;
+    }
+
+    std::shared_ptr<ConsumerMetrics> MetricsRegistry::addConsumer(const std::string& name) {
+        auto ret = std::make_shared<ConsumerMetrics>();
+        ret->name = name;
+        std::lock_guard lock(mtx);
+        std::erase_if(consumers, [](const auto& c) { return c.expired(); });
+        consumers.push_back(ret);
+        return ret;
+    }
+
+    void MetricsRegistry::sampleClients(MetricsSnapshot& out) {
+        std::lock_guard lock(mtx);
+        for (const auto& weak : producers) {
+            if (auto p = weak.lock()) {
+                out.producers.push_back({p->name, p->counters.load(ProducerMetrics::Published),
+                                         p->fan_out.snapshot()});
+            }
+        }
+        for (const auto& weak : consumers) {
+            if (auto c = weak.lock()) {
+                out.consumers.push_back({c->name, c->counters.load(ConsumerMetrics::Fetched),
+                                         c->counters.load(ConsumerMetrics::Waits), c->wait.snapshot()});
+            }
+        }
+    }
+
+    namespace {
+        std::string label(const std::string& value) {
+            std::string ret;
+            ret.reserve(value.size());
+            for (char c : value) {
+                switch (c) {
+                    case '\\':
+                        ret += "\\\\";
+                        break;
+                    case '"':
+                        ret += "\\\"";
+                        break;
+                    case '\n':
+                        ret += "\\n";
+                        break;
+                    default:
+                        ret += c;
+                }
+            }
+            return ret;
+        }
+
+        std::string number(double value) {
+            char buf[32];
+            std::snprintf(buf, sizeof(buf), "%.9g", value);
+            return buf;
+        }
+
+        /**
+         * writes one metric family after another, each with its HELP and TYPE lines
+         */
+        class Writer {
+        public:
+            void family(const char* name, const char* type, const char* help) {
+                out += "# HELP ";
+                out += name;
+                out += ' ';
+                out += help;
+                out += "\n# TYPE ";
+                out += name;
+                out += ' ';
+                out += type;
+                out += '\n';
+            }
+
+            void sample(const char* name, const char* suffix, const char* key, const std::string& value,
+                        const char* extra, double v) {
+                out += name;
+                out += suffix;
+                out += '{';
+                out += key;
+                out += "=\"";
+                out += label(value);
+                out += '"';
+                out += extra;
+                out += "} ";
+                out += number(v);
+                out += '\n';
+            }
+
+            void summary(const char* name, const char* key, const std::string& value, const HistogramSnapshot& h,
+                         double scale) {
+                static constexpr std::pair<double, const char*> quantiles[] = {
+                        {0.5, ",quantile=\"0.5\""}, {0.9, ",quantile=\"0.9\""},
+                        {0.99, ",quantile=\"0.99\""}, {0.999, ",quantile=\"0.999\""}};
+                for (auto [q, extra] : quantiles) {
+                    sample(name, "", key, value, extra, static_cast<double>(h.percentile(q)) * scale);
+                }
+                sample(name, "_sum", key, value, "", static_cast<double>(h.sum) * scale);
+                sample(name, "_count", key, value, "", static_cast<double>(h.count));
+            }
+
+            std::string out;
+        };
+    }
+
+    std::string toPrometheus(const MetricsSnapshot& snapshot) {
+        constexpr double seconds = 1e-9;
+        Writer w;
+        auto counters = [&w](const char* name, const char* type, const char* help, const char* key,
+                             const auto& samples, auto field) {
+            if (samples.empty()) {
+                return;
+            }
+            w.family(name, type, help);
+            for (const auto& s : samples) {
+                w.sample(name, "", key, s.name, "", static_cast<double>(field(s)));
+            }
+        };
+        const auto& q = snapshot.queues;
+        counters("kawaiimq_queue_depth", "gauge", "Messages in the queue.", "queue", q,
+                 [](const QueueSample& s) { return s.depth; });
+        counters("kawaiimq_queue_capacity", "gauge", "Capacity of the queue, 0 if unbounded.", "queue", q,
+                 [](const QueueSample& s) { return s.capacity; });
+        counters("kawaiimq_queue_enqueued_total", "counter", "Messages pushed.", "queue", q,
+                 [](const QueueSample& s) { return s.enqueued; });
+        counters("kawaiimq_queue_dequeued_total", "counter", "Messages handed to consumers.", "queue", q,
+                 [](const QueueSample& s) { return s.dequeued; });
+        counters("kawaiimq_queue_contended_total", "counter", "Lock acquisitions that found the lock taken.", "queue",
+                 q, [](const QueueSample& s) { return s.contended; });
+        counters("kawaiimq_queue_waits_total", "counter", "Waits that blocked on an empty queue.", "queue", q,
+                 [](const QueueSample& s) { return s.waits; });
+        counters("kawaiimq_queue_dropped_total", "counter", "Messages dropped by the overflow policy.", "queue", q,
+                 [](const QueueSample& s) { return s.dropped; });
+        counters("kawaiimq_queue_rejected_total", "counter", "Pushes refused by the overflow policy.", "queue", q,
+                 [](const QueueSample& s) { return s.rejected; });
+        counters("kawaiimq_queue_blocked_total", "counter", "Pushes that waited for a free slot.", "queue", q,
+                 [](const QueueSample& s) { return s.blocked; });
+        counters("kawaiimq_queue_expired_total", "counter", "Messages discarded after their expiry.", "queue", q,
+                 [](const QueueSample& s) { return s.expired; });
+        if (!q.empty()) {
+            w.family("kawaiimq_queue_latency_seconds", "summary", "Push to pop time of sampled messages.");
+            for (const auto& s : q) {
+                w.summary("kawaiimq_queue_latency_seconds", "queue", s.name, s.latency, seconds);
+            }
+            w.family("kawaiimq_queue_wait_seconds", "summary", "Time consumers blocked on an empty queue.");
+            for (const auto& s : q) {
+                w.summary("kawaiimq_queue_wait_seconds", "queue", s.name, s.wait, seconds);
+            }
+        }
+        const auto& t = snapshot.topics;
+        counters("kawaiimq_topic_queues", "gauge", "Queues related to the topic.", "topic", t,
+                 [](const TopicSample& s) { return s.queues; });
+        counters("kawaiimq_topic_depth", "gauge", "Messages in the queues of the topic.", "topic", t,
+                 [](const TopicSample& s) { return s.depth; });
+        counters("kawaiimq_topic_partitioned", "gauge", "1 if the topic is partitioned.", "topic", t,
+                 [](const TopicSample& s) { return s.partitioned ? 1 : 0; });
+        const auto& p = snapshot.producers;
+        counters("kawaiimq_producer_published_total", "counter", "Messages published.", "producer", p,
+                 [](const ProducerSample& s) { return s.published; });
+        if (!p.empty()) {
+            w.family("kawaiimq_producer_fan_out", "summary", "Queues a publish pushed into.");
+            for (const auto& s : p) {
+                w.summary("kawaiimq_producer_fan_out", "producer", s.name, s.fan_out, 1);
+            }
+        }
+        const auto& c = snapshot.consumers;
+        counters("kawaiimq_consumer_fetched_total", "counter", "Messages fetched.", "consumer", c,
+                 [](const ConsumerSample& s) { return s.fetched; });
+        counters("kawaiimq_consumer_waits_total", "counter", "Fetches that blocked.", "consumer", c,
+                 [](const ConsumerSample& s) { return s.waits; });
+        if (!c.empty()) {
+            w.family("kawaiimq_consumer_wait_seconds", "summary", "Time fetches blocked.");
+            for (const auto& s : c) {
+                w.summary("kawaiimq_consumer_wait_seconds", "consumer", s.name, s.wait, seconds);
+            }
+        }
+        return std::move(w.out);
+    }
+}
@@ -0,0 +1,231 @@
+/**
+ * @file PriorityQueue.cpp
+ * @author ayano
+ * @date 2/22/24
+ * @brief
+*/
+
+#include "PriorityQueue.h"
+#include <algorithm>
+#include <bit>
+#include <numeric>
+#include <thread>
+
+namespace KawaiiMQ {
+
+    PriorityQueue::PriorityQueue(std::string name, PriorityOptions options)
+            : Queue(std::move(name)), scheduling(options.scheduling) {
+        if (options.lanes == 0 || options.lanes > 64) {
+            throw QueueException("a priority queue has 1 to 64 lanes");
+        }
+        auto& weights = options.weights;
+        if (weights.empty()) {
+            for (std::size_t i = 0; i < options.lanes; ++i) {
+                weights.push_back(static_cast<std::uint32_t>(i + 1));
+            }
+        }
+        if (weights.size() != options.lanes || std::find(weights.begin(), weights.end(), 0) != weights.end()) {
+            throw QueueException("every lane needs a non-zero weight");
+        }
+        auto total = std::accumulate(weights.begin(), weights.end(), std::uint64_t(0));
+        if (total > 65536) {
+            throw QueueException("lane weights add up to more than 65536");
+        }
+        for (std::size_t i = 0; i < options.lanes; ++i) {
+            lanes.push_back(std::make_unique<MpmcRing<Envelope>>(options.lane_capacity));
+        }
+        // smooth weighted round robin, spreads the turns of every lane over the table instead of bunching them
+        std::vector<std::int64_t> credit(options.lanes, 0);
+        turns.reserve(total);
+        for (std::uint64_t t = 0; t < total; ++t) {
+            std::size_t best = 0;
+            for (std::size_t i = 0; i < options.lanes; ++i) {
+                credit[i] += weights[i];
+                if (credit[i] > credit[best]) {
+                    best = i;
+                }
+            }
+            credit[best] -= static_cast<std::int64_t>(total);
+            turns.push_back(static_cast<std::uint8_t>(best));
+        }
+        setWaitStrategy(WaitStrategy::SpinPark, 16, 0);
+    }
+
+    std::size_t PriorityQueue::getLaneCount() const noexcept {
+        return lanes.size();
+    }
+
+    std::size_t PriorityQueue::getLaneSize(unsigned priority) const noexcept {
+        return priority < lanes.size() ? lanes[priority]->sizeApprox() : 0;
+    }
+
+    std::size_t PriorityQueue::size() const noexcept {
+        std::size_t ret = 0;
+        for (const auto& lane : lanes) {
+            ret += lane->sizeApprox();
+        }
+        return ret;
+    }
+
+    bool PriorityQueue::empty() const noexcept {
+        return std::all_of(lanes.begin(), lanes.end(), [](const auto& lane) { return lane->sizeApprox() == 0; });
+    }
+
+    std::size_t PriorityQueue::getCapacity() const noexcept {
+        return lanes.size() * lanes[0]->capacity();
+    }
+
+    bool PriorityQueue::overflow(Envelope& msg, std::size_t lane) {
+        auto& ring = *lanes[lane];
+        switch (policy.load(std::memory_order_relaxed)) {
+            case OverflowPolicy::Fail:
+                rejected.fetch_add(1, std::memory_order_relaxed);
+                parker.unparkAll();
+                throw QueueException("queue is full");
+            case OverflowPolicy::DropNewest:
+                dropped.fetch_add(1, std::memory_order_relaxed);
+                return false;
+            case OverflowPolicy::DropOldest: {
+                Envelope oldest;
+                do {
+                    // a consumer may have taken the oldest message first, then the push simply succeeds
+                    if (ring.tryPop(oldest)) {
+                        dropped.fetch_add(1, std::memory_order_relaxed);
+                    }
+                } while (!ring.tryPush(std::move(msg)));
+                return true;
+            }
+            case OverflowPolicy::Block:
+            default:
+                break;
+        }
+        if (refuseToWait()) {
+            parker.unparkAll();
+            return false;
+        }
+        auto start = std::chrono::steady_clock::now();
+        int timeout = push_timeout_ms.load(std::memory_order_relaxed);
+        auto deadline = start + std::chrono::milliseconds(timeout);
+        while (!ring.tryPush(std::move(msg))) {
+            // wake consumers up for what is already in, otherwise a full lane never drains
+            parker.unparkAll();
+            if (timeout != 0 && std::chrono::steady_clock::now() >= deadline) {
+                countBlocked(std::chrono::steady_clock::now() - start);
+                rejected.fetch_add(1, std::memory_order_relaxed);
+                throw QueueException("queue push timeout");
+            }
+            std::this_thread::yield();
+        }
+        countBlocked(std::chrono::steady_clock::now() - start);
+        return true;
+    }
+
+    bool PriorityQueue::store(Envelope& msg, std::size_t lane) {
+        if (!lanes[lane]->tryPush(std::move(msg)) && !overflow(msg, lane)) {
+            return false;
+        }
+        auto bit = std::uint64_t(1) << lane;
+        // pairs with the fence in tryPop(): either the consumer clearing the bit sees this message, or we see the
+        // bit cleared and set it again. most pushes find it set and leave the shared line alone
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        if ((non_empty.load(std::memory_order_relaxed) & bit) == 0) {
+            non_empty.fetch_or(bit, std::memory_order_release);
+        }
+        return true;
+    }
+
+    void PriorityQueue::enqueue(Envelope msg) {
+        if (store(msg, 0)) {
+            parker.unpark();
+        }
+    }
+
+    void PriorityQueue::enqueueWithPriority(Envelope msg, unsigned priority) {
+        if (store(msg, std::min<std::size_t>(priority, lanes.size() - 1))) {
+            parker.unpark();
+        }
+    }
+
+    void PriorityQueue::enqueueBulk(std::vector<Envelope>& msgs) {
+        for (auto& msg : msgs) {
+            store(msg, 0);
+        }
+        parker.unparkAll();
+    }
+
+    std::size_t PriorityQueue::pick(std::uint64_t mask) noexcept {
+        auto highest = static_cast<std::size_t>(std::bit_width(mask) - 1);
+        if (scheduling == LaneScheduling::Strict) {
+            return highest;
+        }
+        auto lane = turns[turn.fetch_add(1, std::memory_order_relaxed) % turns.size()];
+        return (mask >> lane) & 1 ? lane : highest;
+    }
+
+    bool PriorityQueue::tryPop(Envelope& msg) {
+        std::uint64_t tried = 0;
+        std::uint64_t mask;
+        while ((mask = non_empty.load(std::memory_order_acquire) & ~tried) != 0) {
+            auto lane = pick(mask);
+            if (lanes[lane]->tryPop(msg)) {
+                return true;
+            }
+            // drained by another consumer. clear the bit unless a producer refilled the lane meanwhile
+            auto bit = std::uint64_t(1) << lane;
+            non_empty.fetch_and(~bit, std::memory_order_relaxed);
+            std::atomic_thread_fence(std::memory_order_seq_cst);
+            if (lanes[lane]->sizeApprox() != 0) {
+                non_empty.fetch_or(bit, std::memory_order_release);
+            }
+            tried |= bit;
+        }
+        return false;
+    }
+
+    bool PriorityQueue::popBlocking(Envelope& msg, int timeout_ms) {
+        auto try_pop = [this, &msg]() { return tryPop(msg); };
+        return waitWith(try_pop, [this, &try_pop](int timeout) { return parker.park(try_pop, timeout); }, timeout_ms);
+    }
+
+    bool PriorityQueue::dequeue(Envelope& msg, bool block, int timeout_ms) {
+        if (!(block ? popBlocking(msg, timeout_ms) : tryPop(msg))) {
+            return false;
+        }
+        popped();
+        return true;
+    }
+
+    std::size_t PriorityQueue::dequeueBulk(const Sink& sink, std::size_t max_n, bool block, int timeout_ms) {
+        if (max_n == 0) {
+            return 0;
+        }
+        std::size_t n = 0;
+        Envelope msg;
+        if (block) {
+            if (!popBlocking(msg, timeout_ms)) {
+                return 0;
+            }
+            sink(std::move(msg));
+            ++n;
+        }
+        // every message takes its own turn, a drain gets the same mix of lanes as single pops
+        while (n < max_n && tryPop(msg)) {
+            sink(std::move(msg));
+            ++n;
+        }
+        if (n != 0) {
+            popped();
+        }
+        return n;
+    }
+
+    void PriorityQueue::popped() {
+        if (empty()) {
+            safe_cond.notify_all();
+        }
+    }
+
+    std::shared_ptr<PriorityQueue> makePriorityQueue(const std::string& name, PriorityOptions options) {
+        return std::make_shared<PriorityQueue>(name, std::move(options));
+    }
+}
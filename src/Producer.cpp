@@ -15,11 +15,10 @@ namespace KawaiiMQ {
      */
     void Producer::subscribe(const Topic& topic) {
         std::lock_guard lock(mtx);
-        auto manager = MessageQueueManager::Instance();
         if(!manager->isRelatedAny(topic)) {
             throw TopicException("topic not related to any queue");
         }
-        if (std::find(subscribed.begin(), subscribed.end(), topic) != subscribed.end()) {
+        if (!subscribed_set.insert(topic)) {
             throw TopicException("topic already subscribed");
         }
         subscribed.push_back(topic);
@@ -31,14 +30,103 @@ namespace KawaiiMQ {
      */
     void Producer::unsubscribe(const Topic& topic) {
         std::lock_guard lock(mtx);
-        if (std::find(subscribed.begin(), subscribed.end(),topic) == subscribed.end()) {
+        if (!subscribed_set.erase(topic)) {
             throw TopicException("topic not subscribed");
         }
         subscribed.erase(std::remove(subscribed.begin(), subscribed.end(), topic));
     }
 
-    Producer::Producer(const std::string &name) {
-        this->name = name;
+    Producer::Producer(const std::string &name) : name(name) {
+
+    }
+
+    Producer::Producer(std::vector<Topic> topics, const std::string &name) : subscribed(std::move(topics)), name(name) {
+        for (const auto& topic : subscribed) {
+            subscribed_set.insert(topic);
+        }
+    }
+
+    void Producer::fanOut(const MessageQueueManager::RelatedQueues &queues, Envelope msg) {
+        std::size_t n = queues.size();
+        for (std::size_t i = 0; i + 1 < n; ++i) {
+            queues[i]->push(msg);
+        }
+        if (n != 0) {
+            queues[n - 1]->push(std::move(msg));
+        }
+    }
+
+    void Producer::deliver(const MessageQueueManager::RelatedQueues &queues, Envelope msg,
+                           std::optional<std::size_t> key_hash) {
+        stamp(msg);
+        if (Tracer::enabled()) [[unlikely]] {
+            tracePublish(msg);
+        }
+        if (!queues.partitioned() || queues.empty()) {
+            count(1, queues.size());
+            fanOut(queues, std::move(msg));
+            return;
+        }
+        count(1, 1);
+        auto partition = key_hash ? *key_hash % queues.size() : nextPartition(queues.size());
+        queues[partition]->push(std::move(msg));
+    }
+
+    void Producer::schedule(const MessageQueueManager::RelatedQueues &queues, Envelope msg,
+                            Scheduler::Clock::time_point when) {
+        stamp(msg);
+        if (Tracer::enabled()) [[unlikely]] {
+            tracePublish(msg);
+        }
+        auto scheduler = Scheduler::Instance();
+        count(1, queues.partitioned() && !queues.empty() ? 1 : queues.size());
+        if (queues.partitioned() && !queues.empty()) {
+            scheduler->pushAt(queues[nextPartition(queues.size())], std::move(msg), when);
+            return;
+        }
+        // one timer per queue, the payload is shared
+        for (const auto& queue : queues) {
+            scheduler->pushAt(queue, msg, when);
+        }
+    }
+
+    void Producer::stamp(Envelope &msg) const noexcept {
+        if (ttl.count() != 0) {
+            msg.setExpiry(std::chrono::steady_clock::now() + ttl);
+        }
+    }
+
+    void Producer::count(std::size_t messages, std::size_t width) noexcept {
+        metrics->counters.add(ProducerMetrics::Published, messages);
+        if (MetricsRegistry::samplePublish()) [[unlikely]] {
+            metrics->fan_out.record(width);
+        }
+    }
+
+    void Producer::tracePublish(const Envelope &msg) const noexcept {
+        auto data = msg.getMessageData();
+        if (data == nullptr) {
+            return;
+        }
+        if (auto id = data->trace()) {
+            Tracer::record(TracePoint::Publish, id, name);
+        }
+    }
+
+    ProducerSample Producer::getMetrics() const {
+        return {name, metrics->counters.load(ProducerMetrics::Published), metrics->fan_out.snapshot()};
+    }
+
+    void Producer::setTimeToLive(std::chrono::milliseconds ttl) noexcept {
+        this->ttl = ttl;
+    }
+
+    std::chrono::milliseconds Producer::getTimeToLive() const noexcept {
+        return ttl;
+    }
+
+    std::size_t Producer::nextPartition(std::size_t partitions) noexcept {
+        return next_partition.fetch_add(1, std::memory_order_relaxed) % partitions;
     }
 
     std::vector<Topic> Producer::getSubscribedTopics() const {
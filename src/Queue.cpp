@@ -6,6 +6,10 @@
 */
 
 #include "Queue.h"
+#include "RingQueue.h"
+#include "SpscQueue.h"
+#include "PriorityQueue.h"
+#include <algorithm>
 
 namespace KawaiiMQ {
 
@@ -13,6 +17,11 @@ namespace KawaiiMQ {
 
     }
 
+    Queue::Queue(std::string name, std::size_t capacity, OverflowPolicy policy)
+            : policy(policy), name(std::move(name)), capacity(capacity) {
+
+    }
+
 
     std::size_t Queue::size() const noexcept {
         mtxshared lock(mtx);
@@ -24,11 +33,14 @@ namespace KawaiiMQ {
         return queue.empty();
     }
 
-    Queue::Queue(const Queue &other): queue(other.queue), name(other.name) {
+    Queue::Queue(const Queue &other): policy(other.getOverflowPolicy()), queue(other.queue), name(other.name),
+                                      capacity(other.capacity) {
+        queued.store(queue.size(), std::memory_order_relaxed);
     }
 
-    Queue::Queue(Queue &&other) noexcept: queue(std::move(other.queue)), name(std::move(other.name)) {
-
+    Queue::Queue(Queue &&other) noexcept: policy(other.getOverflowPolicy()), queue(std::move(other.queue)),
+                                          name(std::move(other.name)), capacity(other.capacity) {
+        queued.store(queue.size(), std::memory_order_relaxed);
     }
 
     bool Queue::operator==(const Queue &other) {
@@ -42,6 +54,9 @@ namespace KawaiiMQ {
         if(this != &other) {
             name = other.name;
             queue = other.queue;
+            queued.store(queue.size(), std::memory_order_relaxed);
+            capacity = other.capacity;
+            policy = other.getOverflowPolicy();
         }
         return *this;
     }
@@ -51,6 +66,9 @@ namespace KawaiiMQ {
         if(this != &other) {
             name = std::move(other.name);
             queue = std::move(other.queue);
+            queued.store(queue.size(), std::memory_order_relaxed);
+            capacity = other.capacity;
+            policy = other.getOverflowPolicy();
         }
         return *this;
     }
@@ -65,6 +83,72 @@ namespace KawaiiMQ {
         return timeout_ms;
     }
 
+    std::size_t Queue::getCapacity() const noexcept {
+        mtxshared lock(mtx);
+        return capacity;
+    }
+
+    void Queue::setOverflowPolicy(OverflowPolicy policy) {
+        this->policy.store(policy, std::memory_order_relaxed);
+    }
+
+    OverflowPolicy Queue::getOverflowPolicy() const noexcept {
+        return policy.load(std::memory_order_relaxed);
+    }
+
+    void Queue::setPushTimeout(int timeout_ms) noexcept {
+        push_timeout_ms.store(timeout_ms, std::memory_order_relaxed);
+    }
+
+    int Queue::getPushTimeout() const noexcept {
+        return push_timeout_ms.load(std::memory_order_relaxed);
+    }
+
+    void Queue::setWaitStrategy(WaitStrategy strategy, int spin_limit, int yield_limit) noexcept {
+        this->spin_limit.store(spin_limit, std::memory_order_relaxed);
+        this->yield_limit.store(yield_limit, std::memory_order_relaxed);
+        wait_strategy.store(strategy, std::memory_order_relaxed);
+    }
+
+    WaitStrategy Queue::getWaitStrategy() const noexcept {
+        return wait_strategy.load(std::memory_order_relaxed);
+    }
+
+    QueueStats Queue::getStats() const noexcept {
+        QueueStats ret;
+        ret.dropped = dropped.load(std::memory_order_relaxed);
+        ret.rejected = rejected.load(std::memory_order_relaxed);
+        ret.blocked = blocked.load(std::memory_order_relaxed);
+        ret.blocked_time = std::chrono::nanoseconds(blocked_ns.load(std::memory_order_relaxed));
+        ret.expired = expired.load(std::memory_order_relaxed);
+        return ret;
+    }
+
+    QueueSample Queue::getMetrics() const {
+        QueueSample ret;
+        ret.name = getName();
+        ret.depth = size();
+        ret.capacity = getCapacity();
+        ret.enqueued = metrics->counters.load(QueueMetrics::Enqueued);
+        ret.dequeued = metrics->counters.load(QueueMetrics::Dequeued);
+        ret.contended = metrics->counters.load(QueueMetrics::Contended);
+        ret.waits = metrics->counters.load(QueueMetrics::Waits);
+        auto stats = getStats();
+        ret.dropped = stats.dropped;
+        ret.rejected = stats.rejected;
+        ret.blocked = stats.blocked;
+        ret.expired = stats.expired;
+        ret.latency = metrics->latency.snapshot();
+        ret.wait = metrics->wait.snapshot();
+        return ret;
+    }
+
+    void Queue::countBlocked(std::chrono::steady_clock::duration waited) noexcept {
+        blocked.fetch_add(1, std::memory_order_relaxed);
+        blocked_ns.fetch_add(std::chrono::duration_cast<std::chrono::nanoseconds>(waited).count(),
+                             std::memory_order_relaxed);
+    }
+
     void Queue::setSafeTimeout(int timeout_ms) noexcept {
         mtxsharedguard lock(mtx);
         this->safe_timeout_ms = timeout_ms;
@@ -80,47 +164,466 @@ namespace KawaiiMQ {
         return safe_cond;
     }
 
-    std::shared_ptr<MessageData> Queue::wait() {
-        std::unique_lock lock(mtx);
-        if (timeout_ms == 0) {
-            cond.wait(lock, [this](){return !queue.empty();});
+    void Queue::push(Envelope msg) {
+        stampSampled(msg);
+        if (Tracer::enabled()) [[unlikely]] {
+            tracePush(msg);
         }
-        else {
-            cond.wait_for(lock, std::chrono::milliseconds(timeout_ms), [this](){return !queue.empty();});
-            if(queue.empty()) {
-                throw QueueException("queue fetch timeout");
+        enqueue(std::move(msg));
+        metrics->counters.add(QueueMetrics::Enqueued);
+        signalWatchers();
+    }
+
+    bool Queue::tryPush(Envelope& msg) {
+        // enqueue takes the message over, msg has to stay with the caller if the queue refuses to wait
+        Envelope copy(msg);
+        stampSampled(copy);
+        no_wait = {true, false};
+        try {
+            enqueue(std::move(copy));
+        }
+        catch (...) {
+            no_wait.active = false;
+            throw;
+        }
+        no_wait.active = false;
+        if (no_wait.refused) {
+            return false;
+        }
+        if (Tracer::enabled()) [[unlikely]] {
+            tracePush(msg);
+        }
+        msg = Envelope();
+        metrics->counters.add(QueueMetrics::Enqueued);
+        signalWatchers();
+        return true;
+    }
+
+    void Queue::push(Envelope msg, unsigned priority) {
+        stampSampled(msg);
+        if (Tracer::enabled()) [[unlikely]] {
+            tracePush(msg);
+        }
+        enqueueWithPriority(std::move(msg), priority);
+        metrics->counters.add(QueueMetrics::Enqueued);
+        signalWatchers();
+    }
+
+    void Queue::watch(QueueWatcher *watcher) {
+        {
+            std::lock_guard lock(watch_mtx);
+            watchers.push_back(watcher);
+            watcher_count.store(watchers.size(), std::memory_order_relaxed);
+        }
+        // pairs with the fence in signalWatchers(), the caller checks the queue after this returns
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+    }
+
+    void Queue::unwatch(QueueWatcher *watcher) {
+        std::lock_guard lock(watch_mtx);
+        auto it = std::find(watchers.begin(), watchers.end(), watcher);
+        if (it != watchers.end()) {
+            watchers.erase(it);
+        }
+        watcher_count.store(watchers.size(), std::memory_order_relaxed);
+    }
+
+    QueueAwaiter Queue::asyncWait(Executor executor) {
+        return {*this, std::move(executor)};
+    }
+
+    void Queue::addAwaiter(AsyncWaiter *waiter) {
+        {
+            std::lock_guard lock(awaiter_mtx);
+            awaiters.push_back(waiter);
+            awaiter_count.store(awaiters.size(), std::memory_order_relaxed);
+        }
+        // pairs with the fence in signalWatchers()
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+    }
+
+    void Queue::removeAwaiter(AsyncWaiter *waiter) {
+        std::lock_guard lock(awaiter_mtx);
+        auto it = std::find(awaiters.begin(), awaiters.end(), waiter);
+        if (it != awaiters.end()) {
+            awaiters.erase(it);
+            awaiter_count.store(awaiters.size(), std::memory_order_relaxed);
+        }
+    }
+
+    void Queue::resumeAwaiters() noexcept {
+        std::vector<std::pair<std::coroutine_handle<>, Executor>> ready;
+        {
+            std::lock_guard lock(awaiter_mtx);
+            while (!awaiters.empty()) {
+                auto waiter = awaiters.front();
+                auto offer = waiter->offer(*this);
+                if (offer == AsyncWaiter::Offer::Empty) {
+                    break;
+                }
+                awaiters.pop_front();
+                if (offer == AsyncWaiter::Offer::Resume) {
+                    // nobody else touches the waiter until its coroutine resumes, so the executor can be taken
+                    ready.emplace_back(waiter->handle, std::move(waiter->executor));
+                }
             }
+            awaiter_count.store(awaiters.size(), std::memory_order_relaxed);
         }
-        auto ret = queue.front();
-        queue.pop();
-        if (queue.empty()) {
-            safe_cond.notify_all();
+        // resumed outside the lock, the coroutine may run inline and wait on this queue again
+        for (auto& [handle, executor] : ready) {
+            executor(handle);
         }
-        return ret;
+    }
+
+    void Queue::wakeWatchers() noexcept {
+        std::lock_guard lock(watch_mtx);
+        for (auto watcher : watchers) {
+            watcher->notify();
+        }
+    }
+
+    std::shared_ptr<MessageData> Queue::wait() {
+        return waitValue().toShared();
     }
 
     bool Queue::tryWait(std::shared_ptr<MessageData>& msg) {
-        std::unique_lock lock(mtx);
-        if(queue.empty()) {
+        Envelope env;
+        if (!popLive(env, false, 0)) {
+            return false;
+        }
+        msg = std::move(env).toShared();
+        return true;
+    }
+
+    Envelope Queue::waitValue() {
+        Envelope env;
+        if (!popLive(env, true, timeout_ms.load(std::memory_order_relaxed))) {
+            throw QueueException("queue fetch timeout");
+        }
+        return env;
+    }
+
+    bool Queue::tryWaitValue(Envelope& msg) {
+        return popLive(msg, false, 0);
+    }
+
+    std::size_t Queue::drain(std::vector<std::shared_ptr<MessageData>>& out, std::size_t max_n) {
+        auto put = [&out](Envelope&& msg) { out.push_back(std::move(msg).toShared()); };
+        return drainLive(put, max_n, false, 0);
+    }
+
+    std::size_t Queue::drain(std::vector<Envelope>& out, std::size_t max_n) {
+        auto put = [&out](Envelope&& msg) { out.push_back(std::move(msg)); };
+        return drainLive(put, max_n, false, 0);
+    }
+
+    std::size_t Queue::drain(std::vector<std::shared_ptr<MessageData>>& out, std::size_t max_n, int timeout_ms) {
+        auto put = [&out](Envelope&& msg) { out.push_back(std::move(msg).toShared()); };
+        return drainLive(put, max_n, true, timeout_ms);
+    }
+
+    std::size_t Queue::drain(std::vector<Envelope>& out, std::size_t max_n, int timeout_ms) {
+        auto put = [&out](Envelope&& msg) { out.push_back(std::move(msg)); };
+        return drainLive(put, max_n, true, timeout_ms);
+    }
+
+    bool Queue::discard(const Envelope& msg, std::chrono::steady_clock::time_point& now) noexcept {
+        if (!msg.expires()) {
+            return false;
+        }
+        if (now == std::chrono::steady_clock::time_point()) {
+            now = std::chrono::steady_clock::now();
+        }
+        if (msg.getExpiry() > now) {
             return false;
         }
+        expired.fetch_add(1, std::memory_order_relaxed);
+        return true;
+    }
+
+    /**
+     * time left until a deadline, for a wait that goes on after discarding expired messages
+     * @return milliseconds left, rounded up. 0 if the deadline passed
+     */
+    static int timeLeft(std::chrono::steady_clock::time_point deadline) noexcept {
+        auto left = std::chrono::ceil<std::chrono::milliseconds>(deadline - std::chrono::steady_clock::now());
+        return left.count() > 0 ? static_cast<int>(left.count()) : 0;
+    }
+
+    bool Queue::popLive(Envelope& msg, bool block, int timeout_ms) {
+        std::uint64_t parked = 0;
+        if (block) {
+            // only a wait that finds the queue empty is timed
+            if (popLive(msg, false, 0)) {
+                return true;
+            }
+            parked = metricsNow();
+        }
+        auto deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(timeout_ms);
+        bool got;
+        for (;;) {
+            if (!dequeue(msg, block, timeout_ms)) {
+                got = false;
+                break;
+            }
+            std::chrono::steady_clock::time_point now;
+            if (!discard(msg, now)) {
+                got = true;
+                break;
+            }
+            if (block && timeout_ms != 0 && (timeout_ms = timeLeft(deadline)) == 0) {
+                block = false;
+            }
+        }
+        if (parked != 0) {
+            metrics->wait.record(metricsNow() - parked);
+            metrics->counters.add(QueueMetrics::Waits);
+        }
+        if (got) {
+            metrics->counters.add(QueueMetrics::Dequeued);
+            recordLatency(msg);
+            if (Tracer::enabled()) [[unlikely]] {
+                tracePop(msg);
+            }
+        }
+        return got;
+    }
+
+    template<typename Put>
+    std::size_t Queue::drainLive(Put& put, std::size_t max_n, bool block, int timeout_ms) {
+        std::uint64_t parked = 0;
+        if (block && max_n != 0) {
+            if (auto n = drainLive(put, max_n, false, 0); n != 0) {
+                return n;
+            }
+            parked = metricsNow();
+        }
+        auto deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(timeout_ms);
+        std::size_t n = 0;
+        std::chrono::steady_clock::time_point now;
+        auto live = [this, &put, &n, &now](Envelope&& msg) {
+            if (!discard(msg, now)) {
+                recordLatency(msg);
+                if (Tracer::enabled()) [[unlikely]] {
+                    tracePop(msg);
+                }
+                put(std::move(msg));
+                ++n;
+            }
+        };
+        while (n < max_n) {
+            auto want = max_n - n;
+            auto popped = dequeueBulk(live, want, block && n == 0, timeout_ms);
+            // a short pop means the queue ran dry. only a wait that got nothing but expired messages goes on
+            if (popped == 0 || (popped < want && (n != 0 || !block))) {
+                break;
+            }
+            if (n == 0 && timeout_ms != 0 && (timeout_ms = timeLeft(deadline)) == 0) {
+                block = false;
+            }
+            now = {};
+        }
+        if (parked != 0) {
+            metrics->wait.record(metricsNow() - parked);
+            metrics->counters.add(QueueMetrics::Waits);
+        }
+        metrics->counters.add(QueueMetrics::Dequeued, n);
+        return n;
+    }
+
+    bool Queue::admit(std::unique_lock<std::shared_mutex>& lock) {
+        if (capacity == 0 || queue.size() < capacity) {
+            return true;
+        }
+        switch (policy.load(std::memory_order_relaxed)) {
+            case OverflowPolicy::Fail:
+                rejected.fetch_add(1, std::memory_order_relaxed);
+                // announce what a bulk push already stored before bailing out
+                if (waiters != 0) {
+                    cond.notify_all();
+                }
+                throw QueueException("queue is full");
+            case OverflowPolicy::DropNewest:
+                dropped.fetch_add(1, std::memory_order_relaxed);
+                return false;
+            case OverflowPolicy::DropOldest:
+                queue.pop();
+                dropped.fetch_add(1, std::memory_order_relaxed);
+                return true;
+            case OverflowPolicy::Block:
+            default:
+                break;
+        }
+        // messages pushed earlier in a bulk push are not announced yet, consumers have to see them to make room
+        if (waiters != 0) {
+            cond.notify_all();
+        }
+        if (refuseToWait()) {
+            return false;
+        }
+        auto has_space = [this]() { return queue.size() < capacity; };
+        auto start = std::chrono::steady_clock::now();
+        int timeout = push_timeout_ms.load(std::memory_order_relaxed);
+        ++space_waiters;
+        if (timeout == 0) {
+            space_cond.wait(lock, has_space);
+        }
+        else {
+            space_cond.wait_for(lock, std::chrono::milliseconds(timeout), has_space);
+        }
+        --space_waiters;
+        countBlocked(std::chrono::steady_clock::now() - start);
+        if (!has_space()) {
+            rejected.fetch_add(1, std::memory_order_relaxed);
+            throw QueueException("queue push timeout");
+        }
+        return true;
+    }
+
+    void Queue::tracePush(const Envelope& msg) noexcept {
+        auto data = msg.getMessageData();
+        if (data == nullptr) {
+            return;
+        }
+        if (auto id = data->trace()) {
+            Tracer::record(TracePoint::Enqueue, id, name);
+        }
+    }
+
+    void Queue::tracePop(const Envelope& msg) noexcept {
+        auto data = msg.getMessageData();
+        if (data == nullptr) {
+            return;
+        }
+        // name is not read under the lock, drain calls this with the lock of the mutex engine held
+        if (auto id = data->getTraceId()) {
+            Tracer::record(TracePoint::Dequeue, id, name);
+        }
+    }
+
+    std::unique_lock<std::shared_mutex> Queue::lockCounted() {
+        std::unique_lock lock(mtx, std::try_to_lock);
+        if (!lock.owns_lock()) {
+            metrics->counters.add(QueueMetrics::Contended);
+            lock.lock();
+        }
+        return lock;
+    }
+
+    void Queue::enqueue(Envelope msg) {
+        auto lock = lockCounted();
+        if (!admit(lock)) {
+            return;
+        }
+        queue.push(std::move(msg));
+        queued.store(queue.size(), std::memory_order_relaxed);
+        if (waiters != 0) {
+            cond.notify_one();
+        }
+    }
+
+    void Queue::enqueueWithPriority(Envelope msg, unsigned priority) {
+        enqueue(std::move(msg));
+    }
+
+    void Queue::enqueueBulk(std::vector<Envelope>& msgs) {
+        if (msgs.empty()) {
+            return;
+        }
+        auto lock = lockCounted();
+        std::size_t pushed = 0;
+        for (auto& msg : msgs) {
+            if (admit(lock)) {
+                queue.push(std::move(msg));
+                // stored as it goes, a full queue may throw or wait for consumers before the loop ends
+                queued.store(queue.size(), std::memory_order_relaxed);
+                ++pushed;
+            }
+        }
+        if (waiters == 0) {
+            return;
+        }
+        if (pushed == 1) {
+            cond.notify_one();
+        }
+        else if (pushed > 1) {
+            cond.notify_all();
+        }
+    }
+
+    void Queue::sleepWhileEmpty(std::unique_lock<std::shared_mutex>& lock, int timeout_ms) {
+        ++waiters;
         if (timeout_ms == 0) {
             cond.wait(lock, [this](){return !queue.empty();});
         }
         else {
             cond.wait_for(lock, std::chrono::milliseconds(timeout_ms), [this](){return !queue.empty();});
-            if(queue.empty()) {
-                throw QueueException("queue fetch timeout");
-            }
         }
-        msg = queue.front();
+        --waiters;
+    }
+
+    bool Queue::dequeue(Envelope& msg, bool block, int timeout_ms) {
+        if (!block) {
+            return pop(msg, false, 0);
+        }
+        // spinning polls read the hint and leave the lock to the producers until it shows a message
+        return waitWith([this, &msg]() { return queued.load(std::memory_order_relaxed) != 0 && pop(msg, false, 0); },
+                        [this, &msg](int timeout) { return pop(msg, true, timeout); }, timeout_ms);
+    }
+
+    bool Queue::pop(Envelope& msg, bool block, int timeout_ms) {
+        auto lock = lockCounted();
+        if (block && queue.empty()) {
+            sleepWhileEmpty(lock, timeout_ms);
+        }
+        if (queue.empty()) {
+            return false;
+        }
+        msg = std::move(queue.front());
         queue.pop();
+        queued.store(queue.size(), std::memory_order_relaxed);
+        if (space_waiters != 0) {
+            space_cond.notify_one();
+        }
         if (queue.empty()) {
             safe_cond.notify_all();
         }
         return true;
     }
 
+    std::size_t Queue::dequeueBulk(const Sink& sink, std::size_t max_n, bool block, int timeout_ms) {
+        if (max_n == 0) {
+            return 0;
+        }
+        if (block && wait_strategy.load(std::memory_order_relaxed) != WaitStrategy::Blocking) {
+            // poll for the first message without the lock held, then take the rest in one go
+            Envelope first;
+            if (!Queue::dequeue(first, true, timeout_ms)) {
+                return 0;
+            }
+            sink(std::move(first));
+            return 1 + Queue::dequeueBulk(sink, max_n - 1, false, 0);
+        }
+        auto lock = lockCounted();
+        if (block && queue.empty()) {
+            sleepWhileEmpty(lock, timeout_ms);
+        }
+        std::size_t n = 0;
+        while (n < max_n && !queue.empty()) {
+            sink(std::move(queue.front()));
+            queue.pop();
+            ++n;
+        }
+        queued.store(queue.size(), std::memory_order_relaxed);
+        if (n != 0 && space_waiters != 0) {
+            space_cond.notify_all();
+        }
+        if (n != 0 && queue.empty()) {
+            safe_cond.notify_all();
+        }
+        return n;
+    }
+
     std::string Queue::getName() const {
         mtxshared lock(mtx);
         return name;
@@ -130,6 +633,30 @@ namespace KawaiiMQ {
         return std::make_shared<Queue>(name);
     }
 
+    std::shared_ptr<Queue> makeQueue(const std::string& name, QueueEngine engine, std::size_t capacity,
+                                     OverflowPolicy policy) {
+        std::shared_ptr<Queue> ret;
+        switch (engine) {
+            case QueueEngine::Ring:
+                ret = std::make_shared<RingQueue>(name, capacity);
+                break;
+            case QueueEngine::Spsc:
+                ret = std::make_shared<SpscQueue>(name, capacity);
+                break;
+            case QueueEngine::Priority: {
+                PriorityOptions options;
+                options.lane_capacity = capacity;
+                ret = std::make_shared<PriorityQueue>(name, options);
+                break;
+            }
+            case QueueEngine::Mutex:
+            default:
+                return std::make_shared<Queue>(name, capacity, policy);
+        }
+        ret->setOverflowPolicy(policy);
+        return ret;
+    }
+
     std::shared_ptr<Queue> makeQueue(std::string&& name) {
         return std::make_shared<Queue>(std::move(name));
     }
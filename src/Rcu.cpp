@@ -0,0 +1,147 @@
+/**
+ * @file Rcu.cpp
+ * @author ayano
+ * @date 2/10/24
+ * @brief
+*/
+
+#include "Rcu.h"
+#include <mutex>
+#include <vector>
+#include "RingBuffer.h"
+
+namespace KawaiiMQ {
+
+    namespace {
+        /**
+         * read section state of one thread, slots are recycled when threads exit and never freed
+         */
+        struct alignas(cacheLineSize) Slot {
+            std::atomic<std::uint64_t> epoch{0};
+            std::atomic<bool> used{false};
+            Slot* next = nullptr;
+        };
+
+        struct Retired {
+            void* ptr;
+            void (*deleter)(void*);
+            std::uint64_t epoch;
+        };
+
+        /**
+         * shared state, leaked on purpose so read sections during static destruction stay valid
+         */
+        struct State {
+            // starts at 1, a slot holding 0 is outside any read section
+            std::atomic<std::uint64_t> epoch{1};
+            std::atomic<Slot*> slots{nullptr};
+            std::mutex mtx;
+            std::vector<Retired> retired;
+        };
+
+        State& state() {
+            static auto* s = new State();
+            return *s;
+        }
+
+        Slot* acquireSlot() {
+            auto& st = state();
+            for (auto* s = st.slots.load(std::memory_order_acquire); s != nullptr; s = s->next) {
+                bool expected = false;
+                if (!s->used.load(std::memory_order_relaxed) && s->used.compare_exchange_strong(expected, true)) {
+                    return s;
+                }
+            }
+            auto* s = new Slot();
+            s->used.store(true, std::memory_order_relaxed);
+            auto* head = st.slots.load(std::memory_order_relaxed);
+            do {
+                s->next = head;
+            } while (!st.slots.compare_exchange_weak(head, s, std::memory_order_release, std::memory_order_relaxed));
+            return s;
+        }
+
+        struct ThreadSlot {
+            Slot* slot = acquireSlot();
+            std::size_t depth = 0;
+
+            ~ThreadSlot() {
+                slot->epoch.store(0, std::memory_order_release);
+                slot->used.store(false, std::memory_order_release);
+            }
+        };
+
+        thread_local ThreadSlot threadSlot;
+
+        /**
+         * must hold state().mtx
+         */
+        void reclaimLocked(State& st) {
+            std::uint64_t oldest = UINT64_MAX;
+            for (auto* s = st.slots.load(std::memory_order_acquire); s != nullptr; s = s->next) {
+                std::uint64_t e = s->epoch.load(std::memory_order_seq_cst);
+                if (e != 0 && e < oldest) {
+                    oldest = e;
+                }
+            }
+            // a reader that entered at epoch e may see objects retired at epoch e or later
+            std::erase_if(st.retired, [oldest](const Retired& r) {
+                if (r.epoch < oldest) {
+                    r.deleter(r.ptr);
+                    return true;
+                }
+                return false;
+            });
+        }
+    }
+
+    Rcu::ReadGuard::ReadGuard() {
+        enter();
+    }
+
+    Rcu::ReadGuard::~ReadGuard() {
+        if (active) {
+            leave();
+        }
+    }
+
+    Rcu::ReadGuard::ReadGuard(ReadGuard &&other) noexcept {
+        other.active = false;
+    }
+
+    void Rcu::enter() {
+        auto& ts = threadSlot;
+        if (ts.depth++ == 0) {
+            ts.slot->epoch.store(state().epoch.load(std::memory_order_seq_cst), std::memory_order_seq_cst);
+            // pairs with the epoch bump in retire(): either the writer sees this slot, or we see the new pointer
+            std::atomic_thread_fence(std::memory_order_seq_cst);
+        }
+    }
+
+    void Rcu::leave() noexcept {
+        auto& ts = threadSlot;
+        if (--ts.depth == 0) {
+            ts.slot->epoch.store(0, std::memory_order_release);
+        }
+    }
+
+    void Rcu::retire(void *ptr, void (*deleter)(void *)) {
+        auto& st = state();
+        std::lock_guard lock(st.mtx);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        st.retired.push_back({ptr, deleter, st.epoch.fetch_add(1, std::memory_order_seq_cst)});
+        reclaimLocked(st);
+    }
+
+    void Rcu::reclaim() {
+        auto& st = state();
+        std::lock_guard lock(st.mtx);
+        reclaimLocked(st);
+    }
+
+    std::size_t Rcu::pending() {
+        auto& st = state();
+        std::lock_guard lock(st.mtx);
+        return st.retired.size();
+    }
+}
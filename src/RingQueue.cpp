@@ -0,0 +1,149 @@
+/**
+ * @file RingQueue.cpp
+ * @author ayano
+ * @date 2/3/24
+ * @brief
+*/
+
+#include "RingQueue.h"
+#include <thread>
+
+namespace KawaiiMQ {
+
+    template<template<typename> class Ring>
+    BasicRingQueue<Ring>::BasicRingQueue(std::string name, std::size_t capacity) : Queue(std::move(name)), ring(capacity) {
+        setWaitStrategy(WaitStrategy::SpinPark, 16, 0);
+    }
+
+    template<template<typename> class Ring>
+    bool BasicRingQueue<Ring>::overflow(Envelope& msg) {
+        switch (policy.load(std::memory_order_relaxed)) {
+            case OverflowPolicy::Fail:
+                rejected.fetch_add(1, std::memory_order_relaxed);
+                parker.unparkAll();
+                throw QueueException("queue is full");
+            case OverflowPolicy::DropNewest:
+                dropped.fetch_add(1, std::memory_order_relaxed);
+                return false;
+            case OverflowPolicy::DropOldest: {
+                Envelope oldest;
+                do {
+                    // a consumer may have taken the oldest message first, then the push simply succeeds
+                    if (ring.tryPop(oldest)) {
+                        dropped.fetch_add(1, std::memory_order_relaxed);
+                    }
+                } while (!ring.tryPush(std::move(msg)));
+                return true;
+            }
+            case OverflowPolicy::Block:
+            default:
+                break;
+        }
+        if (refuseToWait()) {
+            parker.unparkAll();
+            return false;
+        }
+        auto start = std::chrono::steady_clock::now();
+        int timeout = push_timeout_ms.load(std::memory_order_relaxed);
+        auto deadline = start + std::chrono::milliseconds(timeout);
+        while (!ring.tryPush(std::move(msg))) {
+            // wake consumers up for what is already in, otherwise a full ring never drains
+            parker.unparkAll();
+            if (timeout != 0 && std::chrono::steady_clock::now() >= deadline) {
+                countBlocked(std::chrono::steady_clock::now() - start);
+                rejected.fetch_add(1, std::memory_order_relaxed);
+                throw QueueException("queue push timeout");
+            }
+            std::this_thread::yield();
+        }
+        countBlocked(std::chrono::steady_clock::now() - start);
+        return true;
+    }
+
+    template<template<typename> class Ring>
+    void BasicRingQueue<Ring>::enqueue(Envelope msg) {
+        if (!ring.tryPush(std::move(msg)) && !overflow(msg)) {
+            return;
+        }
+        parker.unpark();
+    }
+
+    template<template<typename> class Ring>
+    void BasicRingQueue<Ring>::enqueueBulk(std::vector<Envelope>& msgs) {
+        for (auto& msg : msgs) {
+            if (!ring.tryPush(std::move(msg))) {
+                overflow(msg);
+            }
+        }
+        parker.unparkAll();
+    }
+
+    template<template<typename> class Ring>
+    bool BasicRingQueue<Ring>::popBlocking(Envelope& msg, int timeout_ms) {
+        auto try_pop = [this, &msg]() { return ring.tryPop(msg); };
+        return waitWith(try_pop, [this, &try_pop](int timeout) { return parker.park(try_pop, timeout); }, timeout_ms);
+    }
+
+    template<template<typename> class Ring>
+    bool BasicRingQueue<Ring>::dequeue(Envelope& msg, bool block, int timeout_ms) {
+        if (!(block ? popBlocking(msg, timeout_ms) : ring.tryPop(msg))) {
+            return false;
+        }
+        popped();
+        return true;
+    }
+
+    template<template<typename> class Ring>
+    std::size_t BasicRingQueue<Ring>::dequeueBulk(const Sink& sink, std::size_t max_n, bool block, int timeout_ms) {
+        if (max_n == 0) {
+            return 0;
+        }
+        std::size_t n = 0;
+        Envelope msg;
+        if (block) {
+            if (!popBlocking(msg, timeout_ms)) {
+                return 0;
+            }
+            sink(std::move(msg));
+            ++n;
+        }
+        while (n < max_n && ring.tryPop(msg)) {
+            sink(std::move(msg));
+            ++n;
+        }
+        if (n != 0) {
+            popped();
+        }
+        return n;
+    }
+
+    template<template<typename> class Ring>
+    std::size_t BasicRingQueue<Ring>::size() const noexcept {
+        return ring.sizeApprox();
+    }
+
+    template<template<typename> class Ring>
+    bool BasicRingQueue<Ring>::empty() const noexcept {
+        return ring.sizeApprox() == 0;
+    }
+
+    template<template<typename> class Ring>
+    std::size_t BasicRingQueue<Ring>::capacity() const noexcept {
+        return ring.capacity();
+    }
+
+    template<template<typename> class Ring>
+    std::size_t BasicRingQueue<Ring>::getCapacity() const noexcept {
+        return ring.capacity();
+    }
+
+    template<template<typename> class Ring>
+    void BasicRingQueue<Ring>::popped() {
+        if (ring.sizeApprox() == 0) {
+            safe_cond.notify_all();
+        }
+    }
+
+    template class BasicRingQueue<MpmcRing>;
+    template class BasicRingQueue<SpscRing>;
+}
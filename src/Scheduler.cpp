@@ -0,0 +1,116 @@
+/**
+ * @file Scheduler.cpp
+ * @author ayano
+ * @date 2/22/24
+ * @brief
+*/
+
+#include "Scheduler.h"
+
+namespace KawaiiMQ {
+
+    std::shared_ptr<Scheduler> Scheduler::Instance() {
+        static std::shared_ptr<Scheduler> instance(new Scheduler());
+        return instance;
+    }
+
+    Scheduler::TaskId Scheduler::pushAt(const std::shared_ptr<Queue>& queue, Envelope msg, Clock::time_point when) {
+        std::lock_guard lock(mtx);
+        std::uint32_t index;
+        if (free_tasks.empty()) {
+            index = static_cast<std::uint32_t>(tasks.size());
+            tasks.emplace_back();
+        }
+        else {
+            index = free_tasks.back();
+            free_tasks.pop_back();
+        }
+        auto& task = tasks[index];
+        task.queue = queue;
+        task.msg = std::move(msg);
+        task.pending = true;
+        auto id = (static_cast<TaskId>(task.generation) << 32) | index;
+        // the timer may fire right away, onTimer waits for mtx and finds the task complete
+        task.timer = wheel->schedule(when, weak_from_this(), id);
+        ++pending;
+        return id;
+    }
+
+    Scheduler::TaskId Scheduler::pushAfter(const std::shared_ptr<Queue>& queue, Envelope msg, Clock::duration delay) {
+        return pushAt(queue, std::move(msg), Clock::now() + delay);
+    }
+
+    bool Scheduler::cancel(TaskId id) {
+        std::lock_guard lock(mtx);
+        auto* task = find(id);
+        // a task being pushed is as good as delivered
+        if (task == nullptr || task->firing) {
+            return false;
+        }
+        wheel->cancel(task->timer);
+        release(static_cast<std::uint32_t>(id));
+        return true;
+    }
+
+    std::size_t Scheduler::size() const {
+        std::lock_guard lock(mtx);
+        return pending;
+    }
+
+    Scheduler::Task* Scheduler::find(TaskId id) noexcept {
+        auto index = static_cast<std::uint32_t>(id);
+        if (index >= tasks.size() || !tasks[index].pending
+            || tasks[index].generation != static_cast<std::uint32_t>(id >> 32)) {
+            return nullptr;
+        }
+        return &tasks[index];
+    }
+
+    void Scheduler::release(std::uint32_t index) noexcept {
+        auto& task = tasks[index];
+        task.queue.reset();
+        task.msg = Envelope();
+        task.pending = false;
+        task.firing = false;
+        ++task.generation;
+        free_tasks.push_back(index);
+        --pending;
+    }
+
+    void Scheduler::onTimer(std::uint64_t cookie) noexcept {
+        std::shared_ptr<Queue> queue;
+        Envelope msg;
+        {
+            std::lock_guard lock(mtx);
+            auto* task = find(cookie);
+            // cancelled just after the timer was taken off the wheel
+            if (task == nullptr) {
+                return;
+            }
+            queue = task->queue.lock();
+            if (queue == nullptr) {
+                release(static_cast<std::uint32_t>(cookie));
+                return;
+            }
+            msg = std::move(task->msg);
+            task->firing = true;
+        }
+        bool pushed = true;
+        try {
+            // every other timer waits for this thread, a full queue is tried again on the next tick instead
+            pushed = queue->tryPush(msg);
+        }
+        catch (const QueueException&) {
+            // refused by a full queue, counted in its own stats
+        }
+        std::lock_guard lock(mtx);
+        auto& task = tasks[static_cast<std::uint32_t>(cookie)];
+        if (pushed) {
+            release(static_cast<std::uint32_t>(cookie));
+            return;
+        }
+        task.msg = std::move(msg);
+        task.firing = false;
+        task.timer = wheel->schedule(Clock::now() + wheel->getTick(), weak_from_this(), cookie);
+    }
+}
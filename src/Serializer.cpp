@@ -0,0 +1,70 @@
+/**
+ * @file Serializer.cpp
+ * @author ayano
+ * @date 2/17/24
+ * @brief
+*/
+
+#include "Serializer.h"
+
+namespace KawaiiMQ {
+
+    std::shared_ptr<SerializerRegistry> SerializerRegistry::Instance() {
+        static std::shared_ptr<SerializerRegistry> instance(new SerializerRegistry());
+        return instance;
+    }
+
+    SerializerRegistry::SerializerRegistry() {
+        add<bool>("bool");
+        add<char>("char");
+        add<signed char>("signed char");
+        add<unsigned char>("unsigned char");
+        add<short>("short");
+        add<unsigned short>("unsigned short");
+        add<int>("int");
+        add<unsigned int>("unsigned int");
+        add<long>("long");
+        add<unsigned long>("unsigned long");
+        add<long long>("long long");
+        add<unsigned long long>("unsigned long long");
+        add<float>("float");
+        add<double>("double");
+        add<long double>("long double");
+        add<std::string>("std::string");
+        add<Bytes>("KawaiiMQ::Bytes");
+    }
+
+    bool SerializerRegistry::contains(std::uint64_t id) const {
+        std::shared_lock lock(mtx);
+        return by_id.contains(id);
+    }
+
+    std::uint64_t SerializerRegistry::serialize(const Envelope& msg, std::string& out) const {
+        void (*fn)(const Envelope&, std::string&);
+        std::uint64_t id;
+        {
+            std::shared_lock lock(mtx);
+            auto it = entries.find(msg.getTypeTag());
+            if (it == entries.end()) {
+                throw TypeException("no serializer registered for the message type");
+            }
+            fn = it->second.serialize;
+            id = it->second.id;
+        }
+        fn(msg, out);
+        return id;
+    }
+
+    Envelope SerializerRegistry::deserialize(std::uint64_t id, std::string_view in) const {
+        Envelope (*fn)(std::string_view);
+        {
+            std::shared_lock lock(mtx);
+            auto it = by_id.find(id);
+            if (it == by_id.end()) {
+                throw TypeException("no serializer registered for the message type");
+            }
+            fn = entries.find(it->second)->second.deserialize;
+        }
+        return fn(in);
+    }
+}
@@ -0,0 +1,224 @@
+/**
+ * @file TimerWheel.cpp
+ * @author ayano
+ * @date 2/21/24
+ * @brief
+*/
+
+#include "TimerWheel.h"
+#include <algorithm>
+#include <limits>
+
+namespace KawaiiMQ {
+
+    std::shared_ptr<TimerWheel> TimerWheel::Instance() {
+        static std::shared_ptr<TimerWheel> instance(new TimerWheel());
+        return instance;
+    }
+
+    TimerWheel::TimerWheel(std::chrono::milliseconds tick)
+            : tick(std::max(tick, std::chrono::milliseconds(1))), start(Clock::now()),
+              heads(levelSize * levelCount, none), tails(levelSize * levelCount, none) {
+        thread = std::thread([this]() { timerLoop(); });
+    }
+
+    TimerWheel::~TimerWheel() {
+        {
+            std::lock_guard lock(mtx);
+            stopping = true;
+        }
+        cond.notify_all();
+        thread.join();
+    }
+
+    std::uint64_t TimerWheel::tickOf(Clock::time_point when, bool round_up) const noexcept {
+        if (when <= start) {
+            return 0;
+        }
+        auto elapsed = std::chrono::duration_cast<std::chrono::nanoseconds>(when - start).count();
+        auto length = std::chrono::duration_cast<std::chrono::nanoseconds>(tick).count();
+        return static_cast<std::uint64_t>(round_up ? (elapsed + length - 1) / length : elapsed / length);
+    }
+
+    void TimerWheel::place(std::uint32_t index, std::uint64_t base) {
+        auto& node = nodes[index];
+        auto at = std::max(node.tick, base);
+        std::size_t level = 0;
+        while (level + 1 < levelCount && at - base >= (std::uint64_t(1) << (levelBits * (level + 1)))) {
+            ++level;
+        }
+        // too far even for the top level, wait in its last slot of this turn and get placed again from there
+        auto range = std::uint64_t(1) << (levelBits * levelCount);
+        if (at - base >= range) {
+            at = base + range - 1;
+        }
+        auto slot = static_cast<std::uint32_t>(level * levelSize + ((at >> (levelBits * level)) & (levelSize - 1)));
+        node.slot = slot;
+        node.next = none;
+        node.prev = tails[slot];
+        if (node.prev != none) {
+            nodes[node.prev].next = index;
+        }
+        else {
+            heads[slot] = index;
+        }
+        tails[slot] = index;
+    }
+
+    void TimerWheel::unlink(std::uint32_t index) {
+        auto& node = nodes[index];
+        if (node.prev != none) {
+            nodes[node.prev].next = node.next;
+        }
+        else {
+            heads[node.slot] = node.next;
+        }
+        if (node.next != none) {
+            nodes[node.next].prev = node.prev;
+        }
+        else {
+            tails[node.slot] = node.prev;
+        }
+        node.slot = none;
+    }
+
+    void TimerWheel::release(std::uint32_t index) {
+        unlink(index);
+        auto& node = nodes[index];
+        node.target.reset();
+        ++node.generation;
+        free_nodes.push_back(index);
+        --pending;
+    }
+
+    TimerWheel::TimerId TimerWheel::schedule(Clock::time_point when, std::weak_ptr<TimerTarget> target,
+                                             std::uint64_t cookie) {
+        TimerId id;
+        bool wake = false;
+        {
+            std::lock_guard lock(mtx);
+            if (pending == 0) {
+                // the wheel does not turn while empty, skip the ticks that passed meanwhile
+                current = std::max(current, tickOf(Clock::now(), false));
+            }
+            std::uint32_t index;
+            if (free_nodes.empty()) {
+                index = static_cast<std::uint32_t>(nodes.size());
+                nodes.emplace_back();
+            }
+            else {
+                index = free_nodes.back();
+                free_nodes.pop_back();
+            }
+            auto& node = nodes[index];
+            // a tick already processed would never be looked at again
+            node.tick = std::max(tickOf(when, true), current + 1);
+            node.target = std::move(target);
+            node.cookie = cookie;
+            place(index, current + 1);
+            id = (static_cast<TimerId>(node.generation) << 32) | index;
+            ++pending;
+            if (node.tick < wake_tick) {
+                wake_tick = node.tick;
+                wake = true;
+            }
+        }
+        if (wake) {
+            cond.notify_one();
+        }
+        return id;
+    }
+
+    bool TimerWheel::cancel(TimerId id) {
+        auto index = static_cast<std::uint32_t>(id);
+        auto generation = static_cast<std::uint32_t>(id >> 32);
+        std::lock_guard lock(mtx);
+        if (index >= nodes.size() || nodes[index].generation != generation || nodes[index].slot == none) {
+            return false;
+        }
+        release(index);
+        return true;
+    }
+
+    std::size_t TimerWheel::size() const {
+        std::lock_guard lock(mtx);
+        return pending;
+    }
+
+    std::chrono::milliseconds TimerWheel::getTick() const noexcept {
+        return tick;
+    }
+
+    void TimerWheel::advance(std::uint64_t tick, std::vector<Due>& due) {
+        // the highest level whose slot turns over at this tick, the levels above it keep their timers
+        std::size_t top = 0;
+        while (top + 1 < levelCount && (tick & ((std::uint64_t(1) << (levelBits * (top + 1))) - 1)) == 0) {
+            ++top;
+        }
+        for (auto level = top; level >= 1; --level) {
+            auto slot = level * levelSize + ((tick >> (levelBits * level)) & (levelSize - 1));
+            auto index = heads[slot];
+            heads[slot] = none;
+            tails[slot] = none;
+            while (index != none) {
+                auto next = nodes[index].next;
+                place(index, tick);
+                index = next;
+            }
+        }
+        auto index = heads[tick & (levelSize - 1)];
+        while (index != none) {
+            auto next = nodes[index].next;
+            due.push_back({std::move(nodes[index].target), nodes[index].cookie});
+            release(index);
+            index = next;
+        }
+    }
+
+    std::uint64_t TimerWheel::nextWake() const noexcept {
+        auto turn = ((current >> levelBits) + 1) << levelBits;
+        for (auto t = current + 1; t < turn; ++t) {
+            if (heads[t & (levelSize - 1)] != none) {
+                return t;
+            }
+        }
+        return turn;
+    }
+
+    void TimerWheel::timerLoop() {
+        std::vector<Due> due;
+        std::unique_lock lock(mtx);
+        while (!stopping) {
+            if (pending == 0) {
+                wake_tick = std::numeric_limits<std::uint64_t>::max();
+                cond.wait(lock, [this]() { return stopping || pending != 0; });
+                continue;
+            }
+            wake_tick = nextWake();
+            auto planned = wake_tick;
+            // schedule() lowers wake_tick for a timer due earlier
+            cond.wait_until(lock, start + tick * planned, [this, planned]() {
+                return stopping || wake_tick != planned;
+            });
+            if (stopping) {
+                break;
+            }
+            auto now = tickOf(Clock::now(), false);
+            while (current < now && pending != 0) {
+                advance(++current, due);
+            }
+            current = std::max(current, now);
+            if (due.empty()) {
+                continue;
+            }
+            lock.unlock();
+            for (auto& entry : due) {
+                if (auto target = entry.target.lock()) {
+                    target->onTimer(entry.cookie);
+                }
+            }
+            due.clear();
+            lock.lock();
+        }
+    }
+}
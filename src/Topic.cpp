@@ -10,34 +10,94 @@
 
 namespace KawaiiMQ{
 
+    std::shared_ptr<TopicRegistry> TopicRegistry::Instance() {
+        static std::shared_ptr<TopicRegistry> instance(new TopicRegistry());
+        return instance;
+    }
+
+    std::uint32_t TopicRegistry::intern(std::string_view name) {
+        {
+            std::shared_lock lock(mtx);
+            auto it = ids.find(name);
+            if (it != ids.end()) {
+                return it->second;
+            }
+        }
+        std::lock_guard lock(mtx);
+        auto it = ids.find(name);
+        if (it != ids.end()) {
+            return it->second;
+        }
+        auto id = static_cast<std::uint32_t>(names.size());
+        const auto& stored = names.emplace_back(name);
+        ids.emplace(stored, id);
+        return id;
+    }
+
+    const std::string& TopicRegistry::name(std::uint32_t id) const {
+        std::shared_lock lock(mtx);
+        if (id >= names.size()) {
+            throw TopicException("Unknown topic id " + std::to_string(id));
+        }
+        return names[id];
+    }
+
+    std::size_t TopicRegistry::size() const {
+        std::shared_lock lock(mtx);
+        return names.size();
+    }
+
+    Topic::Topic(std::string name) {
+        auto registry = TopicRegistry::Instance();
+        this->id = registry->intern(name);
+        this->name = &registry->name(id);
+    }
 
-    Topic::Topic(std::string name): name(std::move(name)) {
+    Topic::Topic(std::uint32_t id, const std::string* name) noexcept: id(id), name(name) {
 
     }
 
-    Topic::Topic(const Topic &other): name(other.name) {
+    Topic::Topic(const Topic &other) = default;
 
+    Topic::Topic(Topic &&other) noexcept = default;
+
+    Topic Topic::fromId(std::uint32_t id) {
+        return {id, &TopicRegistry::Instance()->name(id)};
     }
 
-    Topic::Topic(Topic &&other) noexcept: name(std::move(other.name)) {
+    const std::string& Topic::getName() const noexcept {
+        return *name;
+    }
 
+    std::uint32_t Topic::getId() const noexcept {
+        return id;
     }
 
-    std::string Topic::getName() const {
-        return name;
+    bool Topic::operator==(const Topic &other) const noexcept {
+        return id == other.id;
     }
+    Topic& Topic::operator=(const Topic& other) = default;
 
-    bool Topic::operator==(const Topic &other) const {
-        return name == other.getName();
+    bool TopicSet::insert(const Topic &topic) {
+        if (contains(topic)) {
+            return false;
+        }
+        if (topic.getId() >= bits.size()) {
+            bits.resize(topic.getId() + 1);
+        }
+        bits[topic.getId()] = true;
+        return true;
     }
-    Topic& Topic::operator=(const Topic& other) {
-        if (&other != this) {
-            name = other.name;
+
+    bool TopicSet::erase(const Topic &topic) {
+        if (!contains(topic)) {
+            return false;
         }
-        return *this;
+        bits[topic.getId()] = false;
+        return true;
     }
 
 }
-std::size_t std::hash<KawaiiMQ::Topic>::operator()(const KawaiiMQ::Topic &topic) const  {
-    return (std::hash<string>()(topic.getName()) << 1) ^ (std::hash<string>()(topic.getName()) >> 1);
-}
\ No newline at end of file
+std::size_t std::hash<KawaiiMQ::Topic>::operator()(const KawaiiMQ::Topic &topic) const noexcept {
+    return topic.getId();
+}
@@ -0,0 +1,260 @@
+/**
+ * @file Tracer.cpp
+ * @author ayano
+ * @date 2/24/24
+ * @brief
+*/
+
+#include "Tracer.h"
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <mutex>
+#include <sstream>
+#include <vector>
+
+namespace KawaiiMQ {
+
+    namespace {
+        /**
+         * one event, written by the owning thread and read under a sequence number like a seqlock
+         */
+        struct TraceSlot {
+            // 2 * index + 2 once the event of that index is complete, odd while it is being written
+            std::atomic<std::uint64_t> seq{0};
+            std::atomic<std::uint64_t> ts{0};
+            std::atomic<std::uint64_t> trace{0};
+            std::atomic<std::uint64_t> point{0};
+            std::array<std::atomic<std::uint64_t>, Tracer::nameSize / sizeof(std::uint64_t)> name{};
+        };
+
+        /**
+         * the ring of events of one thread
+         */
+        struct TraceBuffer {
+            explicit TraceBuffer(std::uint32_t tid) : tid(tid) {}
+
+            std::uint32_t tid;
+            std::unique_ptr<TraceSlot[]> slots = std::make_unique<TraceSlot[]>(Tracer::bufferSize);
+            // events written so far, only the owner writes it
+            std::atomic<std::uint64_t> head{0};
+            // events before this index were cleared
+            std::atomic<std::uint64_t> cleared{0};
+            std::atomic<bool> alive{true};
+        };
+
+        struct TraceRegistry {
+            std::mutex mtx;
+            std::vector<std::shared_ptr<TraceBuffer>> buffers;
+            std::uint32_t next_tid = 1;
+        };
+
+        TraceRegistry& registry() {
+            static TraceRegistry instance;
+            return instance;
+        }
+
+        /**
+         * the buffer of a thread, marked dead when the thread exits so clear() can free it
+         */
+        struct BufferHandle {
+            std::shared_ptr<TraceBuffer> buffer;
+
+            ~BufferHandle() {
+                if (buffer != nullptr) {
+                    buffer->alive.store(false, std::memory_order_relaxed);
+                }
+            }
+        };
+
+        thread_local BufferHandle handle;
+
+        TraceBuffer* attach() {
+            auto& reg = registry();
+            std::lock_guard lock(reg.mtx);
+            handle.buffer = std::make_shared<TraceBuffer>(reg.next_tid++);
+            reg.buffers.push_back(handle.buffer);
+            return handle.buffer.get();
+        }
+
+        struct Event {
+            std::uint64_t ts;
+            std::uint64_t trace;
+            std::uint32_t tid;
+            TracePoint point;
+            std::string where;
+        };
+
+        const char* pointName(TracePoint point) noexcept {
+            switch (point) {
+                case TracePoint::Publish:
+                    return "publish";
+                case TracePoint::Enqueue:
+                    return "enqueue";
+                case TracePoint::Dequeue:
+                    return "dequeue";
+                case TracePoint::Read:
+                default:
+                    return "getMessage";
+            }
+        }
+
+        void writeEscaped(std::ostream& out, std::string_view text) {
+            for (char c : text) {
+                if (c == '"' || c == '\\') {
+                    out << '\\' << c;
+                }
+                else if (static_cast<unsigned char>(c) < 0x20) {
+                    char buf[8];
+                    std::snprintf(buf, sizeof(buf), "\\u%04x", static_cast<unsigned>(c));
+                    out << buf;
+                }
+                else {
+                    out << c;
+                }
+            }
+        }
+
+        /**
+         * write one event of the trace format
+         * @param phase b, n or e
+         */
+        void writeEvent(std::ostream& out, const char* name, char phase, const Event& event, bool args) {
+            char buf[160];
+            std::snprintf(buf, sizeof(buf),
+                          R"({"name":"%s","cat":"kawaiimq","ph":"%c","id":"0x%llx","pid":1,"tid":%u,"ts":%llu.%03llu)",
+                          name, phase, static_cast<unsigned long long>(event.trace), event.tid,
+                          static_cast<unsigned long long>(event.ts / 1000),
+                          static_cast<unsigned long long>(event.ts % 1000));
+            out << buf;
+            if (args && !event.where.empty()) {
+                out << R"(,"args":{"at":")";
+                writeEscaped(out, event.where);
+                out << "\"}";
+            }
+            out << '}';
+        }
+    }
+
+    std::shared_ptr<Tracer> Tracer::Instance() {
+        static std::shared_ptr<Tracer> instance(new Tracer());
+        return instance;
+    }
+
+    void Tracer::setSampleEvery(std::uint32_t every) noexcept {
+        sample_every.store(every, std::memory_order_relaxed);
+    }
+
+    std::uint32_t Tracer::getSampleEvery() const noexcept {
+        return sample_every.load(std::memory_order_relaxed);
+    }
+
+    void Tracer::record(TracePoint point, std::uint64_t trace, std::string_view where) noexcept {
+        auto* buffer = handle.buffer.get();
+        if (buffer == nullptr) [[unlikely]] {
+            try {
+                buffer = attach();
+            }
+            catch (...) {
+                return;
+            }
+        }
+        std::array<std::uint64_t, nameSize / sizeof(std::uint64_t)> name{};
+        if (!where.empty()) {
+            std::memcpy(name.data(), where.data(), std::min(where.size(), nameSize));
+        }
+        auto ts = static_cast<std::uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(
+                std::chrono::steady_clock::now().time_since_epoch()).count());
+        auto index = buffer->head.load(std::memory_order_relaxed);
+        auto& slot = buffer->slots[index % bufferSize];
+        slot.seq.store(2 * index + 1, std::memory_order_relaxed);
+        // orders the odd sequence number before the fields, a reader seeing a field checks the number again
+        std::atomic_thread_fence(std::memory_order_release);
+        slot.ts.store(ts, std::memory_order_relaxed);
+        slot.trace.store(trace, std::memory_order_relaxed);
+        slot.point.store(static_cast<std::uint64_t>(point), std::memory_order_relaxed);
+        for (std::size_t i = 0; i < name.size(); ++i) {
+            slot.name[i].store(name[i], std::memory_order_relaxed);
+        }
+        slot.seq.store(2 * index + 2, std::memory_order_release);
+        buffer->head.store(index + 1, std::memory_order_release);
+    }
+
+    void Tracer::writeChromeTrace(std::ostream& out) const {
+        std::vector<Event> events;
+        {
+            auto& reg = registry();
+            std::lock_guard lock(reg.mtx);
+            for (const auto& buffer : reg.buffers) {
+                auto head = buffer->head.load(std::memory_order_acquire);
+                auto from = std::max(buffer->cleared.load(std::memory_order_relaxed),
+                                     head > bufferSize ? head - bufferSize : 0);
+                for (auto index = from; index < head; ++index) {
+                    auto& slot = buffer->slots[index % bufferSize];
+                    auto seq = slot.seq.load(std::memory_order_acquire);
+                    if (seq != 2 * index + 2) {
+                        // overwritten by a later event meanwhile
+                        continue;
+                    }
+                    Event event{slot.ts.load(std::memory_order_relaxed), slot.trace.load(std::memory_order_relaxed),
+                                buffer->tid, static_cast<TracePoint>(slot.point.load(std::memory_order_relaxed)), {}};
+                    std::array<std::uint64_t, nameSize / sizeof(std::uint64_t)> name{};
+                    for (std::size_t i = 0; i < name.size(); ++i) {
+                        name[i] = slot.name[i].load(std::memory_order_relaxed);
+                    }
+                    std::atomic_thread_fence(std::memory_order_acquire);
+                    if (slot.seq.load(std::memory_order_relaxed) != seq) {
+                        continue;
+                    }
+                    auto chars = reinterpret_cast<const char*>(name.data());
+                    event.where.assign(chars, strnlen(chars, nameSize));
+                    events.push_back(std::move(event));
+                }
+            }
+        }
+        std::sort(events.begin(), events.end(), [](const Event& a, const Event& b) {
+            return a.trace != b.trace ? a.trace < b.trace : a.ts < b.ts;
+        });
+        out << R"({"displayTimeUnit":"ns","traceEvents":[)";
+        bool first = true;
+        auto separate = [&out, &first]() {
+            if (!first) {
+                out << ",\n";
+            }
+            first = false;
+        };
+        for (std::size_t begin = 0; begin < events.size();) {
+            auto end = begin;
+            while (end < events.size() && events[end].trace == events[begin].trace) {
+                ++end;
+            }
+            separate();
+            writeEvent(out, "message", 'b', events[begin], false);
+            for (auto i = begin; i < end; ++i) {
+                separate();
+                writeEvent(out, pointName(events[i].point), 'n', events[i], true);
+            }
+            separate();
+            writeEvent(out, "message", 'e', events[end - 1], false);
+            begin = end;
+        }
+        out << "]}\n";
+    }
+
+    std::string Tracer::chromeTrace() const {
+        std::ostringstream out;
+        writeChromeTrace(out);
+        return out.str();
+    }
+
+    void Tracer::clear() {
+        auto& reg = registry();
+        std::lock_guard lock(reg.mtx);
+        std::erase_if(reg.buffers, [](const auto& buffer) { return !buffer->alive.load(std::memory_order_relaxed); });
+        for (const auto& buffer : reg.buffers) {
+            buffer->cleared.store(buffer->head.load(std::memory_order_acquire), std::memory_order_relaxed);
+        }
+    }
+}
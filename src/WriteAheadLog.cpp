@@ -0,0 +1,343 @@
+/**
+ * @file WriteAheadLog.cpp
+ * @author ayano
+ * @date 2/17/24
+ * @brief
+*/
+
+#include "WriteAheadLog.h"
+#include <algorithm>
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <limits>
+#include <fcntl.h>
+#include <unistd.h>
+#include "Exceptions.h"
+
+namespace KawaiiMQ {
+
+    namespace {
+        // record layout: [u32 payload size][u8 kind][u64 seq][u64 type id][payload][u32 checksum]
+        constexpr std::size_t headerSize = 4 + 1 + 8 + 8;
+        constexpr std::size_t trailerSize = 4;
+        // buffered records are written out once they reach this size, even if no fsync is due
+        constexpr std::size_t writeThreshold = std::size_t(1) << 20;
+
+        enum class Kind : std::uint8_t {
+            Data = 1,
+            // seq holds the consumed watermark
+            Checkpoint = 2
+        };
+
+        std::uint32_t checksum(std::string_view bytes) {
+            std::uint32_t hash = 2166136261u;
+            for (unsigned char c : bytes) {
+                hash = (hash ^ c) * 16777619u;
+            }
+            return hash;
+        }
+
+        template<typename T>
+        void put(std::string& out, T value) {
+            out.append(reinterpret_cast<const char*>(&value), sizeof(T));
+        }
+
+        template<typename T>
+        T get(const char* in) {
+            T value;
+            std::memcpy(&value, in, sizeof(T));
+            return value;
+        }
+
+        void encode(std::string& out, Kind kind, std::uint64_t seq, std::uint64_t type_id, std::string_view payload) {
+            auto start = out.size();
+            put(out, static_cast<std::uint32_t>(payload.size()));
+            put(out, kind);
+            put(out, seq);
+            put(out, type_id);
+            out.append(payload);
+            put(out, checksum(std::string_view(out).substr(start)));
+        }
+
+        std::string segmentName(std::uint64_t first) {
+            char name[32];
+            std::snprintf(name, sizeof(name), "%020llu.log", static_cast<unsigned long long>(first));
+            return name;
+        }
+
+        [[noreturn]] void fail(const std::string& what) {
+            throw QueueException("write ahead log: " + what + ": " + std::strerror(errno));
+        }
+    }
+
+    WriteAheadLog::WriteAheadLog(std::filesystem::path directory, std::size_t segment_size, FsyncPolicy policy)
+            : directory(std::move(directory)), segment_size(segment_size), policy(policy) {
+        std::error_code ec;
+        std::filesystem::create_directories(this->directory, ec);
+        if (ec) {
+            throw QueueException("write ahead log: cannot create " + this->directory.string() + ": " + ec.message());
+        }
+        recover();
+        {
+            std::lock_guard io(io_mtx);
+            if (segments.empty() || segments.back().first != next_seq) {
+                openSegment(next_seq);
+            }
+            else {
+                fd = ::open(segments.back().path.c_str(), O_WRONLY | O_APPEND | O_CLOEXEC);
+                if (fd < 0) {
+                    fail("cannot open " + segments.back().path.string());
+                }
+                segment_bytes = std::filesystem::file_size(segments.back().path);
+            }
+            removeConsumed();
+        }
+        if (policy.every_ms.count() > 0) {
+            timer = std::thread(&WriteAheadLog::timerLoop, this);
+        }
+    }
+
+    WriteAheadLog::~WriteAheadLog() {
+        if (timer.joinable()) {
+            {
+                std::lock_guard lock(timer_mtx);
+                stopping = true;
+            }
+            timer_cond.notify_one();
+            timer.join();
+        }
+        try {
+            sync();
+        }
+        catch (const std::exception& e) {
+            std::cerr << e.what() << std::endl;
+        }
+        if (fd >= 0) {
+            ::close(fd);
+        }
+    }
+
+    void WriteAheadLog::recover() {
+        std::vector<std::filesystem::path> files;
+        for (const auto& entry : std::filesystem::directory_iterator(directory)) {
+            if (entry.is_regular_file() && entry.path().extension() == ".log") {
+                files.push_back(entry.path());
+            }
+        }
+        // names are zero padded, so they sort by sequence number
+        std::sort(files.begin(), files.end());
+        std::uint64_t checkpoint = 0;
+        bool damaged = false;
+        for (const auto& path : files) {
+            if (damaged) {
+                // a gap in the log, whatever follows cannot be trusted
+                std::filesystem::remove(path);
+                continue;
+            }
+            std::uint64_t first = std::stoull(path.stem().string());
+            if (segments.empty()) {
+                next_seq = first;
+            }
+            std::ifstream in(path, std::ios::binary);
+            std::string bytes((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+            std::size_t offset = 0;
+            while (offset < bytes.size()) {
+                if (bytes.size() - offset < headerSize + trailerSize) {
+                    damaged = true;
+                    break;
+                }
+                const char* head = bytes.data() + offset;
+                auto size = get<std::uint32_t>(head);
+                std::size_t total = headerSize + size + trailerSize;
+                if (bytes.size() - offset < total ||
+                    checksum(std::string_view(head, headerSize + size)) != get<std::uint32_t>(head + headerSize + size)) {
+                    damaged = true;
+                    break;
+                }
+                auto kind = static_cast<Kind>(get<std::uint8_t>(head + 4));
+                auto seq = get<std::uint64_t>(head + 5);
+                if (kind == Kind::Data) {
+                    recovered.push_back({seq, get<std::uint64_t>(head + 13), std::string(head + headerSize, size)});
+                    next_seq = seq + 1;
+                }
+                else if (kind == Kind::Checkpoint) {
+                    checkpoint = std::max(checkpoint, seq);
+                }
+                offset += total;
+            }
+            if (damaged) {
+                std::cerr << "write ahead log: dropping damaged tail of " << path.string() << " at byte " << offset
+                          << std::endl;
+                std::filesystem::resize_file(path, offset);
+            }
+            segments.push_back({path, first});
+        }
+        checkpoint = std::min(checkpoint, next_seq);
+        std::erase_if(recovered, [checkpoint](const Record& r) { return r.seq < checkpoint; });
+        consumed.store(checkpoint, std::memory_order_relaxed);
+        written_checkpoint = checkpoint;
+        written_seq = next_seq;
+        synced_seq = next_seq;
+    }
+
+    std::vector<WriteAheadLog::Record> WriteAheadLog::takeRecovered() {
+        return std::move(recovered);
+    }
+
+    std::uint64_t WriteAheadLog::append(std::uint64_t type_id, std::string_view payload) {
+        std::lock_guard lock(mtx);
+        encode(buffer, Kind::Data, next_seq, type_id, payload);
+        ++unsynced;
+        return next_seq++;
+    }
+
+    void WriteAheadLog::commit(std::uint64_t seq) {
+        bool need_sync;
+        bool need_write;
+        {
+            std::lock_guard lock(mtx);
+            // with every_messages == 1 the record may have been taken by another flush that is still syncing
+            need_sync = policy.every_messages == 1 || (policy.every_messages != 0 && unsynced >= policy.every_messages);
+            need_write = buffer.size() >= writeThreshold;
+        }
+        if (need_sync || need_write) {
+            flush(need_sync, seq + 1);
+        }
+    }
+
+    void WriteAheadLog::consume(std::uint64_t n) noexcept {
+        consumed.fetch_add(n, std::memory_order_relaxed);
+    }
+
+    std::uint64_t WriteAheadLog::getConsumed() const noexcept {
+        return consumed.load(std::memory_order_relaxed);
+    }
+
+    void WriteAheadLog::sync() {
+        flush(true, std::numeric_limits<std::uint64_t>::max());
+    }
+
+    std::size_t WriteAheadLog::getSegmentCount() const {
+        std::lock_guard io(io_mtx);
+        return segments.size();
+    }
+
+    std::uint64_t WriteAheadLog::getSyncCount() const noexcept {
+        return syncs.load(std::memory_order_relaxed);
+    }
+
+    void WriteAheadLog::flush(bool sync, std::uint64_t upto) {
+        std::lock_guard io(io_mtx);
+        // the previous leader may have taken our record along already
+        if ((sync ? synced_seq : written_seq) >= upto) {
+            return;
+        }
+        std::uint64_t end;
+        spare.clear();
+        {
+            std::lock_guard lock(mtx);
+            // a pop may be counted before the push it pairs with is logged
+            auto checkpoint = std::min(consumed.load(std::memory_order_relaxed), next_seq);
+            if (checkpoint != written_checkpoint) {
+                encode(buffer, Kind::Checkpoint, checkpoint, 0, {});
+                written_checkpoint = checkpoint;
+            }
+            std::swap(buffer, spare);
+            end = next_seq;
+            if (sync) {
+                unsynced = 0;
+            }
+        }
+        if (!spare.empty()) {
+            writeAll(spare);
+            segment_bytes += spare.size();
+            dirty = true;
+        }
+        written_seq = end;
+        if (sync) {
+            if (dirty) {
+                syncFile();
+            }
+            synced_seq = end;
+        }
+        if (segment_bytes >= segment_size) {
+            openSegment(end);
+        }
+        removeConsumed();
+    }
+
+    void WriteAheadLog::openSegment(std::uint64_t first) {
+        if (fd >= 0) {
+            if (dirty) {
+                syncFile();
+            }
+            ::close(fd);
+        }
+        auto path = directory / segmentName(first);
+        fd = ::open(path.c_str(), O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC, 0644);
+        if (fd < 0) {
+            fail("cannot open " + path.string());
+        }
+        segments.push_back({path, first});
+        segment_bytes = 0;
+        // every segment starts with the watermark, so deleting older segments never loses it
+        std::string head;
+        encode(head, Kind::Checkpoint, written_checkpoint, 0, {});
+        writeAll(head);
+        segment_bytes += head.size();
+        syncFile();
+        int dir = ::open(directory.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+        if (dir >= 0) {
+            ::fsync(dir);
+            ::close(dir);
+        }
+    }
+
+    void WriteAheadLog::removeConsumed() {
+        std::size_t n = 0;
+        while (n + 1 < segments.size() && segments[n + 1].first <= written_checkpoint) {
+            std::error_code ec;
+            std::filesystem::remove(segments[n].path, ec);
+            ++n;
+        }
+        segments.erase(segments.begin(), segments.begin() + static_cast<std::ptrdiff_t>(n));
+    }
+
+    void WriteAheadLog::writeAll(std::string_view bytes) {
+        while (!bytes.empty()) {
+            auto n = ::write(fd, bytes.data(), bytes.size());
+            if (n < 0) {
+                if (errno == EINTR) {
+                    continue;
+                }
+                fail("write failed");
+            }
+            bytes.remove_prefix(static_cast<std::size_t>(n));
+        }
+    }
+
+    void WriteAheadLog::syncFile() {
+        if (::fdatasync(fd) != 0) {
+            fail("fsync failed");
+        }
+        dirty = false;
+        syncs.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    void WriteAheadLog::timerLoop() {
+        std::unique_lock lock(timer_mtx);
+        while (!timer_cond.wait_for(lock, policy.every_ms, [this]() { return stopping; })) {
+            lock.unlock();
+            try {
+                sync();
+            }
+            catch (const std::exception& e) {
+                std::cerr << e.what() << std::endl;
+            }
+            lock.lock();
+        }
+    }
+}
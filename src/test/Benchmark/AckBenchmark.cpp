@@ -0,0 +1,54 @@
+/**
+ * @file AckBenchmark.cpp
+ * @author ayano
+ * @date 2/21/24
+ * @brief Cost of leasing and acking messages compared with plain pops
+*/
+
+#include "kawaiiMQ.h"
+#include "benchmark/benchmark.h"
+
+namespace KawaiiMQ {
+
+    static constexpr int ackBurst = 256;
+
+    /**
+     * pushes a burst, leases it with fetchBulk and acks every message
+     */
+    static void BM_FetchAck(benchmark::State& state) {
+        auto queue = makeAckQueue("acks");
+        std::vector<Delivery> deliveries;
+        deliveries.reserve(ackBurst);
+        for (auto _ : state) {
+            for (int i = 0; i < ackBurst; ++i) {
+                queue->pushValue(i);
+            }
+            queue->fetchBulk(deliveries, ackBurst);
+            for (auto& delivery : deliveries) {
+                queue->ack(delivery.lease);
+            }
+            deliveries.clear();
+        }
+        state.SetItemsProcessed(state.iterations() * ackBurst);
+        state.counters["timers"] = static_cast<double>(TimerWheel::Instance()->size());
+    }
+    BENCHMARK(BM_FetchAck);
+
+    /**
+     * the same traffic popped without leases
+     */
+    static void BM_DrainNoAck(benchmark::State& state) {
+        auto queue = makeAckQueue("acks");
+        std::vector<std::shared_ptr<MessageData>> out;
+        out.reserve(ackBurst);
+        for (auto _ : state) {
+            for (int i = 0; i < ackBurst; ++i) {
+                queue->pushValue(i);
+            }
+            queue->drain(out, ackBurst);
+            out.clear();
+        }
+        state.SetItemsProcessed(state.iterations() * ackBurst);
+    }
+    BENCHMARK(BM_DrainNoAck);
+}
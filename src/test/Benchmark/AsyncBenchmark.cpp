@@ -0,0 +1,135 @@
+/**
+ * @file AsyncBenchmark.cpp
+ * @author ayano
+ * @date 2/15/24
+ * @brief 10k coroutines awaiting queues, resumed on a small thread pool
+*/
+
+#include "kawaiiMQ.h"
+#include "benchmark/benchmark.h"
+#include <condition_variable>
+#include <coroutine>
+#include <deque>
+#include <thread>
+
+namespace KawaiiMQ {
+
+    namespace {
+        /**
+         * fire-and-forget coroutine
+         */
+        struct Detached {
+            struct promise_type {
+                Detached get_return_object() { return {}; }
+                std::suspend_never initial_suspend() noexcept { return {}; }
+                std::suspend_never final_suspend() noexcept { return {}; }
+                void return_void() {}
+                void unhandled_exception() { std::terminate(); }
+            };
+        };
+
+        /**
+         * fixed thread pool resuming posted coroutines
+         */
+        class Pool {
+        public:
+            explicit Pool(std::size_t n) {
+                for (std::size_t i = 0; i < n; ++i) {
+                    threads.emplace_back([this]() {
+                        for (;;) {
+                            std::unique_lock lock(mtx);
+                            cond.wait(lock, [this]() { return stopping || !ready.empty(); });
+                            if (ready.empty()) {
+                                return;
+                            }
+                            auto h = ready.front();
+                            ready.pop_front();
+                            lock.unlock();
+                            h.resume();
+                        }
+                    });
+                }
+            }
+
+            ~Pool() {
+                {
+                    std::lock_guard lock(mtx);
+                    stopping = true;
+                }
+                cond.notify_all();
+                for (auto& t : threads) {
+                    t.join();
+                }
+            }
+
+            Executor executor() {
+                return [this](std::coroutine_handle<> h) {
+                    {
+                        std::lock_guard lock(mtx);
+                        ready.push_back(h);
+                    }
+                    cond.notify_one();
+                };
+            }
+
+        private:
+            std::mutex mtx;
+            std::condition_variable cond;
+            std::deque<std::coroutine_handle<>> ready;
+            std::vector<std::thread> threads;
+            bool stopping = false;
+        };
+
+        constexpr int awaiters = 10000;
+    }
+
+    /**
+     * 10k coroutines, each awaiting its own queue in a loop, resumed on state.range(0) threads. one iteration
+     * pushes one message into every queue and waits until all of them were handled
+     */
+    template<QueueEngine engine>
+    static void BM_AsyncWaitMany(benchmark::State& state) {
+        std::vector<std::shared_ptr<Queue>> queues;
+        for (int i = 0; i < awaiters; ++i) {
+            queues.push_back(makeQueue("async" + std::to_string(i), engine, 4));
+        }
+        std::atomic<std::int64_t> handled = 0;
+        std::atomic<int> finished = 0;
+        {
+            Pool pool(static_cast<std::size_t>(state.range(0)));
+            auto executor = pool.executor();
+            auto consume = [&](Queue& queue) -> Detached {
+                for (;;) {
+                    auto msg = co_await queue.asyncWait(executor);
+                    if (getMessage<int>(msg) < 0) {
+                        break;
+                    }
+                    handled.fetch_add(1, std::memory_order_relaxed);
+                }
+                finished.fetch_add(1, std::memory_order_relaxed);
+            };
+            for (auto& queue : queues) {
+                consume(*queue);
+            }
+            std::int64_t sent = 0;
+            for (auto _ : state) {
+                for (auto& queue : queues) {
+                    queue->pushValue(1);
+                }
+                sent += awaiters;
+                while (handled.load(std::memory_order_relaxed) < sent) {
+                    std::this_thread::yield();
+                }
+            }
+            state.SetItemsProcessed(sent);
+            for (auto& queue : queues) {
+                queue->pushValue(-1);
+            }
+            while (finished.load(std::memory_order_relaxed) < awaiters) {
+                std::this_thread::yield();
+            }
+        }
+    }
+    BENCHMARK(BM_AsyncWaitMany<QueueEngine::Mutex>)->Arg(1)->Arg(4)->UseRealTime();
+    BENCHMARK(BM_AsyncWaitMany<QueueEngine::Ring>)->Arg(1)->Arg(4)->UseRealTime();
+}
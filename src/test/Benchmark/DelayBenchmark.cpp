@@ -0,0 +1,60 @@
+/**
+ * @file DelayBenchmark.cpp
+ * @author ayano
+ * @date 2/22/24
+ * @brief Cost of scheduling delayed messages with many timers pending
+*/
+
+#include "kawaiiMQ.h"
+#include "benchmark/benchmark.h"
+
+using namespace std::chrono_literals;
+
+namespace KawaiiMQ {
+
+    /**
+     * schedules and cancels a message while state.range(0) other messages are pending, far from being due
+     */
+    static void BM_ScheduleCancel(benchmark::State& state) {
+        auto queue = makeQueue("delayed");
+        auto scheduler = Scheduler::Instance();
+        std::vector<Scheduler::TaskId> parked;
+        for (std::int64_t i = 0; i < state.range(0); ++i) {
+            parked.push_back(scheduler->pushAfter(queue, Envelope::of(i), 1h + std::chrono::milliseconds(i)));
+        }
+        int i = 0;
+        for (auto _ : state) {
+            scheduler->cancel(scheduler->pushAfter(queue, Envelope::of(i++), 10min));
+        }
+        state.SetItemsProcessed(state.iterations());
+        state.counters["pending"] = static_cast<double>(scheduler->size());
+        for (auto id : parked) {
+            scheduler->cancel(id);
+        }
+    }
+    BENCHMARK(BM_ScheduleCancel)->Arg(0)->Arg(1000000);
+
+    /**
+     * schedules a burst due on the next ticks and waits until the queue received all of it
+     */
+    static void BM_DelayedDelivery(benchmark::State& state) {
+        auto queue = makeQueue("delayed");
+        auto scheduler = Scheduler::Instance();
+        auto burst = state.range(0);
+        std::vector<std::shared_ptr<MessageData>> out;
+        for (auto _ : state) {
+            auto now = std::chrono::steady_clock::now();
+            for (std::int64_t i = 0; i < burst; ++i) {
+                scheduler->pushAt(queue, Envelope::of(i), now + std::chrono::milliseconds(1 + i % 8));
+            }
+            std::int64_t got = 0;
+            while (got < burst) {
+                out.push_back(queue->wait());
+                got += 1 + static_cast<std::int64_t>(queue->drain(out, burst));
+                out.clear();
+            }
+        }
+        state.SetItemsProcessed(state.iterations() * burst);
+    }
+    BENCHMARK(BM_DelayedDelivery)->Arg(100000);
+}
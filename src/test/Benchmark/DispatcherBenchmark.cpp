@@ -0,0 +1,57 @@
+/**
+ * @file DispatcherBenchmark.cpp
+ * @author ayano
+ * @date 2/14/24
+ * @brief Throughput of handlers for many topics running on a fixed worker pool
+*/
+
+#include "kawaiiMQ.h"
+#include "benchmark/benchmark.h"
+#include <thread>
+
+namespace KawaiiMQ {
+
+    /**
+     * state.range(0) topics with one queue each, 64 messages per topic per iteration, handled by one worker per
+     * hardware thread
+     */
+    static void BM_DispatcherTopics(benchmark::State& state) {
+        auto manager = MessageQueueManager::Instance();
+        auto n = static_cast<int>(state.range(0));
+        std::vector<Topic> topics;
+        std::vector<std::shared_ptr<Queue>> queues;
+        Producer producer("dispatcherBenchmark");
+        for (int i = 0; i < n; ++i) {
+            topics.emplace_back("dispatcherBenchmark" + std::to_string(i));
+            queues.push_back(makeQueue("dispatcherBenchmark" + std::to_string(i), QueueEngine::Ring, 128));
+            manager->relate(topics.back(), queues.back());
+            producer.subscribe(topics.back());
+        }
+        std::atomic<std::int64_t> handled = 0;
+        {
+            Dispatcher dispatcher;
+            for (auto& topic : topics) {
+                dispatcher.onMessage(topic, [&handled](const std::shared_ptr<MessageData>&) {
+                    handled.fetch_add(1, std::memory_order_relaxed);
+                });
+            }
+            std::int64_t sent = 0;
+            for (auto _ : state) {
+                for (int i = 0; i < 64; ++i) {
+                    for (auto& topic : topics) {
+                        producer.publishValue(topic, i);
+                    }
+                }
+                sent += 64 * n;
+                while (handled.load(std::memory_order_relaxed) < sent) {
+                    std::this_thread::yield();
+                }
+            }
+            state.SetItemsProcessed(sent);
+        }
+        for (int i = 0; i < n; ++i) {
+            manager->unrelate(topics[i], queues[i]);
+        }
+    }
+    BENCHMARK(BM_DispatcherTopics)->Arg(16)->Arg(256)->UseRealTime();
+}
@@ -0,0 +1,63 @@
+/**
+ * @file DurableBenchmark.cpp
+ * @author ayano
+ * @date 2/17/24
+ * @brief Push throughput of a durable queue under each fsync policy
+*/
+
+#include "kawaiiMQ.h"
+#include "benchmark/benchmark.h"
+
+namespace KawaiiMQ {
+
+    static constexpr int durableBurst = 256;
+
+    /**
+     * fsync policy picked by state.range(0): every message, every 64 messages, every 10 ms, never
+     */
+    static FsyncPolicy durablePolicy(std::int64_t index) {
+        switch (index) {
+            case 0:
+                return FsyncPolicy::everyMessages(1);
+            case 1:
+                return FsyncPolicy::everyMessages(64);
+            case 2:
+                return FsyncPolicy::everyMillis(std::chrono::milliseconds(10));
+            default:
+                return FsyncPolicy::never();
+        }
+    }
+
+    /**
+     * pushes bursts of ints from state.threads() producers, the log is shared so concurrent producers share fsyncs
+     */
+    static void BM_DurablePush(benchmark::State& state) {
+        static std::shared_ptr<DurableQueue> queue;
+        static DurableOptions options;
+        if (state.thread_index() == 0) {
+            options.directory = std::filesystem::temp_directory_path() / "kawaiimq-benchmark";
+            options.fsync = durablePolicy(state.range(0));
+            std::filesystem::remove_all(options.directory);
+            queue = makeDurableQueue("durable", options);
+        }
+        std::vector<Envelope> out;
+        out.reserve(durableBurst);
+        for (auto _ : state) {
+            for (int i = 0; i < durableBurst; ++i) {
+                queue->pushValue(i);
+            }
+            state.PauseTiming();
+            while (queue->drain(out, durableBurst) != 0) {
+                out.clear();
+            }
+            state.ResumeTiming();
+        }
+        state.SetItemsProcessed(state.iterations() * durableBurst);
+        if (state.thread_index() == 0) {
+            state.counters["fsyncs"] = static_cast<double>(queue->getLog().getSyncCount());
+            queue.reset();
+            std::filesystem::remove_all(options.directory);
+        }
+    }
+    BENCHMARK(BM_DurablePush)->DenseRange(0, 3)->Threads(1)->Threads(4)->UseRealTime();
+}
@@ -0,0 +1,41 @@
+/**
+ * @file ExpiryBenchmark.cpp
+ * @author ayano
+ * @date 2/22/24
+ * @brief Cost of expiry checks on the pop path, with and without expired messages in the backlog
+*/
+
+#include "Queue.h"
+#include "benchmark/benchmark.h"
+
+namespace KawaiiMQ {
+
+    static constexpr int expiryBurst = 256;
+
+    /**
+     * pushes a burst and drains it, state.range(0) is the share of expired messages in percent, -1 sets no expiry
+     */
+    static void BM_DrainWithExpiry(benchmark::State& state) {
+        auto queue = makeQueue("bench", QueueEngine::Ring, 1024);
+        auto expired_share = state.range(0);
+        std::vector<Envelope> burst;
+        auto now = std::chrono::steady_clock::now();
+        for (int i = 0; i < expiryBurst; ++i) {
+            auto msg = Envelope::of(i);
+            if (expired_share >= 0) {
+                msg.setExpiry(i % 100 < expired_share ? now : now + std::chrono::hours(1));
+            }
+            burst.push_back(msg);
+        }
+        std::vector<Envelope> out;
+        out.reserve(expiryBurst);
+        for (auto _ : state) {
+            queue->pushBulk(burst);
+            queue->drain(out, expiryBurst);
+            out.clear();
+        }
+        state.SetItemsProcessed(state.iterations() * expiryBurst);
+        state.counters["expired"] = static_cast<double>(queue->getStats().expired);
+    }
+    BENCHMARK(BM_DrainWithExpiry)->Arg(-1)->Arg(0)->Arg(50)->Arg(100);
+}
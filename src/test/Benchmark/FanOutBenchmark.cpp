@@ -0,0 +1,47 @@
+/**
+ * @file FanOutBenchmark.cpp
+ * @author ayano
+ * @date 2/11/24
+ * @brief Cost of publishing one message to a topic related to many queues
+*/
+
+#include "kawaiiMQ.h"
+#include "benchmark/benchmark.h"
+
+namespace KawaiiMQ {
+
+    static constexpr int fanOutBurst = 256;
+
+    /**
+     * publishes to a topic with state.range(0) related queues, the payload is shared by every queue
+     */
+    static void BM_FanOutPublish(benchmark::State& state) {
+        auto manager = MessageQueueManager::Instance();
+        Topic topic("fanOutBenchmark" + std::to_string(state.range(0)));
+        std::vector<std::shared_ptr<Queue>> queues;
+        for (int i = 0; i < state.range(0); ++i) {
+            queues.push_back(makeQueue(topic.getName() + "_" + std::to_string(i)));
+            manager->relate(topic, queues.back());
+        }
+        Producer producer("fanOutBenchmark");
+        producer.subscribe(topic);
+        std::vector<Envelope> out;
+        out.reserve(fanOutBurst);
+        for (auto _ : state) {
+            for (int i = 0; i < fanOutBurst; ++i) {
+                producer.publishMessage(topic, makeMessage(std::string("fan out payload")));
+            }
+            state.PauseTiming();
+            for (auto& queue : queues) {
+                queue->drain(out, fanOutBurst);
+                out.clear();
+            }
+            state.ResumeTiming();
+        }
+        state.SetItemsProcessed(state.iterations() * fanOutBurst);
+        for (auto& queue : queues) {
+            manager->unrelate(topic, queue);
+        }
+    }
+    BENCHMARK(BM_FanOutPublish)->Arg(1)->Arg(8)->Arg(64);
+}
@@ -0,0 +1,69 @@
+/**
+ * @file FetchBenchmark.cpp
+ * @author ayano
+ * @date 2/12/24
+ * @brief Latency of a consumer subscribed to many topics under skewed traffic
+*/
+
+#include "kawaiiMQ.h"
+#include "benchmark/benchmark.h"
+#include <atomic>
+#include <thread>
+
+namespace KawaiiMQ {
+
+    /**
+     * one message in flight at a time, 15 of 16 go to the last topic and the rest to the others in turn.
+     * the time per iteration is the delay between publishing and the consumer receiving the message
+     * @tparam multiplexed true to block once on all topics with fetchMessage, false to wait on the topics one
+     * after another with fetchBatch
+     */
+    template<bool multiplexed>
+    static void BM_FetchSkewed(benchmark::State& state) {
+        auto manager = MessageQueueManager::Instance();
+        auto n = static_cast<int>(state.range(0));
+        std::vector<Topic> topics;
+        std::vector<std::shared_ptr<Queue>> queues;
+        Producer producer("fetchBenchmark");
+        Consumer consumer("fetchBenchmark");
+        for (int i = 0; i < n; ++i) {
+            topics.emplace_back("fetchBenchmark" + std::to_string(i));
+            queues.push_back(makeQueue("fetchBenchmark" + std::to_string(i)));
+            manager->relate(topics.back(), queues.back());
+            producer.subscribe(topics.back());
+            consumer.subscribe(topics.back());
+        }
+        std::atomic<int> received = 0;
+        std::atomic<bool> stop = false;
+        std::thread t([&]() {
+            while (!stop.load(std::memory_order_relaxed)) {
+                if constexpr (multiplexed) {
+                    for (auto& [topic, messages] : consumer.fetchMessage(10)) {
+                        received.fetch_add(static_cast<int>(messages.size()), std::memory_order_release);
+                    }
+                }
+                else {
+                    for (auto& topic : topics) {
+                        auto messages = consumer.fetchBatch(topic, 64, 1);
+                        received.fetch_add(static_cast<int>(messages.size()), std::memory_order_release);
+                    }
+                }
+            }
+        });
+        int sent = 0;
+        for (auto _ : state) {
+            auto& topic = sent % 16 == 15 ? topics[(sent / 16) % n] : topics[n - 1];
+            producer.publishValue(topic, sent);
+            ++sent;
+            while (received.load(std::memory_order_acquire) < sent) {
+            }
+        }
+        stop = true;
+        t.join();
+        for (int i = 0; i < n; ++i) {
+            manager->unrelate(topics[i], queues[i]);
+        }
+    }
+    BENCHMARK(BM_FetchSkewed<true>)->Arg(1)->Arg(8)->Arg(50)->UseRealTime();
+    BENCHMARK(BM_FetchSkewed<false>)->Arg(1)->Arg(8)->Arg(50)->UseRealTime();
+}
@@ -0,0 +1,64 @@
+/**
+ * @file LogBenchmark.cpp
+ * @author ayano
+ * @date 2/19/24
+ * @brief One log read by many cursors, compared with one queue per reader
+*/
+
+#include "kawaiiMQ.h"
+#include "benchmark/benchmark.h"
+
+namespace KawaiiMQ {
+
+    static constexpr int logBurst = 256;
+
+    /**
+     * appends to one log and lets state.range(0) cursors read every message
+     */
+    static void BM_LogCursors(benchmark::State& state) {
+        auto log = makeLogQueue("log");
+        std::vector<std::unique_ptr<LogCursor>> cursors;
+        for (int i = 0; i < state.range(0); ++i) {
+            cursors.push_back(log->openCursor());
+        }
+        std::vector<Envelope> out;
+        out.reserve(logBurst);
+        for (auto _ : state) {
+            for (int i = 0; i < logBurst; ++i) {
+                log->push(makeMessage(std::string("fan out payload")));
+            }
+            for (auto& cursor : cursors) {
+                cursor->readBulk(out, logBurst);
+                out.clear();
+            }
+        }
+        state.SetItemsProcessed(state.iterations() * logBurst * state.range(0));
+    }
+    BENCHMARK(BM_LogCursors)->Arg(1)->Arg(8)->Arg(64);
+
+    /**
+     * the same traffic with a queue per reader, every message is pushed to state.range(0) queues
+     */
+    static void BM_QueuePerReader(benchmark::State& state) {
+        std::vector<std::shared_ptr<Queue>> queues;
+        for (int i = 0; i < state.range(0); ++i) {
+            queues.push_back(makeQueue("reader" + std::to_string(i)));
+        }
+        std::vector<Envelope> out;
+        out.reserve(logBurst);
+        for (auto _ : state) {
+            for (int i = 0; i < logBurst; ++i) {
+                auto msg = makeMessage(std::string("fan out payload"));
+                for (auto& queue : queues) {
+                    queue->push(msg);
+                }
+            }
+            for (auto& queue : queues) {
+                queue->drain(out, logBurst);
+                out.clear();
+            }
+        }
+        state.SetItemsProcessed(state.iterations() * logBurst * state.range(0));
+    }
+    BENCHMARK(BM_QueuePerReader)->Arg(1)->Arg(8)->Arg(64);
+}
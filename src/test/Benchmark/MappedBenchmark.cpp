@@ -0,0 +1,69 @@
+/**
+ * @file MappedBenchmark.cpp
+ * @author ayano
+ * @date 2/18/24
+ * @brief Byte messages through a mapped queue, compared with string messages in a mutex queue
+*/
+
+#include "kawaiiMQ.h"
+#include "benchmark/benchmark.h"
+
+namespace KawaiiMQ {
+
+    static constexpr int mappedBurst = 256;
+
+    /**
+     * pushes and drains state.range(0) byte messages, the consumer reads them straight from the mapping
+     */
+    static void BM_MappedPushDrain(benchmark::State& state) {
+        MappedOptions options;
+        options.directory = std::filesystem::temp_directory_path() / "kawaiimq-benchmark-mapped";
+        std::filesystem::remove_all(options.directory);
+        auto queue = makeMappedQueue("mapped", options);
+        std::string payload(state.range(0), 'x');
+        std::vector<Envelope> out;
+        out.reserve(mappedBurst);
+        std::size_t total = 0;
+        for (auto _ : state) {
+            for (int i = 0; i < mappedBurst; ++i) {
+                queue->pushBytes(payload);
+            }
+            queue->drain(out, mappedBurst);
+            for (const auto& msg : out) {
+                total += getMessage<Bytes>(msg).size();
+            }
+            out.clear();
+        }
+        benchmark::DoNotOptimize(total);
+        state.SetItemsProcessed(state.iterations() * mappedBurst);
+        state.SetBytesProcessed(state.iterations() * mappedBurst * state.range(0));
+        queue.reset();
+        std::filesystem::remove_all(options.directory);
+    }
+    BENCHMARK(BM_MappedPushDrain)->Arg(64)->Arg(1024)->Arg(16384);
+
+    /**
+     * the same traffic as string messages in a mutex queue, every push copies the payload into a heap message
+     */
+    static void BM_StringPushDrain(benchmark::State& state) {
+        auto queue = makeQueue("string");
+        std::string payload(state.range(0), 'x');
+        std::vector<Envelope> out;
+        out.reserve(mappedBurst);
+        std::size_t total = 0;
+        for (auto _ : state) {
+            for (int i = 0; i < mappedBurst; ++i) {
+                queue->pushValue(std::string(payload));
+            }
+            queue->drain(out, mappedBurst);
+            for (const auto& msg : out) {
+                total += getMessage<std::string>(msg).size();
+            }
+            out.clear();
+        }
+        benchmark::DoNotOptimize(total);
+        state.SetItemsProcessed(state.iterations() * mappedBurst);
+        state.SetBytesProcessed(state.iterations() * mappedBurst * state.range(0));
+    }
+    BENCHMARK(BM_StringPushDrain)->Arg(64)->Arg(1024)->Arg(16384);
+}
@@ -0,0 +1,96 @@
+/**
+ * @file MessageBenchmark.cpp
+ * @author ayano
+ * @date 2/6/24
+ * @brief Cost of reading message content back out of a MessageData
+*/
+
+#include "Message.h"
+#include "benchmark/benchmark.h"
+#include <string>
+
+namespace KawaiiMQ {
+
+    /**
+     * the dynamic_cast based lookup getMessage used before type tags, kept as a baseline
+     */
+    template<typename T>
+    static T getMessageDynamic(std::shared_ptr<MessageData> in) {
+        auto tmp = std::dynamic_pointer_cast<Message<T>>(in);
+        if (tmp != nullptr) {
+            return tmp->getContent();
+        }
+        throw TypeException("Expected type " + std::string(typeid(T).name()));
+    }
+
+    static std::shared_ptr<MessageData> stringMessage() {
+        return makeMessage(std::string(64, 'x'));
+    }
+
+    static void BM_GetMessageDynamicCast(benchmark::State& state) {
+        auto m = stringMessage();
+        for (auto _ : state) {
+            benchmark::DoNotOptimize(getMessageDynamic<std::string>(m));
+        }
+    }
+    BENCHMARK(BM_GetMessageDynamicCast);
+
+    static void BM_GetMessageRef(benchmark::State& state) {
+        auto m = stringMessage();
+        for (auto _ : state) {
+            benchmark::DoNotOptimize(&getMessage<std::string>(m));
+        }
+    }
+    BENCHMARK(BM_GetMessageRef);
+
+    static void BM_VisitMessage(benchmark::State& state) {
+        auto m = stringMessage();
+        for (auto _ : state) {
+            visitMessage<std::string>(m, [](const std::string& s) { benchmark::DoNotOptimize(s.data()); });
+        }
+    }
+    BENCHMARK(BM_VisitMessage);
+
+    /**
+     * consumer loop shape: the message is released right after reading, so the content can be moved out
+     */
+    static void BM_GetMessageMoveOut(benchmark::State& state) {
+        for (auto _ : state) {
+            state.PauseTiming();
+            auto m = stringMessage();
+            state.ResumeTiming();
+            benchmark::DoNotOptimize(getMessage<std::string>(std::move(m)));
+        }
+    }
+    BENCHMARK(BM_GetMessageMoveOut);
+
+    static void BM_GetMessageDynamicCastRelease(benchmark::State& state) {
+        for (auto _ : state) {
+            state.PauseTiming();
+            auto m = stringMessage();
+            state.ResumeTiming();
+            benchmark::DoNotOptimize(getMessageDynamic<std::string>(std::move(m)));
+        }
+    }
+    BENCHMARK(BM_GetMessageDynamicCastRelease);
+
+    /**
+     * allocation as makeMessage did before the pool
+     */
+    static void BM_MakeMessageHeap(benchmark::State& state) {
+        for (auto _ : state) {
+            benchmark::DoNotOptimize(std::make_shared<Message<std::string>>(std::string(16, 'x')));
+        }
+    }
+    BENCHMARK(BM_MakeMessageHeap)->ThreadRange(1, 8);
+
+    static void BM_MakeMessagePooled(benchmark::State& state) {
+        for (auto _ : state) {
+            benchmark::DoNotOptimize(makeMessage(std::string(16, 'x')));
+        }
+        if (state.thread_index() == 0) {
+            state.counters["hit_rate"] = messagePoolStats<std::string>().hitRate();
+        }
+    }
+    BENCHMARK(BM_MakeMessagePooled)->ThreadRange(1, 8);
+}
@@ -0,0 +1,51 @@
+/**
+ * @file MetricsBenchmark.cpp
+ * @author ayano
+ * @date 2/23/24
+ * @brief Cost of the metrics on the push and pop path, by sampling period
+*/
+
+#include "Queue.h"
+#include "benchmark/benchmark.h"
+
+namespace KawaiiMQ {
+
+    /**
+     * one push and one pop per iteration, state.range(0) is the sampling period, 0 records no latency
+     */
+    static void BM_PushPopSampled(benchmark::State& state) {
+        auto registry = MetricsRegistry::Instance();
+        registry->setSampleEvery(static_cast<std::uint32_t>(state.range(0)));
+        auto queue = makeQueue("bench", QueueEngine::Ring, 1024);
+        Envelope msg;
+        for (auto _ : state) {
+            queue->pushValue(1);
+            queue->tryWaitValue(msg);
+        }
+        state.SetItemsProcessed(state.iterations());
+        state.counters["sampled"] = static_cast<double>(queue->getMetrics().latency.count);
+        registry->setSampleEvery(64);
+    }
+    BENCHMARK(BM_PushPopSampled)->Arg(0)->Arg(1024)->Arg(64)->Arg(1);
+
+    /**
+     * contended counting: every thread bumps the same counters, sharded versus one shared atomic
+     */
+    static void BM_ShardedCounter(benchmark::State& state) {
+        static ShardedCounters<1> counters;
+        for (auto _ : state) {
+            counters.add(0);
+        }
+        state.SetItemsProcessed(state.iterations());
+    }
+    BENCHMARK(BM_ShardedCounter)->Threads(1)->Threads(4);
+
+    static void BM_SharedCounter(benchmark::State& state) {
+        static std::atomic<std::uint64_t> counter;
+        for (auto _ : state) {
+            counter.fetch_add(1, std::memory_order_relaxed);
+        }
+        state.SetItemsProcessed(state.iterations());
+    }
+    BENCHMARK(BM_SharedCounter)->Threads(1)->Threads(4);
+}
@@ -0,0 +1,72 @@
+/**
+ * @file PartitionBenchmark.cpp
+ * @author ayano
+ * @date 2/20/24
+ * @brief Keyed publishing to a partitioned topic consumed by a group
+*/
+
+#include "kawaiiMQ.h"
+#include "benchmark/benchmark.h"
+#include <atomic>
+#include <thread>
+
+namespace KawaiiMQ {
+
+    static constexpr int partitionBurst = 4096;
+    static constexpr int partitionCount = 8;
+
+    /**
+     * publishes keyed messages to a topic of 8 partitions, read by a group of state.range(0) consumer threads
+     */
+    static void BM_GroupConsume(benchmark::State& state) {
+        auto manager = MessageQueueManager::Instance();
+        Topic topic("partitionBenchmark" + std::to_string(state.range(0)));
+        std::vector<std::shared_ptr<Queue>> partitions;
+        for (int i = 0; i < partitionCount; ++i) {
+            partitions.push_back(makeQueue(topic.getName() + "_" + std::to_string(i)));
+        }
+        manager->partition(topic, partitions);
+        Producer producer({topic}, "partitionBenchmark");
+        auto group = makeConsumerGroup(topic.getName());
+        std::vector<std::unique_ptr<Consumer>> members;
+        for (int i = 0; i < state.range(0); ++i) {
+            members.push_back(std::make_unique<Consumer>(std::vector{topic}));
+            members.back()->join(group);
+        }
+        std::atomic<int> received = 0;
+        std::atomic<bool> stop = false;
+        std::vector<std::thread> threads;
+        for (auto& member : members) {
+            threads.emplace_back([&received, &stop, &topic, consumer = member.get()]() {
+                std::uint64_t sum = 0;
+                while (!stop.load(std::memory_order_relaxed)) {
+                    auto messages = consumer->fetchBatch(topic, 256, 10);
+                    for (auto& msg : messages) {
+                        sum += getMessage<int>(msg);
+                    }
+                    received.fetch_add(static_cast<int>(messages.size()), std::memory_order_release);
+                }
+                benchmark::DoNotOptimize(sum);
+            });
+        }
+        int sent = 0;
+        for (auto _ : state) {
+            for (int i = 0; i < partitionBurst; ++i) {
+                producer.publishValue(topic, i, i);
+            }
+            sent += partitionBurst;
+            while (received.load(std::memory_order_acquire) < sent) {
+            }
+        }
+        stop = true;
+        for (auto& t : threads) {
+            t.join();
+        }
+        state.SetItemsProcessed(state.iterations() * partitionBurst);
+        members.clear();
+        for (auto& partition : partitions) {
+            manager->unrelate(topic, partition);
+        }
+    }
+    BENCHMARK(BM_GroupConsume)->Arg(1)->Arg(2)->Arg(4)->Arg(8)->UseRealTime();
+}
@@ -0,0 +1,109 @@
+/**
+ * @file PipelineBenchmark.cpp
+ * @author ayano
+ * @date 2/25/24
+ * @brief Throughput of many producers and consumers on one queue, and end to end latency percentiles
+*/
+
+#include "kawaiiMQ.h"
+#include "benchmark/benchmark.h"
+#include <thread>
+
+namespace KawaiiMQ {
+
+    /**
+     * state.range(0) producer threads push into one queue that state.range(1) consumer threads wait on
+     */
+    template<QueueEngine engine>
+    static void BM_ProducersConsumers(benchmark::State& state) {
+        constexpr std::int64_t batch = 1 << 14;
+        auto producers = state.range(0);
+        auto consumers = state.range(1);
+        auto queue = makeQueue("bench", engine, 1024);
+        auto msg = makeMessage(0);
+        for (auto _ : state) {
+            // a consumer claims a message before waiting for it, so every message is waited for exactly once
+            std::atomic<std::int64_t> unclaimed = batch;
+            std::vector<std::thread> threads;
+            for (std::int64_t c = 0; c < consumers; ++c) {
+                threads.emplace_back([&]() {
+                    while (unclaimed.fetch_sub(1, std::memory_order_relaxed) > 0) {
+                        benchmark::DoNotOptimize(queue->wait());
+                    }
+                });
+            }
+            for (std::int64_t p = 0; p < producers; ++p) {
+                threads.emplace_back([&, p]() {
+                    for (auto i = p; i < batch; i += producers) {
+                        queue->push(msg);
+                    }
+                });
+            }
+            for (auto& thread : threads) {
+                thread.join();
+            }
+        }
+        state.SetItemsProcessed(state.iterations() * batch);
+    }
+    BENCHMARK(BM_ProducersConsumers<QueueEngine::Mutex>)
+            ->ArgsProduct({{1, 2, 4, 8}, {1, 2, 4, 8}})->ArgNames({"producers", "consumers"})->UseRealTime();
+    BENCHMARK(BM_ProducersConsumers<QueueEngine::Ring>)
+            ->ArgsProduct({{1, 2, 4, 8}, {1, 2, 4, 8}})->ArgNames({"producers", "consumers"})->UseRealTime();
+
+    /**
+     * a Producer publishes its send time, a Consumer on another thread fetches it and records the difference.
+     * state.range(0) set waits for every message to arrive before publishing the next one, which measures the
+     * latency of an idle pipeline. unset publishes as fast as the bounded queue takes it, which measures the
+     * latency under saturation, queueing included
+     */
+    template<QueueEngine engine>
+    static void BM_EndToEndLatency(benchmark::State& state) {
+        auto paced = state.range(0) != 0;
+        auto manager = MessageQueueManager::Instance();
+        Topic topic("endToEndBenchmark" + std::to_string(static_cast<int>(engine)) + "_" +
+                    std::to_string(state.range(0)));
+        auto queue = makeQueue(topic.getName(), engine, 1024);
+        manager->relate(topic, queue);
+        Producer producer({topic}, "endToEndBenchmark");
+        Consumer consumer("endToEndBenchmark");
+        consumer.subscribe(topic);
+        Histogram latency;
+        std::atomic<std::uint64_t> received = 0;
+        std::atomic<bool> stopping = false;
+        std::thread reader([&]() {
+            while (!stopping.load(std::memory_order_relaxed)) {
+                auto messages = consumer.fetchBatch(topic, 256, 10);
+                auto now = metricsNow();
+                for (auto& msg : messages) {
+                    latency.record(now - getMessage<std::uint64_t>(msg));
+                }
+                received.fetch_add(messages.size(), std::memory_order_release);
+            }
+        });
+        std::uint64_t sent = 0;
+        for (auto _ : state) {
+            producer.publishMessage(topic, makeMessage(metricsNow()));
+            ++sent;
+            if (paced) {
+                while (received.load(std::memory_order_acquire) != sent) {
+                    std::this_thread::yield();
+                }
+            }
+        }
+        while (received.load(std::memory_order_acquire) != sent) {
+            std::this_thread::yield();
+        }
+        stopping.store(true, std::memory_order_relaxed);
+        reader.join();
+        manager->unrelate(topic, queue);
+        auto snapshot = latency.snapshot();
+        state.counters["p50_ns"] = static_cast<double>(snapshot.percentile(0.5));
+        state.counters["p90_ns"] = static_cast<double>(snapshot.percentile(0.9));
+        state.counters["p99_ns"] = static_cast<double>(snapshot.percentile(0.99));
+        state.counters["p999_ns"] = static_cast<double>(snapshot.percentile(0.999));
+        state.counters["max_ns"] = static_cast<double>(snapshot.max);
+        state.SetItemsProcessed(state.iterations());
+    }
+    BENCHMARK(BM_EndToEndLatency<QueueEngine::Mutex>)->Arg(1)->Arg(0)->UseRealTime();
+    BENCHMARK(BM_EndToEndLatency<QueueEngine::Ring>)->Arg(1)->Arg(0)->UseRealTime();
+}
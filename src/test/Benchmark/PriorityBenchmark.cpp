@@ -0,0 +1,68 @@
+/**
+ * @file PriorityBenchmark.cpp
+ * @author ayano
+ * @date 2/22/24
+ * @brief Cost of priority lanes, and how long a control message waits behind bulk data
+*/
+
+#include "Queue.h"
+#include "PriorityQueue.h"
+#include "benchmark/benchmark.h"
+
+namespace KawaiiMQ {
+
+    static constexpr int priorityBurst = 256;
+
+    /**
+     * pushes a burst spread over every lane and pops it, compared with a plain ring
+     */
+    template<QueueEngine engine>
+    static void BM_PriorityPushPop(benchmark::State& state) {
+        auto queue = makeQueue("bench", engine, 1024);
+        Envelope msg;
+        for (auto _ : state) {
+            for (int i = 0; i < priorityBurst; ++i) {
+                queue->pushValue(i, static_cast<unsigned>(i % 8));
+            }
+            for (int i = 0; i < priorityBurst; ++i) {
+                queue->tryWaitValue(msg);
+            }
+        }
+        state.SetItemsProcessed(state.iterations() * priorityBurst);
+    }
+    BENCHMARK(BM_PriorityPushPop<QueueEngine::Ring>);
+    BENCHMARK(BM_PriorityPushPop<QueueEngine::Priority>);
+
+    /**
+     * a control message pushed behind state.range(0) bulk messages, counts the pops until it comes out
+     */
+    template<QueueEngine engine>
+    static void BM_ControlBehindBulk(benchmark::State& state) {
+        auto backlog = static_cast<int>(state.range(0));
+        auto queue = makeQueue("bench", engine, 4096);
+        std::vector<Envelope> out;
+        double pops = 0;
+        for (auto _ : state) {
+            state.PauseTiming();
+            for (int i = 0; i < backlog; ++i) {
+                queue->pushValue(0, 0);
+            }
+            state.ResumeTiming();
+            queue->pushValue(1, 7);
+            Envelope msg;
+            int n = 0;
+            do {
+                queue->tryWaitValue(msg);
+                ++n;
+            } while (getMessage<int>(std::move(msg).toShared()) != 1);
+            pops += n;
+            state.PauseTiming();
+            queue->drain(out, backlog);
+            out.clear();
+            state.ResumeTiming();
+        }
+        state.counters["pops"] = pops / static_cast<double>(state.iterations());
+    }
+    BENCHMARK(BM_ControlBehindBulk<QueueEngine::Ring>)->Arg(4000);
+    BENCHMARK(BM_ControlBehindBulk<QueueEngine::Priority>)->Arg(4000);
+}
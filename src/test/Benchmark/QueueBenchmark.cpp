@@ -0,0 +1,112 @@
+/**
+ * @file QueueBenchmark.cpp
+ * @author ayano
+ * @date 2/3/24
+ * @brief Contention benchmarks of the queue engines
+*/
+
+#include "Queue.h"
+#include "RingQueue.h"
+#include "benchmark/benchmark.h"
+
+namespace KawaiiMQ {
+
+    /**
+     * every thread pushes a message and then waits for one on the same queue, so all threads contend on both ends
+     */
+    template<QueueEngine engine>
+    static void BM_QueuePushWait(benchmark::State& state) {
+        static std::shared_ptr<Queue> queue;
+        if (state.thread_index() == 0) {
+            queue = makeQueue("bench", engine, 4096);
+        }
+        auto msg = makeMessage(0);
+        for (auto _ : state) {
+            queue->push(msg);
+            benchmark::DoNotOptimize(queue->wait());
+        }
+        state.SetItemsProcessed(state.iterations());
+        if (state.thread_index() == 0) {
+            queue.reset();
+        }
+    }
+    BENCHMARK(BM_QueuePushWait<QueueEngine::Mutex>)->ThreadRange(1, 16)->UseRealTime();
+    BENCHMARK(BM_QueuePushWait<QueueEngine::Ring>)->ThreadRange(1, 16)->UseRealTime();
+
+    /**
+     * push a burst then drain it, measures the uncontended cost of both ends
+     */
+    template<QueueEngine engine>
+    static void BM_QueueBurst(benchmark::State& state) {
+        auto queue = makeQueue("bench", engine, 1024);
+        auto msg = makeMessage(0);
+        for (auto _ : state) {
+            for (int i = 0; i < 1024; ++i) {
+                queue->push(msg);
+            }
+            for (int i = 0; i < 1024; ++i) {
+                benchmark::DoNotOptimize(queue->wait());
+            }
+        }
+        state.SetItemsProcessed(state.iterations() * 1024);
+    }
+    BENCHMARK(BM_QueueBurst<QueueEngine::Mutex>);
+    BENCHMARK(BM_QueueBurst<QueueEngine::Ring>);
+
+    /**
+     * same as BM_QueueBurst, but moving the burst with pushBulk and drain
+     */
+    template<QueueEngine engine>
+    static void BM_QueueBulkBurst(benchmark::State& state) {
+        auto queue = makeQueue("bench", engine, 1024);
+        std::vector<std::shared_ptr<Message<int>>> batch(1024, makeMessage(0));
+        std::vector<std::shared_ptr<MessageData>> out;
+        out.reserve(1024);
+        for (auto _ : state) {
+            queue->pushBulk(batch);
+            queue->drain(out, 1024);
+            out.clear();
+        }
+        state.SetItemsProcessed(state.iterations() * 1024);
+    }
+    BENCHMARK(BM_QueueBulkBurst<QueueEngine::Mutex>);
+    BENCHMARK(BM_QueueBulkBurst<QueueEngine::Ring>);
+
+    /**
+     * BM_QueueBurst with fresh int messages, allocating one Message<int> per push
+     */
+    template<QueueEngine engine>
+    static void BM_QueueBurstShared(benchmark::State& state) {
+        auto queue = makeQueue("bench", engine, 1024);
+        for (auto _ : state) {
+            for (int i = 0; i < 1024; ++i) {
+                queue->push(makeMessage(i));
+            }
+            for (int i = 0; i < 1024; ++i) {
+                benchmark::DoNotOptimize(getMessage<int>(queue->wait()));
+            }
+        }
+        state.SetItemsProcessed(state.iterations() * 1024);
+    }
+    BENCHMARK(BM_QueueBurstShared<QueueEngine::Mutex>);
+    BENCHMARK(BM_QueueBurstShared<QueueEngine::Ring>);
+
+    /**
+     * same traffic as BM_QueueBurstShared, with the ints stored inline in the queue slots
+     */
+    template<QueueEngine engine>
+    static void BM_QueueBurstInline(benchmark::State& state) {
+        auto queue = makeQueue("bench", engine, 1024);
+        for (auto _ : state) {
+            for (int i = 0; i < 1024; ++i) {
+                queue->pushValue(i);
+            }
+            for (int i = 0; i < 1024; ++i) {
+                benchmark::DoNotOptimize(getMessage<int>(queue->waitValue()));
+            }
+        }
+        state.SetItemsProcessed(state.iterations() * 1024);
+    }
+    BENCHMARK(BM_QueueBurstInline<QueueEngine::Mutex>);
+    BENCHMARK(BM_QueueBurstInline<QueueEngine::Ring>);
+}
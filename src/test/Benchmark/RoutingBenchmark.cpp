@@ -0,0 +1,49 @@
+/**
+ * @file RoutingBenchmark.cpp
+ * @author ayano
+ * @date 2/10/24
+ * @brief Cost of looking up the queues of a topic from many threads
+*/
+
+#include "MessageQueueManager.h"
+#include "benchmark/benchmark.h"
+
+namespace KawaiiMQ {
+
+    static Topic routingTopic() {
+        static Topic topic = []() {
+            Topic t("routingBenchmark");
+            for (int i = 0; i < 4; ++i) {
+                MessageQueueManager::Instance()->relate(t, makeQueue("routingBenchmark" + std::to_string(i)));
+            }
+            return t;
+        }();
+        return topic;
+    }
+
+    /**
+     * copies the queue list, one reference count increment and decrement per queue
+     */
+    static void BM_GetAllRelatedQueue(benchmark::State& state) {
+        auto manager = MessageQueueManager::Instance();
+        auto topic = routingTopic();
+        for (auto _ : state) {
+            benchmark::DoNotOptimize(manager->getAllRelatedQueue(topic));
+        }
+    }
+    BENCHMARK(BM_GetAllRelatedQueue)->ThreadRange(1, 16)->UseRealTime();
+
+    /**
+     * reads the published snapshot in place
+     */
+    static void BM_RelatedQueues(benchmark::State& state) {
+        auto manager = MessageQueueManager::Instance();
+        auto topic = routingTopic();
+        for (auto _ : state) {
+            for (auto& queue : manager->relatedQueues(topic)) {
+                benchmark::DoNotOptimize(queue.get());
+            }
+        }
+    }
+    BENCHMARK(BM_RelatedQueues)->ThreadRange(1, 16)->UseRealTime();
+}
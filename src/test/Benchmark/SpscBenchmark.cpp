@@ -0,0 +1,67 @@
+/**
+ * @file SpscBenchmark.cpp
+ * @author ayano
+ * @date 2/4/24
+ * @brief Single producer single consumer throughput and latency of the queue engines
+*/
+
+#include "Queue.h"
+#include "SpscQueue.h"
+#include "benchmark/benchmark.h"
+#include <thread>
+
+namespace KawaiiMQ {
+
+    /**
+     * one thread pushes, another waits, measures hand-off throughput
+     */
+    template<QueueEngine engine>
+    static void BM_SpscThroughput(benchmark::State& state) {
+        constexpr int batch = 4096;
+        auto queue = makeQueue("bench", engine, 1024);
+        auto msg = makeMessage(0);
+        for (auto _ : state) {
+            std::thread consumer([&]() {
+                for (int i = 0; i < batch; ++i) {
+                    benchmark::DoNotOptimize(queue->wait());
+                }
+            });
+            for (int i = 0; i < batch; ++i) {
+                queue->push(msg);
+            }
+            consumer.join();
+        }
+        state.SetItemsProcessed(state.iterations() * batch);
+    }
+    BENCHMARK(BM_SpscThroughput<QueueEngine::Mutex>)->UseRealTime();
+    BENCHMARK(BM_SpscThroughput<QueueEngine::Ring>)->UseRealTime();
+    BENCHMARK(BM_SpscThroughput<QueueEngine::Spsc>)->UseRealTime();
+
+    /**
+     * ping-pong between two threads over two queues, one iteration is a full round trip
+     */
+    template<QueueEngine engine>
+    static void BM_SpscRoundTrip(benchmark::State& state) {
+        auto ping = makeQueue("ping", engine, 16);
+        auto pong = makeQueue("pong", engine, 16);
+        std::thread echo([&]() {
+            for (;;) {
+                auto msg = ping->wait();
+                if (msg == nullptr) {
+                    return;
+                }
+                pong->push(msg);
+            }
+        });
+        auto msg = makeMessage(0);
+        for (auto _ : state) {
+            ping->push(msg);
+            benchmark::DoNotOptimize(pong->wait());
+        }
+        ping->push(std::shared_ptr<MessageData>());
+        echo.join();
+    }
+    BENCHMARK(BM_SpscRoundTrip<QueueEngine::Mutex>)->UseRealTime();
+    BENCHMARK(BM_SpscRoundTrip<QueueEngine::Ring>)->UseRealTime();
+    BENCHMARK(BM_SpscRoundTrip<QueueEngine::Spsc>)->UseRealTime();
+}
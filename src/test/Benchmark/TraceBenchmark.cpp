@@ -0,0 +1,30 @@
+/**
+ * @file TraceBenchmark.cpp
+ * @author ayano
+ * @date 2/24/24
+ * @brief Cost of tracing on the push, pop and read path, by sampling period
+*/
+
+#include "Queue.h"
+#include "benchmark/benchmark.h"
+
+namespace KawaiiMQ {
+
+    /**
+     * one push, pop and read of a heap message per iteration, state.range(0) is the sampling period, 0 is off
+     */
+    static void BM_PushPopTraced(benchmark::State& state) {
+        auto tracer = Tracer::Instance();
+        tracer->setSampleEvery(static_cast<std::uint32_t>(state.range(0)));
+        auto queue = makeQueue("bench", QueueEngine::Ring, 1024);
+        for (auto _ : state) {
+            // a new message every time, a traced message stays traced
+            queue->push(makeMessage(std::uint64_t(1)));
+            benchmark::DoNotOptimize(getMessage<std::uint64_t>(queue->wait()));
+        }
+        state.SetItemsProcessed(state.iterations());
+        tracer->setSampleEvery(0);
+        tracer->clear();
+    }
+    BENCHMARK(BM_PushPopTraced)->Arg(0)->Arg(64)->Arg(1);
+}
@@ -0,0 +1,62 @@
+/**
+ * @file WaitBenchmark.cpp
+ * @author ayano
+ * @date 2/13/24
+ * @brief Wake-up latency of each wait strategy, as p50/p99 of the round trip between two threads
+*/
+
+#include "kawaiiMQ.h"
+#include "benchmark/benchmark.h"
+#include <algorithm>
+#include <chrono>
+#include <thread>
+
+namespace KawaiiMQ {
+
+    /**
+     * ping-pong over two queues with the given wait strategy, reports the p50 and p99 round trip in microseconds
+     */
+    template<QueueEngine engine, WaitStrategy strategy>
+    static void BM_WaitRoundTrip(benchmark::State& state) {
+        auto ping = makeQueue("ping", engine, 16);
+        auto pong = makeQueue("pong", engine, 16);
+        ping->setWaitStrategy(strategy);
+        pong->setWaitStrategy(strategy);
+        std::thread echo([&]() {
+            for (;;) {
+                auto msg = ping->waitValue();
+                if (getMessage<int>(msg) < 0) {
+                    return;
+                }
+                pong->push(std::move(msg));
+            }
+        });
+        std::vector<double> samples;
+        samples.reserve(1 << 16);
+        for (auto _ : state) {
+            auto start = std::chrono::steady_clock::now();
+            ping->pushValue(0);
+            benchmark::DoNotOptimize(pong->waitValue());
+            auto end = std::chrono::steady_clock::now();
+            samples.push_back(std::chrono::duration<double, std::micro>(end - start).count());
+        }
+        ping->pushValue(-1);
+        echo.join();
+        if (samples.empty()) {
+            return;
+        }
+        std::sort(samples.begin(), samples.end());
+        state.counters["p50_us"] = samples[samples.size() / 2];
+        state.counters["p99_us"] = samples[samples.size() * 99 / 100];
+    }
+    BENCHMARK(BM_WaitRoundTrip<QueueEngine::Mutex, WaitStrategy::Blocking>)->UseRealTime();
+    BENCHMARK(BM_WaitRoundTrip<QueueEngine::Mutex, WaitStrategy::SpinPark>)->UseRealTime();
+    BENCHMARK(BM_WaitRoundTrip<QueueEngine::Mutex, WaitStrategy::SpinYield>)->UseRealTime();
+    BENCHMARK(BM_WaitRoundTrip<QueueEngine::Mutex, WaitStrategy::BusySpin>)->UseRealTime();
+    BENCHMARK(BM_WaitRoundTrip<QueueEngine::Ring, WaitStrategy::Blocking>)->UseRealTime();
+    BENCHMARK(BM_WaitRoundTrip<QueueEngine::Ring, WaitStrategy::SpinPark>)->UseRealTime();
+    BENCHMARK(BM_WaitRoundTrip<QueueEngine::Ring, WaitStrategy::SpinYield>)->UseRealTime();
+    BENCHMARK(BM_WaitRoundTrip<QueueEngine::Ring, WaitStrategy::BusySpin>)->UseRealTime();
+    BENCHMARK(BM_WaitRoundTrip<QueueEngine::Spsc, WaitStrategy::SpinPark>)->UseRealTime();
+    BENCHMARK(BM_WaitRoundTrip<QueueEngine::Spsc, WaitStrategy::BusySpin>)->UseRealTime();
+}
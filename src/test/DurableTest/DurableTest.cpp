@@ -0,0 +1,210 @@
+/**
+ * @file DurableTest.cpp
+ * @author ayano
+ * @date 2/17/24
+ * @brief
+*/
+
+#include "kawaiiMQ.h"
+#include "gtest/gtest.h"
+#include <fstream>
+#include <thread>
+
+namespace KawaiiMQ {
+
+    struct Point {
+        int x;
+        int y;
+        std::string label;
+    };
+
+    template<>
+    struct Serializer<Point> {
+        static void serialize(const Point& value, std::string& out) {
+            Serializer<int>::serialize(value.x, out);
+            Serializer<int>::serialize(value.y, out);
+            out.append(value.label);
+        }
+
+        static Point deserialize(std::string_view in) {
+            return {Serializer<int>::deserialize(in.substr(0, sizeof(int))),
+                    Serializer<int>::deserialize(in.substr(sizeof(int), sizeof(int))),
+                    std::string(in.substr(2 * sizeof(int)))};
+        }
+    };
+
+    class DurableQueueTest : public ::testing::Test {
+    protected:
+        void SetUp() override {
+            options.directory = std::filesystem::temp_directory_path() /
+                                ("kawaiimq-test-" + std::string(::testing::UnitTest::GetInstance()->current_test_info()->name()));
+            std::filesystem::remove_all(options.directory);
+        }
+
+        void TearDown() override {
+            MessageQueueManager::Instance()->flush();
+            std::filesystem::remove_all(options.directory);
+        }
+
+        DurableOptions options;
+    };
+
+    TEST_F(DurableQueueTest, ReplayAfterRestart) {
+        {
+            auto queue = makeDurableQueue("q", options);
+            for (int i = 0; i < 100; ++i) {
+                queue->pushValue(i);
+            }
+            queue->pushValue(std::string("last"));
+        }
+        auto queue = makeDurableQueue("q", options);
+        ASSERT_EQ(queue->getRecoveredCount(), 101);
+        for (int i = 0; i < 100; ++i) {
+            ASSERT_EQ(getMessage<int>(queue->waitValue()), i);
+        }
+        ASSERT_EQ(getMessage<std::string>(queue->waitValue()), "last");
+    }
+
+    TEST_F(DurableQueueTest, ConsumedMessagesAreNotReplayed) {
+        options.segment_size = 256;
+        {
+            auto queue = makeDurableQueue("q", options);
+            for (int i = 0; i < 100; ++i) {
+                queue->pushValue(i);
+            }
+            for (int i = 0; i < 60; ++i) {
+                ASSERT_EQ(getMessage<int>(queue->waitValue()), i);
+            }
+            queue->sync();
+            // old segments only hold consumed messages by now
+            ASSERT_LT(queue->getLog().getSegmentCount(), 10);
+        }
+        {
+            auto queue = makeDurableQueue("q", options);
+            ASSERT_EQ(queue->getRecoveredCount(), 40);
+            ASSERT_EQ(getMessage<int>(queue->waitValue()), 60);
+            queue->pushValue(100);
+        }
+        auto queue = makeDurableQueue("q", options);
+        ASSERT_EQ(queue->getRecoveredCount(), 40);
+        std::vector<Envelope> rest;
+        queue->drain(rest, 100);
+        ASSERT_EQ(rest.size(), 40);
+        ASSERT_EQ(getMessage<int>(rest.front()), 61);
+        ASSERT_EQ(getMessage<int>(rest.back()), 100);
+    }
+
+    TEST_F(DurableQueueTest, CustomSerializer) {
+        registerSerializer<Point>("Point");
+        {
+            auto queue = makeDurableQueue("q", options);
+            queue->pushValue(Point{1, 2, "a"});
+            queue->push(makeMessage(Point{3, 4, "b"}));
+        }
+        auto queue = makeDurableQueue("q", options);
+        auto first = getMessage<Point>(queue->waitValue());
+        ASSERT_EQ(first.x, 1);
+        ASSERT_EQ(first.label, "a");
+        ASSERT_EQ(getMessage<Point>(queue->wait()).label, "b");
+    }
+
+    TEST_F(DurableQueueTest, SerializerNamesAreStable) {
+        std::string bytes;
+        // what is written to disk depends on the name only, not on the compiler spelling of the type
+        ASSERT_EQ(SerializerRegistry::Instance()->serialize(Envelope::of(1), bytes), serializerId("int"));
+        ASSERT_EQ(serializerId("int"), 0x2b9fff192bd4c83eull);
+        registerSerializer<Point>("Point");
+        ASSERT_THROW(registerSerializer<Point>("Point2"), TypeException);
+        struct Other {
+            int value;
+        };
+        ASSERT_THROW(registerSerializer<Other>("Point"), TypeException);
+        ASSERT_TRUE(SerializerRegistry::Instance()->contains(serializerId("Point")));
+        ASSERT_FALSE(SerializerRegistry::Instance()->contains(serializerId("Point2")));
+    }
+
+    TEST_F(DurableQueueTest, UnregisteredTypeThrows) {
+        struct Unknown {
+            int value;
+        };
+        auto queue = makeDurableQueue("q", options);
+        ASSERT_THROW(queue->pushValue(Unknown{1}), TypeException);
+        ASSERT_TRUE(queue->empty());
+    }
+
+    TEST_F(DurableQueueTest, TornTailIsDropped) {
+        {
+            auto queue = makeDurableQueue("q", options);
+            for (int i = 0; i < 10; ++i) {
+                queue->pushValue(i);
+            }
+        }
+        std::filesystem::path segment;
+        for (const auto& entry : std::filesystem::directory_iterator(options.directory / "q")) {
+            if (entry.path().extension() == ".log") {
+                segment = entry.path();
+            }
+        }
+        // cut the last record in half, as a crash in the middle of a write would
+        std::filesystem::resize_file(segment, std::filesystem::file_size(segment) - 10);
+        {
+            auto queue = makeDurableQueue("q", options);
+            ASSERT_EQ(queue->getRecoveredCount(), 9);
+            queue->pushValue(9);
+        }
+        auto queue = makeDurableQueue("q", options);
+        ASSERT_EQ(queue->getRecoveredCount(), 10);
+        for (int i = 0; i < 10; ++i) {
+            ASSERT_EQ(getMessage<int>(queue->waitValue()), i);
+        }
+    }
+
+    TEST_F(DurableQueueTest, GroupCommitAcrossProducers) {
+        options.fsync = FsyncPolicy::everyMessages(1);
+        auto queue = makeDurableQueue("q", options);
+        std::vector<std::thread> producers;
+        for (int t = 0; t < 4; ++t) {
+            producers.emplace_back([&queue]() {
+                for (int i = 0; i < 100; ++i) {
+                    queue->pushValue(i);
+                }
+            });
+        }
+        for (auto& t : producers) {
+            t.join();
+        }
+        ASSERT_EQ(queue->size(), 400);
+        ASSERT_LE(queue->getLog().getSyncCount(), 401);
+    }
+
+    TEST_F(DurableQueueTest, TimedFsync) {
+        options.fsync = FsyncPolicy::everyMillis(std::chrono::milliseconds(5));
+        auto queue = makeDurableQueue("q", options);
+        queue->pushValue(1);
+        auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(5);
+        while (queue->getLog().getSyncCount() < 2 && std::chrono::steady_clock::now() < deadline) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
+        // one for the new segment, one from the timer
+        ASSERT_GE(queue->getLog().getSyncCount(), 2);
+    }
+
+    TEST_F(DurableQueueTest, RecoverRelatesTopics) {
+        auto manager = MessageQueueManager::Instance();
+        Topic topic("durable");
+        {
+            auto queue = makeDurableQueue("q", options);
+            manager->relate(topic, queue);
+            Producer producer({topic}, "producer");
+            producer.publishValue(topic, 42);
+            manager->flush();
+        }
+        auto queues = manager->recover(options);
+        ASSERT_EQ(queues.size(), 1);
+        ASSERT_TRUE(manager->isRelated(topic, queues[0]));
+        Consumer consumer({topic});
+        auto messages = consumer.fetchMessage();
+        ASSERT_EQ(messages[topic].size(), 1);
+        ASSERT_EQ(getMessage<int>(messages[topic][0]), 42);
+    }
+}
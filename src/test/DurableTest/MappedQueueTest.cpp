@@ -0,0 +1,113 @@
+/**
+ * @file MappedQueueTest.cpp
+ * @author ayano
+ * @date 2/18/24
+ * @brief
+*/
+
+#include "kawaiiMQ.h"
+#include "gtest/gtest.h"
+#include <thread>
+
+namespace KawaiiMQ {
+
+    class MappedQueueTest : public ::testing::Test {
+    protected:
+        void SetUp() override {
+            options.directory = std::filesystem::temp_directory_path() /
+                                ("kawaiimq-mapped-" + std::string(::testing::UnitTest::GetInstance()->current_test_info()->name()));
+            options.segment_size = 4096;
+            std::filesystem::remove_all(options.directory);
+        }
+
+        void TearDown() override {
+            std::filesystem::remove_all(options.directory);
+        }
+
+        MappedOptions options;
+    };
+
+    TEST_F(MappedQueueTest, PushAndWaitBytes) {
+        auto queue = makeMappedQueue("q", options);
+        queue->pushBytes("hello");
+        queue->push(makeMessage(std::string("world")));
+        queue->pushValue(Bytes::copyOf("!"));
+        ASSERT_EQ(queue->size(), 3);
+        ASSERT_EQ(getMessage<Bytes>(queue->wait()).view(), "hello");
+        ASSERT_EQ(getMessage<Bytes>(queue->wait()).view(), "world");
+        std::shared_ptr<MessageData> msg;
+        ASSERT_TRUE(queue->tryWait(msg));
+        ASSERT_EQ(getMessage<Bytes>(msg).view(), "!");
+        ASSERT_FALSE(queue->tryWait(msg));
+        ASSERT_THROW(queue->pushValue(1), TypeException);
+    }
+
+    TEST_F(MappedQueueTest, ViewOutlivesQueue) {
+        std::shared_ptr<MessageData> msg;
+        {
+            auto queue = makeMappedQueue("q", options);
+            queue->pushBytes(std::string(1000, 'x'));
+            msg = queue->wait();
+        }
+        auto bytes = getMessage<Bytes>(msg);
+        ASSERT_EQ(bytes.size(), 1000);
+        ASSERT_EQ(bytes.view(), std::string(1000, 'x'));
+    }
+
+    TEST_F(MappedQueueTest, SegmentsRollOverAndAreDeleted) {
+        auto queue = makeMappedQueue("q", options);
+        for (int i = 0; i < 100; ++i) {
+            queue->pushBytes(std::string(100, static_cast<char>('a' + i % 26)));
+        }
+        ASSERT_EQ(queue->getSegmentCount(), 3);
+        ASSERT_THROW(queue->pushBytes(std::string(5000, 'x')), QueueException);
+        std::vector<Envelope> out;
+        ASSERT_EQ(queue->drain(out, 1000), 100);
+        for (int i = 0; i < 100; ++i) {
+            ASSERT_EQ(getMessage<Bytes>(out[i]).view(), std::string(100, static_cast<char>('a' + i % 26)));
+        }
+        ASSERT_EQ(queue->getSegmentCount(), 1);
+    }
+
+    TEST_F(MappedQueueTest, RestartRemaps) {
+        {
+            auto queue = makeMappedQueue("q", options);
+            for (int i = 0; i < 100; ++i) {
+                queue->pushBytes(std::to_string(i));
+            }
+            for (int i = 0; i < 30; ++i) {
+                queue->wait();
+            }
+            queue->sync();
+        }
+        // a different segment size is ignored, the one stored with the queue wins
+        options.segment_size = 1 << 20;
+        auto queue = makeMappedQueue("q", options);
+        ASSERT_EQ(queue->size(), 70);
+        for (int i = 30; i < 100; ++i) {
+            ASSERT_EQ(getMessage<Bytes>(queue->wait()).view(), std::to_string(i));
+        }
+        ASSERT_TRUE(queue->empty());
+    }
+
+    TEST_F(MappedQueueTest, BlockingWait) {
+        auto queue = makeMappedQueue("q", options);
+        std::thread producer([&queue]() {
+            std::this_thread::sleep_for(std::chrono::milliseconds(10));
+            queue->pushBytes("late");
+        });
+        ASSERT_EQ(getMessage<Bytes>(queue->wait()).view(), "late");
+        producer.join();
+    }
+
+    TEST_F(MappedQueueTest, BytesInDurableQueue) {
+        DurableOptions durable;
+        durable.directory = options.directory / "durable";
+        {
+            auto queue = makeDurableQueue("q", durable);
+            queue->pushValue(Bytes::copyOf("payload"));
+        }
+        auto queue = makeDurableQueue("q", durable);
+        ASSERT_EQ(getMessage<Bytes>(queue->wait()).view(), "payload");
+    }
+}
@@ -79,4 +79,80 @@ namespace KawaiiMQ{
             thread.join();
         }
     }
+
+    TEST_F(MessageQueueManagerTest, TopicInterning) {
+        Topic a("internedTopic");
+        Topic b(std::string("interned") + "Topic");
+        Topic c("otherTopic");
+        ASSERT_EQ(a.getId(), b.getId());
+        ASSERT_EQ(&a.getName(), &b.getName());
+        ASSERT_EQ(a, b);
+        ASSERT_NE(a, c);
+        ASSERT_EQ(std::hash<Topic>()(a), a.getId());
+        ASSERT_EQ(Topic::fromId(c.getId()).getName(), "otherTopic");
+        ASSERT_THROW(Topic::fromId(TopicRegistry::Instance()->size()), TopicException);
+    }
+
+    TEST_F(MessageQueueManagerTest, RelatedTopics) {
+        auto instance = MessageQueueManager::Instance();
+        Topic topic1("relatedTopic1");
+        Topic topic2("relatedTopic2");
+        ASSERT_FALSE(instance->isRelatedAny(topic1));
+        instance->relate(topic1, makeQueue("q1"));
+        instance->relate(topic2, makeQueue("q2"));
+        instance->relate(topic2, makeQueue("q3"));
+        ASSERT_TRUE(instance->isRelatedAny(topic1));
+        ASSERT_EQ(instance->getAllRelatedQueue(topic2).size(), 2);
+        auto topics = instance->getRelatedTopic();
+        ASSERT_EQ(topics.size(), 2);
+        ASSERT_NE(std::find(topics.begin(), topics.end(), topic2), topics.end());
+    }
+
+    TEST_F(MessageQueueManagerTest, RelatedQueuesViewOutlivesUnrelate) {
+        auto instance = MessageQueueManager::Instance();
+        Topic topic("viewTopic");
+        auto queue1 = makeQueue("q1");
+        auto queue2 = makeQueue("q2");
+        instance->relate(topic, queue1);
+        instance->relate(topic, queue2);
+        {
+            auto view = instance->relatedQueues(topic);
+            instance->unrelate(topic, queue1);
+            ASSERT_EQ(view.size(), 2);
+            ASSERT_EQ(view[0], queue1);
+            ASSERT_EQ(instance->relatedQueues(topic).size(), 1);
+            ASSERT_GT(Rcu::pending(), 0);
+        }
+        Rcu::reclaim();
+        ASSERT_EQ(Rcu::pending(), 0);
+    }
+
+    TEST_F(MessageQueueManagerTest, ConcurrentLookupAndRelate) {
+        auto instance = MessageQueueManager::Instance();
+        Topic topic("churnTopic");
+        auto stable = makeQueue("stable");
+        instance->relate(topic, stable);
+        std::atomic<bool> stop = false;
+        std::vector<std::thread> readers;
+        for (int i = 0; i < 4; ++i) {
+            readers.emplace_back([&]() {
+                while (!stop) {
+                    auto view = instance->relatedQueues(topic);
+                    ASSERT_FALSE(view.empty());
+                    ASSERT_EQ(view[0], stable);
+                }
+            });
+        }
+        for (int i = 0; i < 1000; ++i) {
+            auto q = makeQueue("churn" + std::to_string(i));
+            q->setSafeTimeout(0);
+            instance->relate(topic, q);
+            instance->unrelate(topic, q);
+        }
+        stop = true;
+        for (auto& reader : readers) {
+            reader.join();
+        }
+        ASSERT_EQ(instance->relatedQueues(topic).size(), 1);
+    }
 }
@@ -0,0 +1,163 @@
+/**
+ * @file MetricsTest.cpp
+ * @author ayano
+ * @date 2/23/24
+ * @brief
+*/
+
+#include "kawaiiMQ.h"
+#include "gtest/gtest.h"
+#include <algorithm>
+#include <thread>
+#include <chrono>
+
+using namespace std::chrono_literals;
+
+namespace KawaiiMQ {
+
+    class MetricsTest : public ::testing::Test {
+    protected:
+        void TearDown() override {
+            MetricsRegistry::Instance()->setSampleEvery(64);
+            MessageQueueManager::Instance()->flush();
+        }
+    };
+
+    TEST(HistogramTest, BucketsBoundValues) {
+        for (std::uint64_t v = 0; v < (std::uint64_t(1) << 40); v = v * 3 / 2 + 1) {
+            auto bucket = Histogram::bucketOf(v);
+            ASSERT_LT(bucket, Histogram::bucketCount);
+            ASSERT_GE(Histogram::upperBound(bucket), v);
+            ASSERT_LE(Histogram::upperBound(bucket), v + v / 8);
+            ASSERT_EQ(Histogram::bucketOf(Histogram::upperBound(bucket)), bucket);
+        }
+        ASSERT_EQ(Histogram::bucketOf(UINT64_MAX), Histogram::bucketCount - 1);
+    }
+
+    TEST(HistogramTest, Percentiles) {
+        Histogram histogram;
+        ASSERT_EQ(histogram.snapshot().percentile(0.5), 0);
+        for (std::uint64_t v = 1; v <= 1000; ++v) {
+            histogram.record(v);
+        }
+        auto snapshot = histogram.snapshot();
+        ASSERT_EQ(snapshot.count, 1000);
+        ASSERT_EQ(snapshot.max, 1000);
+        ASSERT_DOUBLE_EQ(snapshot.mean(), 500.5);
+        ASSERT_GE(snapshot.percentile(0.5), 500);
+        ASSERT_LE(snapshot.percentile(0.5), 500 + 500 / 8);
+        ASSERT_GE(snapshot.percentile(0.99), 990);
+        ASSERT_EQ(snapshot.percentile(1), 1000);
+    }
+
+    TEST(ShardedCountersTest, MoreThreadsThanShards) {
+        ShardedCounters<2> counters;
+        std::vector<std::thread> threads;
+        for (unsigned i = 0; i < MetricShard::shardCount + 8; ++i) {
+            threads.emplace_back([&counters]() {
+                for (int j = 0; j < 10000; ++j) {
+                    counters.add(0);
+                }
+                counters.add(1, 2);
+            });
+        }
+        for (auto& thread : threads) {
+            thread.join();
+        }
+        ASSERT_EQ(counters.load(0), (MetricShard::shardCount + 8) * 10000);
+        ASSERT_EQ(counters.load(1), (MetricShard::shardCount + 8) * 2);
+    }
+
+    TEST_F(MetricsTest, QueueCountsAndSamplesLatency) {
+        MetricsRegistry::Instance()->setSampleEvery(1);
+        auto queue = makeQueue("metricsQueue", QueueEngine::Ring, 1024);
+        // a new thread starts sampling right away, the period of this one may still be running
+        std::thread producer([&queue]() {
+            for (int i = 0; i < 100; ++i) {
+                queue->pushValue(i);
+            }
+        });
+        producer.join();
+        std::vector<Envelope> out;
+        ASSERT_EQ(queue->drain(out, 60), 60);
+        for (int i = 60; i < 100; ++i) {
+            queue->waitValue();
+        }
+        auto metrics = queue->getMetrics();
+        ASSERT_EQ(metrics.name, "metricsQueue");
+        ASSERT_EQ(metrics.depth, 0);
+        ASSERT_EQ(metrics.capacity, 1024);
+        ASSERT_EQ(metrics.enqueued, 100);
+        ASSERT_EQ(metrics.dequeued, 100);
+        ASSERT_EQ(metrics.waits, 0);
+        ASSERT_EQ(metrics.latency.count, 100);
+        ASSERT_GT(metrics.latency.max, 0);
+    }
+
+    TEST_F(MetricsTest, BlockingWaitIsTimed) {
+        auto queue = makeQueue("metricsQueue");
+        std::thread producer([&queue]() {
+            std::this_thread::sleep_for(20ms);
+            queue->pushValue(1);
+        });
+        ASSERT_EQ(getMessage<int>(queue->waitValue()), 1);
+        producer.join();
+        auto metrics = queue->getMetrics();
+        ASSERT_EQ(metrics.waits, 1);
+        ASSERT_EQ(metrics.wait.count, 1);
+        ASSERT_GE(metrics.wait.max, std::chrono::nanoseconds(10ms).count());
+    }
+
+    TEST_F(MetricsTest, SnapshotAndPrometheus) {
+        auto manager = MessageQueueManager::Instance();
+        Topic topic("metricsTopic");
+        auto queue = makeQueue("metrics\"Queue");
+        auto other = makeQueue("metricsOther");
+        manager->relate(topic, queue);
+        manager->relate(topic, other);
+        Producer producer("metricsProducer");
+        producer.subscribe(topic);
+        Consumer consumer("metricsConsumer");
+        consumer.subscribe(topic);
+        for (int i = 0; i < 3; ++i) {
+            producer.publishValue(topic, i);
+        }
+        ASSERT_EQ(consumer.fetchSingleTopic(topic).size(), 2);
+
+        auto snapshot = manager->snapshotMetrics();
+        auto topic_sample = std::find_if(snapshot.topics.begin(), snapshot.topics.end(),
+                                         [](const TopicSample& t) { return t.name == "metricsTopic"; });
+        ASSERT_NE(topic_sample, snapshot.topics.end());
+        ASSERT_EQ(topic_sample->queues, 2);
+        ASSERT_EQ(topic_sample->depth, 4);
+        ASSERT_EQ(snapshot.queues.size(), 2);
+        auto producer_sample = std::find_if(snapshot.producers.begin(), snapshot.producers.end(),
+                                            [](const ProducerSample& p) { return p.name == "metricsProducer"; });
+        ASSERT_NE(producer_sample, snapshot.producers.end());
+        ASSERT_EQ(producer_sample->published, 3);
+        auto consumer_sample = std::find_if(snapshot.consumers.begin(), snapshot.consumers.end(),
+                                            [](const ConsumerSample& c) { return c.name == "metricsConsumer"; });
+        ASSERT_NE(consumer_sample, snapshot.consumers.end());
+        ASSERT_EQ(consumer_sample->fetched, 2);
+
+        auto text = manager->exportPrometheus();
+        ASSERT_NE(text.find("# TYPE kawaiimq_queue_enqueued_total counter\n"), std::string::npos);
+        ASSERT_NE(text.find("kawaiimq_queue_enqueued_total{queue=\"metrics\\\"Queue\"} 3\n"), std::string::npos);
+        ASSERT_NE(text.find("kawaiimq_queue_depth{queue=\"metricsOther\"} 2\n"), std::string::npos);
+        ASSERT_NE(text.find("kawaiimq_topic_depth{topic=\"metricsTopic\"} 4\n"), std::string::npos);
+        ASSERT_NE(text.find("kawaiimq_producer_published_total{producer=\"metricsProducer\"} 3\n"), std::string::npos);
+        ASSERT_NE(text.find("kawaiimq_queue_latency_seconds{queue=\"metricsOther\",quantile=\"0.99\"}"),
+                  std::string::npos);
+        ASSERT_NE(text.find("kawaiimq_consumer_fetched_total{consumer=\"metricsConsumer\"} 2\n"), std::string::npos);
+    }
+
+    TEST_F(MetricsTest, RegistrationGoesAwayWithTheProducer) {
+        {
+            Producer producer("metricsGone");
+        }
+        MetricsSnapshot snapshot;
+        MetricsRegistry::Instance()->sampleClients(snapshot);
+        ASSERT_TRUE(std::none_of(snapshot.producers.begin(), snapshot.producers.end(),
+                                 [](const ProducerSample& p) { return p.name == "metricsGone"; }));
+    }
+}
@@ -0,0 +1,159 @@
+/**
+ * @file MessageTest.cpp
+ * @author ayano
+ * @date 2/6/24
+ * @brief
+*/
+
+#include "Message.h"
+#include "Envelope.h"
+#include "gtest/gtest.h"
+#include <string>
+#include <vector>
+#include <thread>
+
+namespace {
+    // same name as the one in OtherUnit.cpp, a different type
+    struct Local {
+        int x;
+        int y;
+    };
+}
+
+namespace KawaiiMQ {
+    std::uint64_t otherLocalTag();
+
+    Envelope otherLocalEnvelope();
+
+    TEST(MessageTest, TypeTagsAreDistinct) {
+        ASSERT_NE(typeTag<int>(), typeTag<long>());
+        ASSERT_NE(typeTag<std::string>(), typeTag<std::vector<char>>());
+        ASSERT_EQ(typeTag<int>(), typeTag<int>());
+        ASSERT_EQ(makeMessage(1)->getTypeTag(), typeTag<int>());
+    }
+
+    TEST(MessageTest, TypeTagsTellLocalTypesApart) {
+        ASSERT_NE(typeTag<Local>(), otherLocalTag());
+        auto env = otherLocalEnvelope();
+        ASSERT_TRUE(env.isInline());
+        ASSERT_EQ(env.get<Local>(), nullptr);
+        ASSERT_THROW(getMessage<Local>(env), TypeException);
+        ASSERT_THROW(getMessage<Local>(env.toShared()), TypeException);
+    }
+
+    TEST(MessageTest, GetMessageReturnsReference) {
+        std::shared_ptr<MessageData> m = makeMessage(std::string("hello"));
+        const std::string& content = getMessage<std::string>(m);
+        ASSERT_EQ(content, "hello");
+        ASSERT_EQ(&content, &getMessage<std::string>(m));
+    }
+
+    TEST(MessageTest, GetMessageMovesOutLastReference) {
+        std::shared_ptr<MessageData> m = makeMessage(std::vector<int>(100, 1));
+        auto keep = m;
+        auto copied = getMessage<std::vector<int>>(std::move(m));
+        ASSERT_EQ(getMessage<std::vector<int>>(keep).size(), 100);
+        auto moved = getMessage<std::vector<int>>(std::move(keep));
+        ASSERT_EQ(copied, moved);
+    }
+
+    TEST(MessageTest, GetMessageMovesOutAfterOtherReadersRelease) {
+        for (int round = 0; round < 100; ++round) {
+            std::shared_ptr<MessageData> m = makeMessage(std::string(64, 'x'));
+            std::vector<std::thread> readers;
+            std::atomic<std::size_t> seen = 0;
+            for (int i = 0; i < 4; ++i) {
+                readers.emplace_back([copy = m, &seen]() mutable {
+                    seen.fetch_add(getMessage<std::string>(copy).size(), std::memory_order_relaxed);
+                    copy.reset();
+                });
+            }
+            // no join yet, only the reference counts order the readers before the move
+            while (m.use_count() != 1) {
+                std::this_thread::yield();
+            }
+            ASSERT_EQ(getMessage<std::string>(std::move(m)), std::string(64, 'x'));
+            for (auto& reader : readers) {
+                reader.join();
+            }
+            ASSERT_EQ(seen.load(), 4 * 64);
+        }
+    }
+
+    TEST(MessageTest, WrongTypeThrows) {
+        std::shared_ptr<MessageData> m = makeMessage(1);
+        ASSERT_THROW(getMessage<long>(m), TypeException);
+        ASSERT_THROW(getMessage<int>(std::shared_ptr<MessageData>()), TypeException);
+    }
+
+    TEST(MessageTest, VisitMessage) {
+        std::shared_ptr<MessageData> m = makeMessage(42);
+        int seen = 0;
+        ASSERT_TRUE(visitMessage<int>(m, [&](const int& v) { seen = v; }));
+        ASSERT_FALSE(visitMessage<std::string>(m, [&](const std::string&) { seen = -1; }));
+        ASSERT_EQ(seen, 42);
+    }
+
+    TEST(MessageTest, PoolRecyclesBlocks) {
+        struct Payload {
+            int a;
+            double b;
+        };
+        auto before = messagePoolStats<Payload>();
+        for (int i = 0; i < 100; ++i) {
+            auto m = makeMessage(Payload{i, 0.5});
+            ASSERT_EQ(getMessage<Payload>(m).a, i);
+        }
+        auto after = messagePoolStats<Payload>();
+        ASSERT_EQ(after.requests - before.requests, 100);
+        ASSERT_EQ(after.misses - before.misses, 1);
+        ASSERT_GT(after.hitRate(), 0.9);
+        ASSERT_EQ(after.footprint(), after.block_size);
+    }
+
+    TEST(MessageTest, PoolAcrossThreads) {
+        std::vector<std::shared_ptr<MessageData>> messages;
+        std::thread producer([&]() {
+            for (int i = 0; i < 10000; ++i) {
+                messages.push_back(makeMessage(static_cast<short>(i)));
+            }
+        });
+        producer.join();
+        for (int i = 0; i < 10000; ++i) {
+            ASSERT_EQ(getMessage<short>(messages[i]), static_cast<short>(i));
+        }
+        messages.clear();
+        auto stats = messagePoolStats<short>();
+        ASSERT_EQ(stats.requests, 10000);
+        ASSERT_LE(stats.blocks, 10000);
+        for (int i = 0; i < 10000; ++i) {
+            messages.push_back(makeMessage(static_cast<short>(i)));
+        }
+        ASSERT_EQ(messagePoolStats<short>().misses, stats.misses);
+    }
+
+    TEST(MessageTest, EnvelopeStoresSmallPayloadInline) {
+        struct Point {
+            int x;
+            int y;
+        };
+        auto env = Envelope::of(Point{1, 2});
+        ASSERT_TRUE(env.isInline());
+        ASSERT_EQ(env.getTypeTag(), typeTag<Point>());
+        ASSERT_EQ(getMessage<Point>(env).y, 2);
+        ASSERT_EQ(env.get<int>(), nullptr);
+        ASSERT_THROW(getMessage<int>(env), TypeException);
+        auto boxed = env.toShared();
+        ASSERT_EQ(getMessage<Point>(boxed).x, 1);
+    }
+
+    TEST(MessageTest, EnvelopeSpillsLargePayload) {
+        auto env = Envelope::of(std::string("not trivially copyable"));
+        ASSERT_FALSE(env.isInline());
+        ASSERT_EQ(getMessage<std::string>(env), "not trivially copyable");
+        ASSERT_EQ(getMessage<std::string>(std::move(env)), "not trivially copyable");
+        std::shared_ptr<MessageData> m = makeMessage(7);
+        Envelope wrapped(m);
+        ASSERT_EQ(std::move(wrapped).toShared(), m);
+    }
+}
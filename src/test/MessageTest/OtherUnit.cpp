@@ -0,0 +1,27 @@
+/**
+ * @file OtherUnit.cpp
+ * @author ayano
+ * @date 2/26/24
+ * @brief a second translation unit for the type tag tests
+*/
+
+#include "Message.h"
+#include "Envelope.h"
+
+namespace {
+    // same name as the one in MessageTest.cpp, a different type
+    struct Local {
+        int x;
+        int y;
+    };
+}
+
+namespace KawaiiMQ {
+    std::uint64_t otherLocalTag() {
+        return typeTag<Local>();
+    }
+
+    Envelope otherLocalEnvelope() {
+        return Envelope::of(Local{1, 2});
+    }
+}
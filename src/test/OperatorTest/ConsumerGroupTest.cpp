@@ -0,0 +1,128 @@
+/**
+ * @file ConsumerGroupTest.cpp
+ * @author ayano
+ * @date 2/20/24
+ * @brief
+*/
+
+#include "kawaiiMQ.h"
+#include "gtest/gtest.h"
+#include <thread>
+
+namespace KawaiiMQ {
+
+    class ConsumerGroupTest : public ::testing::Test {
+    protected:
+        void SetUp() override {
+            for (int i = 0; i < 4; ++i) {
+                partitions.push_back(makeQueue("partition" + std::to_string(i)));
+            }
+            MessageQueueManager::Instance()->partition(topic, partitions);
+        }
+
+        void TearDown() override {
+            MessageQueueManager::Instance()->flush();
+        }
+
+        Topic topic{"partitionedTopic"};
+        std::vector<std::shared_ptr<Queue>> partitions;
+    };
+
+    TEST_F(ConsumerGroupTest, SameKeySamePartition) {
+        ASSERT_TRUE(MessageQueueManager::Instance()->isPartitioned(topic));
+        ASSERT_THROW(MessageQueueManager::Instance()->partition(topic, {makeQueue("other")}), TopicException);
+        Producer producer({topic}, "producer");
+        for (int i = 0; i < 100; ++i) {
+            producer.publishValue(topic, i, "user" + std::to_string(i % 10));
+        }
+        std::size_t total = 0;
+        for (auto& partition : partitions) {
+            total += partition->size();
+            // every key of a partition in order, and nowhere else
+            std::vector<Envelope> out;
+            partition->drain(out, 100);
+            std::unordered_map<int, int> last;
+            for (auto& msg : out) {
+                auto value = getMessage<int>(msg);
+                auto it = last.find(value % 10);
+                if (it != last.end()) {
+                    ASSERT_EQ(value, it->second + 10);
+                }
+                last[value % 10] = value;
+            }
+            for (auto& [key, value] : last) {
+                ASSERT_EQ(value, 90 + key);
+            }
+        }
+        ASSERT_EQ(total, 100);
+    }
+
+    TEST_F(ConsumerGroupTest, UnkeyedTakesPartitionsInTurn) {
+        Producer producer({topic}, "producer");
+        for (int i = 0; i < 8; ++i) {
+            producer.publishMessage(topic, makeMessage(i));
+        }
+        producer.publishBatch(topic, std::vector{makeMessage(8), makeMessage(9)});
+        std::size_t total = 0;
+        for (auto& partition : partitions) {
+            ASSERT_GE(partition->size(), 2);
+            total += partition->size();
+        }
+        ASSERT_EQ(total, 10);
+    }
+
+    TEST_F(ConsumerGroupTest, MembersSplitPartitions) {
+        auto group = makeConsumerGroup("group");
+        Consumer a({topic});
+        Consumer b({topic});
+        a.join(group);
+        ASSERT_EQ(group->getPartitions(a, topic).size(), 4);
+        b.join(group);
+        ASSERT_THROW(b.join(group), TopicException);
+        ASSERT_EQ(group->getPartitions(a, topic).size(), 2);
+        ASSERT_EQ(group->getPartitions(b, topic).size(), 2);
+        {
+            Consumer c({topic});
+            c.join(group);
+            ASSERT_EQ(group->getPartitions(a, topic).size(), 2);
+            ASSERT_EQ(group->getPartitions(c, topic).size(), 1);
+            c.unsubscribe(topic);
+            ASSERT_TRUE(group->getPartitions(c, topic).empty());
+            ASSERT_EQ(group->getPartitions(b, topic).size(), 2);
+        }
+        ASSERT_EQ(group->getMemberCount(), 2);
+        Producer producer({topic}, "producer");
+        for (int i = 0; i < 100; ++i) {
+            producer.publishValue(topic, i, i);
+        }
+        auto from_a = a.fetchBatch(topic, 1000, 0);
+        auto from_b = b.fetchMessage(10)[topic];
+        ASSERT_EQ(from_a.size() + from_b.size(), 100);
+        ASSERT_FALSE(from_a.empty());
+        ASSERT_FALSE(from_b.empty());
+        b.leave();
+        ASSERT_EQ(group->getPartitions(a, topic).size(), 4);
+        // outside the group, every partition is read
+        producer.publishValue(topic, 0, 0);
+        producer.publishValue(topic, 1, 1);
+        ASSERT_EQ(b.fetchBatch(topic, 10, 0).size(), 2);
+    }
+
+    TEST_F(ConsumerGroupTest, RebalanceWakesBlockedFetch) {
+        auto group = makeConsumerGroup("group");
+        Consumer a({topic});
+        auto b = std::make_unique<Consumer>(std::vector{topic});
+        a.join(group);
+        b->join(group);
+        auto b_partitions = group->getPartitions(*b, topic);
+        std::thread leaver([&]() {
+            std::this_thread::sleep_for(std::chrono::milliseconds(20));
+            b.reset();
+            b_partitions[0]->pushValue(42);
+        });
+        auto got = a.fetchMessage(2000)[topic];
+        leaver.join();
+        ASSERT_EQ(got.size(), 1);
+        ASSERT_EQ(getMessage<int>(got[0]), 42);
+    }
+}
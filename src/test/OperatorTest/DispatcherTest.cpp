@@ -0,0 +1,106 @@
+/**
+ * @file DispatcherTest.cpp
+ * @author ayano
+ * @date 2/14/24
+ * @brief
+*/
+
+#include "kawaiiMQ.h"
+#include "gtest/gtest.h"
+#include <thread>
+
+namespace KawaiiMQ {
+    class DispatcherTest : public ::testing::Test {
+    protected:
+        void TearDown() override {
+            MessageQueueManager::Instance()->flush();
+        }
+    };
+
+    TEST_F(DispatcherTest, HandlesMessagesInQueueOrder) {
+        std::vector<Topic> topics;
+        Producer producer("prod");
+        for (int i = 0; i < 8; ++i) {
+            topics.emplace_back("testTopic" + std::to_string(i));
+            MessageQueueManager::Instance()->relate(topics.back(), makeQueue("testQueue" + std::to_string(i)));
+            producer.subscribe(topics.back());
+        }
+        std::vector<std::vector<int>> received(topics.size());
+        std::atomic<int> total = 0;
+        {
+            Dispatcher dispatcher(4);
+            ASSERT_EQ(dispatcher.getWorkerCount(), 4);
+            for (std::size_t i = 0; i < topics.size(); ++i) {
+                dispatcher.onMessage(topics[i], [&, i](const std::shared_ptr<MessageData>& msg) {
+                    received[i].push_back(getMessage<int>(msg));
+                    ++total;
+                });
+            }
+            for (int n = 0; n < 1000; ++n) {
+                for (auto& topic : topics) {
+                    producer.publishValue(topic, n);
+                }
+            }
+            while (total.load() < 8000) {
+                std::this_thread::yield();
+            }
+        }
+        for (auto& r : received) {
+            ASSERT_EQ(r.size(), 1000);
+            for (int n = 0; n < 1000; ++n) {
+                ASSERT_EQ(r[n], n);
+            }
+        }
+    }
+
+    TEST_F(DispatcherTest, PicksUpMessagesPushedBeforeRegistration) {
+        Topic topic("testTopic");
+        auto queue = makeQueue("testQueue", QueueEngine::Ring);
+        MessageQueueManager::Instance()->relate(topic, queue);
+        queue->pushValue(1);
+        std::atomic<int> received = 0;
+        Dispatcher dispatcher(2);
+        dispatcher.onMessage(topic, [&](const std::shared_ptr<MessageData>& msg) { received += getMessage<int>(msg); });
+        while (received.load() != 1) {
+            std::this_thread::yield();
+        }
+        dispatcher.removeHandlers(topic);
+        ASSERT_THROW(dispatcher.removeHandlers(topic), TopicException);
+        queue->pushValue(2);
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+        ASSERT_EQ(received.load(), 1);
+        ASSERT_EQ(queue->size(), 1);
+    }
+
+    TEST_F(DispatcherTest, SurvivesNonStandardExceptions) {
+        Topic topic("testTopic");
+        auto queue = makeAckQueue("testQueue");
+        MessageQueueManager::Instance()->relate(topic, queue);
+        std::atomic<int> calls = 0;
+        std::atomic<int> handled = 0;
+        {
+            Dispatcher dispatcher(1);
+            dispatcher.onMessage(topic, [&](const std::shared_ptr<MessageData>& msg) {
+                if (calls++ == 0) {
+                    throw 42;
+                }
+                handled += getMessage<int>(msg);
+            });
+            queue->pushValue(1);
+            queue->pushValue(2);
+            auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(2);
+            while (handled.load() != 3 && std::chrono::steady_clock::now() < deadline) {
+                std::this_thread::sleep_for(std::chrono::milliseconds(1));
+            }
+        }
+        // the first message was nacked and came back
+        ASSERT_EQ(calls.load(), 3);
+        ASSERT_EQ(handled.load(), 3);
+        ASSERT_EQ(queue->getAckStats().acked, 2);
+    }
+
+    TEST_F(DispatcherTest, UnrelatedTopic) {
+        Dispatcher dispatcher(1);
+        ASSERT_THROW(dispatcher.onMessage(Topic("unrelatedTopic"), [](const auto&) {}), TopicException);
+    }
+}
@@ -8,8 +8,22 @@
 #include "kawaiiMQ.h"
 #include "gtest/gtest.h"
 #include <thread>
+#include <coroutine>
 
 namespace KawaiiMQ {
+    /**
+     * fire-and-forget coroutine used by the async tests
+     */
+    struct Detached {
+        struct promise_type {
+            Detached get_return_object() { return {}; }
+            std::suspend_never initial_suspend() noexcept { return {}; }
+            std::suspend_never final_suspend() noexcept { return {}; }
+            void return_void() {}
+            void unhandled_exception() { std::terminate(); }
+        };
+    };
+
     class ProducerTest : public ::testing::Test {
     protected:
         void TearDown() override {
@@ -32,6 +46,23 @@ namespace KawaiiMQ {
         ASSERT_EQ(message[0], m);
     }
 
+    TEST_F(ProducerTest, PublishToEveryRelatedQueue) {
+        Topic topic("testTopic");
+        auto queue1 = makeQueue("testQueue1");
+        auto queue2 = makeQueue("testQueue2", QueueEngine::Ring);
+        MessageQueueManager::Instance()->relate(topic, queue1);
+        MessageQueueManager::Instance()->relate(topic, queue2);
+        Producer producer("prod");
+        producer.subscribe(topic);
+        auto m = makeMessage(std::string("every queue"));
+        producer.publishMessage(topic, m);
+        producer.broadcastMessage(m);
+        for (auto& queue : {queue1, queue2}) {
+            ASSERT_EQ(queue->wait(), m);
+            ASSERT_EQ(queue->wait(), m);
+        }
+    }
+
     TEST_F(ProducerTest, SubscribeAndUnsubscribe) {
         Topic topic("testTopic");
         auto q = makeQueue("queue");
@@ -94,9 +125,18 @@ namespace KawaiiMQ {
             }
         });
 
-        std::thread t2([&]() { consumer1.fetchMessage(); });
-        std::thread t3([&]() { consumer2.fetchMessage(); });
-        std::thread t4([&]() { consumer3.fetchMessage(); });
+        // every consumer drains whatever is ready, together they have to receive all 9 messages
+        std::atomic<int> received = 0;
+        auto fetch = [&](Consumer& consumer) {
+            while (received.load() < 9) {
+                for (auto& [t, messages] : consumer.fetchMessage(10)) {
+                    received += static_cast<int>(messages.size());
+                }
+            }
+        };
+        std::thread t2([&]() { fetch(consumer1); });
+        std::thread t3([&]() { fetch(consumer2); });
+        std::thread t4([&]() { fetch(consumer3); });
 
         t1.join();
         t2.join();
@@ -107,4 +147,146 @@ namespace KawaiiMQ {
         ASSERT_EQ(queue2->size(), 0);
         ASSERT_EQ(queue3->size(), 0);
     }
+
+    TEST_F(ProducerTest, SpscQueueRelatedToTopic) {
+        Topic topic("testTopic");
+        auto queue = makeQueue("testQueue", QueueEngine::Spsc);
+        MessageQueueManager::Instance()->relate(topic, queue);
+        Producer producer("prod");
+        producer.subscribe(topic);
+        Consumer consumer("cons");
+        consumer.subscribe(topic);
+        std::thread t1([&]() { for (int i = 0; i < 100; ++i) producer.publishMessage(topic, makeMessage(i)); });
+        for (int i = 0; i < 100;) {
+            auto messages = consumer.fetchMessage();
+            for (auto& msg : messages[topic]) {
+                ASSERT_EQ(getMessage<int>(msg), i++);
+            }
+        }
+        t1.join();
+        ASSERT_EQ(queue->size(), 0);
+    }
+
+    TEST_F(ProducerTest, PublishAndFetchBatch) {
+        Topic topic("testTopic");
+        auto queue1 = makeQueue("testQueue1");
+        auto queue2 = makeQueue("testQueue2", QueueEngine::Ring);
+        MessageQueueManager::Instance()->relate(topic, queue1);
+        MessageQueueManager::Instance()->relate(topic, queue2);
+        Producer producer("prod");
+        producer.subscribe(topic);
+        Consumer consumer("cons");
+        consumer.subscribe(topic);
+        std::vector<std::shared_ptr<Message<int>>> batch;
+        for (int i = 0; i < 5; ++i) {
+            batch.push_back(makeMessage(i));
+        }
+        producer.publishBatch(topic, batch);
+        ASSERT_EQ(queue1->size(), 5);
+        ASSERT_EQ(queue2->size(), 5);
+        ASSERT_EQ(consumer.fetchBatch(topic, 7, 10).size(), 7);
+        ASSERT_EQ(consumer.fetchBatch(topic, 7, 10).size(), 3);
+        ASSERT_TRUE(consumer.fetchBatch(topic, 7, 10).empty());
+    }
+
+    TEST_F(ProducerTest, FetchBatchWakesOnAnyRelatedQueue) {
+        Topic topic("testTopic");
+        auto queue1 = makeQueue("testQueue1");
+        auto queue2 = makeQueue("testQueue2", QueueEngine::Ring);
+        MessageQueueManager::Instance()->relate(topic, queue1);
+        MessageQueueManager::Instance()->relate(topic, queue2);
+        Consumer consumer("cons");
+        consumer.subscribe(topic);
+        std::thread t([&]() {
+            std::this_thread::sleep_for(std::chrono::milliseconds(10));
+            queue2->pushValue(2);
+        });
+        // without a timeout, an idle first queue must not keep it from seeing the second one
+        auto messages = consumer.fetchBatch(topic, 10, 0);
+        t.join();
+        ASSERT_EQ(messages.size(), 1);
+        ASSERT_EQ(getMessage<int>(messages[0]), 2);
+        t = std::thread([&]() {
+            std::this_thread::sleep_for(std::chrono::milliseconds(10));
+            queue2->pushValue(3);
+        });
+        auto start = std::chrono::steady_clock::now();
+        messages = consumer.fetchBatch(topic, 10, 2000);
+        t.join();
+        ASSERT_LT(std::chrono::steady_clock::now() - start, std::chrono::milliseconds(1000));
+        ASSERT_EQ(messages.size(), 1);
+        ASSERT_EQ(getMessage<int>(messages[0]), 3);
+    }
+
+    TEST_F(ProducerTest, PublishSharesMessageAcrossQueues) {
+        Topic topic("testTopic");
+        std::vector<std::shared_ptr<Queue>> queues;
+        for (int i = 0; i < 3; ++i) {
+            queues.push_back(makeQueue("testQueue" + std::to_string(i)));
+            MessageQueueManager::Instance()->relate(topic, queues.back());
+        }
+        Producer producer("prod");
+        producer.subscribe(topic);
+        auto m = makeMessage(std::string("fan out"));
+        producer.publishMessage(topic, m);
+        producer.publishValue(topic, 42);
+        for (auto& queue : queues) {
+            auto msg = queue->wait();
+            ASSERT_EQ(msg.get(), m.get());
+            ASSERT_EQ(getMessage<int>(queue->waitValue()), 42);
+        }
+        ASSERT_EQ(m.use_count(), 1);
+    }
+
+    TEST_F(ProducerTest, FetchMessageSkipsIdleQueues) {
+        Topic idle("idleTopic");
+        Topic busy("busyTopic");
+        auto idle_queue = makeQueue("idleQueue");
+        auto busy_queue = makeQueue("busyQueue", QueueEngine::Ring);
+        MessageQueueManager::Instance()->relate(idle, idle_queue);
+        MessageQueueManager::Instance()->relate(busy, busy_queue);
+        Producer producer("prod");
+        producer.subscribe(busy);
+        Consumer consumer("cons");
+        consumer.subscribe(idle);
+        consumer.subscribe(busy);
+        ASSERT_TRUE(consumer.fetchMessage(10).empty());
+        std::thread t([&]() {
+            std::this_thread::sleep_for(std::chrono::milliseconds(10));
+            producer.publishValue(busy, 1);
+        });
+        auto messages = consumer.fetchMessage();
+        t.join();
+        ASSERT_EQ(messages.size(), 1);
+        ASSERT_EQ(getMessage<int>(messages[busy][0]), 1);
+    }
+
+    TEST_F(ProducerTest, AsyncFetchFromAnyRelatedQueue) {
+        Topic topic("testTopic");
+        auto queue1 = makeQueue("testQueue1");
+        auto queue2 = makeQueue("testQueue2", QueueEngine::Ring);
+        MessageQueueManager::Instance()->relate(topic, queue1);
+        MessageQueueManager::Instance()->relate(topic, queue2);
+        Producer producer("prod");
+        producer.subscribe(topic);
+        Consumer consumer("cons");
+        ASSERT_THROW(consumer.asyncFetch(topic, [](std::coroutine_handle<> h) { h.resume(); }), TopicException);
+        consumer.subscribe(topic);
+        std::vector<int> received;
+        auto consume = [&]() -> Detached {
+            auto messages = co_await consumer.asyncFetch(topic, [](std::coroutine_handle<> h) { h.resume(); });
+            for (auto& msg : messages) {
+                received.push_back(getMessage<int>(msg));
+            }
+        };
+        consume();
+        ASSERT_TRUE(received.empty());
+        queue2->pushValue(2);
+        ASSERT_EQ(received, std::vector<int>{2});
+        // resumed once, the other queue does not hand it a message anymore
+        queue1->pushValue(1);
+        ASSERT_EQ(received, std::vector<int>{2});
+        ASSERT_EQ(queue1->size(), 1);
+        queue1->wait();
+    }
 }
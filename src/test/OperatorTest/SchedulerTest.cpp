@@ -0,0 +1,134 @@
+/**
+ * @file SchedulerTest.cpp
+ * @author ayano
+ * @date 2/22/24
+ * @brief
+*/
+
+#include "kawaiiMQ.h"
+#include "gtest/gtest.h"
+#include <thread>
+
+using namespace std::chrono_literals;
+
+namespace KawaiiMQ {
+
+    class SchedulerTest : public ::testing::Test {
+    protected:
+        void TearDown() override {
+            MessageQueueManager::Instance()->flush();
+        }
+
+        Topic topic{"delayedTopic"};
+    };
+
+    TEST_F(SchedulerTest, DelayedMessageIsInvisibleUntilDue) {
+        auto first = makeQueue("first");
+        auto second = makeQueue("second");
+        MessageQueueManager::Instance()->relate(topic, first);
+        MessageQueueManager::Instance()->relate(topic, second);
+        Producer producer({topic}, "producer");
+        auto published = std::chrono::steady_clock::now();
+        producer.publishMessage(topic, makeMessage(2), 50ms);
+        producer.publishMessage(topic, makeMessage(1));
+        std::shared_ptr<MessageData> msg;
+        ASSERT_TRUE(first->tryWait(msg));
+        ASSERT_EQ(getMessage<int>(msg), 1);
+        ASSERT_FALSE(first->tryWait(msg));
+        msg = first->wait();
+        ASSERT_GE(std::chrono::steady_clock::now() - published, 50ms);
+        ASSERT_EQ(getMessage<int>(msg), 2);
+        // every related queue gets it, sharing the payload
+        ASSERT_EQ(second->size(), 2);
+        ASSERT_EQ(second->wait().get() != msg.get(), true);
+        ASSERT_EQ(second->wait().get(), msg.get());
+    }
+
+    TEST_F(SchedulerTest, PublishAtTimePoint) {
+        auto queue = makeQueue("queue");
+        MessageQueueManager::Instance()->relate(topic, queue);
+        Producer producer({topic}, "producer");
+        auto published = std::chrono::steady_clock::now();
+        producer.publishMessage(topic, makeMessage(2), std::chrono::system_clock::now() + 40ms);
+        producer.publishMessage(topic, makeMessage(1), published + 20ms);
+        producer.publishMessage(topic, makeMessage(0), published - 1s);
+        for (int i = 0; i < 3; ++i) {
+            ASSERT_EQ(getMessage<int>(queue->wait()), i);
+        }
+        ASSERT_GE(std::chrono::steady_clock::now() - published, 30ms);
+        ASSERT_THROW(producer.publishMessage(Topic("unsubscribed"), makeMessage(0), 1ms), TopicException);
+    }
+
+    TEST_F(SchedulerTest, CancelledMessageIsDropped) {
+        auto queue = makeQueue("queue");
+        auto scheduler = Scheduler::Instance();
+        auto before = scheduler->size();
+        auto id = scheduler->pushAfter(queue, Envelope::of(1), 20ms);
+        scheduler->pushAfter(queue, Envelope::of(2), 20ms);
+        ASSERT_EQ(scheduler->size(), before + 2);
+        ASSERT_TRUE(scheduler->cancel(id));
+        ASSERT_FALSE(scheduler->cancel(id));
+        ASSERT_EQ(getMessage<int>(queue->wait()), 2);
+        std::this_thread::sleep_for(20ms);
+        ASSERT_TRUE(queue->empty());
+        ASSERT_EQ(scheduler->size(), before);
+    }
+
+    TEST_F(SchedulerTest, GoneQueueDropsMessage) {
+        auto queue = makeQueue("queue");
+        auto scheduler = Scheduler::Instance();
+        auto before = scheduler->size();
+        scheduler->pushAfter(queue, Envelope::of(1), 10ms);
+        std::weak_ptr<Queue> weak = queue;
+        queue.reset();
+        ASSERT_TRUE(weak.expired());
+        std::this_thread::sleep_for(50ms);
+        ASSERT_EQ(scheduler->size(), before);
+    }
+
+    TEST_F(SchedulerTest, FullQueueDoesNotStallTheTimer) {
+        auto full = makeQueue("full", QueueEngine::Ring, 2);
+        auto other = makeQueue("other");
+        full->pushValue(0);
+        full->pushValue(1);
+        Envelope msg = Envelope::of(2);
+        ASSERT_FALSE(full->tryPush(msg));
+        ASSERT_EQ(getMessage<int>(msg), 2);
+        auto scheduler = Scheduler::Instance();
+        auto before = scheduler->size();
+        scheduler->pushAfter(full, Envelope::of(2), 5ms);
+        scheduler->pushAfter(other, Envelope::of(3), 10ms);
+        std::vector<Envelope> got;
+        ASSERT_EQ(other->drain(got, 1, 1000), 1);
+        ASSERT_EQ(getMessage<int>(got[0]), 3);
+        // still waiting for room, tried again every tick
+        ASSERT_EQ(scheduler->size(), before + 1);
+        ASSERT_EQ(full->size(), 2);
+        got.clear();
+        ASSERT_EQ(full->drain(got, 1, 0), 1);
+        ASSERT_EQ(getMessage<int>(full->wait()), 1);
+        ASSERT_EQ(getMessage<int>(full->wait()), 2);
+        std::this_thread::sleep_for(10ms);
+        ASSERT_EQ(scheduler->size(), before);
+    }
+
+    TEST_F(SchedulerTest, ManyPendingMessages) {
+        auto queue = makeQueue("queue");
+        auto scheduler = Scheduler::Instance();
+        auto now = std::chrono::steady_clock::now();
+        // far enough out that none is due before the last one is scheduled
+        constexpr int count = 200000;
+        for (int i = 0; i < count; ++i) {
+            scheduler->pushAt(queue, Envelope::of(i), now + std::chrono::milliseconds(300 + i % 200));
+        }
+        std::vector<int> got;
+        while (got.size() < count) {
+            got.push_back(getMessage<int>(queue->wait()));
+        }
+        // due times never go backwards
+        for (std::size_t i = 1; i < got.size(); ++i) {
+            ASSERT_LE(got[i - 1] % 200, got[i] % 200);
+        }
+        ASSERT_GE(std::chrono::steady_clock::now() - now, 499ms);
+    }
+}
@@ -0,0 +1,107 @@
+/**
+ * @file TracerTest.cpp
+ * @author ayano
+ * @date 2/24/24
+ * @brief
+*/
+
+#include "kawaiiMQ.h"
+#include "gtest/gtest.h"
+#include <thread>
+
+namespace KawaiiMQ {
+
+    class TracerTest : public ::testing::Test {
+    protected:
+        void SetUp() override {
+            Tracer::Instance()->clear();
+        }
+
+        void TearDown() override {
+            Tracer::Instance()->setSampleEvery(0);
+            Tracer::Instance()->clear();
+            MessageQueueManager::Instance()->flush();
+        }
+
+        static std::size_t count(const std::string& text, const std::string& what) {
+            std::size_t n = 0;
+            for (auto at = text.find(what); at != std::string::npos; at = text.find(what, at + what.size())) {
+                ++n;
+            }
+            return n;
+        }
+    };
+
+    TEST_F(TracerTest, OffByDefault) {
+        ASSERT_EQ(Tracer::Instance()->getSampleEvery(), 0);
+        auto queue = makeQueue("traceQueue");
+        queue->push(makeMessage(std::string("untraced")));
+        ASSERT_EQ(getMessage<std::string>(queue->wait()), "untraced");
+        ASSERT_EQ(Tracer::Instance()->chromeTrace(), "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[]}\n");
+    }
+
+    TEST_F(TracerTest, FollowsMessageThroughThePipeline) {
+        Tracer::Instance()->setSampleEvery(1);
+        Topic topic("traceTopic");
+        auto queue = makeQueue("traceQueue");
+        MessageQueueManager::Instance()->relate(topic, queue);
+        Producer producer({topic}, "traceProducer");
+        auto msg = makeMessage(std::string("traced"));
+        producer.publishMessage(topic, msg);
+        ASSERT_NE(msg->getTraceId(), 0);
+        std::thread consumer([&queue]() {
+            ASSERT_EQ(getMessage<std::string>(queue->wait()), "traced");
+        });
+        consumer.join();
+
+        auto trace = Tracer::Instance()->chromeTrace();
+        ASSERT_EQ(count(trace, R"("name":"publish")"), 1);
+        ASSERT_EQ(count(trace, R"("name":"enqueue")"), 1);
+        ASSERT_EQ(count(trace, R"("name":"dequeue")"), 1);
+        ASSERT_EQ(count(trace, R"("name":"getMessage")"), 1);
+        ASSERT_EQ(count(trace, R"("ph":"b")"), 1);
+        ASSERT_EQ(count(trace, R"("ph":"e")"), 1);
+        ASSERT_NE(trace.find(R"("args":{"at":"traceProducer"})"), std::string::npos);
+        ASSERT_NE(trace.find(R"("args":{"at":"traceQueue"})"), std::string::npos);
+        // publish, enqueue and the begin of the slice come from this thread, dequeue and read from the consumer
+        ASSERT_LT(trace.find(R"("name":"publish")"), trace.find(R"("name":"getMessage")"));
+    }
+
+    TEST_F(TracerTest, SamplesOneMessageInN) {
+        Tracer::Instance()->setSampleEvery(4);
+        auto queue = makeQueue("traceQueue");
+        // a new thread starts its period with the first message
+        std::thread producer([&queue]() {
+            for (int i = 0; i < 100; ++i) {
+                queue->push(makeMessage(std::string("sampled")));
+            }
+        });
+        producer.join();
+        auto trace = Tracer::Instance()->chromeTrace();
+        ASSERT_EQ(count(trace, R"("name":"enqueue")"), 25);
+    }
+
+    TEST_F(TracerTest, InlineValuesAreNotTraced) {
+        Tracer::Instance()->setSampleEvery(1);
+        auto queue = makeQueue("traceQueue");
+        queue->pushValue(42);
+        Envelope msg;
+        ASSERT_TRUE(queue->tryWaitValue(msg));
+        ASSERT_EQ(count(Tracer::Instance()->chromeTrace(), R"("name":)"), 0);
+    }
+
+    TEST_F(TracerTest, BufferKeepsTheLatestEvents) {
+        Tracer::Instance()->setSampleEvery(1);
+        auto queue = makeQueue("traceQueue");
+        std::thread producer([&queue]() {
+            for (std::size_t i = 0; i < Tracer::bufferSize + 100; ++i) {
+                queue->push(makeMessage(static_cast<std::uint64_t>(i)));
+            }
+        });
+        producer.join();
+        auto trace = Tracer::Instance()->chromeTrace();
+        ASSERT_EQ(count(trace, R"("name":"enqueue")"), Tracer::bufferSize);
+        Tracer::Instance()->clear();
+        ASSERT_EQ(count(Tracer::Instance()->chromeTrace(), R"("name":)"), 0);
+    }
+}
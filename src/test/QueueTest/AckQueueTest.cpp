@@ -0,0 +1,233 @@
+/**
+ * @file AckQueueTest.cpp
+ * @author ayano
+ * @date 2/21/24
+ * @brief
+*/
+
+#include "kawaiiMQ.h"
+#include "gtest/gtest.h"
+#include <thread>
+
+namespace KawaiiMQ {
+
+    using namespace std::chrono_literals;
+
+    TEST(AckQueueTest, AckRemovesMessage) {
+        AckQueue queue("acks");
+        for (int i = 0; i < 3; ++i) {
+            queue.pushValue(i);
+        }
+        Delivery delivery;
+        ASSERT_TRUE(queue.tryFetch(delivery));
+        ASSERT_EQ(getMessage<int>(delivery.message), 0);
+        ASSERT_EQ(delivery.attempt, 1);
+        ASSERT_EQ(queue.size(), 2);
+        ASSERT_EQ(queue.getInFlightCount(), 1);
+        ASSERT_TRUE(queue.ack(delivery.lease));
+        ASSERT_FALSE(queue.ack(delivery.lease));
+        ASSERT_EQ(queue.getInFlightCount(), 0);
+        // plain pops do not lease
+        ASSERT_EQ(getMessage<int>(queue.wait()), 1);
+        ASSERT_EQ(queue.getInFlightCount(), 0);
+        ASSERT_EQ(queue.getAckStats().acked, 1);
+    }
+
+    TEST(AckQueueTest, AckCancelsTimer) {
+        auto wheel = TimerWheel::Instance();
+        auto before = wheel->size();
+        AckQueue queue("acks");
+        queue.pushValue(1);
+        Delivery delivery;
+        ASSERT_TRUE(queue.tryFetch(delivery));
+        ASSERT_EQ(wheel->size(), before + 1);
+        ASSERT_TRUE(queue.ack(delivery.lease));
+        ASSERT_EQ(wheel->size(), before);
+    }
+
+    TEST(AckQueueTest, ExpiredLeaseIsRedelivered) {
+        AckOptions options;
+        options.visibility_timeout = 30ms;
+        AckQueue queue("acks", options);
+        queue.pushValue(7);
+        queue.pushValue(8);
+        Delivery first;
+        ASSERT_TRUE(queue.fetch(first));
+        Delivery second;
+        ASSERT_TRUE(queue.fetch(second));
+        ASSERT_TRUE(queue.ack(second.lease));
+        auto fetched = std::chrono::steady_clock::now();
+        Delivery again;
+        ASSERT_TRUE(queue.fetch(again, 1000));
+        ASSERT_GE(std::chrono::steady_clock::now() - fetched, 20ms);
+        ASSERT_EQ(getMessage<int>(again.message), 7);
+        ASSERT_EQ(again.attempt, 2);
+        ASSERT_FALSE(queue.ack(first.lease));
+        ASSERT_TRUE(queue.ack(again.lease));
+        ASSERT_EQ(queue.getAckStats().redelivered, 1);
+    }
+
+    TEST(AckQueueTest, DeadLetterAfterMaxDeliveries) {
+        auto dead = makeQueue("dead");
+        AckQueue queue("acks", {.max_deliveries = 2, .dead_letter = dead});
+        queue.pushValue(1);
+        Delivery delivery;
+        ASSERT_TRUE(queue.tryFetch(delivery));
+        ASSERT_TRUE(queue.nack(delivery.lease));
+        ASSERT_TRUE(queue.tryFetch(delivery));
+        ASSERT_EQ(delivery.attempt, 2);
+        ASSERT_TRUE(queue.nack(delivery.lease));
+        ASSERT_FALSE(queue.tryFetch(delivery));
+        ASSERT_EQ(dead->size(), 1);
+        ASSERT_EQ(getMessage<int>(dead->wait()), 1);
+        auto stats = queue.getAckStats();
+        ASSERT_EQ(stats.redelivered, 1);
+        ASSERT_EQ(stats.dead_lettered, 1);
+    }
+
+    TEST(AckQueueTest, FullDeadLetterQueueDoesNotStallTheTimer) {
+        auto dead = makeQueue("dead", QueueEngine::Ring, 2);
+        dead->pushValue(0);
+        dead->pushValue(0);
+        AckOptions options;
+        options.visibility_timeout = 10ms;
+        options.max_deliveries = 1;
+        options.dead_letter = dead;
+        AckQueue queue("acks", options);
+        queue.pushValue(1);
+        queue.pushValue(2);
+        Delivery first;
+        ASSERT_TRUE(queue.tryFetch(first));
+        Delivery second;
+        ASSERT_TRUE(queue.tryFetch(second));
+        // both leases expire on the timer thread, the second one after the first found the queue full
+        std::this_thread::sleep_for(60ms);
+        ASSERT_EQ(queue.getInFlightCount(), 0);
+        ASSERT_EQ(queue.getAckStats().dead_lettered, 2);
+        ASSERT_EQ(dead->size(), 2);
+        std::vector<int> got;
+        for (int i = 0; i < 4; ++i) {
+            got.push_back(getMessage<int>(dead->wait()));
+        }
+        std::sort(got.begin() + 2, got.end());
+        ASSERT_EQ(got, std::vector<int>({0, 0, 1, 2}));
+    }
+
+    TEST(AckQueueTest, ExtendKeepsLease) {
+        AckOptions options;
+        options.visibility_timeout = 20ms;
+        AckQueue queue("acks", options);
+        queue.pushValue(1);
+        Delivery delivery;
+        ASSERT_TRUE(queue.tryFetch(delivery));
+        ASSERT_TRUE(queue.extend(delivery.lease, 500ms));
+        std::this_thread::sleep_for(60ms);
+        ASSERT_FALSE(queue.tryFetch(delivery));
+        ASSERT_TRUE(queue.ack(delivery.lease));
+    }
+
+    TEST(AckQueueTest, ManyLeasesExpire) {
+        AckOptions options;
+        // long enough that none expires while the rest are still being leased
+        options.visibility_timeout = 500ms;
+        AckQueue queue("acks", options);
+        std::vector<Envelope> batch;
+        for (int i = 0; i < 100000; ++i) {
+            batch.push_back(Envelope::of(i));
+        }
+        queue.pushBulk(std::move(batch));
+        std::vector<Delivery> deliveries;
+        ASSERT_EQ(queue.fetchBulk(deliveries, 200000), 100000);
+        ASSERT_EQ(queue.getInFlightCount(), 100000);
+        auto deadline = std::chrono::steady_clock::now() + 5s;
+        while (queue.size() != 100000 && std::chrono::steady_clock::now() < deadline) {
+            std::this_thread::sleep_for(10ms);
+        }
+        ASSERT_EQ(queue.size(), 100000);
+        ASSERT_EQ(queue.getInFlightCount(), 0);
+    }
+
+    TEST(AckQueueTest, DispatcherRedeliversWhenHandlerThrows) {
+        Topic topic("ackTopic");
+        auto queue = makeAckQueue("ackTopicQueue");
+        MessageQueueManager::Instance()->relate(topic, queue);
+        std::atomic<int> calls = 0;
+        std::atomic<int> handled = 0;
+        {
+            Dispatcher dispatcher(2);
+            dispatcher.onMessage(topic, [&](const std::shared_ptr<MessageData>& msg) {
+                if (calls++ == 0) {
+                    throw std::runtime_error("first try fails");
+                }
+                handled += getMessage<int>(msg);
+            });
+            queue->pushValue(5);
+            auto deadline = std::chrono::steady_clock::now() + 2s;
+            while (handled == 0 && std::chrono::steady_clock::now() < deadline) {
+                std::this_thread::sleep_for(1ms);
+            }
+        }
+        ASSERT_EQ(calls, 2);
+        ASSERT_EQ(handled, 5);
+        ASSERT_EQ(queue->getInFlightCount(), 0);
+        ASSERT_EQ(queue->getAckStats().acked, 1);
+        MessageQueueManager::Instance()->unrelate(topic, queue);
+    }
+
+    struct Recorder : TimerTarget {
+        void onTimer(std::uint64_t cookie) noexcept override {
+            std::lock_guard lock(mtx);
+            fired.emplace_back(cookie, std::chrono::steady_clock::now());
+        }
+
+        std::mutex mtx;
+        std::vector<std::pair<std::uint64_t, std::chrono::steady_clock::time_point>> fired;
+    };
+
+    TEST(TimerWheelTest, FiresAtDeadline) {
+        TimerWheel wheel(1ms);
+        auto recorder = std::make_shared<Recorder>();
+        auto now = std::chrono::steady_clock::now();
+        wheel.schedule(now + 30ms, recorder, 3);
+        wheel.schedule(now + 5ms, recorder, 1);
+        wheel.schedule(now + 10ms, recorder, 2);
+        wheel.schedule(now - 5ms, recorder, 0);
+        auto gone = std::make_shared<Recorder>();
+        wheel.schedule(now + 1ms, gone, 9);
+        gone.reset();
+        auto cancelled = wheel.schedule(now + 2ms, recorder, 8);
+        ASSERT_EQ(wheel.size(), 6);
+        ASSERT_TRUE(wheel.cancel(cancelled));
+        ASSERT_FALSE(wheel.cancel(cancelled));
+        ASSERT_EQ(wheel.size(), 5);
+        std::this_thread::sleep_for(100ms);
+        ASSERT_EQ(wheel.size(), 0);
+        std::lock_guard lock(recorder->mtx);
+        ASSERT_EQ(recorder->fired.size(), 4);
+        for (std::size_t i = 0; i < 4; ++i) {
+            ASSERT_EQ(recorder->fired[i].first, i);
+        }
+        ASSERT_GE(recorder->fired[3].second, now + 30ms);
+    }
+
+    TEST(TimerWheelTest, CascadesFarDeadlines) {
+        TimerWheel wheel(1ms);
+        auto recorder = std::make_shared<Recorder>();
+        auto now = std::chrono::steady_clock::now();
+        // beyond the lowest level, they come down a level before firing
+        wheel.schedule(now + 600ms, recorder, 2);
+        wheel.schedule(now + 300ms, recorder, 1);
+        wheel.schedule(now + 300ms, recorder, 3);
+        auto far = wheel.schedule(now + std::chrono::hours(24 * 365), recorder, 9);
+        std::this_thread::sleep_for(800ms);
+        ASSERT_EQ(wheel.size(), 1);
+        ASSERT_TRUE(wheel.cancel(far));
+        std::lock_guard lock(recorder->mtx);
+        ASSERT_EQ(recorder->fired.size(), 3);
+        ASSERT_EQ(recorder->fired[0].first, 1);
+        ASSERT_EQ(recorder->fired[1].first, 3);
+        ASSERT_EQ(recorder->fired[2].first, 2);
+        ASSERT_GE(recorder->fired[0].second, now + 300ms);
+        ASSERT_GE(recorder->fired[2].second, now + 600ms);
+    }
+}
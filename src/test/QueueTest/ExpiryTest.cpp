@@ -0,0 +1,141 @@
+/**
+ * @file ExpiryTest.cpp
+ * @author ayano
+ * @date 2/22/24
+ * @brief
+*/
+
+#include "kawaiiMQ.h"
+#include "gtest/gtest.h"
+#include <thread>
+#include <chrono>
+
+using namespace std::chrono_literals;
+
+namespace KawaiiMQ {
+
+    static Envelope expiring(int value, std::chrono::steady_clock::time_point when) {
+        auto ret = Envelope::of(value);
+        ret.setExpiry(when);
+        return ret;
+    }
+
+    TEST(ExpiryTest, TryWaitSkipsExpiredMessages) {
+        auto queue = makeQueue("expiry");
+        auto now = std::chrono::steady_clock::now();
+        queue->push(expiring(0, now - 1ms));
+        queue->push(expiring(1, now + 1h));
+        queue->push(expiring(2, now - 1ms));
+        queue->pushValue(3);
+        std::shared_ptr<MessageData> msg;
+        ASSERT_TRUE(queue->tryWait(msg));
+        ASSERT_EQ(getMessage<int>(msg), 1);
+        ASSERT_EQ(getMessage<int>(queue->wait()), 3);
+        ASSERT_TRUE(queue->empty());
+        ASSERT_EQ(queue->getStats().expired, 2);
+    }
+
+    TEST(ExpiryTest, WaitTimesOutOnExpiredMessages) {
+        auto queue = makeQueue("expiry");
+        queue->setTimeout(50);
+        queue->push(expiring(0, std::chrono::steady_clock::now() - 1ms));
+        auto start = std::chrono::steady_clock::now();
+        ASSERT_THROW(queue->wait(), QueueException);
+        ASSERT_GE(std::chrono::steady_clock::now() - start, 40ms);
+        ASSERT_EQ(queue->getStats().expired, 1);
+        std::vector<Envelope> out;
+        queue->push(expiring(1, std::chrono::steady_clock::now() - 1ms));
+        ASSERT_EQ(queue->drain(out, 8, 20), 0);
+        ASSERT_EQ(queue->getStats().expired, 2);
+    }
+
+    TEST(ExpiryTest, DrainTopsUpAfterExpiredMessages) {
+        for (auto engine : {QueueEngine::Mutex, QueueEngine::Ring, QueueEngine::Priority}) {
+            auto queue = makeQueue("expiry", engine, 64);
+            auto now = std::chrono::steady_clock::now();
+            for (int i = 0; i < 20; ++i) {
+                queue->push(expiring(i, i % 2 == 0 ? now - 1ms : now + 1h));
+            }
+            std::vector<Envelope> out;
+            ASSERT_EQ(queue->drain(out, 8), 8);
+            ASSERT_EQ(getMessage<int>(out[0]), 1);
+            ASSERT_EQ(getMessage<int>(out[7]), 15);
+            out.clear();
+            ASSERT_EQ(queue->drain(out, 8, 10), 2);
+            ASSERT_TRUE(queue->empty());
+            ASSERT_EQ(queue->getStats().expired, 10);
+        }
+    }
+
+    TEST(ExpiryTest, ProducerStampsTimeToLive) {
+        Topic topic("expiringTopic");
+        auto queue = makeQueue("expiry");
+        MessageQueueManager::Instance()->relate(topic, queue);
+        Producer producer({topic}, "producer");
+        producer.setTimeToLive(20ms);
+        ASSERT_EQ(producer.getTimeToLive(), 20ms);
+        producer.publishValue(topic, 0);
+        producer.publishBatch(topic, std::vector{makeMessage(1), makeMessage(2)});
+        std::this_thread::sleep_for(40ms);
+        producer.setTimeToLive(0ms);
+        producer.publishValue(topic, 3);
+        ASSERT_EQ(getMessage<int>(queue->wait()), 3);
+        ASSERT_EQ(queue->getStats().expired, 3);
+        MessageQueueManager::Instance()->unrelate(topic, queue);
+    }
+
+    TEST(ExpiryTest, FetchSingleTopicThrowsOnExpiredMessages) {
+        Topic topic("expiringTopic");
+        auto queue = makeQueue("expiry");
+        MessageQueueManager::Instance()->relate(topic, queue);
+        Producer producer({topic}, "producer");
+        producer.setTimeToLive(1ms);
+        producer.publishValue(topic, 0);
+        std::this_thread::sleep_for(20ms);
+        Consumer consumer("consumer");
+        consumer.subscribe(topic);
+        ASSERT_THROW(consumer.fetchSingleTopic(topic), QueueException);
+        ASSERT_EQ(queue->getStats().expired, 1);
+        MessageQueueManager::Instance()->unrelate(topic, queue);
+    }
+
+    TEST(ExpiryTest, LogCursorsSkipExpiredMessages) {
+        Topic topic("expiringLog");
+        auto queue = makeLogQueue("expiry");
+        MessageQueueManager::Instance()->relate(topic, queue);
+        auto now = std::chrono::steady_clock::now();
+        queue->push(expiring(0, now - 1ms));
+        queue->push(expiring(1, now + 1h));
+        queue->push(expiring(2, now - 1ms));
+        queue->pushValue(3);
+        auto cursor = queue->openCursor();
+        Envelope msg;
+        ASSERT_TRUE(cursor->tryRead(msg));
+        ASSERT_EQ(getMessage<int>(msg), 1);
+        ASSERT_TRUE(cursor->tryRead(msg));
+        ASSERT_EQ(getMessage<int>(msg), 3);
+        ASSERT_FALSE(cursor->tryRead(msg));
+        // a consumer reads through a cursor of its own
+        Consumer consumer("consumer");
+        consumer.subscribe(topic);
+        auto got = consumer.fetchBatch(topic, 8, 10);
+        ASSERT_EQ(got.size(), 2);
+        ASSERT_EQ(getMessage<int>(got[0]), 1);
+        ASSERT_EQ(getMessage<int>(got[1]), 3);
+        ASSERT_EQ(queue->getStats().expired, 4);
+        ASSERT_EQ(queue->getRetainedCount(), 4);
+        MessageQueueManager::Instance()->unrelate(topic, queue);
+    }
+
+    TEST(ExpiryTest, AckQueueDoesNotLeaseExpiredMessages) {
+        auto queue = makeAckQueue("expiry");
+        auto now = std::chrono::steady_clock::now();
+        queue->push(expiring(0, now - 1ms));
+        queue->push(expiring(1, now + 1h));
+        Delivery delivery;
+        ASSERT_TRUE(queue->tryFetch(delivery));
+        ASSERT_EQ(getMessage<int>(delivery.message), 1);
+        ASSERT_FALSE(queue->tryFetch(delivery));
+        ASSERT_EQ(queue->getStats().expired, 1);
+    }
+}
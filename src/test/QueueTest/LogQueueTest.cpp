@@ -0,0 +1,160 @@
+/**
+ * @file LogQueueTest.cpp
+ * @author ayano
+ * @date 2/19/24
+ * @brief
+*/
+
+#include "LogQueue.h"
+#include "Consumer.h"
+#include "Producer.h"
+#include "gtest/gtest.h"
+#include <thread>
+#include <chrono>
+
+namespace KawaiiMQ {
+
+    TEST(LogQueueTest, CursorsReadIndependently) {
+        LogQueue log("log");
+        auto first = log.openCursor();
+        for (int i = 0; i < 10; ++i) {
+            log.pushValue(i);
+        }
+        auto second = log.openCursor(LogStart::Earliest);
+        auto late = log.openCursor(LogStart::Latest);
+        Envelope msg;
+        for (int i = 0; i < 10; ++i) {
+            ASSERT_TRUE(first->tryRead(msg));
+            ASSERT_EQ(getMessage<int>(msg), i);
+        }
+        ASSERT_FALSE(first->tryRead(msg));
+        std::vector<Envelope> out;
+        ASSERT_EQ(second->readBulk(out, 100), 10);
+        ASSERT_EQ(getMessage<int>(out.back()), 9);
+        ASSERT_FALSE(late->available());
+        log.pushValue(10);
+        ASSERT_TRUE(late->tryRead(msg));
+        ASSERT_EQ(getMessage<int>(msg), 10);
+        ASSERT_EQ(first->getLag(), 1);
+        first->seek(3);
+        ASSERT_TRUE(first->tryRead(msg));
+        ASSERT_EQ(getMessage<int>(msg), 3);
+    }
+
+    TEST(LogQueueTest, QueueApiSharesOneCursor) {
+        LogQueue log("log");
+        for (int i = 0; i < 5; ++i) {
+            log.pushValue(i);
+        }
+        ASSERT_EQ(log.size(), 5);
+        ASSERT_EQ(getMessage<int>(log.wait()), 0);
+        std::shared_ptr<MessageData> msg;
+        ASSERT_TRUE(log.tryWait(msg));
+        ASSERT_EQ(getMessage<int>(msg), 1);
+        ASSERT_EQ(log.size(), 3);
+        // a cursor of its own still sees everything
+        auto cursor = log.openCursor();
+        ASSERT_EQ(cursor->getLag(), 5);
+    }
+
+    TEST(LogQueueTest, TrimmedBySlowestCursor) {
+        LogQueue log("log");
+        auto fast = log.openCursor();
+        auto slow = log.openCursor();
+        std::vector<Envelope> out;
+        for (int i = 0; i < 128; ++i) {
+            log.pushValue(i);
+        }
+        fast->readBulk(out, 128);
+        slow->readBulk(out, 100);
+        for (int i = 128; i < 192; ++i) {
+            log.pushValue(i);
+        }
+        ASSERT_EQ(log.getStartOffset(), 100);
+        slow.reset();
+        for (int i = 192; i < 256; ++i) {
+            log.pushValue(i);
+        }
+        ASSERT_EQ(log.getStartOffset(), 128);
+        ASSERT_EQ(log.getEndOffset(), 256);
+    }
+
+    TEST(LogQueueTest, SizeRetentionSkipsSlowCursor) {
+        LogQueue log("log", {.trim_read = false, .max_messages = 10});
+        auto cursor = log.openCursor();
+        for (int i = 0; i < 25; ++i) {
+            log.pushValue(i);
+        }
+        ASSERT_EQ(log.getRetainedCount(), 10);
+        Envelope msg;
+        ASSERT_TRUE(cursor->tryRead(msg));
+        ASSERT_EQ(getMessage<int>(msg), 15);
+        ASSERT_EQ(cursor->getMissed(), 15);
+    }
+
+    TEST(LogQueueTest, AgeRetention) {
+        LogQueue log("log", {.trim_read = false, .max_age = std::chrono::milliseconds(20)});
+        log.pushValue(1);
+        log.pushValue(2);
+        std::this_thread::sleep_for(std::chrono::milliseconds(30));
+        log.pushValue(3);
+        ASSERT_EQ(log.getRetainedCount(), 1);
+        ASSERT_EQ(getMessage<int>(log.wait()), 3);
+    }
+
+    TEST(LogQueueTest, BlockingRead) {
+        LogQueue log("log");
+        auto cursor = log.openCursor();
+        Envelope msg;
+        ASSERT_FALSE(cursor->read(msg, 10));
+        std::thread producer([&log]() {
+            std::this_thread::sleep_for(std::chrono::milliseconds(10));
+            log.pushValue(7);
+        });
+        ASSERT_TRUE(cursor->read(msg));
+        ASSERT_EQ(getMessage<int>(msg), 7);
+        producer.join();
+    }
+
+    TEST(LogQueueTest, CursorOutlivesLog) {
+        std::unique_ptr<LogCursor> cursor;
+        {
+            LogQueue log("log");
+            cursor = log.openCursor();
+            log.pushValue(1);
+        }
+        Envelope msg;
+        ASSERT_TRUE(cursor->tryRead(msg));
+        ASSERT_EQ(getMessage<int>(msg), 1);
+    }
+
+    TEST(LogQueueTest, ConsumersGetEveryMessage) {
+        auto manager = MessageQueueManager::Instance();
+        Topic topic("logTopic");
+        auto log = makeLogQueue("logTopicQueue");
+        manager->relate(topic, log);
+        Producer producer({topic}, "producer");
+        Consumer a({topic});
+        Consumer b({topic});
+        for (int i = 0; i < 10; ++i) {
+            producer.publishMessage(topic, makeMessage(i));
+        }
+        auto from_a = a.fetchMessage()[topic];
+        auto from_b = b.fetchBatch(topic, 100, 0);
+        ASSERT_EQ(from_a.size(), 10);
+        ASSERT_EQ(from_b.size(), 10);
+        ASSERT_EQ(getMessage<int>(from_a[9]), 9);
+        ASSERT_EQ(getMessage<int>(from_b[9]), 9);
+        // one copy for both consumers
+        ASSERT_EQ(from_a[3], from_b[3]);
+        ASSERT_TRUE(a.fetchMessage(10).empty());
+        std::thread late([&producer, &topic]() {
+            std::this_thread::sleep_for(std::chrono::milliseconds(10));
+            producer.publishValue(topic, 10);
+        });
+        auto next = a.fetchMessage()[topic];
+        ASSERT_EQ(getMessage<int>(next[0]), 10);
+        late.join();
+        manager->unrelate(topic, log);
+    }
+}
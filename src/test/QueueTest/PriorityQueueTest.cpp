@@ -0,0 +1,142 @@
+/**
+ * @file PriorityQueueTest.cpp
+ * @author ayano
+ * @date 2/22/24
+ * @brief
+*/
+
+#include "PriorityQueue.h"
+#include "gtest/gtest.h"
+#include <thread>
+#include <chrono>
+
+namespace KawaiiMQ {
+
+    TEST(PriorityQueueTest, StrictServesHighestLaneFirst) {
+        PriorityOptions options;
+        options.lanes = 4;
+        options.scheduling = LaneScheduling::Strict;
+        PriorityQueue queue("priority", options);
+        queue.pushValue(0);
+        queue.pushValue(10, 1);
+        queue.pushValue(30, 3);
+        queue.pushValue(11, 1);
+        // beyond the last lane
+        queue.pushValue(31, 9);
+        ASSERT_EQ(queue.size(), 5);
+        ASSERT_EQ(queue.getLaneSize(3), 2);
+        ASSERT_EQ(queue.getLaneSize(2), 0);
+        for (int expected : {30, 31, 10, 11, 0}) {
+            std::shared_ptr<MessageData> msg;
+            ASSERT_TRUE(queue.tryWait(msg));
+            ASSERT_EQ(getMessage<int>(msg), expected);
+        }
+        ASSERT_TRUE(queue.empty());
+    }
+
+    TEST(PriorityQueueTest, WeightedFairDoesNotStarveLowLanes) {
+        PriorityOptions options;
+        options.lanes = 8;
+        PriorityQueue queue("priority", options);
+        for (int i = 0; i < 1000; ++i) {
+            queue.pushValue(0, 0);
+            queue.pushValue(7, 7);
+        }
+        // lane 0 owns 1 of 36 turns, the turns of the idle lanes go to lane 7
+        std::vector<Envelope> out;
+        ASSERT_EQ(queue.drain(out, 360), 360);
+        auto low = std::count_if(out.begin(), out.end(), [](Envelope& msg) {
+            return getMessage<int>(std::move(msg).toShared()) == 0;
+        });
+        ASSERT_EQ(low, 10);
+        ASSERT_EQ(queue.getLaneSize(0), 990);
+    }
+
+    TEST(PriorityQueueTest, RejectsInvalidOptions) {
+        PriorityOptions options;
+        options.lanes = 0;
+        ASSERT_THROW(PriorityQueue("priority", options), QueueException);
+        options.lanes = 65;
+        ASSERT_THROW(PriorityQueue("priority", options), QueueException);
+        options.lanes = 2;
+        options.weights = {1, 0};
+        ASSERT_THROW(PriorityQueue("priority", options), QueueException);
+        options.weights = {1, 2, 3};
+        ASSERT_THROW(PriorityQueue("priority", options), QueueException);
+    }
+
+    TEST(PriorityQueueTest, OverflowPolicyAppliesPerLane) {
+        PriorityOptions options;
+        options.lanes = 2;
+        options.lane_capacity = 2;
+        PriorityQueue queue("priority", options);
+        queue.setOverflowPolicy(OverflowPolicy::Fail);
+        queue.pushValue(0);
+        queue.pushValue(1);
+        ASSERT_THROW(queue.pushValue(2), QueueException);
+        // the other lane still has room
+        queue.pushValue(3, 1);
+        ASSERT_EQ(queue.size(), 3);
+        ASSERT_EQ(queue.getCapacity(), 4);
+        ASSERT_EQ(queue.getStats().rejected, 1);
+    }
+
+    TEST(PriorityQueueTest, EnginesWithoutLanesIgnorePriority) {
+        auto plain = makeQueue("plain");
+        plain->pushValue(1, 5);
+        plain->pushValue(2, 0);
+        ASSERT_EQ(getMessage<int>(plain->wait()), 1);
+        auto priority = makeQueue("priority", QueueEngine::Priority, 16);
+        ASSERT_NE(std::dynamic_pointer_cast<PriorityQueue>(priority), nullptr);
+        priority->pushValue(1);
+        priority->pushValue(2, 5);
+        ASSERT_EQ(getMessage<int>(priority->wait()), 2);
+    }
+
+    TEST(PriorityQueueTest, ConcurrentProducersAndConsumers) {
+        PriorityOptions options;
+        options.lanes = 4;
+        options.lane_capacity = 256;
+        auto queue = makePriorityQueue("priority", options);
+        constexpr int producers = 4;
+        constexpr int perProducer = 20000;
+        std::atomic<int> received = 0;
+        std::vector<std::vector<int>> last(2, std::vector<int>(producers * 4, -1));
+        std::atomic<bool> ordered = true;
+        std::vector<std::thread> threads;
+        for (int c = 0; c < 2; ++c) {
+            threads.emplace_back([&, c]() {
+                while (received.load() < producers * perProducer) {
+                    Envelope msg;
+                    if (!queue->tryWaitValue(msg)) {
+                        std::this_thread::yield();
+                        continue;
+                    }
+                    // producer, lane and sequence number packed into the value
+                    auto value = getMessage<int>(std::move(msg).toShared());
+                    auto stream = value / perProducer % (producers * 4);
+                    auto seq = value % perProducer;
+                    if (seq <= last[c][stream]) {
+                        ordered = false;
+                    }
+                    last[c][stream] = seq;
+                    ++received;
+                }
+            });
+        }
+        for (int p = 0; p < producers; ++p) {
+            threads.emplace_back([&, p]() {
+                for (int i = 0; i < perProducer; ++i) {
+                    unsigned lane = i % 4;
+                    queue->pushValue((p * 4 + static_cast<int>(lane)) * perProducer + i, lane);
+                }
+            });
+        }
+        for (auto& t : threads) {
+            t.join();
+        }
+        ASSERT_EQ(received.load(), producers * perProducer);
+        ASSERT_TRUE(ordered.load());
+        ASSERT_TRUE(queue->empty());
+    }
+}
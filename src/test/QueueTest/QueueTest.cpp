@@ -6,13 +6,29 @@
 */
 
 #include "Queue.h"
+#include "RingQueue.h"
+#include "SpscQueue.h"
 #include "Message.h"
 #include "gtest/gtest.h"
 #include <thread>
 #include <string>
 #include <chrono>
+#include <coroutine>
 
 namespace KawaiiMQ {
+    /**
+     * fire-and-forget coroutine used by the async tests
+     */
+    struct Detached {
+        struct promise_type {
+            Detached get_return_object() { return {}; }
+            std::suspend_never initial_suspend() noexcept { return {}; }
+            std::suspend_never final_suspend() noexcept { return {}; }
+            void return_void() {}
+            void unhandled_exception() { std::terminate(); }
+        };
+    };
+
     TEST(QueueTest, PushIncreasesSize) {
         Queue queue("test");
         auto m = makeMessage(0);
@@ -83,5 +99,262 @@ namespace KawaiiMQ {
 
         ASSERT_EQ(queue.size(), 0);
     }
-}
 
+    TEST(QueueTest, RingQueueWaitReturnsPushedMessage) {
+        auto queue = makeQueue("test", QueueEngine::Ring, 8);
+        auto m = makeMessage(0);
+        queue->push(m);
+        ASSERT_EQ(queue->size(), 1);
+        ASSERT_EQ(queue->wait(), m);
+        ASSERT_TRUE(queue->empty());
+    }
+
+    TEST(QueueTest, RingQueueCapacityIsPowerOfTwo) {
+        RingQueue queue("test", 100);
+        ASSERT_EQ(queue.capacity(), 128);
+    }
+
+    TEST(QueueTest, RingQueueTryWaitOnEmpty) {
+        RingQueue queue("test", 4);
+        std::shared_ptr<MessageData> msg;
+        ASSERT_FALSE(queue.tryWait(msg));
+        queue.push(makeMessage(1));
+        ASSERT_TRUE(queue.tryWait(msg));
+        ASSERT_EQ(getMessage<int>(msg), 1);
+    }
+
+    TEST(QueueTest, RingQueueWaitTimeout) {
+        RingQueue queue("test", 4);
+        queue.setTimeout(10);
+        ASSERT_THROW(queue.wait(), QueueException);
+    }
+
+    TEST(QueueTest, RingQueueMultipleProducersMultipleConsumers) {
+        // small ring so producers also hit the full path
+        RingQueue queue("test", 16);
+        std::atomic<int> sum = 0;
+        std::vector<std::thread> threads;
+        for (int t = 0; t < 4; ++t) {
+            threads.emplace_back([&]() { for (int i = 0; i < 1000; ++i) queue.push(makeMessage(i)); });
+            threads.emplace_back([&]() { for (int i = 0; i < 1000; ++i) sum += getMessage<int>(queue.wait()); });
+        }
+        for (auto& thread : threads) {
+            thread.join();
+        }
+        ASSERT_EQ(queue.size(), 0);
+        ASSERT_EQ(sum, 4 * 999 * 1000 / 2);
+    }
+
+    TEST(QueueTest, SpscQueueTryWaitOnEmpty) {
+        SpscQueue queue("test", 4);
+        std::shared_ptr<MessageData> msg;
+        ASSERT_FALSE(queue.tryWait(msg));
+        queue.push(makeMessage(1));
+        ASSERT_EQ(queue.size(), 1);
+        ASSERT_TRUE(queue.tryWait(msg));
+        ASSERT_EQ(getMessage<int>(msg), 1);
+        ASSERT_TRUE(queue.empty());
+    }
+
+    TEST(QueueTest, SpscQueueKeepsOrder) {
+        // capacity far below the message count, so the producer wraps around and waits on a full ring
+        auto queue = makeQueue("test", QueueEngine::Spsc, 8);
+        std::thread producer([&]() { for (int i = 0; i < 10000; ++i) queue->push(makeMessage(i)); });
+        for (int i = 0; i < 10000; ++i) {
+            ASSERT_EQ(getMessage<int>(queue->wait()), i);
+        }
+        producer.join();
+        ASSERT_TRUE(queue->empty());
+    }
+
+    TEST(QueueTest, PushBulkAndDrain) {
+        for (auto engine : {QueueEngine::Mutex, QueueEngine::Ring, QueueEngine::Spsc}) {
+            auto queue = makeQueue("test", engine, 64);
+            std::vector<std::shared_ptr<Message<int>>> batch;
+            for (int i = 0; i < 10; ++i) {
+                batch.push_back(makeMessage(i));
+            }
+            queue->pushBulk(batch);
+            ASSERT_EQ(queue->size(), 10);
+            std::vector<std::shared_ptr<MessageData>> out;
+            ASSERT_EQ(queue->drain(out, 4), 4);
+            ASSERT_EQ(queue->drain(out, 100), 6);
+            ASSERT_TRUE(queue->empty());
+            for (int i = 0; i < 10; ++i) {
+                ASSERT_EQ(getMessage<int>(out[i]), i);
+            }
+        }
+    }
+
+    TEST(QueueTest, DrainWaitsForFirstMessage) {
+        for (auto engine : {QueueEngine::Mutex, QueueEngine::Ring}) {
+            auto queue = makeQueue("test", engine);
+            std::vector<std::shared_ptr<MessageData>> out;
+            ASSERT_EQ(queue->drain(out, 8, 10), 0);
+            std::thread t([&]() { queue->pushBulk(std::vector{makeMessage(1), makeMessage(2)}); });
+            while (out.size() < 2) {
+                queue->drain(out, 8, 0);
+            }
+            t.join();
+            ASSERT_EQ(out.size(), 2);
+        }
+    }
+
+    TEST(QueueTest, PushValueAndWaitValue) {
+        for (auto engine : {QueueEngine::Mutex, QueueEngine::Ring, QueueEngine::Spsc}) {
+            auto queue = makeQueue("test", engine);
+            queue->pushValue(1);
+            queue->push(makeMessage(std::string("two")));
+            queue->pushValue(3.0);
+            auto first = queue->waitValue();
+            ASSERT_TRUE(first.isInline());
+            ASSERT_EQ(getMessage<int>(first), 1);
+            ASSERT_EQ(getMessage<std::string>(queue->waitValue()), "two");
+            // shared_ptr consumers still work, the inline payload is boxed on the way out
+            ASSERT_EQ(getMessage<double>(queue->wait()), 3.0);
+        }
+    }
+
+    TEST(QueueTest, OverflowFailAndDrop) {
+        for (auto engine : {QueueEngine::Mutex, QueueEngine::Ring}) {
+            auto queue = makeQueue("test", engine, 2, OverflowPolicy::Fail);
+            queue->pushValue(1);
+            queue->pushValue(2);
+            ASSERT_THROW(queue->pushValue(3), QueueException);
+            ASSERT_EQ(queue->size(), 2);
+            queue->setOverflowPolicy(OverflowPolicy::DropNewest);
+            queue->pushValue(3);
+            queue->setOverflowPolicy(OverflowPolicy::DropOldest);
+            queue->pushValue(4);
+            ASSERT_EQ(getMessage<int>(queue->waitValue()), 2);
+            ASSERT_EQ(getMessage<int>(queue->waitValue()), 4);
+            auto stats = queue->getStats();
+            ASSERT_EQ(stats.rejected, 1);
+            ASSERT_EQ(stats.dropped, 2);
+        }
+        auto spsc = makeQueue("test", QueueEngine::Spsc, 2);
+        ASSERT_THROW(spsc->setOverflowPolicy(OverflowPolicy::DropOldest), QueueException);
+    }
+
+    TEST(QueueTest, OverflowBlock) {
+        for (auto engine : {QueueEngine::Mutex, QueueEngine::Ring, QueueEngine::Spsc}) {
+            auto queue = makeQueue("test", engine, 2);
+            queue->setPushTimeout(10);
+            queue->pushValue(1);
+            queue->pushValue(2);
+            ASSERT_THROW(queue->pushValue(3), QueueException);
+            queue->setPushTimeout(0);
+            std::thread consumer([&]() {
+                std::this_thread::sleep_for(std::chrono::milliseconds(10));
+                queue->waitValue();
+            });
+            queue->pushValue(3);
+            consumer.join();
+            ASSERT_EQ(queue->size(), 2);
+            auto stats = queue->getStats();
+            ASSERT_EQ(stats.rejected, 1);
+            ASSERT_EQ(stats.blocked, 2);
+            ASSERT_GE(stats.blocked_time, std::chrono::milliseconds(10));
+        }
+    }
+
+    TEST(QueueTest, BoundedPushBulk) {
+        auto queue = makeQueue("test", QueueEngine::Mutex, 4);
+        std::vector<Envelope> out;
+        std::thread consumer([&]() {
+            while (out.size() < 10) {
+                queue->drain(out, 3, 0);
+            }
+        });
+        std::vector<std::shared_ptr<Message<int>>> batch;
+        for (int i = 0; i < 10; ++i) {
+            batch.push_back(makeMessage(i));
+        }
+        queue->pushBulk(batch);
+        consumer.join();
+        for (int i = 0; i < 10; ++i) {
+            ASSERT_EQ(getMessage<int>(out[i]), i);
+        }
+    }
+
+    TEST(QueueTest, WaitStrategies) {
+        for (auto engine : {QueueEngine::Mutex, QueueEngine::Ring, QueueEngine::Spsc}) {
+            for (auto strategy : {WaitStrategy::Blocking, WaitStrategy::BusySpin, WaitStrategy::SpinYield,
+                                  WaitStrategy::SpinPark}) {
+                auto queue = makeQueue("test", engine, 16);
+                queue->setWaitStrategy(strategy, 8, 4);
+                ASSERT_EQ(queue->getWaitStrategy(), strategy);
+                queue->setTimeout(5);
+                ASSERT_THROW(queue->wait(), QueueException);
+                queue->setTimeout(0);
+                std::thread producer([&]() {
+                    for (int i = 0; i < 100; ++i) {
+                        queue->pushValue(i);
+                    }
+                });
+                for (int i = 0; i < 100; ++i) {
+                    ASSERT_EQ(getMessage<int>(queue->waitValue()), i);
+                }
+                producer.join();
+                std::vector<Envelope> out;
+                ASSERT_EQ(queue->drain(out, 4, 5), 0);
+            }
+        }
+    }
+
+    TEST(QueueTest, AsyncWaitResumesOnPush) {
+        for (auto engine : {QueueEngine::Mutex, QueueEngine::Ring}) {
+            auto queue = makeQueue("test", engine);
+            Executor inline_executor = [](std::coroutine_handle<> h) { h.resume(); };
+            std::vector<int> received;
+            auto consume = [&]() -> Detached {
+                for (int i = 0; i < 3; ++i) {
+                    received.push_back(getMessage<int>(co_await queue->asyncWait(inline_executor)));
+                }
+            };
+            queue->pushValue(0);
+            consume();
+            // took the ready message without suspending, now suspended with nobody parked
+            ASSERT_EQ(received, std::vector<int>{0});
+            queue->pushValue(1);
+            ASSERT_EQ(received, (std::vector<int>{0, 1}));
+            queue->pushValue(2);
+            queue->pushValue(3);
+            ASSERT_EQ(received, (std::vector<int>{0, 1, 2}));
+            ASSERT_EQ(queue->size(), 1);
+        }
+    }
+
+    TEST(QueueTest, AsyncWaitOnExecutorThread) {
+        auto queue = makeQueue("test", QueueEngine::Ring);
+        std::vector<std::coroutine_handle<>> posted;
+        std::mutex mtx;
+        Executor post = [&](std::coroutine_handle<> h) {
+            std::lock_guard lock(mtx);
+            posted.push_back(h);
+        };
+        std::atomic<int> sum = 0;
+        auto consume = [&]() -> Detached {
+            sum += getMessage<int>(co_await queue->asyncWait(post));
+        };
+        for (int i = 0; i < 100; ++i) {
+            consume();
+        }
+        std::thread producer([&]() {
+            for (int i = 1; i <= 100; ++i) {
+                queue->pushValue(i);
+            }
+        });
+        producer.join();
+        ASSERT_EQ(posted.size(), 100);
+        ASSERT_EQ(sum.load(), 0);
+        std::thread executor([&]() {
+            for (auto h : posted) {
+                h.resume();
+            }
+        });
+        executor.join();
+        ASSERT_EQ(sum.load(), 5050);
+        ASSERT_TRUE(queue->empty());
+    }
+}